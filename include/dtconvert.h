@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -12,6 +13,7 @@
 #include <libgen.h>
 #include <ctype.h>
 #include <sys/stat.h>
+#include <stdint.h>
 
 // Version information
 #define DTCONVERT_VERSION "1.0.0"
@@ -46,8 +48,50 @@ typedef struct {
     char *output_path;
     bool overwrite;
     bool verbose;
+    int threads;  // -j/--threads for helpers that parallelize (0 = helper default)
+    bool infer_types;  // --infer-types: typed JSON/YAML values and SQL columns
+    bool explain;      // --explain: print the plan instead of converting
+    bool no_cache;     // --no-cache: neither reuse nor keep step outputs
+    bool incremental;  // --incremental: convert only what was appended since the checkpoint
+    bool follow;       // --follow: keep converting appended records (implies incremental)
 } ConversionRequest;
 
+// What bounds how many conversions of a kind can run at once. Ordered from
+// least to most constraining; a multi-step route takes its heaviest step's.
+typedef enum {
+    RESOURCE_CPU = 0,  // compute-bound, modest memory (the built-in helpers)
+    RESOURCE_IO,       // mostly moves bytes
+    RESOURCE_DB,       // holds a database connection
+    RESOURCE_MEMORY,   // large resident set (LibreOffice)
+    RESOURCE_CLASSES
+} ResourceClass;
+
+// Optional cost hints a converter declares for itself (0 = use the figure for
+// its resource class).
+typedef struct {
+    double startup;  // seconds per run
+    double rate;     // input bytes per second
+} CostHint;
+
+// Converter capabilities (Converter.flags)
+#define CONV_STREAM_IN 0x1   // reads its input sequentially, so a pipe ("-") will do
+#define CONV_STREAM_OUT 0x2  // writes its output sequentially, so a pipe ("-") will do
+#define CONV_STREAMS (CONV_STREAM_IN | CONV_STREAM_OUT)
+#define CONV_NAMED_OUTPUT 0x4  // output depends on the output file's name (csv -> sql table names)
+
+// One registry entry: a program that turns from_format into to_format.
+// converter_path is logical ("modules/x.sh", "lib/converters/x") and resolved
+// against the install layout when run.
+typedef struct {
+    char *from_format;
+    char *to_format;
+    char *converter_path;
+    char *description;
+    unsigned flags;
+    ResourceClass resource;  // what limits running many at once (see --batch)
+    CostHint hint;
+} Converter;
+
 // Function prototypes
 // Document handling
 Document* document_create(const char *path);
@@ -58,16 +102,94 @@ char* document_get_extension(const char *filename);
 // Conversion handling
 int convert_document(ConversionRequest *request);
 int find_converter(const char *from_format, const char *to_format);
+// Plans from -> to and resolves every external converter on the way (kept for
+// later conversions). Returns the number of steps, -1 if there is no route, or
+// -2 if a converter on it is not installed. *resource (if not NULL) gets the
+// route's resource class.
+int prepare_conversion(const char *from_format, const char *to_format, off_t size, ResourceClass *resource);
+// --explain: prints the cheapest route for an input of the given size, with
+// each step's estimated cost.
+int explain_conversion(const char *from_format, const char *to_format, off_t size, FILE *out);
+const char *resource_class_name(ResourceClass resource);
+bool parse_resource_class(const char *name, ResourceClass *out);
+// Peak RSS in KiB of converter processes reaped since the last call (0 if none).
+long take_converter_peak_rss(void);
+// NULL-terminated, malloc'd list of the directories searched for converters of
+// one kind ("modules" or "lib/converters"), in lookup order; free with
+// free_string_list().
+char **converter_search_dirs(const char *kind);
+void free_string_list(char **list);
 int execute_converter(const char *converter_path, 
                       const char *input_path, 
                       const char *output_path);
 
+// Built-in converters run in-process (src/native.c); NULL when converter_path
+// is an external module or DTCONVERT_NATIVE=0.
+typedef int (*NativeConverter)(const char *input_path, const char *output_path);
+NativeConverter find_native_converter(const char *converter_path);
+
+// Converter registry (src/registry.c): the built-in table plus converters that
+// describe themselves with --describe, found in the search directories.
+// Sentinel-terminated (from_format == NULL); built on first use.
+const Converter *converter_registry(void);
+// --list-converters
+void list_converters(FILE *out);
+
+// Converter cost model (src/costs.c): seconds one step is expected to take,
+// from static per-class figures refined by timings of earlier runs.
+typedef enum {
+    COST_STATIC,    // per-class guess; never timed
+    COST_MEASURED,  // timed runs of this very step
+    COST_PROGRAM    // timed runs of the same program on other formats
+} CostBasis;
+double converter_cost(const char *from_format, const char *to_format, const char *program, ResourceClass resource,
+                      const CostHint *hint, bool native, off_t bytes, CostBasis *basis);
+void record_converter_run(const char *from_format, const char *to_format, const char *program, off_t bytes,
+                          double seconds);
+// Merges this process's recorded runs into the shared costs file.
+void save_converter_costs(void);
+
+// Conversion cache (src/cache.c): step outputs stored under a hash of the
+// input bytes, the converters that produced them and the settings they read.
+void conversion_cache_disable(void);
+bool conversion_cache_enabled(void);
+uint64_t xxh64(const void *data, size_t len, uint64_t seed);
+// XXH64 of a regular file's contents; false for anything else.
+bool cache_input_key(const char *path, uint64_t *key);
+// Key of a step's output: the key of its input, the program (with the size
+// and mtime of version_file), the formats, variant (e.g. a compression
+// suffix) and the DTCONVERT_* settings that can change the result.
+uint64_t cache_step_key(uint64_t input_key, const char *program, const char *version_file, const char *from_format,
+                        const char *to_format, const char *variant);
+// Copy out (or hard-link, when the output is a private intermediate) a cached
+// output; "-" writes it to stdout. Returns false on a miss.
+bool cache_fetch(uint64_t key, const char *ext, const char *output_path, bool intermediate);
+void cache_store(uint64_t key, const char *ext, const char *output_path, bool intermediate);
+
+// Incremental conversion of append-only CSV (src/incremental.c)
+int convert_incremental(ConversionRequest *request);
+
 // AI subcommand entrypoint
 int ai_command(int argc, char **argv);
 
+// Batch mode (--batch / --files-from)
+bool is_batch_command(int argc, char **argv);
+int batch_command(int argc, char **argv);
+
+// Watch mode: convert files dropped into a directory (src/watch.c)
+int watch_command(int argc, char **argv);
+
+// Server mode and its client (src/serve.c); run_command() is the CLI proper
+// (src/main.c), run by main() and by each server job.
+int run_command(int argc, char **argv);
+int serve_command(int argc, char **argv);
+bool is_client_command(int argc, char **argv);
+int client_command(int argc, char **argv);
+
 // Format utilities
 bool is_supported_format(const char *format);
 const char* get_format_description(const char *format);
+const char* canonical_format(const char *format);
 
 // CLI interface
 void print_usage(const char *program_name);
@@ -77,6 +199,12 @@ int parse_arguments(int argc, char *argv[], ConversionRequest *request);
 // Utility functions
 char* str_lower(char *str);
 bool ends_with(const char *str, const char *suffix);
+size_t compression_suffix_len(const char *filename);
+FILE* verbose_stream(const ConversionRequest *request);
 char* replace_extension(const char *filename, const char *new_ext);
+char *derive_output_path(const char *input, const char *output_dir, const char *format);
+char *cache_file_path(const char *env_var, const char *name);
+void make_parent_dirs(const char *path);
+bool parse_size_kb(const char *spec, long *kb);
 
 #endif // DTCONVERT_H
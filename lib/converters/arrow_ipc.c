@@ -0,0 +1,523 @@
+#include "arrow_ipc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// MetadataVersion V5; V4 streams use the same layout and are read too.
+#define ARROW_VERSION_V4 3
+#define ARROW_VERSION_V5 4
+
+// Message.header union tags
+#define HEADER_SCHEMA 1
+#define HEADER_DICTIONARY_BATCH 2
+#define HEADER_RECORD_BATCH 3
+
+// ---------------- Flatbuffer builder ----------------
+//
+// Flatbuffers are normally built back to front. These are small and fixed in
+// shape, so they are built front to back instead: a parent table is written
+// first with zeroed offset fields, each child is appended after it, and the
+// offset (child position minus field position, always positive) is patched
+// in. Each table is preceded by its vtable, which is what the signed soffset
+// at the start of a table allows. Positions are relative to the start of the
+// flatbuffer, which sits 8-aligned in the stream.
+
+typedef struct {
+    // Bytes of the field (1, 2, 4 or 8), 0 when absent. Offset fields are 4
+    // bytes and patched later.
+    uint8_t size;
+    uint64_t value;
+} FbField;
+
+#define FB_MAX_FIELDS 8
+
+static void fb_pad(OutBuf *b, size_t align) {
+    while (b->len % align) ob_putc(b, '\0');
+}
+
+static void fb_put(OutBuf *b, uint64_t v, size_t size) {
+    uint8_t tmp[8];
+    arrow_put_le(tmp, v, size);
+    ob_put(b, (const char *)tmp, size);
+}
+
+// Writes a vtable and a table holding fields[0..n) by id, and returns the
+// table's position. at[i] receives the position of field i, for patching.
+static size_t fb_table(OutBuf *b, const FbField *fields, size_t n, size_t *at) {
+    uint16_t off[FB_MAX_FIELDS];
+    size_t size = 4;  // soffset to the vtable
+    for (size_t i = 0; i < n; i++) {
+        off[i] = 0;
+        if (fields[i].size == 0) continue;
+        size = (size + fields[i].size - 1) / fields[i].size * fields[i].size;
+        off[i] = (uint16_t)size;
+        size += fields[i].size;
+    }
+
+    fb_pad(b, 2);
+    size_t vtable = b->len;
+    fb_put(b, 4 + 2 * n, 2);
+    fb_put(b, size, 2);
+    for (size_t i = 0; i < n; i++) fb_put(b, off[i], 2);
+
+    // Tables start 8-aligned so 8-byte fields are aligned too.
+    fb_pad(b, 8);
+    size_t table = b->len;
+    fb_put(b, (uint32_t)(int32_t)(table - vtable), 4);
+    for (size_t i = 0; i < n; i++) {
+        if (at) at[i] = table + off[i];
+        if (fields[i].size == 0) continue;
+        fb_pad(b, fields[i].size);
+        fb_put(b, fields[i].value, fields[i].size);
+    }
+    while (b->len < table + size) ob_putc(b, '\0');
+    return table;
+}
+
+// Points the offset field at `at` to target, which lies after it.
+static void fb_patch(OutBuf *b, size_t at, size_t target) {
+    if (b->err) return;
+    arrow_put_le((uint8_t *)b->data + at, target - at, 4);
+}
+
+// Starts a vector of n elements whose data is aligned to align; the caller
+// appends the elements. Returns the vector's position.
+static size_t fb_vector(OutBuf *b, size_t n, size_t align) {
+    if (align < 4) align = 4;
+    while ((b->len + 4) % align) ob_putc(b, '\0');
+    size_t v = b->len;
+    fb_put(b, n, 4);
+    return v;
+}
+
+static size_t fb_string(OutBuf *b, const char *s) {
+    size_t n = strlen(s);
+    size_t v = fb_vector(b, n, 4);
+    ob_put(b, s, n);
+    ob_putc(b, '\0');
+    return v;
+}
+
+// Frames a finished Message flatbuffer and appends it to out.
+static void write_framed(OutBuf *out, OutBuf *fb) {
+    fb_pad(fb, 8);
+    if (fb->err) {
+        out->err = fb->err;
+        return;
+    }
+    fb_put(out, 0xFFFFFFFFu, 4);
+    fb_put(out, fb->len, 4);
+    ob_put(out, fb->data, fb->len);
+}
+
+// Message table with an empty header slot; returns the slot's position.
+static size_t write_message(OutBuf *b, int header_type, int64_t body_len) {
+    fb_put(b, 0, 4);  // root offset
+    FbField f[4] = {
+        {2, ARROW_VERSION_V5},
+        {1, (uint64_t)header_type},
+        {4, 0},
+        {8, (uint64_t)body_len},
+    };
+    size_t at[4];
+    size_t msg = fb_table(b, f, 4, at);
+    fb_patch(b, 0, msg);
+    return at[2];
+}
+
+static size_t write_type(OutBuf *b, const ArrowField *f) {
+    switch (f->kind) {
+        case ARROW_INT: {
+            FbField t[2] = {{4, (uint64_t)f->bit_width}, {1, f->is_signed ? 1 : 0}};
+            return fb_table(b, t, 2, NULL);
+        }
+        case ARROW_FLOAT: {
+            FbField t[1] = {{2, f->bit_width == 16 ? 0u : f->bit_width == 32 ? 1u : 2u}};
+            return fb_table(b, t, 1, NULL);
+        }
+        case ARROW_DATE:
+        case ARROW_TIMESTAMP: {
+            FbField t[2] = {{2, (uint64_t)f->unit}, {f->timezone ? 4 : 0, 0}};
+            size_t at[2];
+            size_t table = fb_table(b, t, f->kind == ARROW_TIMESTAMP ? 2 : 1, at);
+            if (f->timezone) fb_patch(b, at[1], fb_string(b, f->timezone));
+            return table;
+        }
+        default:
+            // Null, Utf8, Bool, Binary and their Large variants have no fields.
+            return fb_table(b, NULL, 0, NULL);
+    }
+}
+
+void arrow_write_schema(OutBuf *out, const ArrowField *fields, size_t n) {
+    OutBuf b;
+    ob_init(&b, -1);
+    size_t header = write_message(&b, HEADER_SCHEMA, 0);
+
+    // Schema { endianness = Little, fields }
+    FbField s[2] = {{2, 0}, {4, 0}};
+    size_t sat[2];
+    fb_patch(&b, header, fb_table(&b, s, 2, sat));
+
+    size_t vec = fb_vector(&b, n, 4);
+    for (size_t i = 0; i < n; i++) fb_put(&b, 0, 4);
+    fb_patch(&b, sat[1], vec);
+
+    for (size_t i = 0; i < n; i++) {
+        // Field { name, nullable, type_type, type, dictionary, children }
+        FbField f[6] = {
+            {4, 0}, {1, fields[i].nullable ? 1 : 0}, {1, (uint64_t)fields[i].kind}, {4, 0}, {0, 0}, {4, 0},
+        };
+        size_t at[6];
+        size_t field = fb_table(&b, f, 6, at);
+        fb_patch(&b, vec + 4 + 4 * i, field);
+        fb_patch(&b, at[0], fb_string(&b, fields[i].name));
+        fb_patch(&b, at[3], write_type(&b, &fields[i]));
+        fb_patch(&b, at[5], fb_vector(&b, 0, 4));
+    }
+
+    write_framed(out, &b);
+    ob_free(&b);
+}
+
+void arrow_write_batch(OutBuf *out, int64_t rows, const ArrowNode *nodes, size_t nnodes, const ArrowBuffer *buffers,
+                       size_t nbuffers, int64_t body_len) {
+    OutBuf b;
+    ob_init(&b, -1);
+    size_t header = write_message(&b, HEADER_RECORD_BATCH, body_len);
+
+    // RecordBatch { length, nodes, buffers }
+    FbField r[3] = {{8, (uint64_t)rows}, {4, 0}, {4, 0}};
+    size_t at[3];
+    fb_patch(&b, header, fb_table(&b, r, 3, at));
+
+    fb_patch(&b, at[1], fb_vector(&b, nnodes, 8));
+    for (size_t i = 0; i < nnodes; i++) {
+        fb_put(&b, (uint64_t)nodes[i].length, 8);
+        fb_put(&b, (uint64_t)nodes[i].null_count, 8);
+    }
+    fb_patch(&b, at[2], fb_vector(&b, nbuffers, 8));
+    for (size_t i = 0; i < nbuffers; i++) {
+        fb_put(&b, (uint64_t)buffers[i].offset, 8);
+        fb_put(&b, (uint64_t)buffers[i].length, 8);
+    }
+
+    write_framed(out, &b);
+    ob_free(&b);
+}
+
+void arrow_write_eos(OutBuf *out) {
+    fb_put(out, 0xFFFFFFFFu, 4);
+    fb_put(out, 0, 4);
+}
+
+size_t arrow_buffer_count(ArrowKind kind) {
+    switch (kind) {
+        case ARROW_NULL: return 0;
+        case ARROW_BINARY:
+        case ARROW_UTF8:
+        case ARROW_LARGE_BINARY:
+        case ARROW_LARGE_UTF8: return 3;
+        default: return 2;
+    }
+}
+
+// ---------------- Flatbuffer reader ----------------
+//
+// Every access is bounds-checked, since the input is untrusted. Position 0
+// holds the root offset, so no table lives there and 0 doubles as "absent".
+
+typedef struct {
+    const uint8_t *p;
+    size_t n;
+    const char *err;
+} Fbr;
+
+static bool fbr_has(Fbr *f, size_t pos, size_t size) {
+    if (pos <= f->n && size <= f->n - pos) return true;
+    if (!f->err) f->err = "metadata offset out of range";
+    return false;
+}
+
+static uint64_t fbr_get(Fbr *f, size_t pos, size_t size) {
+    return fbr_has(f, pos, size) ? arrow_le(f->p + pos, size) : 0;
+}
+
+// Position of field id of the table at `table`, or 0 when it is absent.
+static size_t fbr_field(Fbr *f, size_t table, size_t id) {
+    if (table == 0 || !fbr_has(f, table, 4)) return 0;
+    int64_t vtable = (int64_t)table - (int32_t)(uint32_t)fbr_get(f, table, 4);
+    if (vtable < 0 || !fbr_has(f, (size_t)vtable, 4)) return 0;
+    size_t vsize = (size_t)fbr_get(f, (size_t)vtable, 2);
+    size_t tsize = (size_t)fbr_get(f, (size_t)vtable + 2, 2);
+    if (4 + 2 * id + 2 > vsize) return 0;
+    size_t off = (size_t)fbr_get(f, (size_t)vtable + 4 + 2 * id, 2);
+    if (off == 0) return 0;
+    if (off >= tsize || !fbr_has(f, table + off, 1)) {
+        if (!f->err) f->err = "bad vtable";
+        return 0;
+    }
+    return table + off;
+}
+
+static uint64_t fbr_scalar(Fbr *f, size_t table, size_t id, size_t size, uint64_t dflt) {
+    size_t at = fbr_field(f, table, id);
+    return at ? fbr_get(f, at, size) : dflt;
+}
+
+// Target of the offset field id, or 0 when absent.
+static size_t fbr_ref(Fbr *f, size_t table, size_t id) {
+    size_t at = fbr_field(f, table, id);
+    if (!at) return 0;
+    size_t target = at + (size_t)fbr_get(f, at, 4);
+    return fbr_has(f, target, 4) ? target : 0;
+}
+
+// Length of the vector at v, checked against elem-sized elements.
+static size_t fbr_vector(Fbr *f, size_t v, size_t elem) {
+    if (!v) return 0;
+    size_t n = (size_t)fbr_get(f, v, 4);
+    return fbr_has(f, v + 4, n * elem) ? n : 0;
+}
+
+// Element i of a vector of tables.
+static size_t fbr_vector_table(Fbr *f, size_t v, size_t i) {
+    size_t at = v + 4 + 4 * i;
+    size_t target = at + (size_t)fbr_get(f, at, 4);
+    return fbr_has(f, target, 4) ? target : 0;
+}
+
+static char *fbr_string(Fbr *f, size_t v) {
+    size_t n = fbr_vector(f, v, 1);
+    char *s = (char *)malloc(n + 1);
+    if (!s) return NULL;
+    if (n) memcpy(s, f->p + v + 4, n);
+    s[n] = '\0';
+    return s;
+}
+
+static const char *parse_field(Fbr *f, size_t table, ArrowField *out) {
+    memset(out, 0, sizeof(*out));
+    out->name = fbr_string(f, fbr_ref(f, table, 0));
+    if (!out->name) return "out of memory";
+    out->nullable = fbr_scalar(f, table, 1, 1, 0) != 0;
+    out->kind = (ArrowKind)fbr_scalar(f, table, 2, 1, 0);
+    size_t type = fbr_ref(f, table, 3);
+    if (fbr_field(f, table, 4)) return "dictionary-encoded columns are not supported";
+    if (fbr_vector(f, fbr_ref(f, table, 5), 4) != 0) return "nested columns are not supported";
+
+    switch (out->kind) {
+        case ARROW_NULL:
+        case ARROW_BINARY:
+        case ARROW_UTF8:
+        case ARROW_BOOL:
+        case ARROW_LARGE_BINARY:
+        case ARROW_LARGE_UTF8: break;
+        case ARROW_INT:
+            out->bit_width = (int)(int32_t)fbr_scalar(f, type, 0, 4, 0);
+            out->is_signed = fbr_scalar(f, type, 1, 1, 0) != 0;
+            if (out->bit_width != 8 && out->bit_width != 16 && out->bit_width != 32 && out->bit_width != 64) {
+                return "bad integer width";
+            }
+            break;
+        case ARROW_FLOAT: {
+            uint64_t precision = fbr_scalar(f, type, 0, 2, 0);
+            if (precision == 0) return "half-precision floats are not supported";
+            out->bit_width = precision == 1 ? 32 : 64;
+            break;
+        }
+        case ARROW_DATE:
+            out->unit = (int)fbr_scalar(f, type, 0, 2, ARROW_DATE_MILLI);
+            if (out->unit > ARROW_DATE_MILLI) return "bad date unit";
+            break;
+        case ARROW_TIMESTAMP: {
+            out->unit = (int)fbr_scalar(f, type, 0, 2, 0);
+            if (out->unit > 3) return "bad timestamp unit";
+            size_t tz = fbr_ref(f, type, 1);
+            if (tz) {
+                out->timezone = fbr_string(f, tz);
+                if (!out->timezone) return "out of memory";
+            }
+            break;
+        }
+        default: return "unsupported column type";
+    }
+    return f->err;
+}
+
+const char *arrow_parse_message(const uint8_t *p, size_t n, ArrowMessage *m) {
+    memset(m, 0, sizeof(*m));
+    Fbr f = {p, n, NULL};
+    size_t msg = (size_t)fbr_get(&f, 0, 4);
+    if (msg == 0 || !fbr_has(&f, msg, 4)) return "bad message";
+
+    uint64_t version = fbr_scalar(&f, msg, 0, 2, 0);
+    if (version < ARROW_VERSION_V4) return "metadata versions before V4 are not supported";
+    m->type = (int)fbr_scalar(&f, msg, 1, 1, 0);
+    size_t header = fbr_ref(&f, msg, 2);
+    m->body_len = (int64_t)fbr_scalar(&f, msg, 3, 8, 0);
+    if (m->body_len < 0) return "bad body length";
+    if (f.err) return f.err;
+
+    if (m->type == HEADER_SCHEMA) {
+        if (fbr_scalar(&f, header, 0, 2, 0) != 0) return "big-endian data is not supported";
+        size_t vec = fbr_ref(&f, header, 1);
+        size_t count = fbr_vector(&f, vec, 4);
+        m->fields = (ArrowField *)calloc(count ? count : 1, sizeof(ArrowField));
+        if (!m->fields) return "out of memory";
+        for (size_t i = 0; i < count; i++) {
+            m->nfields = i + 1;
+            const char *err = parse_field(&f, fbr_vector_table(&f, vec, i), &m->fields[i]);
+            if (err) return err;
+        }
+    } else if (m->type == HEADER_RECORD_BATCH) {
+        m->rows = (int64_t)fbr_scalar(&f, header, 0, 8, 0);
+        if (fbr_field(&f, header, 3)) return "compressed record batches are not supported";
+
+        size_t nodes = fbr_ref(&f, header, 1);
+        m->nnodes = fbr_vector(&f, nodes, 16);
+        size_t buffers = fbr_ref(&f, header, 2);
+        m->nbuffers = fbr_vector(&f, buffers, 16);
+        m->nodes = (ArrowNode *)calloc(m->nnodes ? m->nnodes : 1, sizeof(ArrowNode));
+        m->buffers = (ArrowBuffer *)calloc(m->nbuffers ? m->nbuffers : 1, sizeof(ArrowBuffer));
+        if (!m->nodes || !m->buffers) return "out of memory";
+        for (size_t i = 0; i < m->nnodes; i++) {
+            m->nodes[i].length = (int64_t)arrow_le(p + nodes + 4 + 16 * i, 8);
+            m->nodes[i].null_count = (int64_t)arrow_le(p + nodes + 12 + 16 * i, 8);
+        }
+        for (size_t i = 0; i < m->nbuffers; i++) {
+            m->buffers[i].offset = (int64_t)arrow_le(p + buffers + 4 + 16 * i, 8);
+            m->buffers[i].length = (int64_t)arrow_le(p + buffers + 12 + 16 * i, 8);
+        }
+    } else if (m->type == HEADER_DICTIONARY_BATCH) {
+        return "dictionary-encoded columns are not supported";
+    } else {
+        return "unsupported message type";
+    }
+    return f.err;
+}
+
+void arrow_message_free(ArrowMessage *m) {
+    for (size_t i = 0; i < m->nfields; i++) {
+        free(m->fields[i].name);
+        free(m->fields[i].timezone);
+    }
+    free(m->fields);
+    free(m->nodes);
+    free(m->buffers);
+    memset(m, 0, sizeof(*m));
+}
+
+// ---------------- Dates and times ----------------
+
+// Proleptic Gregorian calendar; see Howard Hinnant's "chrono-Compatible
+// Low-Level Date Algorithms".
+static int64_t days_from_civil(int64_t y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static void civil_from_days(int64_t z, int64_t *y, int *m, int *d) {
+    z += 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    *d = (int)(doy - (153 * mp + 2) / 5 + 1);
+    *m = (int)(mp < 10 ? mp + 3 : mp - 9);
+    *y = yoe + era * 400 + (*m <= 2);
+}
+
+static int digits(const char *s, size_t n) {
+    int v = 0;
+    for (size_t i = 0; i < n; i++) v = v * 10 + (s[i] - '0');
+    return v;
+}
+
+int32_t arrow_parse_date(const char *s) {
+    return (int32_t)days_from_civil(digits(s, 4), digits(s + 5, 2), digits(s + 8, 2));
+}
+
+int64_t arrow_parse_timestamp(const char *s, size_t n) {
+    int64_t secs = days_from_civil(digits(s, 4), digits(s + 5, 2), digits(s + 8, 2)) * 86400;
+    if (n == 10) return secs * 1000000;
+
+    secs += digits(s + 11, 2) * 3600 + digits(s + 14, 2) * 60;
+    size_t i = 16;
+    int64_t micros = 0;
+    if (i < n && s[i] == ':') {
+        secs += digits(s + i + 1, 2);
+        i += 3;
+        if (i < n && s[i] == '.') {
+            // Digits past microseconds are dropped.
+            int scale = 100000;
+            for (i++; i < n && s[i] >= '0' && s[i] <= '9'; i++, scale /= 10) {
+                if (scale > 0) micros += (s[i] - '0') * scale;
+            }
+        }
+    }
+    if (i < n && (s[i] == '+' || s[i] == '-')) {
+        int sign = s[i] == '-' ? -1 : 1;
+        int64_t off = digits(s + i + 1, 2) * 3600;
+        i += 3;
+        if (i < n && s[i] == ':') i++;
+        if (i + 2 <= n) off += digits(s + i, 2) * 60;
+        secs -= sign * off;
+    }
+    return secs * 1000000 + micros;
+}
+
+static size_t put_digits(char *out, int64_t v, int width) {
+    for (int i = width - 1; i >= 0; i--) {
+        out[i] = (char)('0' + v % 10);
+        v /= 10;
+    }
+    return (size_t)width;
+}
+
+size_t arrow_format_date(int64_t days, char *out) {
+    int64_t y;
+    int m, d;
+    civil_from_days(days, &y, &m, &d);
+    if (y < 0 || y > 9999) return (size_t)snprintf(out, 16, "%lld-%02d-%02d", (long long)y, m, d);
+    size_t n = put_digits(out, y, 4);
+    out[n++] = '-';
+    n += put_digits(out + n, m, 2);
+    out[n++] = '-';
+    n += put_digits(out + n, d, 2);
+    return n;
+}
+
+size_t arrow_format_timestamp(int64_t v, int unit, bool utc, char *out) {
+    int64_t per = 1;
+    for (int i = 0; i < unit; i++) per *= 1000;
+    int64_t secs = v / per, frac = v % per;
+    if (frac < 0) {
+        frac += per;
+        secs--;
+    }
+    int64_t days = secs / 86400, sod = secs % 86400;
+    if (sod < 0) {
+        sod += 86400;
+        days--;
+    }
+
+    size_t n = arrow_format_date(days, out);
+    out[n++] = 'T';
+    n += put_digits(out + n, sod / 3600, 2);
+    out[n++] = ':';
+    n += put_digits(out + n, sod / 60 % 60, 2);
+    out[n++] = ':';
+    n += put_digits(out + n, sod % 60, 2);
+    if (frac) {
+        out[n++] = '.';
+        n += put_digits(out + n, frac, 3 * unit);
+    }
+    if (utc) out[n++] = 'Z';
+    return n;
+}
@@ -0,0 +1,140 @@
+#ifndef DTCONVERT_ARROW_IPC_H
+#define DTCONVERT_ARROW_IPC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "outbuf.h"
+
+// Apache Arrow IPC streaming format, as read and written by data_convert.
+//
+// A stream is a Schema message, then RecordBatch messages, then an
+// end-of-stream marker. Each message is framed as 0xFFFFFFFF, an int32
+// metadata length, a Message flatbuffer padded to 8 bytes, and a body holding
+// the batch's buffers. The flatbuffers are built and parsed by hand here (no
+// flatbuffers or Arrow library); only the tables this tool needs are known.
+//
+// Supported column types are flat: Null, Bool, Int, FloatingPoint, Utf8,
+// LargeUtf8, Binary, LargeBinary, Date and Timestamp. Dictionary encoding,
+// compressed bodies and nested types are rejected. Data is little-endian.
+
+// First bytes of an Arrow IPC *file*, which wraps a stream. Readers skip it.
+#define ARROW_FILE_MAGIC "ARROW1"
+
+// Type union tags (Schema.fbs).
+typedef enum {
+    ARROW_NULL = 1,
+    ARROW_INT = 2,
+    ARROW_FLOAT = 3,
+    ARROW_BINARY = 4,
+    ARROW_UTF8 = 5,
+    ARROW_BOOL = 6,
+    ARROW_DATE = 8,
+    ARROW_TIMESTAMP = 10,
+    ARROW_LARGE_BINARY = 19,
+    ARROW_LARGE_UTF8 = 20,
+} ArrowKind;
+
+// Date units
+#define ARROW_DATE_DAY 0
+#define ARROW_DATE_MILLI 1
+// Timestamp units: seconds times 1000^unit
+#define ARROW_TIME_SECOND 0
+#define ARROW_TIME_MICRO 2
+
+typedef struct {
+    char *name;
+    ArrowKind kind;
+    bool nullable;
+    // ARROW_INT: 8, 16, 32 or 64; ARROW_FLOAT: 16, 32 or 64
+    int bit_width;
+    bool is_signed;
+    // ARROW_DATE and ARROW_TIMESTAMP
+    int unit;
+    // ARROW_TIMESTAMP; NULL for wall-clock time
+    char *timezone;
+} ArrowField;
+
+typedef struct {
+    int64_t length;
+    int64_t null_count;
+} ArrowNode;
+
+typedef struct {
+    int64_t offset;
+    int64_t length;
+} ArrowBuffer;
+
+typedef enum {
+    ARROW_MSG_SCHEMA = 1,
+    ARROW_MSG_DICTIONARY = 2,
+    ARROW_MSG_BATCH = 3,
+} ArrowMessageType;
+
+typedef struct {
+    int type;
+    int64_t body_len;
+
+    // ARROW_MSG_SCHEMA
+    ArrowField *fields;
+    size_t nfields;
+
+    // ARROW_MSG_BATCH
+    int64_t rows;
+    ArrowNode *nodes;
+    size_t nnodes;
+    ArrowBuffer *buffers;
+    size_t nbuffers;
+} ArrowMessage;
+
+// Buffers each field kind uses in a record batch (validity first).
+size_t arrow_buffer_count(ArrowKind kind);
+
+// ---------------- Writing ----------------
+
+void arrow_write_schema(OutBuf *out, const ArrowField *fields, size_t n);
+
+// The framed metadata of a record batch; the caller writes body_len bytes of
+// buffers after it, each starting at its 8-byte aligned offset.
+void arrow_write_batch(OutBuf *out, int64_t rows, const ArrowNode *nodes, size_t nnodes, const ArrowBuffer *buffers,
+                       size_t nbuffers, int64_t body_len);
+
+void arrow_write_eos(OutBuf *out);
+
+// ---------------- Reading ----------------
+
+// Parses a Message flatbuffer (the bytes after the framing). Returns NULL on
+// success or a description of what is wrong with it.
+const char *arrow_parse_message(const uint8_t *p, size_t n, ArrowMessage *m);
+
+void arrow_message_free(ArrowMessage *m);
+
+// ---------------- Values ----------------
+
+static inline uint64_t arrow_le(const uint8_t *p, size_t size) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < size; i++) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+static inline void arrow_put_le(uint8_t *p, uint64_t v, size_t size) {
+    for (size_t i = 0; i < size; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+// Days since 1970-01-01 of a valid ISO date (YYYY-MM-DD...).
+int32_t arrow_parse_date(const char *s);
+
+// Microseconds since the epoch of a timestamp type_of_value() accepted. An
+// offset, if any, is applied, so the result is UTC.
+int64_t arrow_parse_timestamp(const char *s, size_t n);
+
+// Formats days since the epoch as YYYY-MM-DD. out needs 16 bytes.
+size_t arrow_format_date(int64_t days, char *out);
+
+// Formats a timestamp in the given unit as YYYY-MM-DDTHH:MM:SS, with a
+// fraction when it is not zero and Z when utc. out needs 40 bytes.
+size_t arrow_format_timestamp(int64_t v, int unit, bool utc, char *out);
+
+#endif // DTCONVERT_ARROW_IPC_H
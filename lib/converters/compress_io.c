@@ -0,0 +1,547 @@
+// pipe2() and F_SETPIPE_SZ
+#define _GNU_SOURCE
+
+#include "compress_io.h"
+#include "libdtconvert.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#ifdef DTCONVERT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// Worker read/write size, and the pipe capacity asked for (best effort), so
+// the two sides trade large blocks rather than 64 KiB ones.
+#define IO_CHUNK ((size_t)256 * 1024)
+#define PIPE_BYTES (1024 * 1024)
+
+struct CompressStream {
+    CompressCodec codec;
+    bool writing;
+    int level;
+    // The worker reads src and writes dst, and closes both when done.
+    int src;
+    int dst;
+    bool threaded;
+    pthread_t thread;
+    pid_t pid;
+    // SIGPIPE handler to put back once a zstd command writer is finished.
+    bool ignoring_pipe;
+    void (*old_pipe)(int);
+    // First failure: an errno value, or msg for corrupt input.
+    int err;
+    const char *msg;
+};
+
+size_t compress_suffix_len(const char *path) {
+    size_t n = strlen(path);
+    if (n > 3 && strcasecmp(path + n - 3, ".gz") == 0) return 3;
+    if (n > 4 && strcasecmp(path + n - 4, ".zst") == 0) return 4;
+    return 0;
+}
+
+CompressCodec compress_codec_from_path(const char *path) {
+    switch (compress_suffix_len(path)) {
+        case 3: return COMPRESS_GZIP;
+        case 4: return COMPRESS_ZSTD;
+        default: return COMPRESS_NONE;
+    }
+}
+
+CompressCodec compress_codec_from_magic(const unsigned char *p, size_t n) {
+    if (n >= 2 && p[0] == 0x1f && p[1] == 0x8b) return COMPRESS_GZIP;
+    if (n >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd) return COMPRESS_ZSTD;
+    return COMPRESS_NONE;
+}
+
+static int env_level(CompressCodec codec) {
+    int lo = 1, hi = codec == COMPRESS_GZIP ? 9 : 19;
+    int level = codec == COMPRESS_GZIP ? 6 : 3;
+    const char *s = getenv("DTCONVERT_COMPRESS_LEVEL");
+    if (s && s[0]) {
+        char *end = NULL;
+        long v = strtol(s, &end, 10);
+        if (*end == '\0') level = v < lo ? lo : v > hi ? hi : (int)v;
+    }
+    return level;
+}
+
+static void fail(CompressStream *s, int err, const char *msg) {
+    if (s->err == 0 && s->msg == NULL) {
+        s->err = err;
+        s->msg = msg;
+    }
+}
+
+static bool failed(const CompressStream *s) { return s->err != 0 || s->msg != NULL; }
+
+// ---------------- Worker I/O ----------------
+
+static ssize_t read_some(int fd, unsigned char *buf, size_t n) {
+    while (true) {
+        ssize_t r = read(fd, buf, n);
+        if (r >= 0 || errno != EINTR) return r;
+    }
+}
+
+// Returns false once dst is unusable. A closed pipe on the decompressing side
+// only means the reader stopped early, so it is not recorded as a failure.
+static bool write_full(CompressStream *s, const unsigned char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(s->dst, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (s->writing || errno != EPIPE) fail(s, errno, NULL);
+            return false;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+// After a failure the compressing worker keeps draining its pipe, so the
+// writer never blocks or gets EPIPE; the error surfaces in compress_finish().
+static void drain(CompressStream *s, unsigned char *buf) {
+    while (read_some(s->src, buf, IO_CHUNK) > 0) {
+    }
+}
+
+// ---------------- gzip ----------------
+
+static void gzip_inflate(CompressStream *s, unsigned char *in, unsigned char *out) {
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    // 15 + 32: gzip or zlib header, detected automatically.
+    if (inflateInit2(&z, 15 + 32) != Z_OK) {
+        fail(s, ENOMEM, NULL);
+        return;
+    }
+    // more: the last call filled out, so output may be pending without
+    // further input.
+    bool ended = false, more = false;
+    while (true) {
+        if (z.avail_in == 0 && !more) {
+            ssize_t r = read_some(s->src, in, IO_CHUNK);
+            if (r < 0) {
+                fail(s, errno, NULL);
+                break;
+            }
+            if (r == 0) {
+                if (!ended) fail(s, 0, "truncated gzip data");
+                break;
+            }
+            z.next_in = in;
+            z.avail_in = (uInt)r;
+        }
+        // Concatenated members (as from `cat a.gz b.gz`) decode as one stream.
+        if (ended) {
+            inflateReset(&z);
+            ended = false;
+        }
+        z.next_out = out;
+        z.avail_out = (uInt)IO_CHUNK;
+        int rc = inflate(&z, Z_NO_FLUSH);
+        if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+            fail(s, 0, "corrupt gzip data");
+            break;
+        }
+        if (!write_full(s, out, IO_CHUNK - z.avail_out)) break;
+        more = z.avail_out == 0 && rc != Z_STREAM_END;
+        if (rc == Z_STREAM_END) ended = true;
+    }
+    inflateEnd(&z);
+}
+
+static void gzip_deflate(CompressStream *s, unsigned char *in, unsigned char *out) {
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    // 15 + 16: gzip header and trailer.
+    if (deflateInit2(&z, s->level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        fail(s, ENOMEM, NULL);
+        return;
+    }
+    int flush = Z_NO_FLUSH;
+    while (flush != Z_FINISH) {
+        ssize_t r = read_some(s->src, in, IO_CHUNK);
+        if (r < 0) {
+            fail(s, errno, NULL);
+            break;
+        }
+        if (r == 0) flush = Z_FINISH;
+        z.next_in = in;
+        z.avail_in = (uInt)r;
+        int rc;
+        do {
+            z.next_out = out;
+            z.avail_out = (uInt)IO_CHUNK;
+            rc = deflate(&z, flush);
+            if (!write_full(s, out, IO_CHUNK - z.avail_out)) break;
+        } while (z.avail_out == 0 || (flush == Z_FINISH && rc != Z_STREAM_END));
+        if (failed(s)) break;
+    }
+    deflateEnd(&z);
+}
+
+// ---------------- zstd ----------------
+
+#ifdef DTCONVERT_HAVE_ZSTD
+static void zstd_decompress(CompressStream *s, unsigned char *in, unsigned char *out) {
+    ZSTD_DCtx *d = ZSTD_createDCtx();
+    if (!d) {
+        fail(s, ENOMEM, NULL);
+        return;
+    }
+    // Non-zero while a frame is incomplete.
+    size_t pending = 0;
+    bool more = false;
+    ZSTD_inBuffer ib = {in, 0, 0};
+    while (true) {
+        if (ib.pos == ib.size && !more) {
+            ssize_t r = read_some(s->src, in, IO_CHUNK);
+            if (r < 0) {
+                fail(s, errno, NULL);
+                break;
+            }
+            if (r == 0) {
+                if (pending) fail(s, 0, "truncated zstd data");
+                break;
+            }
+            ib.size = (size_t)r;
+            ib.pos = 0;
+        }
+        ZSTD_outBuffer ob = {out, IO_CHUNK, 0};
+        pending = ZSTD_decompressStream(d, &ob, &ib);
+        if (ZSTD_isError(pending)) {
+            fail(s, 0, "corrupt zstd data");
+            break;
+        }
+        if (!write_full(s, out, ob.pos)) break;
+        more = ob.pos == ob.size;
+    }
+    ZSTD_freeDCtx(d);
+}
+
+static void zstd_compress(CompressStream *s, unsigned char *in, unsigned char *out) {
+    ZSTD_CCtx *c = ZSTD_createCCtx();
+    if (!c) {
+        fail(s, ENOMEM, NULL);
+        return;
+    }
+    ZSTD_CCtx_setParameter(c, ZSTD_c_compressionLevel, s->level);
+    // Fails harmlessly when libzstd was built without threads.
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > 1) ZSTD_CCtx_setParameter(c, ZSTD_c_nbWorkers, (int)cpus);
+
+    ZSTD_EndDirective mode = ZSTD_e_continue;
+    while (mode != ZSTD_e_end) {
+        ssize_t r = read_some(s->src, in, IO_CHUNK);
+        if (r < 0) {
+            fail(s, errno, NULL);
+            break;
+        }
+        if (r == 0) mode = ZSTD_e_end;
+        ZSTD_inBuffer ib = {in, (size_t)r, 0};
+        size_t left;
+        do {
+            ZSTD_outBuffer ob = {out, IO_CHUNK, 0};
+            left = ZSTD_compressStream2(c, &ob, &ib, mode);
+            if (ZSTD_isError(left)) {
+                fail(s, 0, ZSTD_getErrorName(left));
+                break;
+            }
+            if (!write_full(s, out, ob.pos)) break;
+        } while (mode == ZSTD_e_end ? left != 0 : ib.pos < ib.size);
+        if (failed(s)) break;
+    }
+    ZSTD_freeCCtx(c);
+}
+#endif
+
+static void *worker(void *arg) {
+    CompressStream *s = (CompressStream *)arg;
+    unsigned char *in = (unsigned char *)malloc(IO_CHUNK);
+    unsigned char *out = (unsigned char *)malloc(IO_CHUNK);
+    if (!in || !out) {
+        fail(s, ENOMEM, NULL);
+    } else if (s->codec == COMPRESS_GZIP) {
+        if (s->writing) {
+            gzip_deflate(s, in, out);
+        } else {
+            gzip_inflate(s, in, out);
+        }
+    } else {
+#ifdef DTCONVERT_HAVE_ZSTD
+        if (s->writing) {
+            zstd_compress(s, in, out);
+        } else {
+            zstd_decompress(s, in, out);
+        }
+#endif
+    }
+
+    if (s->writing) {
+        if (in) drain(s, in);
+        if (close(s->dst) != 0) fail(s, errno, NULL);
+    } else {
+        close(s->dst);
+    }
+    close(s->src);
+    free(in);
+    free(out);
+    return NULL;
+}
+
+// ---------------- Streams ----------------
+
+#ifndef DTCONVERT_HAVE_ZSTD
+static bool have_program(const char *name) {
+    const char *path = getenv("PATH");
+    if (!path) path = "/usr/bin:/bin";
+    char buf[4096];
+    while (*path) {
+        size_t n = strcspn(path, ":");
+        if (n > 0 && n + strlen(name) + 2 <= sizeof(buf)) {
+            memcpy(buf, path, n);
+            buf[n] = '/';
+            strcpy(buf + n + 1, name);
+            if (access(buf, X_OK) == 0) return true;
+        }
+        path += n;
+        if (*path == ':') path++;
+    }
+    return false;
+}
+
+// Runs the zstd command between src and dst.
+static int spawn_zstd(CompressStream *s) {
+    char level[8];
+    snprintf(level, sizeof(level), "-%d", s->level);
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        dup2(s->src, STDIN_FILENO);
+        dup2(s->dst, STDOUT_FILENO);
+        signal(SIGPIPE, SIG_DFL);
+        if (s->writing) {
+            execlp("zstd", "zstd", "-q", "-c", "-T0", level, (char *)NULL);
+        } else {
+            execlp("zstd", "zstd", "-q", "-d", "-c", (char *)NULL);
+        }
+        fprintf(stderr, "Error: cannot run zstd: %s\n", strerror(errno));
+        _exit(127);
+    }
+    s->pid = pid;
+    close(s->src);
+    close(s->dst);
+    return 0;
+}
+#endif
+
+// Starts the worker between s->src and s->dst, with signals blocked so a
+// closed pipe shows up as EPIPE rather than SIGPIPE.
+static int start(CompressStream *s) {
+#ifndef DTCONVERT_HAVE_ZSTD
+    if (s->codec == COMPRESS_ZSTD) {
+        // The helper would die of SIGPIPE should the command exit early.
+        if (s->writing) {
+            s->old_pipe = signal(SIGPIPE, SIG_IGN);
+            s->ignoring_pipe = true;
+        }
+        if (spawn_zstd(s) != 0) {
+            int saved = errno;
+            if (s->ignoring_pipe) signal(SIGPIPE, s->old_pipe);
+            errno = saved;
+            return -1;
+        }
+        return 0;
+    }
+#endif
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int rc = pthread_create(&s->thread, NULL, worker, s);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        errno = rc;
+        return -1;
+    }
+    s->threaded = true;
+    return 0;
+}
+
+// Without ZSTD=1, zstd needs the command (errno ENOTSUP otherwise).
+static bool codec_available(CompressCodec codec) {
+#ifndef DTCONVERT_HAVE_ZSTD
+    if (codec == COMPRESS_ZSTD && !have_program("zstd")) {
+        errno = ENOTSUP;
+        return false;
+    }
+#else
+    (void)codec;
+#endif
+    return true;
+}
+
+static CompressStream *stream_open(CompressCodec codec, bool writing, int file, int *fd) {
+    if (!codec_available(codec)) return NULL;
+    int p[2];
+    if (pipe2(p, O_CLOEXEC) != 0) return NULL;
+#ifdef F_SETPIPE_SZ
+    (void)fcntl(p[1], F_SETPIPE_SZ, PIPE_BYTES);
+#endif
+
+    CompressStream *s = (CompressStream *)calloc(1, sizeof(*s));
+    if (!s) {
+        close(p[0]);
+        close(p[1]);
+        errno = ENOMEM;
+        return NULL;
+    }
+    s->codec = codec;
+    s->writing = writing;
+    s->level = env_level(codec);
+    s->src = writing ? p[0] : file;
+    s->dst = writing ? file : p[1];
+    if (start(s) != 0) {
+        int saved = errno;
+        close(p[0]);
+        close(p[1]);
+        free(s);
+        errno = saved;
+        return NULL;
+    }
+    *fd = writing ? p[1] : p[0];
+    return s;
+}
+
+static const char *open_error(CompressCodec codec) {
+#ifndef DTCONVERT_HAVE_ZSTD
+    if (codec == COMPRESS_ZSTD && errno == ENOTSUP) return "zstd needs the zstd command or a build with ZSTD=1";
+#else
+    (void)codec;
+#endif
+    return strerror(errno);
+}
+
+// "-" is a duplicate of fd, so closing it leaves the standard stream open.
+static int open_std(const char *path, int fd) {
+    if (strcmp(path, "-") != 0) return -2;
+    return fcntl(fd, F_DUPFD_CLOEXEC, 3);
+}
+
+int compress_open_read(const char *path, int *fd, CompressStream **s) {
+    *s = NULL;
+    int file = open_std(path, STDIN_FILENO);
+    if (file == -2) file = open(path, O_RDONLY | O_CLOEXEC);
+    if (file < 0) {
+        fprintf(stderr, "Error: cannot open '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    CompressCodec codec;
+    struct stat st;
+    bool std_in = strcmp(path, "-") == 0;
+    if (fstat(file, &st) == 0 && S_ISREG(st.st_mode)) {
+        // Standard input redirected from a file starts where the shell left it
+        off_t at = std_in ? lseek(file, 0, SEEK_CUR) : 0;
+        unsigned char magic[4];
+        ssize_t n = pread(file, magic, sizeof(magic), at < 0 ? 0 : at);
+        codec = compress_codec_from_magic(magic, n > 0 ? (size_t)n : 0);
+    } else if (std_in) {
+        codec = COMPRESS_NONE;
+    } else {
+        codec = compress_codec_from_path(path);
+    }
+    if (codec == COMPRESS_NONE) {
+        *fd = file;
+        helper_hold_fd(file);
+        return 0;
+    }
+
+    *s = stream_open(codec, false, file, fd);
+    if (!*s) {
+        fprintf(stderr, "Error: cannot read '%s': %s\n", path, open_error(codec));
+        close(file);
+        return 1;
+    }
+    helper_hold_stream(*s, path);
+    helper_hold_fd(*fd);
+    return 0;
+}
+
+int compress_open_write(const char *path, int *fd, CompressStream **s) {
+    *s = NULL;
+    int out = open_std(path, STDOUT_FILENO);
+    if (out != -2) {
+        if (out < 0) {
+            fprintf(stderr, "Error: cannot write '%s': %s\n", path, strerror(errno));
+            return 1;
+        }
+        *fd = out;
+        helper_hold_fd(out);
+        return 0;
+    }
+    CompressCodec codec = compress_codec_from_path(path);
+    if (!codec_available(codec)) {
+        fprintf(stderr, "Error: cannot write '%s': %s\n", path, open_error(codec));
+        return 1;
+    }
+    int file = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (file < 0) {
+        fprintf(stderr, "Error: cannot write '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (codec == COMPRESS_NONE) {
+        *fd = file;
+        helper_hold_fd(file);
+        return 0;
+    }
+
+    *s = stream_open(codec, true, file, fd);
+    if (!*s) {
+        fprintf(stderr, "Error: cannot write '%s': %s\n", path, open_error(codec));
+        close(file);
+        return 1;
+    }
+    helper_hold_stream(*s, path);
+    helper_hold_fd(*fd);
+    return 0;
+}
+
+int compress_finish(CompressStream *s, const char *path) {
+    if (!s) return 0;
+    helper_drop_stream(s);
+    if (s->threaded) {
+        pthread_join(s->thread, NULL);
+    } else if (s->pid > 0) {
+        int status = 0;
+        while (waitpid(s->pid, &status, 0) < 0 && errno == EINTR) {
+        }
+        // A reader that stopped early leaves `zstd -d` with a closed pipe.
+        bool early = !s->writing && WIFSIGNALED(status) && WTERMSIG(status) == SIGPIPE;
+        if (!early && !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) fail(s, 0, "zstd failed");
+    }
+    if (s->ignoring_pipe) signal(SIGPIPE, s->old_pipe);
+
+    int rc = 0;
+    if (failed(s)) {
+        fprintf(stderr, "Error: cannot %s '%s': %s\n", s->writing ? "write" : "read", path,
+                s->msg ? s->msg : strerror(s->err));
+        rc = 1;
+    }
+    free(s);
+    return rc;
+}
@@ -0,0 +1,52 @@
+#ifndef DTCONVERT_COMPRESS_IO_H
+#define DTCONVERT_COMPRESS_IO_H
+
+#include <stddef.h>
+
+// Transparent gzip / zstd files for the converter helpers.
+//
+// A compressed file is exposed as a plain descriptor: the read end of a pipe
+// fed by a decompressor, or the write end of one drained by a compressor into
+// the file. Parsers and OutBuf therefore work unchanged, and (de)compression
+// overlaps with conversion. gzip runs in-process on a zlib worker thread.
+// zstd does too when built with `make ZSTD=1`, using libzstd's worker threads
+// for compression; otherwise the zstd command is run (with -T0).
+//
+// Inputs are recognised by magic bytes when they are regular files, and by a
+// .gz/.zst suffix otherwise (FIFOs cannot be peeked at). Outputs are
+// compressed when the path ends in .gz or .zst. DTCONVERT_COMPRESS_LEVEL sets
+// the level (gzip 1-9, default 6; zstd 1-19, default 3).
+
+typedef enum { COMPRESS_NONE = 0, COMPRESS_GZIP, COMPRESS_ZSTD } CompressCodec;
+
+typedef struct CompressStream CompressStream;
+
+// Length of a trailing ".gz" or ".zst" in path (any case), or 0.
+size_t compress_suffix_len(const char *path);
+
+// Codec named by the suffix of path.
+CompressCodec compress_codec_from_path(const char *path);
+
+// Codec whose magic number starts p[0..n).
+CompressCodec compress_codec_from_magic(const unsigned char *p, size_t n);
+
+// A path of "-" is standard input or output. Output to it is never
+// compressed; input is decompressed only when redirected from a regular file,
+// since a pipe has no suffix and cannot be peeked at.
+
+// Opens path for reading. *fd yields the decompressed contents: the file
+// itself when it is not compressed (*s = NULL), or a pipe fed by a
+// decompressor (*s set). Prints an error and returns 1 on failure.
+int compress_open_read(const char *path, int *fd, CompressStream **s);
+
+// Creates/truncates path for writing. With a .gz/.zst suffix *fd is a pipe
+// whose bytes are compressed into the file, and *s is set; otherwise *fd is
+// the file and *s = NULL. Prints an error and returns 1 on failure.
+int compress_open_write(const char *path, int *fd, CompressStream **s);
+
+// Waits for the (de)compressor once the caller has closed its descriptor, and
+// frees s (NULL is a no-op). Prints an error naming path and returns 1 if the
+// data was corrupt or could not be written.
+int compress_finish(CompressStream *s, const char *path);
+
+#endif // DTCONVERT_COMPRESS_IO_H
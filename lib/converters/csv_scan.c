@@ -0,0 +1,253 @@
+#include "csv_scan.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CSV_SCAN_X86 1
+#endif
+
+// Each kernel returns the index of the first byte of p[0..n) that equals one
+// of the four bytes in set, or n.
+static size_t scan_scalar(const char *p, size_t n, const char *set) {
+    for (size_t i = 0; i < n; i++) {
+        char ch = p[i];
+        if (ch == set[0] || ch == set[1] || ch == set[2] || ch == set[3]) return i;
+    }
+    return n;
+}
+
+static size_t count_scalar(const char *p, size_t n, char ch) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) count += p[i] == ch;
+    return count;
+}
+
+#ifdef CSV_SCAN_X86
+// SSE2 is part of the x86-64 baseline, so this needs no target attribute.
+static size_t scan_sse2(const char *p, size_t n, const char *set) {
+    const __m128i s0 = _mm_set1_epi8(set[0]);
+    const __m128i s1 = _mm_set1_epi8(set[1]);
+    const __m128i s2 = _mm_set1_epi8(set[2]);
+    const __m128i s3 = _mm_set1_epi8(set[3]);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, s0), _mm_cmpeq_epi8(v, s1)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, s2), _mm_cmpeq_epi8(v, s3)));
+        unsigned int bits = (unsigned int)_mm_movemask_epi8(m);
+        if (bits) return i + (size_t)__builtin_ctz(bits);
+    }
+    return i + scan_scalar(p + i, n - i, set);
+}
+
+static size_t count_sse2(const char *p, size_t n, char ch) {
+    const __m128i c = _mm_set1_epi8(ch);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        count += (size_t)__builtin_popcount((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, c)));
+    }
+    return count + count_scalar(p + i, n - i, ch);
+}
+
+__attribute__((target("avx2"))) static size_t scan_avx2(const char *p, size_t n, const char *set) {
+    const __m256i s0 = _mm256_set1_epi8(set[0]);
+    const __m256i s1 = _mm256_set1_epi8(set[1]);
+    const __m256i s2 = _mm256_set1_epi8(set[2]);
+    const __m256i s3 = _mm256_set1_epi8(set[3]);
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, s0), _mm256_cmpeq_epi8(v, s1)),
+                                    _mm256_or_si256(_mm256_cmpeq_epi8(v, s2), _mm256_cmpeq_epi8(v, s3)));
+        unsigned int bits = (unsigned int)_mm256_movemask_epi8(m);
+        if (bits) return i + (size_t)__builtin_ctz(bits);
+    }
+    // Finish without calling scan_sse2(): legacy SSE code after 256-bit ops
+    // pays an AVX-SSE transition penalty, which dominates on short fields.
+    if (i + 16 <= n) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm256_castsi256_si128(s0)),
+                                              _mm_cmpeq_epi8(v, _mm256_castsi256_si128(s1))),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, _mm256_castsi256_si128(s2)),
+                                              _mm_cmpeq_epi8(v, _mm256_castsi256_si128(s3))));
+        unsigned int bits = (unsigned int)_mm_movemask_epi8(m);
+        if (bits) return i + (size_t)__builtin_ctz(bits);
+        i += 16;
+    }
+    return i + scan_scalar(p + i, n - i, set);
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t count_avx2(const char *p, size_t n, char ch) {
+    const __m256i c = _mm256_set1_epi8(ch);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        count += (size_t)__builtin_popcount((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, c)));
+    }
+    return count + count_scalar(p + i, n - i, ch);
+}
+#endif
+
+typedef size_t (*ScanFn)(const char *p, size_t n, const char *set);
+typedef size_t (*CountFn)(const char *p, size_t n, char ch);
+
+static ScanFn scan_fn = NULL;
+static CountFn count_fn = count_scalar;
+static const char *scan_name = "scalar";
+
+static void scan_select(void) {
+    ScanFn fn = scan_scalar;
+    CountFn cfn = count_scalar;
+    const char *name = "scalar";
+#ifdef CSV_SCAN_X86
+    const char *force = getenv("DTCONVERT_SIMD");
+    __builtin_cpu_init();
+    bool avx2 = __builtin_cpu_supports("avx2");
+    if (force && strcmp(force, "scalar") == 0) {
+        // keep scalar
+    } else if (force && strcmp(force, "sse2") == 0) {
+        fn = scan_sse2;
+        cfn = count_sse2;
+        name = "sse2";
+    } else if (avx2) {
+        fn = scan_avx2;
+        cfn = count_avx2;
+        name = "avx2";
+    } else {
+        fn = scan_sse2;
+        cfn = count_sse2;
+        name = "sse2";
+    }
+#endif
+    scan_name = name;
+    count_fn = cfn;
+    // Racing threads all store the same values; scan_fn is published last.
+    __atomic_store_n(&scan_fn, fn, __ATOMIC_RELEASE);
+}
+
+static ScanFn scan_get(void) {
+    ScanFn fn = __atomic_load_n(&scan_fn, __ATOMIC_ACQUIRE);
+    if (!fn) {
+        scan_select();
+        fn = scan_fn;
+    }
+    return fn;
+}
+
+size_t csv_scan_special(const char *p, size_t n) {
+    static const char special[4] = {'"', ',', '\r', '\n'};
+    return scan_get()(p, n, special);
+}
+
+const char *csv_scan_impl(void) {
+    (void)scan_get();
+    return scan_name;
+}
+
+void csv_chunk_stats(const char *p, size_t n, CsvChunkStats *out) {
+    static const char quote_nl[4] = {'"', '\n', '\n', '\n'};
+    ScanFn scan = scan_get();
+
+    out->first_nl[0] = n;
+    out->first_nl[1] = n;
+    bool odd = false;
+    size_t i = 0;
+    while (i < n) {
+        i += scan(p + i, n - i, quote_nl);
+        if (i >= n) break;
+        if (p[i] == '"') {
+            odd = !odd;
+        } else if (out->first_nl[odd] == n) {
+            out->first_nl[odd] = i;
+            if (out->first_nl[!odd] != n) {
+                // Both candidates known; only the parity of the rest matters.
+                i++;
+                odd ^= count_fn(p + i, n - i, '"') & 1;
+                break;
+            }
+        }
+        i++;
+    }
+    out->odd = odd;
+}
+
+CsvScanStatus csv_scan_field(const char *buf, size_t len, size_t *pos, bool at_eof, CsvField *out) {
+    size_t i = *pos;
+    memset(out, 0, sizeof(*out));
+
+    if (i < len && buf[i] == '"') {
+        // Inside quotes only '"' matters; memchr is already vectorized.
+        size_t start = i + 1;
+        size_t j = start;
+        bool escaped = false;
+        while (true) {
+            const char *q = (j < len) ? (const char *)memchr(buf + j, '"', len - j) : NULL;
+            if (!q) {
+                if (!at_eof) return CSV_SCAN_NEED_MORE;
+                // Unterminated quote: the field runs to the end of input.
+                j = len;
+                break;
+            }
+            j = (size_t)(q - buf);
+            if (j + 1 >= len && !at_eof) return CSV_SCAN_NEED_MORE;  // "" or closing quote?
+            if (j + 1 < len && buf[j + 1] == '"') {
+                escaped = true;
+                j += 2;
+                continue;
+            }
+            break;
+        }
+
+        out->ptr = buf + start;
+        out->len = j - start;
+        out->quoted = true;
+        out->escaped = escaped;
+        *pos = (j < len) ? j + 1 : len;
+        return CSV_SCAN_OK;
+    }
+
+    // Unquoted: a '"' mid-field is literal, so skip past it and keep scanning.
+    size_t j = i;
+    while (true) {
+        j += csv_scan_special(buf + j, len - j);
+        if (j < len && buf[j] == '"') {
+            j++;
+            continue;
+        }
+        break;
+    }
+    if (j >= len && !at_eof) return CSV_SCAN_NEED_MORE;
+
+    out->ptr = buf + i;
+    out->len = j - i;
+    *pos = j;
+    return CSV_SCAN_OK;
+}
+
+size_t csv_unescape(const CsvField *f, char *dst) {
+    if (!f->escaped) {
+        memcpy(dst, f->ptr, f->len);
+        return f->len;
+    }
+
+    const char *s = f->ptr;
+    const char *end = f->ptr + f->len;
+    size_t n = 0;
+    while (s < end) {
+        const char *q = (const char *)memchr(s, '"', (size_t)(end - s));
+        size_t run = q ? (size_t)(q - s) + 1 : (size_t)(end - s);
+        memcpy(dst + n, s, run);
+        n += run;
+        s += run;
+        // skip the second quote of a "" pair
+        if (q && s < end && *s == '"') s++;
+    }
+    return n;
+}
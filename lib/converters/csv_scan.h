@@ -0,0 +1,59 @@
+#ifndef DTCONVERT_CSV_SCAN_H
+#define DTCONVERT_CSV_SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Shared CSV field scanner used by data_convert, sql_convert and pg_store.
+//
+// Structural bytes ('"', ',', '\r', '\n') are located 16 (SSE2) or 32 (AVX2)
+// bytes at a time; the variant is picked once per process from the CPU, or
+// forced with DTCONVERT_SIMD=scalar|sse2|avx2.
+
+typedef enum {
+    CSV_SCAN_OK = 0,
+    // The field runs into the end of the buffer and more input may follow.
+    CSV_SCAN_NEED_MORE = 1,
+} CsvScanStatus;
+
+typedef struct {
+    // Field bytes inside buf. For quoted fields this excludes the quotes and,
+    // when escaped is set, still contains doubled quotes ("").
+    const char *ptr;
+    size_t len;
+    bool quoted;
+    bool escaped;
+} CsvField;
+
+// Index of the first '"', ',', '\r' or '\n' in p[0..n), or n if there is none.
+size_t csv_scan_special(const char *p, size_t n);
+
+// Scans one field starting at buf[*pos]. On CSV_SCAN_OK, *pos is left on the
+// delimiter or line terminator that follows (or at len). Unquoted fields and
+// quoted fields without escapes are returned as slices of buf; nothing is
+// copied. Pass at_eof when buf holds the rest of the input.
+CsvScanStatus csv_scan_field(const char *buf, size_t len, size_t *pos, bool at_eof, CsvField *out);
+
+// Copies the field value to dst, collapsing "" to ". dst must have room for
+// f->len bytes. Returns the value length.
+size_t csv_unescape(const CsvField *f, char *dst);
+
+// Quote-parity summary of one byte range, used to cut CSV input into chunks
+// that can be parsed independently. Under RFC 4180 quoting a '\n' ends a record
+// exactly when an even number of '"' precede it, but a chunk cannot know the
+// quote state it starts in. So both candidates are recorded, and the caller
+// picks one once the parity of all earlier chunks is known.
+typedef struct {
+    // Offset of the first '\n' preceded by an even [0] or odd [1] number of
+    // '"' within the range; n when there is none.
+    size_t first_nl[2];
+    // The range holds an odd number of '"'.
+    bool odd;
+} CsvChunkStats;
+
+void csv_chunk_stats(const char *p, size_t n, CsvChunkStats *out);
+
+// Name of the scanner variant in use ("avx2", "sse2" or "scalar").
+const char *csv_scan_impl(void);
+
+#endif // DTCONVERT_CSV_SCAN_H
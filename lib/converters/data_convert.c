@@ -1,23 +1,38 @@
 #include <ctype.h>
 #include <errno.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "csv_scan.h"
+#include "arrow_ipc.h"
+#include "compress_io.h"
+#include "input_map.h"
+#include "json_scan.h"
+#include "libdtconvert.h"
+#include "outbuf.h"
+#include "parquet.h"
+#include "type_infer.h"
 
 #define MAX_EXT_LEN 16
 
-typedef struct {
-    char **headers;
-    size_t ncols;
+// Input is consumed in chunks of this size; memory use is bounded by the
+// chunk plus the largest single record, not by the file size.
+#define READ_CHUNK (64 * 1024)
 
-    char ***rows;
-    size_t nrows;
-} Table;
+// Output file removed by die() so a failed conversion does not leave a
+// half-written file behind.
+static const char *partial_output = NULL;
 
 static void die(const char *msg) {
     fprintf(stderr, "Error: %s\n", msg);
-    exit(1);
+    if (partial_output) unlink(partial_output);
+    helper_exit(1);
 }
 
 static void *xmalloc(size_t n) {
@@ -40,22 +55,6 @@ static char *xstrdup(const char *s) {
     return out;
 }
 
-static void table_free(Table *t) {
-    if (!t) return;
-
-    for (size_t i = 0; i < t->ncols; i++) free(t->headers[i]);
-    free(t->headers);
-
-    for (size_t r = 0; r < t->nrows; r++) {
-        if (!t->rows[r]) continue;
-        for (size_t c = 0; c < t->ncols; c++) free(t->rows[r][c]);
-        free(t->rows[r]);
-    }
-    free(t->rows);
-
-    memset(t, 0, sizeof(*t));
-}
-
 static void rstrip(char *s) {
     if (!s) return;
     size_t n = strlen(s);
@@ -70,150 +69,636 @@ static char *lskip(char *s) {
     return s;
 }
 
-static int find_header(const Table *t, const char *key) {
-    for (size_t i = 0; i < t->ncols; i++) {
-        if (strcmp(t->headers[i], key) == 0) return (int)i;
+// Extension of path into ext, looking past a .gz/.zst suffix.
+static void path_ext(const char *path, char *ext, size_t size) {
+    size_t n = strlen(path) - compress_suffix_len(path);
+    const char *dot = NULL;
+    for (size_t i = n; i > 0; i--) {
+        if (path[i - 1] == '/') break;
+        if (path[i - 1] == '.') {
+            dot = path + i - 1;
+            break;
+        }
+    }
+    if (!dot || dot == path || (size_t)(dot + 1 - path) >= n) {
+        ext[0] = '\0';
+        return;
+    }
+    snprintf(ext, size, "%.*s", (int)(n - (size_t)(dot + 1 - path)), dot + 1);
+}
+
+static void lower_ascii(char *s) {
+    for (; s && *s; s++) *s = (char)tolower((unsigned char)*s);
+}
+
+// ---------------- Buffers and records ----------------
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} Buf;
+
+static void buf_reserve(Buf *b, size_t extra) {
+    if (b->len + extra <= b->cap) return;
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + extra) cap *= 2;
+    b->data = (char *)xrealloc(b->data, cap);
+    b->cap = cap;
+}
+
+static void buf_putc(Buf *b, char ch) {
+    if (b->len + 1 > b->cap) buf_reserve(b, 1);
+    b->data[b->len++] = ch;
+}
+
+static void buf_put(Buf *b, const char *s, size_t n) {
+    buf_reserve(b, n);
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+}
+
+static void buf_free(Buf *b) {
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+}
+
+typedef struct {
+    const char *ptr;
+    size_t len;
+} Span;
+
+// One record as produced by a reader. A field is either a slice of the
+// reader's input buffer (CSV fields without escapes, never copied) or a copy
+// held in bytes, which is reused for every record. Unset cells are empty.
+// Null fields (an Arrow value whose validity bit is clear) come out as
+// null_cell, so writers can tell them from empty strings.
+typedef struct {
+    size_t off;
+    size_t len;
+    bool in_input;
+    bool null;
+} RecField;
+
+static const char null_cell[] = "";
+
+typedef struct {
+    Buf bytes;
+    RecField *fields;
+    Span *cells;
+    size_t ncols;
+    size_t cap;
+    // Base of in_input slices; set by the reader once the record is complete.
+    const char *input;
+} Record;
+
+static void rec_grow(Record *r, size_t ncols) {
+    if (ncols > r->cap) {
+        size_t cap = r->cap ? r->cap : 16;
+        while (cap < ncols) cap *= 2;
+        r->fields = (RecField *)xrealloc(r->fields, cap * sizeof(RecField));
+        r->cells = (Span *)xrealloc(r->cells, cap * sizeof(Span));
+        r->cap = cap;
+    }
+    for (size_t c = r->ncols; c < ncols; c++) r->fields[c] = (RecField){0, 0, false, false};
+    if (ncols > r->ncols) r->ncols = ncols;
+}
+
+static void rec_reset(Record *r, size_t ncols) {
+    r->ncols = 0;
+    rec_grow(r, ncols);
+    r->bytes.len = 0;
+    r->input = NULL;
+}
+
+// Copied fields are appended to rec->bytes between these two calls.
+static size_t rec_field_begin(const Record *r) { return r->bytes.len; }
+
+static void rec_field_end(Record *r, size_t col, size_t start) {
+    rec_grow(r, col + 1);
+    r->fields[col] = (RecField){start, r->bytes.len - start, false, false};
+}
+
+static void rec_field_slice(Record *r, size_t col, size_t off, size_t len) {
+    rec_grow(r, col + 1);
+    r->fields[col] = (RecField){off, len, true, false};
+}
+
+static void rec_field_null(Record *r, size_t col) {
+    rec_grow(r, col + 1);
+    r->fields[col] = (RecField){0, 0, false, true};
+}
+
+// Offsets are resolved to pointers only once the record is complete, since
+// both buffers may move while fields are being added.
+static const Span *rec_cells(Record *r) {
+    for (size_t c = 0; c < r->ncols; c++) {
+        const RecField *f = &r->fields[c];
+        const char *base = f->in_input ? r->input : r->bytes.data;
+        r->cells[c] = (Span){f->null ? null_cell : f->len ? base + f->off : "", f->len};
+    }
+    return r->cells;
+}
+
+static void rec_free(Record *r) {
+    buf_free(&r->bytes);
+    free(r->fields);
+    free(r->cells);
+    memset(r, 0, sizeof(*r));
+}
+
+// Column names in order of first appearance, with an open-addressing hash
+// index so key lookups stay O(1) for objects with hundreds of keys.
+typedef struct {
+    char **headers;
+    size_t ncols;
+
+    size_t *slots;  // column index + 1; 0 marks an empty slot
+    size_t nslots;  // power of two, kept at most half full
+
+    // Per-column type joined over every value seen (--infer-types).
+    DataType *types;
+} Schema;
+
+static size_t hash_key(const char *key, size_t len) {
+    // FNV-1a
+    size_t h = (size_t)1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)key[i];
+        h *= (size_t)1099511628211ULL;
+    }
+    return h;
+}
+
+static void schema_index(Schema *s, size_t col) {
+    size_t mask = s->nslots - 1;
+    size_t i = hash_key(s->headers[col], strlen(s->headers[col])) & mask;
+    while (s->slots[i] != 0) i = (i + 1) & mask;
+    s->slots[i] = col + 1;
+}
+
+static void schema_rehash(Schema *s) {
+    free(s->slots);
+    s->nslots = s->nslots ? s->nslots * 2 : 64;
+    s->slots = (size_t *)calloc(s->nslots, sizeof(size_t));
+    if (!s->slots) die("out of memory");
+    for (size_t c = 0; c < s->ncols; c++) schema_index(s, c);
+}
+
+// Keys are length-delimited so the JSON reader can look them up straight
+// from the input.
+static int schema_find(const Schema *s, const char *key, size_t len) {
+    if (s->nslots == 0) return -1;
+    size_t mask = s->nslots - 1;
+    for (size_t i = hash_key(key, len) & mask; s->slots[i] != 0; i = (i + 1) & mask) {
+        size_t col = s->slots[i] - 1;
+        const char *h = s->headers[col];
+        if (strncmp(h, key, len) == 0 && h[len] == '\0') return (int)col;
     }
     return -1;
 }
 
-static void ensure_col(Table *t, const char *key) {
-    if (find_header(t, key) >= 0) return;
+static size_t schema_col(Schema *s, const char *key, size_t len) {
+    int found = schema_find(s, key, len);
+    if (found >= 0) return (size_t)found;
+
+    s->headers = (char **)xrealloc(s->headers, (s->ncols + 1) * sizeof(char *));
+    char *h = (char *)xmalloc(len + 1);
+    memcpy(h, key, len);
+    h[len] = '\0';
+    s->headers[s->ncols] = h;
+    s->types = (DataType *)xrealloc(s->types, (s->ncols + 1) * sizeof(DataType));
+    s->types[s->ncols] = DT_NULL;
+    s->ncols++;
+
+    if (2 * s->ncols > s->nslots) {
+        schema_rehash(s);
+    } else {
+        schema_index(s, s->ncols - 1);
+    }
+    return s->ncols - 1;
+}
+
+static void schema_free(Schema *s) {
+    for (size_t i = 0; i < s->ncols; i++) free(s->headers[i]);
+    free(s->headers);
+    free(s->slots);
+    free(s->types);
+    memset(s, 0, sizeof(*s));
+}
+
+// Set by --infer-types or DTCONVERT_INFER_TYPES: column types are collected
+// while reading and the JSON/NDJSON/YAML writers emit typed values.
+static bool infer_types = false;
+
+static void schema_add_types(Schema *s, Record *rec) {
+    const Span *cells = rec_cells(rec);
+    size_t n = rec->ncols < s->ncols ? rec->ncols : s->ncols;
+    for (size_t c = 0; c < n; c++) type_add(&s->types[c], cells[c].ptr, cells[c].len);
+}
+
+// ---------------- Table ----------------
+
+// Column-oriented table used when records have to be held in memory. Cell
+// bytes for every row live in one growable arena (NUL-terminated, offset 0 is
+// the shared empty string); each column keeps an offset/length pair per row.
+// Loading a table therefore costs O(log n) allocations instead of O(cells).
+typedef struct {
+    size_t *offs;
+    size_t *lens;
+} Column;
+
+typedef struct {
+    char **headers;
+    size_t ncols;
+
+    Column *cols;
+    size_t nrows;
+    size_t row_cap;
+
+    Buf arena;
+} Table;
+
+static void table_free(Table *t) {
+    if (!t) return;
+
+    for (size_t i = 0; i < t->ncols; i++) {
+        free(t->headers[i]);
+        free(t->cols[i].offs);
+        free(t->cols[i].lens);
+    }
+    free(t->headers);
+    free(t->cols);
+    buf_free(&t->arena);
+
+    memset(t, 0, sizeof(*t));
+}
 
+// Appends a column; it starts out empty for every existing row.
+static void table_add_col(Table *t, const char *key) {
     t->headers = (char **)xrealloc(t->headers, (t->ncols + 1) * sizeof(char *));
     t->headers[t->ncols] = xstrdup(key);
 
-    // Expand existing rows
-    for (size_t r = 0; r < t->nrows; r++) {
-        t->rows[r] = (char **)xrealloc(t->rows[r], (t->ncols + 1) * sizeof(char *));
-        t->rows[r][t->ncols] = xstrdup("");
-    }
+    t->cols = (Column *)xrealloc(t->cols, (t->ncols + 1) * sizeof(Column));
+    Column *col = &t->cols[t->ncols];
+    col->offs = (size_t *)calloc(t->row_cap ? t->row_cap : 1, sizeof(size_t));
+    col->lens = (size_t *)calloc(t->row_cap ? t->row_cap : 1, sizeof(size_t));
+    if (!col->offs || !col->lens) die("out of memory");
 
     t->ncols++;
 }
 
 static size_t table_add_row(Table *t) {
-    t->rows = (char ***)xrealloc(t->rows, (t->nrows + 1) * sizeof(char **));
-    t->rows[t->nrows] = (char **)xmalloc(t->ncols * sizeof(char *));
-    for (size_t c = 0; c < t->ncols; c++) t->rows[t->nrows][c] = xstrdup("");
-    t->nrows++;
-    return t->nrows - 1;
-}
+    if (t->arena.len == 0) buf_putc(&t->arena, '\0');
 
-static void table_set(Table *t, size_t row, const char *key, const char *value) {
-    ensure_col(t, key);
-    int idx = find_header(t, key);
-    if (idx < 0) return;
+    if (t->nrows == t->row_cap) {
+        t->row_cap = t->row_cap ? t->row_cap * 2 : 1024;
+        for (size_t c = 0; c < t->ncols; c++) {
+            t->cols[c].offs = (size_t *)xrealloc(t->cols[c].offs, t->row_cap * sizeof(size_t));
+            t->cols[c].lens = (size_t *)xrealloc(t->cols[c].lens, t->row_cap * sizeof(size_t));
+        }
+    }
 
-    free(t->rows[row][(size_t)idx]);
-    t->rows[row][(size_t)idx] = xstrdup(value ? value : "");
+    for (size_t c = 0; c < t->ncols; c++) {
+        t->cols[c].offs[t->nrows] = 0;
+        t->cols[c].lens[t->nrows] = 0;
+    }
+    return t->nrows++;
 }
 
-static const char *path_ext(const char *path) {
-    const char *dot = strrchr(path, '.');
-    if (!dot || dot == path || dot[1] == '\0') return "";
-    return dot + 1;
+static void table_set_at(Table *t, size_t row, size_t col, const char *value, size_t len) {
+    if (len == 0) {
+        t->cols[col].offs[row] = 0;
+        t->cols[col].lens[row] = 0;
+        return;
+    }
+
+    buf_reserve(&t->arena, len + 1);
+    t->cols[col].offs[row] = t->arena.len;
+    t->cols[col].lens[row] = len;
+    memcpy(t->arena.data + t->arena.len, value, len);
+    t->arena.len += len;
+    t->arena.data[t->arena.len++] = '\0';
 }
 
-static void lower_ascii(char *s) {
-    for (; s && *s; s++) *s = (char)tolower((unsigned char)*s);
+// Fills cells (t->ncols entries) with slices of the arena for one row.
+static const Span *table_row(const Table *t, size_t row, Span *cells) {
+    for (size_t c = 0; c < t->ncols; c++) {
+        cells[c] = (Span){t->arena.data + t->cols[c].offs[row], t->cols[c].lens[row]};
+    }
+    return cells;
 }
 
-// ---------------- CSV ----------------
+// ---------------- Input cursor ----------------
 
+// Regular files are mapped whole and parsed in place (see input_map.h).
+// Pipes are read in chunks into buf, which slides forward as input is
+// consumed, so a non-seekable source still converts in bounded memory.
+// Compressed files are read the same way, from a decompressor's pipe.
 typedef struct {
+    FILE *f;
+    CompressStream *z;
+    const char *path;
+    InputMap map;
     const char *data;
     size_t len;
     size_t pos;
+    // Offset of data[0] within the whole input (grows as buf slides).
+    size_t base;
+    char *buf;
+    size_t cap;
+    // Bytes from mark onwards survive a refill (NO_MARK when unset).
+    size_t mark;
+    bool eof;
 } Cursor;
 
-static bool cur_eof(const Cursor *c) { return c->pos >= c->len; }
+#define NO_MARK ((size_t)-1)
+
+static int cur_open(Cursor *c, const char *path) {
+    memset(c, 0, sizeof(*c));
+    int fd;
+    if (compress_open_read(path, &fd, &c->z) != 0) return 1;
+    c->f = fdopen(fd, "rb");
+    if (!c->f) die("out of memory");
+    helper_drop_fd(fd);
+    helper_hold_file(c->f);
+    c->path = path;
+    c->mark = NO_MARK;
+
+    int rc = input_map_fd(&c->map, fileno(c->f));
+    if (rc < 0) {
+        fprintf(stderr, "Error: cannot read '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (rc == 0) {
+        c->data = c->map.data;
+        c->len = c->map.len;
+        c->eof = true;
+        return 0;
+    }
 
-static char cur_peek(const Cursor *c) { return cur_eof(c) ? '\0' : c->data[c->pos]; }
+    c->cap = READ_CHUNK;
+    c->buf = (char *)xmalloc(c->cap);
+    c->data = c->buf;
+    return 0;
+}
 
-static char cur_get(Cursor *c) { return cur_eof(c) ? '\0' : c->data[c->pos++]; }
+// Returns 1 when a decompressor reports corrupt or truncated input.
+static int cur_close(Cursor *c) {
+    if (c->f) {
+        helper_drop_file(c->f);
+        fclose(c->f);
+    }
+    int rc = compress_finish(c->z, c->path);
+    if (c->map.mapped) input_map_close(&c->map);
+    free(c->buf);
+    memset(c, 0, sizeof(*c));
+    return rc;
+}
 
-static char *read_file_all(const char *path, size_t *out_len) {
-    FILE *f = fopen(path, "rb");
-    if (!f) {
-        fprintf(stderr, "Error: cannot open '%s': %s\n", path, strerror(errno));
-        return NULL;
+// Drops consumed bytes and reads the next chunk. Returns false at end of input.
+static bool cur_fill(Cursor *c) {
+    if (c->eof) return false;
+
+    size_t drop = c->mark < c->pos ? c->mark : c->pos;
+    if (drop > 0) {
+        memmove(c->buf, c->buf + drop, c->len - drop);
+        c->base += drop;
+        c->len -= drop;
+        c->pos -= drop;
+        if (c->mark != NO_MARK) c->mark -= drop;
     }
-    if (fseek(f, 0, SEEK_END) != 0) {
-        fclose(f);
-        return NULL;
+    if (c->len == c->cap) {
+        c->cap *= 2;
+        c->buf = (char *)xrealloc(c->buf, c->cap);
+        c->data = c->buf;
     }
-    long sz = ftell(f);
-    if (sz < 0) {
-        fclose(f);
-        return NULL;
+
+    size_t n = fread(c->buf + c->len, 1, c->cap - c->len, c->f);
+    if (n == 0) {
+        if (ferror(c->f)) die("read error");
+        c->eof = true;
+        return false;
     }
-    rewind(f);
+    c->len += n;
+    return true;
+}
+
+static bool cur_eof(Cursor *c) { return c->pos >= c->len && !cur_fill(c); }
 
-    char *buf = (char *)xmalloc((size_t)sz + 1);
-    size_t nread = fread(buf, 1, (size_t)sz, f);
-    fclose(f);
-    buf[nread] = '\0';
-    if (out_len) *out_len = nread;
-    return buf;
+// Reads until n bytes from the current position are buffered. Returns false
+// when the input ends first.
+static bool cur_need(Cursor *c, size_t n) {
+    while (c->len - c->pos < n) {
+        if (!cur_fill(c)) return false;
+    }
+    return true;
 }
 
-static char *csv_parse_field(Cursor *c) {
-    // RFC4180-ish: quoted fields, double quotes escaping
-    // Does NOT consume line terminators. Consumes a single comma delimiter for quoted fields.
-    char *out = NULL;
-    size_t cap = 0, n = 0;
+// Everything before the current position (and mark) has been consumed.
+static void cur_release(Cursor *c) {
+    input_map_release(&c->map, c->mark < c->pos ? c->mark : c->pos);
+}
 
-    bool quoted = false;
-    if (cur_peek(c) == '"') {
-        quoted = true;
-        (void)cur_get(c);
+// Only regular files can be read twice (see prescan_schema()).
+static bool cur_seekable(const Cursor *c) {
+    if (c->map.mapped) return true;
+    struct stat st;
+    return fstat(fileno(c->f), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+static int cur_rewind(Cursor *c) {
+    c->pos = 0;
+    c->base = 0;
+    c->mark = NO_MARK;
+    if (c->map.mapped) {
+        // Released pages fault back in from the file.
+        c->map.released = 0;
+        return 0;
     }
+    if (fseek(c->f, 0, SEEK_SET) != 0) return 1;
+    c->len = 0;
+    c->eof = false;
+    return 0;
+}
 
+static char cur_peek(Cursor *c) { return cur_eof(c) ? '\0' : c->data[c->pos]; }
+
+static char cur_get(Cursor *c) { return cur_eof(c) ? '\0' : c->data[c->pos++]; }
+
+// Reads one line (without its terminator). Returns false at end of input.
+static bool cur_read_line(Cursor *c, Buf *line) {
+    line->len = 0;
+    if (cur_eof(c)) return false;
     while (!cur_eof(c)) {
-        char ch = cur_peek(c);
-        if (quoted) {
-            if (ch == '"') {
-                (void)cur_get(c);
-                if (cur_peek(c) == '"') {
-                    (void)cur_get(c);
-                    ch = '"';
-                } else {
-                    // end quote
-                    quoted = false;
-                    // next must be comma or newline or EOF; consume optional spaces
-                    while (!cur_eof(c) && (cur_peek(c) == ' ' || cur_peek(c) == '\t')) (void)cur_get(c);
-                    break;
-                }
-            }
-        } else {
-            if (ch == ',' || ch == '\n' || ch == '\r') break;
-        }
+        char ch = c->data[c->pos++];
+        if (ch == '\n') break;
+        buf_putc(line, ch);
+    }
+    buf_putc(line, '\0');
+    return true;
+}
+
+// Structural index over a cursor's input, built and consumed by the JSON
+// reader (see JSON below). Offsets are into the whole input (Cursor.base +
+// position), so they stay valid while a streaming cursor slides its buffer.
+typedef struct {
+    JsonScanState st;
+    size_t *pos;
+    size_t n;
+    size_t i;
+    size_t scanned;
+} JsonIndex;
 
-        // consume and append
-        ch = cur_get(c);
+// Record batch being read by the Arrow reader (see Arrow IPC stream below).
+// Buffer pointers point into the batch body held in the cursor's input.
+typedef struct {
+    const uint8_t *validity;  // NULL when no value is null
+    const uint8_t *values;
+    const uint8_t *data;
+    size_t data_len;
+} ArrowColumnIn;
 
-        if (n + 2 > cap) {
-            cap = cap ? cap * 2 : 64;
-            out = (char *)xrealloc(out, cap);
-        }
-        out[n++] = ch;
+typedef struct {
+    ArrowMessage schema;
+    ArrowMessage batch;
+    ArrowColumnIn *cols;
+    const uint8_t *body;
+    int64_t row;
+} ArrowIn;
+
+// ---------------- Streaming reader/writer interface ----------------
+
+typedef struct RecordReader RecordReader;
+
+struct RecordReader {
+    Cursor cur;
+    Schema schema;
+    // True when every column is known before the first record (CSV header).
+    bool fixed_schema;
+    // True once schema.types covers every record (after a prescan).
+    bool typed;
+    // True when schema.types come from the input itself (Arrow), so they are
+    // used even without --infer-types.
+    bool native_types;
+    bool done;
+
+    Buf scratch;
+    bool pending;
+    JsonIndex jx;
+    ArrowIn arrow;
+
+    // Positions the reader at the first record (called again after a rewind).
+    int (*start)(RecordReader *r);
+    // Returns 1 when a record was produced, 0 at end of input.
+    int (*next)(RecordReader *r, Record *rec);
+};
+
+typedef struct RecordWriter RecordWriter;
+typedef struct ArrowOut ArrowOut;
+typedef struct ParquetOut ParquetOut;
+
+// Writers format into an OutBuf. row() only reads the writer, so several
+// threads can format disjoint rows at once (see the parallel pipeline).
+struct RecordWriter {
+    OutBuf out;
+    const char *path;
+    const char *const *headers;
+    size_t ncols;
+    size_t nrows;
+    // Per-column text written ahead of each value ("\"id\": " for JSON),
+    // escaped once by writer_prepare() instead of on every row.
+    Span *keys;
+    OutBuf keybuf;
+
+    // Column types with --infer-types, otherwise NULL (every value a string).
+    const DataType *types;
+
+    // Column builders of the Arrow and Parquet writers, which row() appends
+    // to; such writers are serial.
+    ArrowOut *arrow;
+    ParquetOut *parquet;
+
+    // Emitted between consecutive rows, never before the first.
+    const char *sep;
+    void (*key)(OutBuf *out, const char *header);
+    void (*begin)(const RecordWriter *w, OutBuf *out);
+    void (*row)(const RecordWriter *w, OutBuf *out, const Span *cells);
+    void (*end)(const RecordWriter *w, OutBuf *out);
+};
+
+static void writer_prepare(RecordWriter *w) {
+    w->keys = (Span *)xmalloc((w->ncols ? w->ncols : 1) * sizeof(Span));
+    if (!w->key) return;
+    ob_init(&w->keybuf, -1);
+    size_t *offs = (size_t *)xmalloc((w->ncols ? w->ncols : 1) * sizeof(size_t));
+    for (size_t c = 0; c < w->ncols; c++) {
+        offs[c] = w->keybuf.len;
+        w->key(&w->keybuf, w->headers[c]);
     }
+    if (w->keybuf.err) die("out of memory");
+    for (size_t c = 0; c < w->ncols; c++) {
+        size_t end = c + 1 < w->ncols ? offs[c + 1] : w->keybuf.len;
+        w->keys[c] = (Span){w->keybuf.data + offs[c], end - offs[c]};
+    }
+    free(offs);
+}
+
+// With --infer-types, replaces *v with the bare token to write for cell c of
+// a typed column (a number as is, true/false, or null) and returns true. A
+// false return means the value is written as a string, as are the NaN and
+// Infinity an Arrow float column can hold.
+static bool writer_token(const RecordWriter *w, size_t c, Span *v) {
+    DataType t = w->types ? w->types[c] : DT_TEXT;
+    if (v->ptr == null_cell) {
+        *v = (Span){"null", 4};
+        return true;
+    }
+    if (t == DT_TEXT) return false;
+    if (type_is_null(v->ptr, v->len)) {
+        *v = (Span){"null", 4};
+    } else if (t == DT_BOOLEAN) {
+        *v = (v->ptr[0] | 0x20) == 't' ? (Span){"true", 4} : (Span){"false", 5};
+    } else if (!type_is_number(t)) {
+        return false;
+    } else {
+        const char *p = v->ptr[0] == '-' && v->len > 1 ? v->ptr + 1 : v->ptr;
+        if (*p < '0' || *p > '9') return false;
+    }
+    return true;
+}
+
+static void writer_emit(RecordWriter *w, const Span *cells) {
+    if (w->nrows > 0) ob_puts(&w->out, w->sep);
+    w->row(w, &w->out, cells);
+    w->nrows++;
+}
+
+// ---------------- CSV ----------------
 
-    if (!out) {
-        out = (char *)xmalloc(1);
-        out[0] = '\0';
-        return out;
+// Scans the next field, reading more input as needed. The slice stays valid
+// until the next refill; csv_next() sets cursor->mark so refills keep the
+// current record in the buffer.
+static void csv_next_field(Cursor *c, CsvField *f) {
+    while (csv_scan_field(c->data, c->len, &c->pos, c->eof, f) == CSV_SCAN_NEED_MORE) {
+        (void)cur_fill(c);
     }
-    out[n] = '\0';
+}
 
-    // If we just ended a quoted field, consume a single comma delimiter (leave newlines for caller).
-    if (!quoted) {
-        // quoted==false also true for unquoted; only consume comma if present.
-        if (cur_peek(c) == ',') (void)cur_get(c);
+// Skips what follows a closing quote up to the delimiter. Only blanks belong
+// there, but "ab"cd is read as abcd, as lenient RFC 4180 readers do, rather
+// than shifting cd into the next column.
+static void csv_skip_after_quote(Cursor *c) {
+    while (!cur_eof(c)) {
+        char ch = cur_peek(c);
+        if (ch == ',' || ch == '\n' || ch == '\r') break;
+        c->pos++;
     }
+}
 
-    return out;
+static size_t rstrip_len(const char *s, size_t n) {
+    while (n > 0 && isspace((unsigned char)s[n - 1])) n--;
+    return n;
 }
 
 static bool csv_consume_newline(Cursor *c) {
@@ -229,344 +714,444 @@ static bool csv_consume_newline(Cursor *c) {
     return false;
 }
 
-static bool csv_skip_empty_lines(Cursor *c) {
-    size_t start = c->pos;
+static void csv_skip_empty_lines(Cursor *c) {
     while (true) {
-        size_t p = c->pos;
+        c->mark = c->pos;
         while (!cur_eof(c) && (cur_peek(c) == ' ' || cur_peek(c) == '\t')) (void)cur_get(c);
-        if (csv_consume_newline(c)) {
-            start = c->pos;
-            continue;
-        }
-        c->pos = p;
+        if (csv_consume_newline(c)) continue;
+        c->pos = c->mark;
         break;
     }
-    return c->pos != start;
+    c->mark = NO_MARK;
 }
 
-static int csv_read_table(const char *path, Table *out) {
-    memset(out, 0, sizeof(*out));
-    size_t len = 0;
-    char *buf = read_file_all(path, &len);
-    if (!buf) return 1;
-
-    Cursor c = {.data = buf, .len = len, .pos = 0};
-    csv_skip_empty_lines(&c);
+// Parses the record starting at the cursor (empty lines already skipped).
+static void csv_read_record(Cursor *c, size_t ncols, Record *rec) {
+    rec_reset(rec, ncols);
+    c->mark = c->pos;
+
+    bool line_done = false;
+    for (size_t col = 0; col < ncols; col++) {
+        CsvField f;
+        csv_next_field(c, &f);
+        // Offsets from the mark survive the refills csv_skip_after_quote()
+        // may do.
+        size_t off = (size_t)(f.ptr - (c->data + c->mark));
+        size_t tail_off = c->pos - c->mark;
+        if (f.quoted) csv_skip_after_quote(c);
+        size_t tail_len = c->pos - c->mark - tail_off;
+        f.ptr = c->data + c->mark + off;
+        const char *tail = c->data + c->mark + tail_off;
+        if (rstrip_len(tail, tail_len) == 0) tail_len = 0;
+
+        if (f.escaped || tail_len > 0) {
+            size_t start = rec_field_begin(rec);
+            buf_reserve(&rec->bytes, f.len + tail_len);
+            size_t n = csv_unescape(&f, rec->bytes.data + start);
+            memcpy(rec->bytes.data + start + n, tail, tail_len);
+            rec->bytes.len = start + rstrip_len(rec->bytes.data + start, n + tail_len);
+            rec_field_end(rec, col, start);
+        } else {
+            rec_field_slice(rec, col, off, rstrip_len(f.ptr, f.len));
+        }
 
-    // header
-    while (!cur_eof(&c)) {
-        char *field = csv_parse_field(&c);
-        rstrip(field);
-        char *trimmed = lskip(field);
-        // Normalize by copying trimmed into field
-        if (trimmed != field) memmove(field, trimmed, strlen(trimmed) + 1);
-        ensure_col(out, field);
-        free(field);
-
-        if (cur_peek(&c) == ',') {
-            (void)cur_get(&c);
+        if (cur_peek(c) == ',') {
+            (void)cur_get(c);
             continue;
         }
-        if (csv_consume_newline(&c)) break;
-        if (cur_eof(&c)) break;
+        if (cur_peek(c) == '\n' || cur_peek(c) == '\r') {
+            (void)csv_consume_newline(c);
+            line_done = true;
+            break;
+        }
+        if (cur_eof(c)) break;
     }
-
-    if (out->ncols == 0) {
-        free(buf);
-        return 1;
+    // consume to end of line if there are extra fields
+    if (!line_done) {
+        while (!cur_eof(c) && cur_peek(c) != '\n' && cur_peek(c) != '\r') (void)cur_get(c);
+        (void)csv_consume_newline(c);
     }
+    rec->input = c->data + c->mark;
+}
 
-    // rows
-    while (!cur_eof(&c)) {
-        csv_skip_empty_lines(&c);
-        if (cur_eof(&c)) break;
+static int csv_next(RecordReader *r, Record *rec) {
+    Cursor *c = &r->cur;
+    csv_skip_empty_lines(c);
+    if (cur_eof(c)) return 0;
 
-        size_t row = table_add_row(out);
-        bool line_done = false;
-        for (size_t col = 0; col < out->ncols; col++) {
-            char *field = csv_parse_field(&c);
-            rstrip(field);
-            table_set(out, row, out->headers[col], field);
-            free(field);
+    csv_read_record(c, r->schema.ncols, rec);
+    return 1;
+}
 
-            if (cur_peek(&c) == ',') {
-                (void)cur_get(&c);
-                continue;
-            }
-            if (cur_peek(&c) == '\n' || cur_peek(&c) == '\r') {
-                (void)csv_consume_newline(&c);
-                line_done = true;
-                break;
-            }
-            if (cur_eof(&c)) break;
-        }
-        // consume to end of line if there are extra fields
-        if (!line_done) {
-            while (!cur_eof(&c) && cur_peek(&c) != '\n' && cur_peek(&c) != '\r') (void)cur_get(&c);
-            (void)csv_consume_newline(&c);
+static int csv_open_reader(RecordReader *r) {
+    Cursor *c = &r->cur;
+    csv_skip_empty_lines(c);
+
+    // header
+    while (!cur_eof(c)) {
+        CsvField f;
+        csv_next_field(c, &f);
+        r->scratch.len = 0;
+        buf_reserve(&r->scratch, f.len + 1);
+        r->scratch.len = csv_unescape(&f, r->scratch.data);
+        buf_putc(&r->scratch, '\0');
+        rstrip(r->scratch.data);
+        const char *name = lskip(r->scratch.data);
+        (void)schema_col(&r->schema, name, strlen(name));
+
+        if (cur_peek(c) == ',') {
+            (void)cur_get(c);
+            continue;
         }
+        if (csv_consume_newline(c)) break;
+        if (cur_eof(c)) break;
     }
 
-    free(buf);
+    if (r->schema.ncols == 0) return 1;
+
+    r->fixed_schema = true;
+    r->next = csv_next;
     return 0;
 }
 
-static void csv_write_escaped(FILE *f, const char *s) {
-    bool need_quote = false;
-    for (const char *p = s; p && *p; p++) {
-        if (*p == ',' || *p == '"' || *p == '\n' || *p == '\r') {
-            need_quote = true;
-            break;
-        }
-    }
-    if (!need_quote) {
-        fputs(s ? s : "", f);
-        return;
-    }
-
-    fputc('"', f);
-    for (const char *p = s; p && *p; p++) {
-        if (*p == '"') fputc('"', f);
-        fputc(*p, f);
+static void csv_write_begin(const RecordWriter *w, OutBuf *out) {
+    for (size_t c = 0; c < w->ncols; c++) {
+        if (c) ob_putc(out, ',');
+        ob_csv_field(out, w->headers[c], strlen(w->headers[c]));
     }
-    fputc('"', f);
+    ob_putc(out, '\n');
 }
 
-static int csv_write_table(const char *path, const Table *t) {
-    FILE *f = fopen(path, "wb");
-    if (!f) {
-        fprintf(stderr, "Error: cannot write '%s': %s\n", path, strerror(errno));
-        return 1;
-    }
-
-    for (size_t c = 0; c < t->ncols; c++) {
-        if (c) fputc(',', f);
-        csv_write_escaped(f, t->headers[c]);
-    }
-    fputc('\n', f);
-
-    for (size_t r = 0; r < t->nrows; r++) {
-        for (size_t c = 0; c < t->ncols; c++) {
-            if (c) fputc(',', f);
-            csv_write_escaped(f, t->rows[r][c] ? t->rows[r][c] : "");
-        }
-        fputc('\n', f);
+static void csv_write_row(const RecordWriter *w, OutBuf *out, const Span *cells) {
+    for (size_t c = 0; c < w->ncols; c++) {
+        if (c) ob_putc(out, ',');
+        ob_csv_field(out, cells[c].ptr, cells[c].len);
     }
-
-    fclose(f);
-    return 0;
+    ob_putc(out, '\n');
 }
 
-// ---------------- JSON (minimal) ----------------
-
-typedef struct {
-    const char *s;
-    size_t n;
-    size_t i;
-} J;
+static void csv_write_end(const RecordWriter *w, OutBuf *out) {
+    (void)w;
+    (void)out;
+}
 
-static void jskip(J *j) {
-    while (j->i < j->n && isspace((unsigned char)j->s[j->i])) j->i++;
+// ---------------- JSON ----------------
+//
+// Two stages, after simdjson. json_scan_index() finds every structural byte
+// 64 at a time; the parser then walks those offsets instead of the bytes, so
+// whitespace and string bodies are never looked at one byte at a time. Keys
+// and values are slices of the input; only strings that contain a backslash
+// are decoded into a copy. Records are flat objects: nested objects and
+// arrays are rejected.
+
+// Input is indexed in batches of this size, which bounds JsonIndex.pos.
+#define JX_BATCH ((size_t)32 * 1024)
+#define JX_END ((size_t)-1)
+
+// Restarts indexing at the cursor, which must not be inside a string.
+static void jx_reset(JsonIndex *x, const Cursor *c) {
+    size_t *pos = x->pos;
+    memset(x, 0, sizeof(*x));
+    x->pos = pos;
+    x->scanned = c->base + c->pos;
 }
 
-static bool jmatch(J *j, char ch) {
-    jskip(j);
-    if (j->i < j->n && j->s[j->i] == ch) {
-        j->i++;
-        return true;
-    }
-    return false;
+static void jx_free(JsonIndex *x) {
+    free(x->pos);
+    memset(x, 0, sizeof(*x));
 }
 
-static void jexpect(J *j, char ch) {
-    if (!jmatch(j, ch)) {
-        fprintf(stderr, "Error: JSON parse error: expected '%c'\n", ch);
-        exit(1);
-    }
-}
-
-static char *jparse_string(J *j) {
-    jskip(j);
-    if (j->i >= j->n || j->s[j->i] != '"') die("JSON parse error: expected string");
-    j->i++;
-
-    char *out = NULL;
-    size_t cap = 0, len = 0;
-
-    while (j->i < j->n) {
-        char ch = j->s[j->i++];
-        if (ch == '"') break;
-        if (ch == '\\') {
-            if (j->i >= j->n) die("JSON parse error: bad escape");
-            char esc = j->s[j->i++];
-            switch (esc) {
-                case '"': ch = '"'; break;
-                case '\\': ch = '\\'; break;
-                case '/': ch = '/'; break;
-                case 'b': ch = '\b'; break;
-                case 'f': ch = '\f'; break;
-                case 'n': ch = '\n'; break;
-                case 'r': ch = '\r'; break;
-                case 't': ch = '\t'; break;
-                case 'u':
-                    // Minimal: skip \uXXXX and emit '?' (keeps output valid)
-                    if (j->i + 4 <= j->n) j->i += 4;
-                    ch = '?';
-                    break;
-                default:
-                    die("JSON parse error: unsupported escape");
-            }
-        }
-        if (len + 2 > cap) {
-            cap = cap ? cap * 2 : 64;
-            out = (char *)xrealloc(out, cap);
-        }
-        out[len++] = ch;
+// Indexes the next batch of input. Returns false once everything is indexed.
+static bool jx_more(JsonIndex *x, Cursor *c) {
+    if (!x->pos) x->pos = (size_t *)xmalloc(JX_BATCH * sizeof(size_t));
+    while (c->base + c->len - x->scanned < 64 && cur_fill(c)) {
     }
+    size_t avail = c->base + c->len - x->scanned;
+    if (avail == 0) return false;
+
+    // Whole 64-byte blocks, except for the tail of the input.
+    size_t n = avail < 64 ? avail : (avail < JX_BATCH ? avail : JX_BATCH) / 64 * 64;
+    x->n = json_scan_index(&x->st, c->data + (x->scanned - c->base), n, x->scanned, x->pos);
+    x->i = 0;
+    x->scanned += n;
+    return true;
+}
 
-    if (!out) {
-        out = (char *)xmalloc(1);
-        out[0] = '\0';
-        return out;
+static size_t jx_peek(JsonIndex *x, Cursor *c) {
+    while (x->i == x->n) {
+        if (!jx_more(x, c)) return JX_END;
     }
-    out[len] = '\0';
-    return out;
+    return x->pos[x->i];
 }
 
-static char *jparse_primitive_as_string(J *j) {
-    jskip(j);
-    size_t start = j->i;
-
-    if (j->i < j->n && j->s[j->i] == '"') return jparse_string(j);
-
-    while (j->i < j->n) {
-        char ch = j->s[j->i];
-        if (ch == ',' || ch == '}' || ch == ']' || isspace((unsigned char)ch)) break;
-        j->i++;
+// Consumes the next structural byte and returns its offset (JX_END at end of
+// input). The cursor moves past it.
+static size_t jx_next(JsonIndex *x, Cursor *c) {
+    size_t at = jx_peek(x, c);
+    if (at != JX_END) {
+        x->i++;
+        c->pos = at + 1 - c->base;
     }
+    return at;
+}
 
-    if (j->i == start) return xstrdup("");
+static char jx_char(const Cursor *c, size_t at) { return at == JX_END ? '\0' : c->data[at - c->base]; }
 
-    size_t len = j->i - start;
-    char *out = (char *)xmalloc(len + 1);
-    memcpy(out, j->s + start, len);
-    out[len] = '\0';
-    return out;
+static void json_expected(char ch) {
+    fprintf(stderr, "Error: JSON parse error: expected '%c'\n", ch);
+    if (partial_output) unlink(partial_output);
+    helper_exit(1);
 }
 
-static int json_read_table(const char *path, Table *out) {
-    memset(out, 0, sizeof(*out));
-    size_t len = 0;
-    char *buf = read_file_all(path, &len);
-    if (!buf) return 1;
+static size_t jx_expect(JsonIndex *x, Cursor *c, char ch) {
+    size_t at = jx_next(x, c);
+    if (jx_char(c, at) != ch) json_expected(ch);
+    return at;
+}
 
-    J j = {.s = buf, .n = len, .i = 0};
-    jexpect(&j, '[');
-    jskip(&j);
+// Returns the offset of the quote that closes the string just opened.
+static size_t jx_string_end(JsonIndex *x, Cursor *c) {
+    size_t at = jx_next(x, c);
+    if (jx_char(c, at) != '"') die("JSON parse error: unterminated string");
+    return at;
+}
 
-    if (jmatch(&j, ']')) {
-        // empty array
-        free(buf);
-        return 0;
+// Decodes a string body that contains backslashes.
+static void json_unescape(const char *p, size_t n, Buf *out) {
+    const char *end = p + n;
+    while (p < end) {
+        const char *bs = (const char *)memchr(p, '\\', (size_t)(end - p));
+        if (!bs) {
+            buf_put(out, p, (size_t)(end - p));
+            break;
+        }
+        buf_put(out, p, (size_t)(bs - p));
+        p = bs + 1;
+        if (p == end) die("JSON parse error: bad escape");
+
+        char ch = '\0';
+        switch (*p++) {
+            case '"': ch = '"'; break;
+            case '\\': ch = '\\'; break;
+            case '/': ch = '/'; break;
+            case 'b': ch = '\b'; break;
+            case 'f': ch = '\f'; break;
+            case 'n': ch = '\n'; break;
+            case 'r': ch = '\r'; break;
+            case 't': ch = '\t'; break;
+            case 'u':
+                // Minimal: skip \uXXXX and emit '?' (keeps output valid)
+                p += end - p < 4 ? end - p : 4;
+                ch = '?';
+                break;
+            default:
+                die("JSON parse error: unsupported escape");
+        }
+        buf_putc(out, ch);
     }
+}
 
+// Parses one flat object into rec. New keys are added to the schema, unless
+// it is frozen because other threads are reading it (see the parallel
+// pipeline); a key missing from a frozen schema is an error.
+//
+// Field slices are relative to the opening brace, which cursor->mark keeps in
+// the buffer; the caller sets rec->input once it has stopped reading.
+static void json_read_object(JsonIndex *x, Cursor *c, Schema *s, bool frozen, Buf *key, Record *rec) {
+    rec_reset(rec, s->ncols);
+    c->mark = NO_MARK;
+    size_t start = jx_expect(x, c, '{');
+    c->mark = start - c->base;
+
+    size_t at = jx_next(x, c);
+    if (jx_char(c, at) == '}') {
+        rec_grow(rec, s->ncols);
+        return;
+    }
     while (true) {
-        jexpect(&j, '{');
-        // ensure at least one row exists
-        if (out->ncols == 0) {
-            // allow headers to be created by first object
+        if (jx_char(c, at) != '"') die("JSON parse error: expected string");
+        size_t close = jx_string_end(x, c);
+        const char *k = c->data + (at + 1 - c->base);
+        size_t klen = close - at - 1;
+        if (memchr(k, '\\', klen)) {
+            key->len = 0;
+            json_unescape(k, klen, key);
+            k = key->data;
+            klen = key->len;
         }
-        size_t row = table_add_row(out);
-
-        jskip(&j);
-        if (jmatch(&j, '}')) {
-            // empty object
+        size_t col;
+        if (frozen) {
+            int found = schema_find(s, k, klen);
+            if (found < 0) die("input changed during conversion");
+            col = (size_t)found;
         } else {
-            while (true) {
-                char *key = jparse_string(&j);
-                jexpect(&j, ':');
-                char *val = jparse_primitive_as_string(&j);
-                table_set(out, row, key, val);
-                free(key);
-                free(val);
-
-                jskip(&j);
-                if (jmatch(&j, '}')) break;
-                jexpect(&j, ',');
+            col = schema_col(s, k, klen);
+        }
+        (void)jx_expect(x, c, ':');
+
+        size_t v = jx_next(x, c);
+        char ch = jx_char(c, v);
+        if (ch == '"') {
+            size_t vclose = jx_string_end(x, c);
+            const char *p = c->data + (v + 1 - c->base);
+            size_t len = vclose - v - 1;
+            if (memchr(p, '\\', len)) {
+                size_t b = rec_field_begin(rec);
+                json_unescape(p, len, &rec->bytes);
+                rec_field_end(rec, col, b);
+            } else {
+                rec_field_slice(rec, col, v + 1 - start, len);
             }
+        } else if (ch == '{' || ch == '[') {
+            die("JSON parse error: nested objects and arrays are not supported");
+        } else if (ch == '\0' || ch == ',' || ch == '}' || ch == ']' || ch == ':') {
+            die("JSON parse error: expected value");
+        } else {
+            // Bare scalar (number, true, false, null), kept as its text. It
+            // runs up to the next structural byte, less trailing whitespace.
+            size_t next = jx_peek(x, c);
+            size_t stop = next == JX_END ? c->base + c->len : next;
+            rec_field_slice(rec, col, v - start, rstrip_len(c->data + (v - c->base), stop - v));
         }
 
-        jskip(&j);
-        if (jmatch(&j, ']')) break;
-        jexpect(&j, ',');
+        at = jx_next(x, c);
+        if (jx_char(c, at) == '}') break;
+        if (jx_char(c, at) != ',') json_expected(',');
+        at = jx_next(x, c);
     }
-
-    free(buf);
-    return 0;
+    rec_grow(rec, s->ncols);
 }
 
-static void json_write_escaped(FILE *f, const char *s) {
-    fputc('"', f);
-    for (const char *p = s ? s : ""; *p; p++) {
-        unsigned char ch = (unsigned char)*p;
-        switch (ch) {
-            case '"': fputs("\\\"", f); break;
-            case '\\': fputs("\\\\", f); break;
-            case '\b': fputs("\\b", f); break;
-            case '\f': fputs("\\f", f); break;
-            case '\n': fputs("\\n", f); break;
-            case '\r': fputs("\\r", f); break;
-            case '\t': fputs("\\t", f); break;
-            default:
-                if (ch < 0x20) {
-                    fprintf(f, "\\u%04x", (unsigned int)ch);
-                } else {
-                    fputc((char)ch, f);
-                }
-        }
+static int json_next(RecordReader *r, Record *rec) {
+    Cursor *c = &r->cur;
+    if (r->done) return 0;
+
+    json_read_object(&r->jx, c, &r->schema, false, &r->scratch, rec);
+
+    size_t at = jx_next(&r->jx, c);
+    if (jx_char(c, at) == ']') {
+        r->done = true;
+    } else if (jx_char(c, at) != ',') {
+        json_expected(',');
     }
-    fputc('"', f);
+    rec->input = c->data + c->mark;
+    return 1;
 }
 
-static int json_write_table(const char *path, const Table *t) {
-    FILE *f = fopen(path, "wb");
-    if (!f) {
-        fprintf(stderr, "Error: cannot write '%s': %s\n", path, strerror(errno));
-        return 1;
+static int json_open_reader(RecordReader *r) {
+    jx_reset(&r->jx, &r->cur);
+    (void)jx_expect(&r->jx, &r->cur, '[');
+    if (jx_char(&r->cur, jx_peek(&r->jx, &r->cur)) == ']') {
+        (void)jx_next(&r->jx, &r->cur);
+        r->done = true;  // empty array
     }
 
-    fputs("[\n", f);
-    for (size_t r = 0; r < t->nrows; r++) {
-        fputs("  {", f);
-        for (size_t c = 0; c < t->ncols; c++) {
-            if (c) fputs(", ", f);
-            json_write_escaped(f, t->headers[c]);
-            fputs(": ", f);
-            json_write_escaped(f, t->rows[r][c] ? t->rows[r][c] : "");
+    r->next = json_next;
+    return 0;
+}
+
+static void json_write_key(OutBuf *out, const char *header) {
+    ob_json_string(out, header, strlen(header));
+    ob_puts(out, ": ");
+}
+
+static void json_write_begin(const RecordWriter *w, OutBuf *out) {
+    (void)w;
+    ob_puts(out, "[\n");
+}
+
+static void json_write_row(const RecordWriter *w, OutBuf *out, const Span *cells) {
+    ob_puts(out, "  {");
+    for (size_t c = 0; c < w->ncols; c++) {
+        if (c) ob_puts(out, ", ");
+        ob_put(out, w->keys[c].ptr, w->keys[c].len);
+        Span v = cells[c];
+        if (writer_token(w, c, &v)) {
+            ob_put(out, v.ptr, v.len);
+        } else {
+            ob_json_string(out, v.ptr, v.len);
         }
-        fputs("}", f);
-        if (r + 1 < t->nrows) fputs(",", f);
-        fputs("\n", f);
     }
-    fputs("]\n", f);
+    ob_putc(out, '}');
+}
+
+static void json_write_end(const RecordWriter *w, OutBuf *out) {
+    if (w->nrows > 0) ob_putc(out, '\n');
+    ob_puts(out, "]\n");
+}
+
+// ---------------- NDJSON (JSON Lines) ----------------
+// One flat object per line, as written by Spark, BigQuery and jq -c. Blank
+// lines are skipped. A newline never occurs inside a valid object (strings
+// escape it), so the input can be split at any '\n' and the pieces parsed
+// independently.
+
+// Reads the next line's object into rec. Returns 0 at end of input.
+static int ndjson_read(JsonIndex *x, Cursor *c, Schema *s, bool frozen, Buf *key, Record *rec) {
+    if (jx_peek(x, c) == JX_END) return 0;
+    json_read_object(x, c, s, frozen, key, rec);
+
+    // Whatever follows the object must start on a later line.
+    size_t end = c->base + c->pos;
+    size_t next = jx_peek(x, c);
+    if (next != JX_END && !memchr(c->data + (end - c->base), '\n', next - end)) {
+        die("NDJSON parse error: expected one object per line");
+    }
+    rec->input = c->data + c->mark;
+    return 1;
+}
 
-    fclose(f);
+static int ndjson_next(RecordReader *r, Record *rec) {
+    return ndjson_read(&r->jx, &r->cur, &r->schema, false, &r->scratch, rec);
+}
+
+static int ndjson_open_reader(RecordReader *r) {
+    jx_reset(&r->jx, &r->cur);
+    r->next = ndjson_next;
     return 0;
 }
 
+static void ndjson_write_key(OutBuf *out, const char *header) {
+    ob_json_string(out, header, strlen(header));
+    ob_putc(out, ':');
+}
+
+static void ndjson_write_begin(const RecordWriter *w, OutBuf *out) {
+    (void)w;
+    (void)out;
+}
+
+static void ndjson_write_row(const RecordWriter *w, OutBuf *out, const Span *cells) {
+    ob_putc(out, '{');
+    for (size_t c = 0; c < w->ncols; c++) {
+        if (c) ob_putc(out, ',');
+        ob_put(out, w->keys[c].ptr, w->keys[c].len);
+        Span v = cells[c];
+        if (writer_token(w, c, &v)) {
+            ob_put(out, v.ptr, v.len);
+        } else {
+            ob_json_string(out, v.ptr, v.len);
+        }
+    }
+    ob_puts(out, "}\n");
+}
+
+static void ndjson_write_end(const RecordWriter *w, OutBuf *out) {
+    (void)w;
+    (void)out;
+}
+
 // ---------------- YAML (very small subset) ----------------
 // Supported YAML shape:
 // - key: "value"
 //   key2: "value"
 // Values may be quoted (recommended) or unquoted single-line scalars.
 
-static char *yaml_parse_value(char *s) {
+static void yaml_parse_value(char *s, Buf *out) {
     s = lskip(s);
     rstrip(s);
     if (*s == '"') {
         s++;
-        char *out = NULL;
-        size_t cap = 0, len = 0;
         while (*s && *s != '"') {
             char ch = *s++;
             if (ch == '\\') {
@@ -580,61 +1165,38 @@ static char *yaml_parse_value(char *s) {
                     default: ch = esc; break;
                 }
             }
-            if (len + 2 > cap) {
-                cap = cap ? cap * 2 : 64;
-                out = (char *)xrealloc(out, cap);
-            }
-            out[len++] = ch;
+            buf_putc(out, ch);
         }
-        if (!out) {
-            out = (char *)xmalloc(1);
-            out[0] = '\0';
-            return out;
-        }
-        out[len] = '\0';
-        return out;
+        return;
     }
-    return xstrdup(s);
+    for (; *s; s++) buf_putc(out, *s);
 }
 
-static int yaml_read_table(const char *path, Table *out) {
-    memset(out, 0, sizeof(*out));
+static int yaml_next(RecordReader *r, Record *rec) {
+    bool in_record = false;
 
-    FILE *f = fopen(path, "rb");
-    if (!f) {
-        fprintf(stderr, "Error: cannot open '%s': %s\n", path, strerror(errno));
-        return 1;
-    }
-
-    char *line = NULL;
-    size_t cap = 0;
-    ssize_t n;
-    size_t current_row = (size_t)-1;
-
-    while ((n = getline(&line, &cap, f)) >= 0) {
-        (void)n;
+    while (r->pending || cur_read_line(&r->cur, &r->scratch)) {
+        r->pending = false;
+        char *line = r->scratch.data;
         rstrip(line);
         char *p = lskip(line);
         if (*p == '\0') continue;
         if (*p == '#') continue;
 
         if (strncmp(p, "- ", 2) == 0) {
-            // new record
-            p += 2;
-            if (out->ncols == 0) {
-                // allow first keys to define columns
+            // A new record ends the current one; keep the line for the next call.
+            if (in_record) {
+                r->pending = true;
+                break;
             }
-            current_row = table_add_row(out);
-            p = lskip(p);
+            in_record = true;
+            rec_reset(rec, r->schema.ncols);
+            p = lskip(p + 2);
             if (*p == '\0') continue;
             // optional inline key: value
         }
 
-        if (current_row == (size_t)-1) {
-            free(line);
-            fclose(f);
-            die("YAML parse error: expected '- ' to start a record");
-        }
+        if (!in_record) die("YAML parse error: expected '- ' to start a record");
 
         // Allow indentation
         p = lskip(p);
@@ -644,113 +1206,2002 @@ static int yaml_read_table(const char *path, Table *out) {
         *colon = '\0';
         char *key = p;
         rstrip(key);
-        char *val_part = colon + 1;
+        size_t col = schema_col(&r->schema, key, strlen(key));
 
-        char *val = yaml_parse_value(val_part);
-        table_set(out, current_row, key, val);
-        free(val);
+        size_t start = rec_field_begin(rec);
+        yaml_parse_value(colon + 1, &rec->bytes);
+        rec_field_end(rec, col, start);
     }
 
-    free(line);
-    fclose(f);
+    if (!in_record) return 0;
+    rec_grow(rec, r->schema.ncols);
+    return 1;
+}
+
+static int yaml_open_reader(RecordReader *r) {
+    r->next = yaml_next;
     return 0;
 }
 
-static void yaml_write_escaped(FILE *f, const char *s) {
-    fputc('"', f);
-    for (const char *p = s ? s : ""; *p; p++) {
-        unsigned char ch = (unsigned char)*p;
-        switch (ch) {
-            case '"': fputs("\\\"", f); break;
-            case '\\': fputs("\\\\", f); break;
-            case '\n': fputs("\\n", f); break;
-            case '\r': fputs("\\r", f); break;
-            case '\t': fputs("\\t", f); break;
-            default: fputc((char)ch, f); break;
+static void yaml_write_key(OutBuf *out, const char *header) {
+    ob_puts(out, header);
+    ob_puts(out, ": ");
+}
+
+static void yaml_write_begin(const RecordWriter *w, OutBuf *out) {
+    (void)w;
+    (void)out;
+}
+
+static void yaml_write_field(const RecordWriter *w, OutBuf *out, size_t c, Span v) {
+    ob_put(out, w->keys[c].ptr, w->keys[c].len);
+    if (writer_token(w, c, &v)) {
+        ob_put(out, v.ptr, v.len);
+    } else {
+        ob_yaml_string(out, v.ptr, v.len);
+    }
+    ob_putc(out, '\n');
+}
+
+static void yaml_write_row(const RecordWriter *w, OutBuf *out, const Span *cells) {
+    ob_puts(out, "- ");
+    if (w->ncols > 0) {
+        yaml_write_field(w, out, 0, cells[0]);
+    } else {
+        ob_puts(out, "{}\n");
+    }
+    for (size_t c = 1; c < w->ncols; c++) {
+        ob_puts(out, "  ");
+        yaml_write_field(w, out, c, cells[c]);
+    }
+}
+
+static void yaml_write_end(const RecordWriter *w, OutBuf *out) {
+    (void)w;
+    (void)out;
+}
+
+// ---------------- Arrow IPC stream ----------------
+//
+// The writer appends each row to per-column buffers (validity bitmap, values
+// or string offsets, string bytes) and writes them out as one record batch
+// every arrow_batch_rows rows, or sooner once the batch holds
+// ARROW_BATCH_BYTES, so memory is bounded by a batch, not the input. Column
+// types are those of --infer-types (or of an Arrow input); without them every
+// column is Utf8. BOOLEAN maps to Bool, INTEGER to Int32, BIGINT to Int64,
+// NUMERIC to Float64, DATE to Date32, TIMESTAMP to Timestamp(us) and
+// TIMESTAMPTZ to Timestamp(us, "UTC"); a column holding only nulls is Null.
+//
+// The reader keeps each batch's body in the input (mapped, for files) and
+// hands out string values as slices of it, so Utf8 columns are never copied.
+// Other values are formatted as text in the same forms type_of_value()
+// recognizes, so the writers keep the schema's types.
+
+#define ARROW_BATCH_ROWS 65536
+#define ARROW_BATCH_BYTES ((size_t)64 * 1024 * 1024)
+
+static size_t arrow_batch_rows = ARROW_BATCH_ROWS;
+
+static void arrow_fail(const char *what) {
+    char msg[160];
+    snprintf(msg, sizeof(msg), "invalid Arrow stream: %s", what);
+    die(msg);
+}
+
+static void buf_put_le(Buf *b, uint64_t v, size_t size) {
+    uint8_t tmp[8];
+    arrow_put_le(tmp, v, size);
+    buf_put(b, (const char *)tmp, size);
+}
+
+static void bit_append(Buf *b, size_t i, bool set) {
+    if (i % 8 == 0) buf_putc(b, '\0');
+    if (set) b->data[i / 8] |= (char)(1u << (i % 8));
+}
+
+typedef struct {
+    DataType type;
+    Buf validity;
+    // Fixed-width values, a Bool bitmap, or Utf8 offsets.
+    Buf values;
+    Buf data;
+    int64_t nulls;
+} ArrowColumn;
+
+struct ArrowOut {
+    ArrowField *fields;
+    ArrowColumn *cols;
+    size_t ncols;
+    size_t rows;
+    size_t bytes;
+    ArrowNode *nodes;
+    ArrowBuffer *buffers;
+    const Buf **sources;
+    Buf scratch;
+};
+
+static void arrow_out_free(ArrowOut *a) {
+    if (!a) return;
+    for (size_t c = 0; a->cols && c < a->ncols; c++) {
+        buf_free(&a->cols[c].validity);
+        buf_free(&a->cols[c].values);
+        buf_free(&a->cols[c].data);
+    }
+    free(a->fields);
+    free(a->cols);
+    free(a->nodes);
+    free(a->buffers);
+    free(a->sources);
+    buf_free(&a->scratch);
+    free(a);
+}
+
+static void arrow_batch_reset(const RecordWriter *w) {
+    ArrowOut *a = w->arrow;
+    for (size_t c = 0; c < w->ncols; c++) {
+        ArrowColumn *col = &a->cols[c];
+        col->validity.len = 0;
+        col->values.len = 0;
+        col->data.len = 0;
+        col->nulls = 0;
+        if (col->type == DT_TEXT) buf_put_le(&col->values, 0, 4);
+    }
+    a->rows = 0;
+    a->bytes = 0;
+}
+
+static void arrow_write_begin(const RecordWriter *w, OutBuf *out) {
+    ArrowOut *a = w->arrow;
+    size_t n = w->ncols ? w->ncols : 1;
+    a->fields = (ArrowField *)xmalloc(n * sizeof(ArrowField));
+    a->cols = (ArrowColumn *)calloc(n, sizeof(ArrowColumn));
+    a->nodes = (ArrowNode *)xmalloc(n * sizeof(ArrowNode));
+    a->buffers = (ArrowBuffer *)xmalloc(3 * n * sizeof(ArrowBuffer));
+    a->sources = (const Buf **)xmalloc(3 * n * sizeof(Buf *));
+    if (!a->cols) die("out of memory");
+    a->ncols = w->ncols;
+
+    for (size_t c = 0; c < w->ncols; c++) {
+        DataType t = w->types ? w->types[c] : DT_TEXT;
+        ArrowField f = {.name = (char *)w->headers[c], .kind = ARROW_UTF8, .nullable = true};
+        switch (t) {
+            case DT_NULL: f.kind = ARROW_NULL; break;
+            case DT_BOOLEAN: f.kind = ARROW_BOOL; break;
+            case DT_INTEGER:
+            case DT_BIGINT:
+                f.kind = ARROW_INT;
+                f.bit_width = t == DT_INTEGER ? 32 : 64;
+                f.is_signed = true;
+                break;
+            case DT_NUMERIC:
+                f.kind = ARROW_FLOAT;
+                f.bit_width = 64;
+                break;
+            case DT_DATE:
+                f.kind = ARROW_DATE;
+                f.unit = ARROW_DATE_DAY;
+                break;
+            case DT_TIMESTAMP:
+            case DT_TIMESTAMPTZ:
+                f.kind = ARROW_TIMESTAMP;
+                f.unit = ARROW_TIME_MICRO;
+                f.timezone = t == DT_TIMESTAMPTZ ? (char *)"UTC" : NULL;
+                break;
+            case DT_TEXT: break;
         }
+        a->fields[c] = f;
+        a->cols[c].type = t;
+    }
+    arrow_batch_reset(w);
+    arrow_write_schema(out, a->fields, w->ncols);
+}
+
+// Writes the buffered rows as one record batch.
+static void arrow_flush(const RecordWriter *w, OutBuf *out) {
+    ArrowOut *a = w->arrow;
+    if (a->rows == 0) return;
+
+    size_t nbuf = 0;
+    int64_t body = 0;
+    for (size_t c = 0; c < w->ncols; c++) {
+        const ArrowColumn *col = &a->cols[c];
+        ArrowKind kind = a->fields[c].kind;
+        a->nodes[c] = (ArrowNode){(int64_t)a->rows, kind == ARROW_NULL ? (int64_t)a->rows : col->nulls};
+        if (kind == ARROW_NULL) continue;
+
+        const Buf *src[3] = {&col->validity, &col->values, &col->data};
+        for (size_t i = 0; i < arrow_buffer_count(kind); i++) {
+            // The validity bitmap may be left out when nothing is null.
+            size_t len = i == 0 && col->nulls == 0 ? 0 : src[i]->len;
+            a->buffers[nbuf] = (ArrowBuffer){body, (int64_t)len};
+            a->sources[nbuf++] = src[i];
+            body += (int64_t)((len + 7) & ~(size_t)7);
+        }
+    }
+
+    arrow_write_batch(out, (int64_t)a->rows, a->nodes, w->ncols, a->buffers, nbuf, body);
+    static const char zeros[8] = {0};
+    for (size_t i = 0; i < nbuf; i++) {
+        size_t len = (size_t)a->buffers[i].length;
+        ob_put(out, a->sources[i]->data, len);
+        ob_put(out, zeros, (8 - len % 8) % 8);
     }
-    fputc('"', f);
+    arrow_batch_reset(w);
 }
 
-static int yaml_write_table(const char *path, const Table *t) {
-    FILE *f = fopen(path, "wb");
-    if (!f) {
-        fprintf(stderr, "Error: cannot write '%s': %s\n", path, strerror(errno));
+static int64_t span_to_int64(Span v) {
+    size_t i = v.len > 0 && v.ptr[0] == '-' ? 1 : 0;
+    uint64_t u = 0;
+    for (; i < v.len; i++) u = u * 10 + (uint64_t)(v.ptr[i] - '0');
+    return v.len > 0 && v.ptr[0] == '-' ? (int64_t)(0 - u) : (int64_t)u;
+}
+
+// strtod() needs a terminated copy; scratch holds it.
+static double span_to_double(Buf *scratch, Span v) {
+    scratch->len = 0;
+    buf_put(scratch, v.ptr, v.len);
+    buf_putc(scratch, '\0');
+    return strtod(scratch->data, NULL);
+}
+
+static void arrow_write_row(const RecordWriter *w, OutBuf *out, const Span *cells) {
+    ArrowOut *a = w->arrow;
+    size_t row = a->rows;
+    for (size_t c = 0; c < w->ncols; c++) {
+        ArrowColumn *col = &a->cols[c];
+        Span v = cells[c];
+        // Strings are null only when read as null; in typed columns empty values
+        // and "null" are too.
+        bool valid = v.ptr != null_cell && (col->type == DT_TEXT || !type_is_null(v.ptr, v.len));
+        if (col->type == DT_NULL) continue;
+        bit_append(&col->validity, row, valid);
+        if (!valid) col->nulls++;
+
+        switch (col->type) {
+            case DT_TEXT:
+                if (col->data.len + v.len > (size_t)INT32_MAX) die("value too large for an Arrow Utf8 column");
+                buf_put(&col->data, v.ptr, v.len);
+                buf_put_le(&col->values, col->data.len, 4);
+                a->bytes += v.len;
+                break;
+            case DT_BOOLEAN: bit_append(&col->values, row, valid && (v.ptr[0] | 0x20) == 't'); break;
+            case DT_INTEGER: buf_put_le(&col->values, valid ? (uint64_t)span_to_int64(v) : 0, 4); break;
+            case DT_BIGINT: buf_put_le(&col->values, valid ? (uint64_t)span_to_int64(v) : 0, 8); break;
+            case DT_NUMERIC: {
+                double d = valid ? span_to_double(&a->scratch, v) : 0.0;
+                uint64_t bits;
+                memcpy(&bits, &d, sizeof(bits));
+                buf_put_le(&col->values, bits, 8);
+                break;
+            }
+            case DT_DATE: buf_put_le(&col->values, valid ? (uint32_t)arrow_parse_date(v.ptr) : 0, 4); break;
+            case DT_TIMESTAMP:
+            case DT_TIMESTAMPTZ:
+                buf_put_le(&col->values, valid ? (uint64_t)arrow_parse_timestamp(v.ptr, v.len) : 0, 8);
+                break;
+            case DT_NULL: break;
+        }
+    }
+    a->rows++;
+    a->bytes += 8 * w->ncols;
+    if (a->rows >= arrow_batch_rows || a->bytes >= ARROW_BATCH_BYTES) arrow_flush(w, out);
+}
+
+static void arrow_write_end(const RecordWriter *w, OutBuf *out) {
+    arrow_flush(w, out);
+    arrow_write_eos(out);
+}
+
+// Reads the next message into m and leaves the cursor after its body, with
+// the mark at its start so the body stays buffered. Returns false at the end
+// of the stream.
+static bool arrow_read_message(RecordReader *r, ArrowMessage *m) {
+    Cursor *c = &r->cur;
+    c->mark = NO_MARK;
+    // A stream cut off where a message would start is taken as ended.
+    if (!cur_need(c, 4)) return false;
+
+    size_t head = 4;
+    uint64_t len = arrow_le((const uint8_t *)c->data + c->pos, 4);
+    // Current streams put a continuation marker before the length; legacy
+    // (pre-0.15) ones start with the length.
+    if (len == 0xFFFFFFFFu) {
+        if (!cur_need(c, 8)) arrow_fail("truncated message");
+        len = arrow_le((const uint8_t *)c->data + c->pos + 4, 4);
+        head = 8;
+    }
+    if (len == 0) {
+        c->pos += head;
+        return false;
+    }
+    if (len > (uint64_t)INT32_MAX) arrow_fail("bad metadata length");
+
+    c->mark = c->pos;
+    if (!cur_need(c, head + len)) arrow_fail("truncated message");
+    const char *err = arrow_parse_message((const uint8_t *)c->data + c->pos + head, len, m);
+    if (err) arrow_fail(err);
+
+    size_t size = head + len;
+    if ((uint64_t)m->body_len > SIZE_MAX - size) arrow_fail("bad body length");
+    size += (size_t)m->body_len;
+    if (!cur_need(c, size)) arrow_fail("truncated message body");
+    r->arrow.body = (const uint8_t *)c->data + c->pos + head + len;
+    c->pos += size;
+    return true;
+}
+
+static DataType arrow_data_type(const ArrowField *f) {
+    switch (f->kind) {
+        case ARROW_NULL: return DT_NULL;
+        case ARROW_BOOL: return DT_BOOLEAN;
+        case ARROW_INT:
+            if (f->bit_width < 32 || (f->bit_width == 32 && f->is_signed)) return DT_INTEGER;
+            return f->bit_width == 64 && !f->is_signed ? DT_NUMERIC : DT_BIGINT;
+        case ARROW_FLOAT: return DT_NUMERIC;
+        case ARROW_DATE: return DT_DATE;
+        case ARROW_TIMESTAMP: return f->timezone ? DT_TIMESTAMPTZ : DT_TIMESTAMP;
+        default: return DT_TEXT;
+    }
+}
+
+// Bytes per value of the values buffer (0 for a bitmap).
+static size_t arrow_value_width(const ArrowField *f) {
+    switch (f->kind) {
+        case ARROW_BOOL: return 0;
+        case ARROW_INT:
+        case ARROW_FLOAT: return (size_t)f->bit_width / 8;
+        case ARROW_DATE: return f->unit == ARROW_DATE_DAY ? 4 : 8;
+        case ARROW_BINARY:
+        case ARROW_UTF8: return 4;
+        default: return 8;
+    }
+}
+
+// Checks the batch's buffers against its schema and locates each column's.
+static void arrow_load_batch(RecordReader *r) {
+    ArrowIn *a = &r->arrow;
+    const ArrowMessage *m = &a->batch;
+    if (m->type != ARROW_MSG_BATCH) arrow_fail("expected a record batch");
+    if (m->rows < 0 || m->nnodes != a->schema.nfields) arrow_fail("record batch does not match the schema");
+
+    uint64_t rows = (uint64_t)m->rows;
+    size_t b = 0;
+    for (size_t c = 0; c < m->nnodes; c++) {
+        const ArrowField *f = &a->schema.fields[c];
+        ArrowColumnIn *col = &a->cols[c];
+        memset(col, 0, sizeof(*col));
+        if (m->nodes[c].length != m->rows) arrow_fail("column length differs from the batch length");
+
+        size_t nb = arrow_buffer_count(f->kind);
+        if (nb > m->nbuffers - b) arrow_fail("missing buffers");
+        const uint8_t *p[3] = {NULL, NULL, NULL};
+        uint64_t len[3] = {0, 0, 0};
+        for (size_t i = 0; i < nb; i++) {
+            const ArrowBuffer *buf = &m->buffers[b + i];
+            if (buf->offset < 0 || buf->length < 0 || buf->offset > m->body_len ||
+                buf->length > m->body_len - buf->offset) {
+                arrow_fail("buffer out of range");
+            }
+            p[i] = a->body + buf->offset;
+            len[i] = (uint64_t)buf->length;
+        }
+        b += nb;
+        if (nb == 0 || rows == 0) continue;
+
+        if (m->nodes[c].null_count > 0) {
+            if (len[0] * 8 < rows) arrow_fail("validity bitmap too short");
+            col->validity = p[0];
+        }
+        size_t width = arrow_value_width(f);
+        bool offsets = nb == 3;
+        if (width == 0 ? len[1] * 8 < rows : len[1] / width < rows + (offsets ? 1 : 0)) {
+            arrow_fail("values buffer too short");
+        }
+        col->values = p[1];
+        col->data = p[2];
+        col->data_len = (size_t)len[2];
+    }
+}
+
+static size_t fmt_u64(uint64_t v, char *out) {
+    char tmp[24];
+    size_t n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    for (size_t i = 0; i < n; i++) out[i] = tmp[n - 1 - i];
+    return n;
+}
+
+static size_t fmt_i64(int64_t v, char *out) {
+    if (v >= 0) return fmt_u64((uint64_t)v, out);
+    out[0] = '-';
+    return 1 + fmt_u64(0 - (uint64_t)v, out + 1);
+}
+
+// Shortest of %.Ng and the round-trip precision that reads back the same.
+static size_t fmt_double(double d, bool single, char *out) {
+    if (isnan(d)) return (size_t)snprintf(out, 48, "NaN");
+    if (isinf(d)) return (size_t)snprintf(out, 48, d > 0 ? "Infinity" : "-Infinity");
+    int n = snprintf(out, 48, "%.*g", single ? 7 : 15, d);
+    bool same = single ? strtof(out, NULL) == (float)d : strtod(out, NULL) == d;
+    if (!same) n = snprintf(out, 48, "%.*g", single ? 9 : 17, d);
+    return (size_t)n;
+}
+
+static void arrow_read_cell(RecordReader *r, Record *rec, size_t c, uint64_t i) {
+    const ArrowIn *a = &r->arrow;
+    const ArrowField *f = &a->schema.fields[c];
+    const ArrowColumnIn *col = &a->cols[c];
+    if (f->kind == ARROW_NULL || (col->validity && !((col->validity[i / 8] >> (i % 8)) & 1))) {
+        rec_field_null(rec, c);
+        return;
+    }
+
+    size_t width = arrow_value_width(f);
+    const uint8_t *p = col->values + i * width;
+    char tmp[48];
+    size_t n = 0;
+    switch (f->kind) {
+        case ARROW_BINARY:
+        case ARROW_UTF8:
+        case ARROW_LARGE_BINARY:
+        case ARROW_LARGE_UTF8: {
+            uint64_t start = arrow_le(p, width), end = arrow_le(p + width, width);
+            if (start > end || end > col->data_len) arrow_fail("string offsets out of range");
+            if (end > start) rec_field_slice(rec, c, (size_t)(col->data - a->body) + start, end - start);
+            return;
+        }
+        case ARROW_BOOL:
+            n = ((col->values[i / 8] >> (i % 8)) & 1) ? 4 : 5;
+            memcpy(tmp, n == 4 ? "true" : "false", n);
+            break;
+        case ARROW_INT: {
+            uint64_t v = arrow_le(p, width);
+            if (f->is_signed) {
+                int shift = 64 - f->bit_width;
+                n = fmt_i64((int64_t)(v << shift) >> shift, tmp);
+            } else {
+                n = fmt_u64(v, tmp);
+            }
+            break;
+        }
+        case ARROW_FLOAT: {
+            uint64_t v = arrow_le(p, width);
+            if (width == 4) {
+                uint32_t bits = (uint32_t)v;
+                float x;
+                memcpy(&x, &bits, sizeof(x));
+                n = fmt_double(x, true, tmp);
+            } else {
+                double x;
+                memcpy(&x, &v, sizeof(x));
+                n = fmt_double(x, false, tmp);
+            }
+            break;
+        }
+        case ARROW_DATE: {
+            int64_t v = (int64_t)arrow_le(p, width);
+            if (width == 4) {
+                v = (int32_t)v;
+            } else {
+                // Milliseconds, a whole number of days.
+                v = v / 86400000 - (v % 86400000 < 0);
+            }
+            n = arrow_format_date(v, tmp);
+            break;
+        }
+        case ARROW_TIMESTAMP:
+            n = arrow_format_timestamp((int64_t)arrow_le(p, 8), f->unit, f->timezone != NULL, tmp);
+            break;
+        default: return;
+    }
+    size_t start = rec_field_begin(rec);
+    buf_put(&rec->bytes, tmp, n);
+    rec_field_end(rec, c, start);
+}
+
+static int arrow_next(RecordReader *r, Record *rec) {
+    ArrowIn *a = &r->arrow;
+    while (a->row >= a->batch.rows) {
+        if (r->done) return 0;
+        arrow_message_free(&a->batch);
+        a->row = 0;
+        if (!arrow_read_message(r, &a->batch)) {
+            r->done = true;
+            return 0;
+        }
+        arrow_load_batch(r);
+    }
+
+    rec_reset(rec, r->schema.ncols);
+    for (size_t c = 0; c < r->schema.ncols; c++) arrow_read_cell(r, rec, c, (uint64_t)a->row);
+    rec->input = (const char *)a->body;
+    a->row++;
+    return 1;
+}
+
+static int arrow_open_reader(RecordReader *r) {
+    Cursor *c = &r->cur;
+    ArrowIn *a = &r->arrow;
+    // An Arrow IPC file is the stream behind 8 bytes of magic, plus a footer
+    // after the end-of-stream marker that is never reached.
+    if (cur_need(c, 8) && memcmp(c->data + c->pos, ARROW_FILE_MAGIC, 6) == 0) c->pos += 8;
+
+    if (!arrow_read_message(r, &a->schema) || a->schema.type != ARROW_MSG_SCHEMA) {
+        fprintf(stderr, "Error: invalid Arrow stream: no schema\n");
         return 1;
     }
+    c->mark = NO_MARK;
+
+    for (size_t i = 0; i < a->schema.nfields; i++) {
+        const ArrowField *f = &a->schema.fields[i];
+        size_t col = schema_col(&r->schema, f->name, strlen(f->name));
+        if (col != i) arrow_fail("duplicate column name");
+        r->schema.types[col] = arrow_data_type(f);
+    }
+    if (r->schema.ncols == 0) return 1;
+
+    a->cols = (ArrowColumnIn *)xmalloc(r->schema.ncols * sizeof(ArrowColumnIn));
+    r->fixed_schema = true;
+    r->typed = true;
+    r->native_types = true;
+    r->next = arrow_next;
+    return 0;
+}
+
+static void arrow_reader_free(ArrowIn *a) {
+    arrow_message_free(&a->schema);
+    arrow_message_free(&a->batch);
+    free(a->cols);
+    memset(a, 0, sizeof(*a));
+}
+
+// ---------------- Parquet ----------------
+//
+// Rows are buffered per column and written out as a row group every
+// parquet_group_rows rows, or sooner once the group holds PQ_GROUP_BYTES.
+// Column types map as for Arrow (BOOLEAN, INT32, INT64, DOUBLE, DATE on
+// INT32, microsecond TIMESTAMP on INT64, STRING on BYTE_ARRAY). Every column
+// is OPTIONAL, with RLE-encoded definition levels marking its nulls: in text
+// columns only cells read as null (null_cell), so an empty string stays one;
+// in typed columns also empty values and "null".
+//
+// Every column but a boolean one starts out dictionary-encoded: values are
+// interned in a hash table and only their indices are kept. A column whose
+// dictionary outgrows PQ_DICT_BYTES, or that ends a row group with more
+// distinct values than half its values, falls back to PLAIN for the rest of
+// the file. Pages hold about PQ_PAGE_BYTES of values each and are compressed
+// with parquet_codec.
+
+#define PQ_GROUP_ROWS ((size_t)1024 * 1024)
+#define PQ_GROUP_BYTES ((size_t)64 * 1024 * 1024)
+#define PQ_PAGE_BYTES ((size_t)1024 * 1024)
+#define PQ_DICT_BYTES ((size_t)1024 * 1024)
+
+static size_t parquet_group_rows = PQ_GROUP_ROWS;
+static int parquet_codec = PQ_SNAPPY;
+
+typedef struct {
+    DataType type;
+    bool byte_array;
+    // Definition level of each row (1 present, 0 null); OPTIONAL columns only.
+    Buf def;
+    // PLAIN-encoded values, or native uint32 dictionary indices while
+    // use_dict is set.
+    Buf values;
+    size_t nvalues;
+    bool use_dict;
+    // Set once the dictionary has been given up on.
+    bool plain;
+    // Dictionary entries, PLAIN-encoded back to back; entry i is
+    // dict[dict_off[i]..dict_off[i + 1]).
+    Buf dict;
+    size_t *dict_off;
+    size_t ndict;
+    size_t dict_cap;
+    uint64_t *slots;  // 0 marks an empty slot
+    size_t nslots;
+} PqColumnBuf;
+
+struct ParquetOut {
+    PqColumn *cols;
+    PqColumnBuf *bufs;
+    size_t ncols;
+    size_t rows;
+    size_t bytes;
+    int64_t total_rows;
+    // Bytes written so far, for the page offsets in the footer.
+    int64_t pos;
+    PqRowGroup *groups;
+    size_t ngroups;
+
+    OutBuf page;
+    OutBuf levels;
+    OutBuf header;
+    Buf packed;
+    uint32_t *def32;
+    size_t def32_cap;
+    Buf scratch;
+};
+
+// A slot holds the entry's hash in its high half, so most mismatches are
+// rejected without touching the dictionary, and entry + 1 in its low half.
+static void pq_rehash(PqColumnBuf *col) {
+    size_t old_n = col->nslots;
+    uint64_t *old = col->slots;
+    col->nslots = old_n ? old_n * 2 : 64;
+    col->slots = (uint64_t *)calloc(col->nslots, sizeof(uint64_t));
+    if (!col->slots) die("out of memory");
+    size_t mask = col->nslots - 1;
+    for (size_t k = 0; k < old_n; k++) {
+        if (old[k] == 0) continue;
+        size_t i = (size_t)(old[k] >> 32) & mask;
+        while (col->slots[i] != 0) i = (i + 1) & mask;
+        col->slots[i] = old[k];
+    }
+    free(old);
+}
+
+static void pq_put_plain(Buf *b, bool byte_array, const char *p, size_t n) {
+    if (byte_array) {
+        if (n > (size_t)INT32_MAX) die("value too large for a Parquet column");
+        buf_put_le(b, n, 4);
+    }
+    buf_put(b, p, n);
+}
 
-    for (size_t r = 0; r < t->nrows; r++) {
-        fputs("- ", f);
-        if (t->ncols > 0) {
-            fputs(t->headers[0], f);
-            fputs(": ", f);
-            yaml_write_escaped(f, t->rows[r][0] ? t->rows[r][0] : "");
-            fputc('\n', f);
+// Rewrites the indices collected so far as PLAIN values and stops using the
+// dictionary for the rest of the row group.
+static void pq_drop_dict(PqColumnBuf *col) {
+    Buf plain = {0};
+    const uint32_t *idx = (const uint32_t *)col->values.data;
+    for (size_t i = 0; i < col->nvalues; i++) {
+        size_t e = idx[i];
+        buf_put(&plain, col->dict.data + col->dict_off[e], col->dict_off[e + 1] - col->dict_off[e]);
+    }
+    buf_free(&col->values);
+    col->values = plain;
+    col->use_dict = false;
+    col->plain = true;
+}
+
+static void pq_add(PqColumnBuf *col, const char *p, size_t n) {
+    if (col->use_dict) {
+        size_t skip = col->byte_array ? 4 : 0;
+        size_t mask = col->nslots - 1;
+        uint64_t h = (uint64_t)(uint32_t)hash_key(p, n) << 32;
+        size_t i = (size_t)(h >> 32) & mask;
+        for (; col->slots[i] != 0; i = (i + 1) & mask) {
+            if ((col->slots[i] & 0xFFFFFFFF00000000ULL) != h) continue;
+            size_t e = (uint32_t)col->slots[i] - 1;
+            size_t off = col->dict_off[e] + skip;
+            if (col->dict_off[e + 1] - off == n && memcmp(col->dict.data + off, p, n) == 0) break;
+        }
+
+        uint32_t e32;
+        if (col->slots[i] != 0) {
+            e32 = (uint32_t)col->slots[i] - 1;
+        } else if (col->dict.len + n + skip <= PQ_DICT_BYTES) {
+            if (col->ndict + 2 > col->dict_cap) {
+                col->dict_cap = col->dict_cap ? col->dict_cap * 2 : 64;
+                col->dict_off = (size_t *)xrealloc(col->dict_off, col->dict_cap * sizeof(size_t));
+            }
+            pq_put_plain(&col->dict, col->byte_array, p, n);
+            col->dict_off[col->ndict + 1] = col->dict.len;
+            e32 = (uint32_t)col->ndict++;
+            col->slots[i] = h | col->ndict;
+            if (2 * col->ndict > col->nslots) pq_rehash(col);
         } else {
-            fputs("{}\n", f);
+            pq_drop_dict(col);
+            e32 = 0;
         }
-        for (size_t c = 1; c < t->ncols; c++) {
-            fputs("  ", f);
-            fputs(t->headers[c], f);
-            fputs(": ", f);
-            yaml_write_escaped(f, t->rows[r][c] ? t->rows[r][c] : "");
-            fputc('\n', f);
+        if (col->use_dict) {
+            buf_put(&col->values, (const char *)&e32, sizeof(e32));
+            col->nvalues++;
+            return;
         }
     }
+    pq_put_plain(&col->values, col->byte_array, p, n);
+    col->nvalues++;
+}
 
-    fclose(f);
-    return 0;
+static void pq_group_reset(ParquetOut *a) {
+    for (size_t c = 0; c < a->ncols; c++) {
+        PqColumnBuf *col = &a->bufs[c];
+        col->def.len = 0;
+        col->values.len = 0;
+        col->nvalues = 0;
+        col->use_dict = !col->plain && col->type != DT_BOOLEAN && col->type != DT_NULL;
+        col->dict.len = 0;
+        col->ndict = 0;
+        if (col->slots) memset(col->slots, 0, col->nslots * sizeof(uint64_t));
+    }
+    a->rows = 0;
+    a->bytes = 0;
+}
+
+static void parquet_out_free(ParquetOut *a) {
+    if (!a) return;
+    for (size_t c = 0; a->bufs && c < a->ncols; c++) {
+        PqColumnBuf *col = &a->bufs[c];
+        buf_free(&col->def);
+        buf_free(&col->values);
+        buf_free(&col->dict);
+        free(col->dict_off);
+        free(col->slots);
+    }
+    for (size_t g = 0; g < a->ngroups; g++) free(a->groups[g].chunks);
+    free(a->groups);
+    free(a->cols);
+    free(a->bufs);
+    ob_free(&a->page);
+    ob_free(&a->levels);
+    ob_free(&a->header);
+    buf_free(&a->packed);
+    free(a->def32);
+    buf_free(&a->scratch);
+    free(a);
+}
+
+static void pq_emit(ParquetOut *a, OutBuf *out, const char *p, size_t n) {
+    ob_put(out, p, n);
+    a->pos += (int64_t)n;
+}
+
+static void parquet_write_begin(const RecordWriter *w, OutBuf *out) {
+    ParquetOut *a = w->parquet;
+    size_t n = w->ncols ? w->ncols : 1;
+    a->cols = (PqColumn *)xmalloc(n * sizeof(PqColumn));
+    a->bufs = (PqColumnBuf *)calloc(n, sizeof(PqColumnBuf));
+    if (!a->bufs) die("out of memory");
+    a->ncols = w->ncols;
+    ob_init(&a->page, -1);
+    ob_init(&a->levels, -1);
+    ob_init(&a->header, -1);
+
+    for (size_t c = 0; c < w->ncols; c++) {
+        DataType t = w->types ? w->types[c] : DT_TEXT;
+        PqColumn pc = {w->headers[c], PQ_BYTE_ARRAY, true, PQ_LOGICAL_STRING, false};
+        switch (t) {
+            case DT_BOOLEAN:
+                pc.type = PQ_BOOLEAN;
+                pc.logical = PQ_LOGICAL_NONE;
+                break;
+            case DT_INTEGER:
+            case DT_BIGINT:
+                pc.type = t == DT_INTEGER ? PQ_INT32 : PQ_INT64;
+                pc.logical = PQ_LOGICAL_NONE;
+                break;
+            case DT_NUMERIC:
+                pc.type = PQ_DOUBLE;
+                pc.logical = PQ_LOGICAL_NONE;
+                break;
+            case DT_DATE:
+                pc.type = PQ_INT32;
+                pc.logical = PQ_LOGICAL_DATE;
+                break;
+            case DT_TIMESTAMP:
+            case DT_TIMESTAMPTZ:
+                pc.type = PQ_INT64;
+                pc.logical = PQ_LOGICAL_TIMESTAMP;
+                pc.utc = t == DT_TIMESTAMPTZ;
+                break;
+            case DT_NULL:
+            case DT_TEXT: break;
+        }
+        a->cols[c] = pc;
+
+        PqColumnBuf *col = &a->bufs[c];
+        col->type = t;
+        col->byte_array = pc.type == PQ_BYTE_ARRAY;
+        col->dict_cap = 64;
+        col->dict_off = (size_t *)xmalloc(col->dict_cap * sizeof(size_t));
+        col->dict_off[0] = 0;
+        pq_rehash(col);
+    }
+    pq_group_reset(a);
+    pq_emit(a, out, PARQUET_MAGIC, 4);
+}
+
+// Compresses body and writes it after its page header.
+static void pq_write_page(ParquetOut *a, OutBuf *out, PqChunk *k, const char *body, size_t len, size_t num_values,
+                          bool dictionary, int encoding) {
+    const char *data = body;
+    size_t clen = len;
+    if (parquet_codec != PQ_UNCOMPRESSED) {
+        buf_reserve(&a->packed, pq_compress_bound(parquet_codec, len));
+        clen = pq_compress(parquet_codec, body, len, a->packed.data);
+        if (clen == SIZE_MAX) die("Parquet page compression failed");
+        data = a->packed.data;
+    }
+    if (len > (size_t)INT32_MAX || clen > (size_t)INT32_MAX) die("Parquet page too large");
+
+    a->header.len = 0;
+    if (dictionary) {
+        pq_write_dictionary_page_header(&a->header, (int32_t)len, (int32_t)clen, (int32_t)num_values);
+    } else {
+        pq_write_data_page_header(&a->header, (int32_t)len, (int32_t)clen, (int32_t)num_values, encoding);
+    }
+    if (a->header.err) die("out of memory");
+    pq_emit(a, out, a->header.data, a->header.len);
+    pq_emit(a, out, data, clen);
+    k->uncompressed_size += (int64_t)(a->header.len + len);
+    k->compressed_size += (int64_t)(a->header.len + clen);
+}
+
+// Data page of rows [r0, r1), whose present values are [v0, v1) and, when
+// PLAIN, bytes [b0, b1) of col->values.
+static void pq_data_page(ParquetOut *a, OutBuf *out, PqChunk *k, size_t c, size_t r0, size_t r1, size_t v0,
+                         size_t v1, size_t b0, size_t b1) {
+    const PqColumnBuf *col = &a->bufs[c];
+    OutBuf *page = &a->page;
+    page->len = 0;
+
+    if (a->cols[c].optional) {
+        size_t n = r1 - r0;
+        if (n > a->def32_cap) {
+            a->def32 = (uint32_t *)xrealloc(a->def32, n * sizeof(uint32_t));
+            a->def32_cap = n;
+        }
+        for (size_t r = 0; r < n; r++) a->def32[r] = (uint8_t)col->def.data[r0 + r];
+        a->levels.len = 0;
+        pq_rle_encode(&a->levels, a->def32, n, 1);
+        uint8_t len[4];
+        arrow_put_le(len, a->levels.len, 4);
+        ob_put(page, (const char *)len, 4);
+        ob_put(page, a->levels.data, a->levels.len);
+    }
+
+    if (col->use_dict) {
+        int width = pq_bit_width(col->ndict > 1 ? (uint32_t)(col->ndict - 1) : 1);
+        ob_putc(page, (char)width);
+        pq_rle_encode(page, (const uint32_t *)col->values.data + v0, v1 - v0, width);
+    } else if (col->type == DT_BOOLEAN) {
+        // PLAIN booleans are bit-packed, least significant bit first.
+        for (size_t v = v0; v < v1; v += 8) {
+            unsigned bits = 0;
+            for (size_t i = 0; i < 8 && v + i < v1; i++) bits |= (unsigned)(col->values.data[v + i] & 1) << i;
+            ob_putc(page, (char)bits);
+        }
+    } else {
+        ob_put(page, col->values.data + b0, b1 - b0);
+    }
+    if (page->err) die("out of memory");
+    pq_write_page(a, out, k, page->data, page->len, r1 - r0, false, col->use_dict ? PQ_RLE_DICTIONARY : PQ_PLAIN);
+}
+
+static size_t pq_value_width(const PqColumnBuf *col) {
+    switch (col->type) {
+        case DT_BOOLEAN: return 1;
+        case DT_INTEGER:
+        case DT_DATE: return 4;
+        default: return 8;
+    }
+}
+
+static void pq_write_chunk(ParquetOut *a, OutBuf *out, size_t c, PqChunk *k) {
+    PqColumnBuf *col = &a->bufs[c];
+    bool optional = a->cols[c].optional;
+    if (col->use_dict && col->nvalues == 0) {
+        col->use_dict = false;
+    } else if (col->use_dict && col->ndict > col->nvalues / 2) {
+        pq_drop_dict(col);
+    }
+
+    memset(k, 0, sizeof(*k));
+    k->dictionary_page_offset = -1;
+    k->num_values = (int64_t)a->rows;
+    if (col->use_dict) {
+        k->dictionary_page_offset = a->pos;
+        pq_write_page(a, out, k, col->dict.data, col->dict.len, col->ndict, true, PQ_PLAIN_DICTIONARY);
+    }
+    k->data_page_offset = a->pos;
+
+    // Pages end once their values (or, for all-null runs, levels) reach
+    // about PQ_PAGE_BYTES.
+    size_t width = pq_value_width(col);
+    size_t r = 0, v = 0, b = 0;
+    do {
+        size_t r0 = r, v0 = v, b0 = b, est = 0;
+        while (r < a->rows && est < PQ_PAGE_BYTES) {
+            bool present = !optional || col->def.data[r];
+            r++;
+            est++;
+            if (!present) continue;
+            v++;
+            if (col->use_dict) {
+                est += 4;
+            } else if (col->byte_array) {
+                size_t n = (size_t)arrow_le((const uint8_t *)col->values.data + b, 4);
+                b += 4 + n;
+                est += 4 + n;
+            } else {
+                b += width;
+                est += width;
+            }
+        }
+        pq_data_page(a, out, k, c, r0, r, v0, v, b0, b);
+    } while (r < a->rows);
+}
+
+static void parquet_flush(const RecordWriter *w, OutBuf *out) {
+    ParquetOut *a = w->parquet;
+    if (a->rows == 0) return;
+
+    a->groups = (PqRowGroup *)xrealloc(a->groups, (a->ngroups + 1) * sizeof(PqRowGroup));
+    PqRowGroup *g = &a->groups[a->ngroups++];
+    g->rows = (int64_t)a->rows;
+    g->chunks = (PqChunk *)xmalloc((a->ncols ? a->ncols : 1) * sizeof(PqChunk));
+    for (size_t c = 0; c < a->ncols; c++) pq_write_chunk(a, out, c, &g->chunks[c]);
+
+    a->total_rows += (int64_t)a->rows;
+    pq_group_reset(a);
+}
+
+static void parquet_write_row(const RecordWriter *w, OutBuf *out, const Span *cells) {
+    ParquetOut *a = w->parquet;
+    for (size_t c = 0; c < w->ncols; c++) {
+        PqColumnBuf *col = &a->bufs[c];
+        Span v = cells[c];
+        if (a->cols[c].optional) {
+            bool valid = v.ptr != null_cell &&
+                         (col->type == DT_TEXT || (col->type != DT_NULL && !type_is_null(v.ptr, v.len)));
+            buf_putc(&col->def, valid ? 1 : 0);
+            if (!valid) continue;
+        }
+
+        uint8_t tmp[8];
+        size_t n = 8;
+        switch (col->type) {
+            case DT_TEXT:
+                pq_add(col, v.ptr, v.len);
+                a->bytes += v.len;
+                continue;
+            case DT_BOOLEAN:
+                tmp[0] = (v.ptr[0] | 0x20) == 't';
+                n = 1;
+                break;
+            case DT_INTEGER:
+                arrow_put_le(tmp, (uint64_t)span_to_int64(v), 4);
+                n = 4;
+                break;
+            case DT_DATE:
+                arrow_put_le(tmp, (uint32_t)arrow_parse_date(v.ptr), 4);
+                n = 4;
+                break;
+            case DT_BIGINT: arrow_put_le(tmp, (uint64_t)span_to_int64(v), 8); break;
+            case DT_NUMERIC: {
+                double d = span_to_double(&a->scratch, v);
+                uint64_t bits;
+                memcpy(&bits, &d, sizeof(bits));
+                arrow_put_le(tmp, bits, 8);
+                break;
+            }
+            case DT_TIMESTAMP:
+            case DT_TIMESTAMPTZ: arrow_put_le(tmp, (uint64_t)arrow_parse_timestamp(v.ptr, v.len), 8); break;
+            case DT_NULL: continue;
+        }
+        pq_add(col, (const char *)tmp, n);
+        a->bytes += n;
+    }
+    a->rows++;
+    a->bytes += w->ncols;
+    if (a->rows >= parquet_group_rows || a->bytes >= PQ_GROUP_BYTES) parquet_flush(w, out);
+}
+
+static void parquet_write_end(const RecordWriter *w, OutBuf *out) {
+    ParquetOut *a = w->parquet;
+    parquet_flush(w, out);
+    pq_write_footer(out, a->cols, a->ncols, a->groups, a->ngroups, parquet_codec, a->total_rows);
+}
+
+// ---------------- Parallel pipeline ----------------
+//
+// With -j N (N > 1), rows are formatted on N worker threads and written in
+// input order. The main thread queues jobs in a ring of N * PAR_WINDOW slots.
+// Workers format each job into its own buffer, and the main thread writes
+// finished buffers oldest first with writev(). A job is one of:
+//
+// - a byte range of a mapped CSV or NDJSON input, which the worker also
+//   parses;
+// - a block of records copied out of a serial reader (JSON, YAML, pipes);
+// - a range of rows of a materialized Table.
+//
+// NDJSON ranges simply end after the first '\n' past each PAR_CHUNK
+// boundary. Their keys are collected the same way: each worker gathers the
+// keys of its ranges in first-seen order, and merging those lists in range
+// order gives the column order a serial pass would.
+//
+// A CSV input is cut into ranges at record boundaries, which is a '\n'
+// preceded by an even number of quotes. A range cannot know its own starting
+// quote state, so a parallel pre-pass (csv_chunk_stats()) records, for each
+// range, the first newline under either starting state. A prefix XOR of the
+// per-range quote parities then picks the real boundary for each range.
+//
+// A '"' inside an unquoted field is literal to the parser but still flips
+// the parity, so a guessed boundary can be wrong. When a range's last record
+// ends past the next range's start, later ranges are discarded unwritten and
+// the rest of the input goes through the serial reader instead.
+
+#define PAR_CHUNK ((size_t)1024 * 1024)
+#define PAR_WINDOW 2
+// A block from a serial reader is handed off at whichever limit comes first.
+#define PAR_BLOCK_ROWS 4096
+#define PAR_BLOCK_BYTES ((size_t)1024 * 1024)
+
+static size_t par_threads = 1;
+static size_t par_chunk = PAR_CHUNK;
+
+typedef struct {
+    void *ctx;
+    size_t id;
+    void *(*fn)(void *);
+    HelperThreads *threads;
+} WorkerArg;
+
+// A failing worker ends its own thread; stop, if set, wakes whatever waits
+// for it (see libdtconvert.h).
+typedef struct {
+    HelperThreads threads;
+    pthread_t *tids;
+    WorkerArg *args;
+    size_t n;
+    void (*stop)(void *);
+    void *ctx;
+} WorkerSet;
+
+static void *worker_main(void *arg) {
+    WorkerArg *a = (WorkerArg *)arg;
+    helper_thread_attach(a->threads);
+    return a->fn(a);
+}
+
+static void workers_join(WorkerSet *ws) {
+    for (size_t t = 0; t < ws->n; t++) pthread_join(ws->tids[t], NULL);
+    free(ws->tids);
+    free(ws->args);
+    HelperThreads threads = ws->threads;
+    memset(ws, 0, sizeof(*ws));
+    helper_threads_stopped(&threads);
+}
+
+static void workers_join_cb(void *ws) {
+    workers_join((WorkerSet *)ws);
+}
+
+static void workers_stop_cb(void *arg) {
+    WorkerSet *ws = (WorkerSet *)arg;
+    ws->stop(ws->ctx);
+}
+
+static void workers_start(WorkerSet *ws, size_t n, void *(*fn)(void *), void *ctx, void (*stop)(void *)) {
+    ws->tids = (pthread_t *)xmalloc(n * sizeof(pthread_t));
+    ws->args = (WorkerArg *)xmalloc(n * sizeof(WorkerArg));
+    ws->n = 0;
+    ws->stop = stop;
+    ws->ctx = ctx;
+    ws->threads = (HelperThreads){.stop = stop ? workers_stop_cb : NULL, .join = workers_join_cb, .ctx = ws};
+    helper_threads_started(&ws->threads);
+    for (size_t t = 0; t < n; t++) {
+        ws->args[t] = (WorkerArg){ctx, t, fn, &ws->threads};
+        if (pthread_create(&ws->tids[t], NULL, worker_main, &ws->args[t]) != 0) die("cannot start worker thread");
+        ws->n++;
+    }
+}
+
+typedef struct {
+    const char *base;
+    size_t len;
+    size_t start;
+    size_t chunk;
+    size_t n;
+    size_t nthreads;
+    const InputMap *map;
+    CsvChunkStats *stats;
+} StatsPass;
+
+static void *csv_stats_worker(void *arg) {
+    const WorkerArg *a = (const WorkerArg *)arg;
+    StatsPass *sp = (StatsPass *)a->ctx;
+    for (size_t k = a->id; k < sp->n; k += sp->nthreads) {
+        size_t off = sp->start + k * sp->chunk;
+        size_t n = sp->len - off < sp->chunk ? sp->len - off : sp->chunk;
+        csv_chunk_stats(sp->base + off, n, &sp->stats[k]);
+        input_map_drop(sp->map, off, n);
+    }
+    return NULL;
+}
+
+// Splits [start, len) of a mapped CSV input into ranges that begin on record
+// boundaries. Returns the number of ranges; range k is [starts[k], starts[k+1])
+// with starts[n] = len.
+static size_t csv_plan_ranges(const Cursor *c, size_t start, size_t **starts_out) {
+    StatsPass sp;
+    memset(&sp, 0, sizeof(sp));
+    sp.base = c->data;
+    sp.len = c->len;
+    sp.start = start;
+    sp.chunk = par_chunk;
+    sp.n = (c->len - start + par_chunk - 1) / par_chunk;
+    sp.nthreads = par_threads;
+    sp.map = &c->map;
+    sp.stats = (CsvChunkStats *)xmalloc(sp.n * sizeof(CsvChunkStats));
+
+    WorkerSet ws;
+    workers_start(&ws, sp.nthreads, csv_stats_worker, &sp, NULL);
+    workers_join(&ws);
+
+    size_t *starts = (size_t *)xmalloc((sp.n + 1) * sizeof(size_t));
+    size_t n = 0;
+    starts[n++] = start;
+    bool odd = sp.stats[0].odd;
+    for (size_t k = 1; k < sp.n; k++) {
+        size_t off = start + k * sp.chunk;
+        size_t len = sp.len - off < sp.chunk ? sp.len - off : sp.chunk;
+        size_t nl = sp.stats[k].first_nl[odd];
+        if (nl < len) starts[n++] = off + nl + 1;
+        odd ^= sp.stats[k].odd;
+    }
+    starts[n] = sp.len;
+    free(sp.stats);
+    *starts_out = starts;
+    return n;
+}
+
+// Splits [start, len) of a mapped NDJSON input into ranges that end after a
+// '\n' (or at the end of input). Same result convention as csv_plan_ranges().
+static size_t ndjson_plan_ranges(const Cursor *c, size_t start, size_t **starts_out) {
+    size_t *starts = (size_t *)xmalloc(((c->len - start) / par_chunk + 2) * sizeof(size_t));
+    size_t n = 0;
+    size_t off = start;
+    while (off < c->len) {
+        starts[n++] = off;
+        if (c->len - off <= par_chunk) break;
+        const char *nl = (const char *)memchr(c->data + off + par_chunk, '\n', c->len - off - par_chunk);
+        if (!nl) break;
+        off = (size_t)(nl - c->data) + 1;
+    }
+    starts[n] = c->len;
+    *starts_out = starts;
+    return n;
+}
+
+typedef struct {
+    const Cursor *cur;
+    const size_t *starts;
+    size_t n;
+    size_t nthreads;
+    // Keys of each worker's ranges, in first-seen order per range.
+    Schema *found;
+} KeyPass;
+
+// Parses range [from, to) of the input, adding its keys (and with
+// --infer-types, their value types) to s.
+static void ndjson_collect_keys(const Cursor *base, size_t from, size_t to, Schema *s, Record *rec, Buf *key) {
+    Cursor c;
+    memset(&c, 0, sizeof(c));
+    c.data = base->data + from;
+    c.len = to - from;
+    c.mark = NO_MARK;
+    c.eof = true;
+
+    JsonIndex x = {0};
+    while (ndjson_read(&x, &c, s, false, key, rec)) {
+        if (infer_types) schema_add_types(s, rec);
+    }
+    jx_free(&x);
+}
+
+static void *ndjson_key_worker(void *arg) {
+    const WorkerArg *a = (const WorkerArg *)arg;
+    KeyPass *kp = (KeyPass *)a->ctx;
+    Record rec = {0};
+    Buf key = {0};
+    for (size_t k = a->id; k < kp->n; k += kp->nthreads) {
+        // One schema per range keeps the merge in input order.
+        ndjson_collect_keys(kp->cur, kp->starts[k], kp->starts[k + 1], &kp->found[k], &rec, &key);
+        input_map_drop(&kp->cur->map, kp->starts[k], kp->starts[k + 1] - kp->starts[k]);
+    }
+    rec_free(&rec);
+    buf_free(&key);
+    return NULL;
+}
+
+// Parallel version of the key-discovery pass for a mapped NDJSON input.
+static void ndjson_prescan_parallel(RecordReader *r) {
+    size_t *starts = NULL;
+    KeyPass kp;
+    memset(&kp, 0, sizeof(kp));
+    kp.cur = &r->cur;
+    kp.n = ndjson_plan_ranges(&r->cur, r->cur.pos, &starts);
+    kp.starts = starts;
+    kp.nthreads = par_threads;
+    kp.found = (Schema *)calloc(kp.n ? kp.n : 1, sizeof(Schema));
+    if (!kp.found) die("out of memory");
+
+    WorkerSet ws;
+    workers_start(&ws, kp.nthreads, ndjson_key_worker, &kp, NULL);
+    workers_join(&ws);
+
+    for (size_t k = 0; k < kp.n; k++) {
+        for (size_t c = 0; c < kp.found[k].ncols; c++) {
+            const char *h = kp.found[k].headers[c];
+            size_t col = schema_col(&r->schema, h, strlen(h));
+            r->schema.types[col] = type_join(r->schema.types[col], kp.found[k].types[c]);
+        }
+        schema_free(&kp.found[k]);
+    }
+    free(kp.found);
+    free(starts);
+}
+
+typedef enum { JOB_CSV_RANGE, JOB_NDJSON_RANGE, JOB_BLOCK, JOB_TABLE } JobKind;
+
+// Records copied out of a serial reader. Cell c of row r is at index
+// r * ncols + c of offs/lens, relative to bytes; a null cell has length
+// NULL_LEN.
+#define NULL_LEN ((size_t)-1)
+
+typedef struct {
+    Buf bytes;
+    size_t *offs;
+    size_t *lens;
+    size_t nrows;
+    size_t cap;
+} RowBlock;
+
+typedef struct {
+    JobKind kind;
+    // JOB_CSV_RANGE, JOB_NDJSON_RANGE: input range, and where its last
+    // record ended.
+    size_t start;
+    size_t end;
+    size_t last_end;
+    RowBlock block;
+    // JOB_TABLE
+    size_t row_begin;
+    size_t row_end;
+
+    // Every row is preceded by the writer's separator; the one in front of
+    // the very first row of the output is skipped when writing.
+    OutBuf out;
+    size_t nrows;
+    bool done;
+} Job;
+
+typedef struct {
+    RecordWriter *w;
+    size_t ncols;
+    Cursor *cur;
+    // Frozen while the workers run.
+    Schema *schema;
+    const Table *table;
+
+    Job *jobs;
+    size_t window;
+    // Sequence numbers: oldest unwritten job, next job to run, next free slot.
+    size_t head;
+    size_t next;
+    size_t tail;
+    bool closing;
+    // A worker failed; everyone stops and the helper's thread fails too.
+    bool stopped;
+    // A CSV range overran its boundary; ranges after it are discarded.
+    bool overrun;
+    size_t resume;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    WorkerSet workers;
+} Pipeline;
+
+static void block_add(RowBlock *b, Record *rec, size_t ncols) {
+    if (b->nrows == b->cap) {
+        b->cap = b->cap ? b->cap * 2 : 256;
+        b->offs = (size_t *)xrealloc(b->offs, b->cap * ncols * sizeof(size_t));
+        b->lens = (size_t *)xrealloc(b->lens, b->cap * ncols * sizeof(size_t));
+    }
+    const Span *cells = rec_cells(rec);
+    size_t *offs = b->offs + b->nrows * ncols;
+    size_t *lens = b->lens + b->nrows * ncols;
+    for (size_t c = 0; c < ncols; c++) {
+        offs[c] = b->bytes.len;
+        lens[c] = c < rec->ncols ? cells[c].len : 0;
+        if (c < rec->ncols && cells[c].ptr == null_cell) {
+            lens[c] = NULL_LEN;
+        } else if (lens[c]) {
+            buf_put(&b->bytes, cells[c].ptr, lens[c]);
+        }
+    }
+    b->nrows++;
+}
+
+static void block_free(RowBlock *b) {
+    buf_free(&b->bytes);
+    free(b->offs);
+    free(b->lens);
+    memset(b, 0, sizeof(*b));
+}
+
+static void job_emit(const Pipeline *p, Job *job, const Span *cells) {
+    ob_puts(&job->out, p->w->sep);
+    p->w->row(p->w, &job->out, cells);
+    job->nrows++;
+}
+
+static void job_run(const Pipeline *p, Job *job, Record *rec, Span *cells) {
+    if (job->kind == JOB_CSV_RANGE) {
+        // The cursor runs to the end of the input so a record that overruns
+        // the range is parsed in full and detected by the writer.
+        Cursor c;
+        memset(&c, 0, sizeof(c));
+        c.data = p->cur->data + job->start;
+        c.len = p->cur->len - job->start;
+        c.mark = NO_MARK;
+        c.eof = true;
+
+        size_t end = job->end - job->start;
+        job->last_end = job->start;
+        while (true) {
+            csv_skip_empty_lines(&c);
+            if (c.pos >= end || cur_eof(&c)) break;
+            csv_read_record(&c, p->ncols, rec);
+            job_emit(p, job, rec_cells(rec));
+            job->last_end = job->start + c.pos;
+        }
+    } else if (job->kind == JOB_NDJSON_RANGE) {
+        Cursor c;
+        memset(&c, 0, sizeof(c));
+        c.data = p->cur->data + job->start;
+        c.len = job->end - job->start;
+        c.mark = NO_MARK;
+        c.eof = true;
+
+        JsonIndex x = {0};
+        Buf key = {0};
+        while (ndjson_read(&x, &c, p->schema, true, &key, rec)) job_emit(p, job, rec_cells(rec));
+        jx_free(&x);
+        buf_free(&key);
+        job->last_end = job->end;
+    } else if (job->kind == JOB_BLOCK) {
+        const RowBlock *b = &job->block;
+        for (size_t r = 0; r < b->nrows; r++) {
+            for (size_t c = 0; c < p->ncols; c++) {
+                size_t i = r * p->ncols + c;
+                if (b->lens[i] == NULL_LEN) {
+                    cells[c] = (Span){null_cell, 0};
+                } else {
+                    cells[c] = (Span){b->lens[i] ? b->bytes.data + b->offs[i] : "", b->lens[i]};
+                }
+            }
+            job_emit(p, job, cells);
+        }
+    } else {
+        for (size_t r = job->row_begin; r < job->row_end; r++) job_emit(p, job, table_row(p->table, r, cells));
+    }
+}
+
+static void *pipeline_worker(void *arg) {
+    Pipeline *p = (Pipeline *)((const WorkerArg *)arg)->ctx;
+    Record rec = {0};
+    Span *cells = (Span *)xmalloc((p->ncols ? p->ncols : 1) * sizeof(Span));
+
+    while (true) {
+        pthread_mutex_lock(&p->lock);
+        while (p->next == p->tail && !p->closing && !p->stopped) pthread_cond_wait(&p->cond, &p->lock);
+        if (p->next == p->tail || p->stopped) {
+            pthread_mutex_unlock(&p->lock);
+            break;
+        }
+        Job *job = &p->jobs[p->next++ % p->window];
+        pthread_mutex_unlock(&p->lock);
+
+        job_run(p, job, &rec, cells);
+
+        pthread_mutex_lock(&p->lock);
+        job->done = true;
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+    }
+
+    rec_free(&rec);
+    free(cells);
+    return NULL;
+}
+
+static void pipeline_stop(void *arg) {
+    Pipeline *p = (Pipeline *)arg;
+    pthread_mutex_lock(&p->lock);
+    p->stopped = true;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void pipeline_start(Pipeline *p, RecordWriter *w, RecordReader *rd, const Table *table) {
+    memset(p, 0, sizeof(*p));
+    p->w = w;
+    p->ncols = w->ncols;
+    p->cur = &rd->cur;
+    p->schema = &rd->schema;
+    p->table = table;
+    p->window = par_threads * PAR_WINDOW;
+    p->jobs = (Job *)calloc(p->window, sizeof(Job));
+    if (!p->jobs) die("out of memory");
+    for (size_t i = 0; i < p->window; i++) ob_init(&p->jobs[i].out, -1);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+
+    // Pick the scanner variant before threads race to do it.
+    (void)csv_scan_impl();
+    workers_start(&p->workers, par_threads, pipeline_worker, p, pipeline_stop);
+}
+
+// Writes every finished job at the head of the ring in one writev() batch.
+// With wait set, first blocks until the oldest job is finished.
+static void pipeline_write_ready(Pipeline *p, bool wait) {
+    pthread_mutex_lock(&p->lock);
+    if (wait) {
+        while (p->head < p->tail && !p->jobs[p->head % p->window].done && !p->stopped) {
+            pthread_cond_wait(&p->cond, &p->lock);
+        }
+    }
+    if (p->stopped) {
+        pthread_mutex_unlock(&p->lock);
+        // The worker has reported the error; this joins the others.
+        helper_exit(1);
+    }
+    size_t n = 0;
+    while (p->head + n < p->tail && p->jobs[(p->head + n) % p->window].done) n++;
+    pthread_mutex_unlock(&p->lock);
+    if (n == 0) return;
+
+    RecordWriter *w = p->w;
+    size_t sep_len = strlen(w->sep);
+    struct iovec *iov = (struct iovec *)xmalloc(n * sizeof(struct iovec));
+    int niov = 0;
+    size_t release = 0;
+    for (size_t i = 0; i < n; i++) {
+        Job *job = &p->jobs[(p->head + i) % p->window];
+        if (job->kind == JOB_CSV_RANGE || job->kind == JOB_NDJSON_RANGE) {
+            if (p->overrun) continue;
+            release = job->end;
+            if (job->last_end > job->end) {
+                p->overrun = true;
+                p->resume = job->last_end;
+            }
+        }
+        if (job->out.err && !w->out.err) w->out.err = job->out.err;
+        size_t skip = (w->nrows == 0 && job->nrows > 0) ? sep_len : 0;
+        if (job->out.len > skip) {
+            iov[niov].iov_base = job->out.data + skip;
+            iov[niov].iov_len = job->out.len - skip;
+            niov++;
+        }
+        w->nrows += job->nrows;
+    }
+    // Also flushes whatever was formatted serially before this batch.
+    ob_writev(&w->out, iov, niov);
+    free(iov);
+    if (release) input_map_release(&p->cur->map, release);
+
+    pthread_mutex_lock(&p->lock);
+    p->head += n;
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Returns the next free job slot, writing finished jobs while the ring is full.
+static Job *pipeline_slot(Pipeline *p, JobKind kind) {
+    while (p->tail - p->head == p->window) pipeline_write_ready(p, true);
+    Job *job = &p->jobs[p->tail % p->window];
+    job->kind = kind;
+    job->out.len = 0;
+    job->nrows = 0;
+    job->done = false;
+    job->block.bytes.len = 0;
+    job->block.nrows = 0;
+    return job;
+}
+
+static void pipeline_submit(Pipeline *p) {
+    pthread_mutex_lock(&p->lock);
+    p->tail++;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    // Keep output flowing without waiting for the ring to fill.
+    pipeline_write_ready(p, false);
+}
+
+static void pipeline_drain(Pipeline *p) {
+    while (p->head < p->tail) pipeline_write_ready(p, true);
+}
+
+static void pipeline_finish(Pipeline *p) {
+    pipeline_drain(p);
+    pthread_mutex_lock(&p->lock);
+    p->closing = true;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+    workers_join(&p->workers);
+
+    for (size_t i = 0; i < p->window; i++) {
+        ob_free(&p->jobs[i].out);
+        block_free(&p->jobs[i].block);
+    }
+    free(p->jobs);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->cond);
+}
+
+// Queues a mapped CSV or NDJSON input as ranges parsed by the workers.
+// Afterwards the cursor is at the end of input, or where a CSV range overran
+// its boundary.
+static void pipeline_ranges(Pipeline *p, RecordReader *rd) {
+    Cursor *cur = &rd->cur;
+    if (!cur->map.mapped || (rd->next != csv_next && rd->next != ndjson_next)) return;
+    if (cur->len - cur->pos < 2 * par_chunk) return;
+
+    JobKind kind = rd->next == csv_next ? JOB_CSV_RANGE : JOB_NDJSON_RANGE;
+    size_t *starts = NULL;
+    size_t n = kind == JOB_CSV_RANGE ? csv_plan_ranges(cur, cur->pos, &starts)
+                                     : ndjson_plan_ranges(cur, cur->pos, &starts);
+    for (size_t k = 0; k < n && !p->overrun; k++) {
+        Job *job = pipeline_slot(p, kind);
+        if (p->overrun) break;
+        job->start = starts[k];
+        job->end = starts[k + 1];
+        pipeline_submit(p);
+    }
+    pipeline_drain(p);
+    free(starts);
+
+    cur->pos = p->overrun ? p->resume : cur->len;
+    cur->mark = NO_MARK;
+    if (kind == JOB_NDJSON_RANGE) jx_reset(&rd->jx, cur);
 }
 
 // ---------------- Dispatch ----------------
 
-static int read_table(const char *path, const char *ext, Table *t) {
-    if (strcmp(ext, "csv") == 0) return csv_read_table(path, t);
-    if (strcmp(ext, "json") == 0) return json_read_table(path, t);
-    if (strcmp(ext, "yaml") == 0 || strcmp(ext, "yml") == 0) return yaml_read_table(path, t);
-    fprintf(stderr, "Error: unsupported input format: %s\n", ext);
-    return 1;
+static int reader_open(RecordReader *r, const char *path, const char *ext) {
+    memset(r, 0, sizeof(*r));
+
+    int (*open_fn)(RecordReader *) = NULL;
+    if (strcmp(ext, "csv") == 0) open_fn = csv_open_reader;
+    if (strcmp(ext, "json") == 0) open_fn = json_open_reader;
+    if (strcmp(ext, "ndjson") == 0) open_fn = ndjson_open_reader;
+    if (strcmp(ext, "yaml") == 0) open_fn = yaml_open_reader;
+    if (strcmp(ext, "arrow") == 0) open_fn = arrow_open_reader;
+    if (!open_fn) {
+        fprintf(stderr, "Error: unsupported input format: %s\n", ext);
+        return 1;
+    }
+
+    if (cur_open(&r->cur, path) != 0) return 1;
+    r->start = open_fn;
+    return open_fn(r);
 }
 
-static int write_table(const char *path, const char *ext, const Table *t) {
-    if (strcmp(ext, "csv") == 0) return csv_write_table(path, t);
-    if (strcmp(ext, "json") == 0) return json_write_table(path, t);
-    if (strcmp(ext, "yaml") == 0 || strcmp(ext, "yml") == 0) return yaml_write_table(path, t);
-    fprintf(stderr, "Error: unsupported output format: %s\n", ext);
-    return 1;
+// The previous record is dead once the next one is requested, so the input
+// behind it can be released first.
+static int reader_next(RecordReader *r, Record *rec) {
+    cur_release(&r->cur);
+    return r->next(r, rec);
 }
 
-int main(int argc, char **argv) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: data_convert <input.(csv|json|yaml)> <output.(csv|json|yaml)>\n");
+// Key-discovery pass for readers without a header: reads the input once to
+// collect every column, then rewinds so the second pass can stream with a
+// fixed schema instead of holding all rows in a Table. With --infer-types the
+// same pass collects column types, so CSV input gets one too.
+static int prescan_schema(RecordReader *r) {
+    if ((r->fixed_schema && (r->typed || !infer_types)) || !cur_seekable(&r->cur)) return 0;
+
+    if (par_threads > 1 && r->next == ndjson_next && r->cur.map.mapped &&
+        r->cur.len - r->cur.pos >= 2 * par_chunk) {
+        ndjson_prescan_parallel(r);
+        r->fixed_schema = true;
+        r->typed = true;
+        return 0;
+    }
+
+    Record rec = {0};
+    while (reader_next(r, &rec)) {
+        if (infer_types) schema_add_types(&r->schema, &rec);
+    }
+    rec_free(&rec);
+
+    if (cur_rewind(&r->cur) != 0) return 1;
+    r->done = false;
+    r->pending = false;
+    if (r->start(r) != 0) return 1;
+    r->fixed_schema = true;
+    r->typed = true;
+    return 0;
+}
+
+static int reader_close(RecordReader *r) {
+    int rc = cur_close(&r->cur);
+    jx_free(&r->jx);
+    arrow_reader_free(&r->arrow);
+    schema_free(&r->schema);
+    buf_free(&r->scratch);
+    return rc;
+}
+
+static int writer_open(RecordWriter *w, const char *path, const char *ext) {
+    memset(w, 0, sizeof(*w));
+    ob_init(&w->out, -1);
+    w->sep = "";
+
+    if (strcmp(ext, "csv") == 0) {
+        w->begin = csv_write_begin;
+        w->row = csv_write_row;
+        w->end = csv_write_end;
+    } else if (strcmp(ext, "json") == 0) {
+        w->sep = ",\n";
+        w->key = json_write_key;
+        w->begin = json_write_begin;
+        w->row = json_write_row;
+        w->end = json_write_end;
+    } else if (strcmp(ext, "ndjson") == 0) {
+        w->key = ndjson_write_key;
+        w->begin = ndjson_write_begin;
+        w->row = ndjson_write_row;
+        w->end = ndjson_write_end;
+    } else if (strcmp(ext, "yaml") == 0) {
+        w->key = yaml_write_key;
+        w->begin = yaml_write_begin;
+        w->row = yaml_write_row;
+        w->end = yaml_write_end;
+    } else if (strcmp(ext, "arrow") == 0) {
+        w->arrow = (ArrowOut *)calloc(1, sizeof(ArrowOut));
+        if (!w->arrow) die("out of memory");
+        w->begin = arrow_write_begin;
+        w->row = arrow_write_row;
+        w->end = arrow_write_end;
+    } else if (strcmp(ext, "parquet") == 0) {
+        w->parquet = (ParquetOut *)calloc(1, sizeof(ParquetOut));
+        if (!w->parquet) die("out of memory");
+        w->begin = parquet_write_begin;
+        w->row = parquet_write_row;
+        w->end = parquet_write_end;
+    } else {
+        fprintf(stderr, "Error: unsupported output format: %s\n", ext);
+        return 1;
+    }
+
+    if (ob_open(&w->out, path) != 0) return 1;
+    w->path = path;
+    return 0;
+}
+
+static int writer_close(RecordWriter *w) {
+    free(w->keys);
+    w->keys = NULL;
+    ob_free(&w->keybuf);
+    arrow_out_free(w->arrow);
+    w->arrow = NULL;
+    parquet_out_free(w->parquet);
+    w->parquet = NULL;
+    if (!w->path) return 0;
+    int rc = ob_close(&w->out, w->path);
+    w->path = NULL;
+    return rc;
+}
+
+// Collects every record into a Table. Used when the reader cannot tell the
+// full column set up front (JSON/YAML keys may first appear on a late record).
+static void materialize(RecordReader *rd, Table *t) {
+    Record rec = {0};
+    while (reader_next(rd, &rec)) {
+        if (infer_types) schema_add_types(&rd->schema, &rec);
+        for (size_t c = t->ncols; c < rd->schema.ncols; c++) table_add_col(t, rd->schema.headers[c]);
+        size_t row = table_add_row(t);
+        const Span *cells = rec_cells(&rec);
+        for (size_t c = 0; c < rec.ncols; c++) table_set_at(t, row, c, cells[c].ptr, cells[c].len);
+    }
+    rec_free(&rec);
+}
+
+// Reads records on the main thread in blocks that the workers format.
+static void pipeline_blocks(Pipeline *p, RecordReader *rd) {
+    Record rec = {0};
+    Job *job = NULL;
+    while (reader_next(rd, &rec)) {
+        if (!job) job = pipeline_slot(p, JOB_BLOCK);
+        block_add(&job->block, &rec, p->ncols);
+        if (job->block.nrows >= PAR_BLOCK_ROWS || job->block.bytes.len >= PAR_BLOCK_BYTES) {
+            pipeline_submit(p);
+            job = NULL;
+        }
+    }
+    if (job) pipeline_submit(p);
+    rec_free(&rec);
+}
+
+static void pipeline_table(Pipeline *p, const Table *t) {
+    for (size_t r = 0; r < t->nrows; r += PAR_BLOCK_ROWS) {
+        Job *job = pipeline_slot(p, JOB_TABLE);
+        job->row_begin = r;
+        job->row_end = t->nrows - r < PAR_BLOCK_ROWS ? t->nrows : r + PAR_BLOCK_ROWS;
+        pipeline_submit(p);
+    }
+}
+
+static int convert_stream(RecordReader *rd, RecordWriter *wr) {
+    // Without a fixed schema every record is collected first, since a late
+    // record may still add a column (or, with --infer-types, widen a type).
+    bool streaming = rd->fixed_schema && (rd->typed || !infer_types);
+    Table t = {0};
+    if (!streaming) materialize(rd, &t);
+
+    wr->headers = (const char *const *)(streaming ? rd->schema.headers : t.headers);
+    wr->ncols = streaming ? rd->schema.ncols : t.ncols;
+    if (infer_types || rd->native_types) wr->types = rd->schema.types;
+    writer_prepare(wr);
+    wr->begin(wr, &wr->out);
+
+    // The Arrow and Parquet writers' column builders are shared, so they
+    // stay serial.
+    if (par_threads > 1 && !wr->arrow && !wr->parquet) {
+        Pipeline p;
+        pipeline_start(&p, wr, rd, &t);
+        if (streaming) {
+            pipeline_ranges(&p, rd);
+            pipeline_blocks(&p, rd);
+        } else {
+            pipeline_table(&p, &t);
+        }
+        pipeline_finish(&p);
+    } else if (streaming) {
+        Record rec = {0};
+        while (reader_next(rd, &rec)) writer_emit(wr, rec_cells(&rec));
+        rec_free(&rec);
+    } else {
+        Span *cells = (Span *)xmalloc((t.ncols ? t.ncols : 1) * sizeof(Span));
+        for (size_t r = 0; r < t.nrows; r++) writer_emit(wr, table_row(&t, r, cells));
+        free(cells);
+    }
+
+    wr->end(wr, &wr->out);
+    table_free(&t);
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "Usage: data_convert [--no-prescan] [--infer-types] [-j N|--threads N] [--from FMT] [--to FMT] "
+            "<input.(csv|json|ndjson|yaml|arrow)|-> <output.(csv|json|ndjson|yaml|arrow|parquet)|->\n");
+}
+
+// Thread counts come from -j/--threads or DTCONVERT_THREADS; 0 means one per
+// online CPU.
+static bool parse_threads(const char *s, size_t *out) {
+    char *end = NULL;
+    errno = 0;
+    long v = strtol(s, &end, 10);
+    if (errno != 0 || end == s || *end != '\0' || v < 0 || v > 1024) return false;
+    if (v == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        v = n > 0 ? n : 1;
+    }
+    *out = (size_t)v;
+    return true;
+}
+
+// Rows per Arrow record batch (DTCONVERT_ARROW_BATCH_ROWS).
+static void parse_arrow_batch_rows(void) {
+    const char *s = getenv("DTCONVERT_ARROW_BATCH_ROWS");
+    if (!s) return;
+    char *end = NULL;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end != s && *end == '\0' && v >= 1) arrow_batch_rows = (size_t)v;
+}
+
+// Row group size and page codec of the Parquet writer.
+static int parse_parquet_options(void) {
+    const char *s = getenv("DTCONVERT_PARQUET_ROW_GROUP_ROWS");
+    if (s) {
+        char *end = NULL;
+        unsigned long long v = strtoull(s, &end, 10);
+        if (end != s && *end == '\0' && v >= 1) parquet_group_rows = (size_t)v;
+    }
+    s = getenv("DTCONVERT_PARQUET_COMPRESSION");
+    if (s && s[0]) {
+        parquet_codec = pq_codec_from_name(s);
+        if (parquet_codec < 0) {
+            fprintf(stderr, "Error: Unsupported DTCONVERT_PARQUET_COMPRESSION: %s (none, snappy%s)\n", s,
+#ifdef DTCONVERT_HAVE_ZSTD
+                    ", zstd"
+#else
+                    "; zstd needs a build with ZSTD=1"
+#endif
+            );
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Internal knob so small inputs can exercise chunk boundaries.
+static void parse_chunk_size(void) {
+    const char *s = getenv("DTCONVERT_CHUNK_SIZE");
+    if (!s) return;
+    char *end = NULL;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end != s && *end == '\0' && v >= 64) par_chunk = (size_t)v;
+}
+
+// Settings left by an earlier in-process run go back to their defaults.
+static void reset_options(void) {
+    partial_output = NULL;
+    infer_types = false;
+    arrow_batch_rows = ARROW_BATCH_ROWS;
+    parquet_group_rows = PQ_GROUP_ROWS;
+    parquet_codec = PQ_SNAPPY;
+    par_threads = 1;
+    par_chunk = PAR_CHUNK;
+}
+
+// --describe: the pairs this helper converts, for dtconvert's registry.
+static void describe(void) {
+    static const struct {
+        const char *ext;
+        const char *name;
+        bool readable;
+    } formats[] = {
+        {"csv", "CSV", true},
+        {"json", "JSON", true},
+        {"ndjson", "NDJSON", true},
+        {"yaml", "YAML", true},
+        {"arrow", "Arrow IPC", true},
+        {"parquet", "Parquet", false},  // write-only
+    };
+    size_t n = sizeof(formats) / sizeof(formats[0]);
+    printf("dtconvert-describe 1\n");
+    for (size_t i = 0; i < n; i++) {
+        if (!formats[i].readable) continue;
+        for (size_t j = 0; j < n; j++) {
+            if (i == j) continue;
+            printf("%s %s stream=in,out resource=cpu description=%s to %s converter\n", formats[i].ext,
+                   formats[j].ext, formats[i].name, formats[j].name);
+        }
+    }
+}
+
+int data_convert_main(int argc, char **argv) {
+    if (argc == 2 && strcmp(argv[1], "--describe") == 0) {
+        describe();
+        return 0;
+    }
+    const char *in_path = NULL;
+    const char *out_path = NULL;
+    bool prescan = true;
+    // Formats named by --from/--to or DTCONVERT_INPUT_FORMAT/OUTPUT_FORMAT
+    // take precedence over the extensions, which "-" (stdin/stdout) lacks.
+    const char *in_fmt = getenv("DTCONVERT_INPUT_FORMAT");
+    const char *out_fmt = getenv("DTCONVERT_OUTPUT_FORMAT");
+    reset_options();
+
+    const char *env_threads = getenv("DTCONVERT_THREADS");
+    if (env_threads && env_threads[0] && !parse_threads(env_threads, &par_threads)) {
+        fprintf(stderr, "Error: Invalid DTCONVERT_THREADS: %s\n", env_threads);
         return 2;
     }
+    parse_chunk_size();
+    parse_arrow_batch_rows();
+    if (parse_parquet_options() != 0) return 2;
+    infer_types = type_infer_enabled();
+
+    for (int i = 1; i < argc; i++) {
+        const char *threads_arg = NULL;
+        if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--threads") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: Missing count after %s\n", argv[i]);
+                return 2;
+            }
+            threads_arg = argv[++i];
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads_arg = argv[i] + 10;
+        } else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2] != '\0') {
+            threads_arg = argv[i] + 2;
+        }
 
-    const char *in_path = argv[1];
-    const char *out_path = argv[2];
+        if (threads_arg) {
+            if (!parse_threads(threads_arg, &par_threads)) {
+                fprintf(stderr, "Error: Invalid thread count: %s\n", threads_arg);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--prescan") == 0) {
+            prescan = true;
+        } else if (strcmp(argv[i], "--no-prescan") == 0) {
+            prescan = false;
+        } else if (strcmp(argv[i], "--infer-types") == 0) {
+            infer_types = true;
+        } else if (strcmp(argv[i], "--from") == 0 || strcmp(argv[i], "--to") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: Missing format after %s\n", argv[i]);
+                return 2;
+            }
+            if (argv[i][2] == 'f') {
+                in_fmt = argv[++i];
+            } else {
+                out_fmt = argv[++i];
+            }
+        } else if (strncmp(argv[i], "--from=", 7) == 0) {
+            in_fmt = argv[i] + 7;
+        } else if (strncmp(argv[i], "--to=", 5) == 0) {
+            out_fmt = argv[i] + 5;
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            fprintf(stderr, "Error: Unknown argument: %s\n", argv[i]);
+            return 2;
+        } else if (!in_path) {
+            in_path = argv[i];
+        } else if (!out_path) {
+            out_path = argv[i];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (!in_path || !out_path) {
+        usage();
+        return 2;
+    }
 
     char in_ext[MAX_EXT_LEN] = {0};
     char out_ext[MAX_EXT_LEN] = {0};
 
-    snprintf(in_ext, sizeof(in_ext), "%s", path_ext(in_path));
-    snprintf(out_ext, sizeof(out_ext), "%s", path_ext(out_path));
+    if (in_fmt && in_fmt[0]) {
+        snprintf(in_ext, sizeof(in_ext), "%s", in_fmt);
+    } else {
+        path_ext(in_path, in_ext, sizeof(in_ext));
+    }
+    if (out_fmt && out_fmt[0]) {
+        snprintf(out_ext, sizeof(out_ext), "%s", out_fmt);
+    } else {
+        path_ext(out_path, out_ext, sizeof(out_ext));
+    }
     lower_ascii(in_ext);
     lower_ascii(out_ext);
 
     if (strcmp(in_ext, "yml") == 0) snprintf(in_ext, sizeof(in_ext), "%s", "yaml");
     if (strcmp(out_ext, "yml") == 0) snprintf(out_ext, sizeof(out_ext), "%s", "yaml");
-
-    Table t = {0};
-    if (read_table(in_path, in_ext, &t) != 0) {
-        table_free(&t);
+    if (strcmp(in_ext, "jsonl") == 0) snprintf(in_ext, sizeof(in_ext), "%s", "ndjson");
+    if (strcmp(out_ext, "jsonl") == 0) snprintf(out_ext, sizeof(out_ext), "%s", "ndjson");
+    if (strcmp(in_ext, "arrows") == 0) snprintf(in_ext, sizeof(in_ext), "%s", "arrow");
+    if (strcmp(out_ext, "arrows") == 0) snprintf(out_ext, sizeof(out_ext), "%s", "arrow");
+
+    RecordReader rd;
+    if (reader_open(&rd, in_path, in_ext) != 0) {
+        reader_close(&rd);
         return 1;
     }
 
-    if (write_table(out_path, out_ext, &t) != 0) {
-        table_free(&t);
+    RecordWriter wr;
+    if (writer_open(&wr, out_path, out_ext) != 0) {
+        reader_close(&rd);
         return 1;
     }
+    // Nothing to clean up after a failure on stdout.
+    partial_output = strcmp(out_path, "-") != 0 ? out_path : NULL;
 
-    table_free(&t);
-    return 0;
+    int rc = 0;
+    if (prescan && prescan_schema(&rd) != 0) {
+        fprintf(stderr, "Error: cannot rewind '%s' for key discovery\n", in_path);
+        rc = 1;
+    }
+    if (rc == 0) rc = convert_stream(&rd, &wr);
+    if (writer_close(&wr) != 0) rc = 1;
+    if (reader_close(&rd) != 0) rc = 1;
+
+    if (rc != 0 && partial_output) unlink(out_path);
+    partial_output = NULL;
+    return rc;
+}
+
+#ifndef DTCONVERT_NO_MAIN
+int main(int argc, char **argv) {
+    return data_convert_main(argc, argv);
 }
+#endif
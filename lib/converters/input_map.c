@@ -0,0 +1,146 @@
+#include "input_map.h"
+
+#include "compress_io.h"
+#include "libdtconvert.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Consumed input is handed back to the kernel in steps of this size.
+#define RELEASE_STEP ((size_t)4 * 1024 * 1024)
+
+#define READ_CHUNK (64 * 1024)
+
+static bool mmap_disabled(void) {
+    const char *v = getenv("DTCONVERT_MMAP");
+    return v && strcmp(v, "0") == 0;
+}
+
+int input_map_fd(InputMap *m, int fd) {
+    memset(m, 0, sizeof(*m));
+    if (mmap_disabled()) return 1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) return -1;
+    if (!S_ISREG(st.st_mode) || st.st_size <= 0) return 1;
+
+    size_t size = (size_t)st.st_size;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t total = (size + 1 + page - 1) / page * page;
+
+    // Reserve one byte past the file so data[len] is a readable '\0' even when
+    // the size is a multiple of the page size, then map the file over it.
+    char *base = (char *)mmap(NULL, total, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) return -1;
+    if (mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        int saved = errno;
+        munmap(base, total);
+        errno = saved;
+        return -1;
+    }
+
+    // Hints only; failures are harmless.
+    (void)madvise(base, size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    (void)madvise(base, size, MADV_HUGEPAGE);
+#endif
+
+    m->data = base;
+    m->len = size;
+    m->mapped = true;
+    m->map_len = total;
+    helper_hold_map(base, total);
+    return 0;
+}
+
+static int read_fd(InputMap *m, int fd) {
+    size_t cap = READ_CHUNK;
+    size_t len = 0;
+    char *buf = (char *)malloc(cap);
+    if (!buf) return -1;
+
+    while (true) {
+        if (cap - len < 2) {
+            char *nb = (char *)realloc(buf, cap * 2);
+            if (!nb) {
+                free(buf);
+                errno = ENOMEM;
+                return -1;
+            }
+            buf = nb;
+            cap *= 2;
+        }
+        ssize_t n = read(fd, buf + len, cap - len - 1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            int saved = errno;
+            free(buf);
+            errno = saved;
+            return -1;
+        }
+        if (n == 0) break;
+        len += (size_t)n;
+    }
+
+    buf[len] = '\0';
+    m->data = buf;
+    m->len = len;
+    m->mapped = false;
+    helper_hold_map(buf, 0);
+    return 0;
+}
+
+int input_map_open(InputMap *m, const char *path) {
+    memset(m, 0, sizeof(*m));
+    int fd;
+    CompressStream *z;
+    if (compress_open_read(path, &fd, &z) != 0) return 1;
+
+    int rc = z ? 1 : input_map_fd(m, fd);
+    if (rc == 1) rc = read_fd(m, fd);
+    if (rc != 0) fprintf(stderr, "Error: cannot read '%s': %s\n", path, strerror(errno));
+    helper_drop_fd(fd);
+    close(fd);
+    if (compress_finish(z, path) != 0) rc = 1;
+    if (rc != 0) {
+        input_map_close(m);
+        return 1;
+    }
+    return 0;
+}
+
+void input_map_release(InputMap *m, size_t upto) {
+    if (!m->mapped) return;
+    if (upto > m->len) upto = m->len;
+    if (upto < m->released + RELEASE_STEP) return;
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t end = upto / page * page;
+    (void)madvise((void *)(m->data + m->released), end - m->released, MADV_DONTNEED);
+    m->released = end;
+}
+
+void input_map_drop(const InputMap *m, size_t off, size_t len) {
+    if (!m->mapped || off >= m->len) return;
+    if (len > m->len - off) len = m->len - off;
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = (off + page - 1) / page * page;
+    size_t end = (off + len) / page * page;
+    if (end > start) (void)madvise((void *)(m->data + start), end - start, MADV_DONTNEED);
+}
+
+void input_map_close(InputMap *m) {
+    helper_drop_map(m->data);
+    if (m->mapped) {
+        munmap((void *)m->data, m->map_len);
+    } else {
+        free((void *)m->data);
+    }
+    memset(m, 0, sizeof(*m));
+}
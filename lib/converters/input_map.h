@@ -0,0 +1,50 @@
+#ifndef DTCONVERT_INPUT_MAP_H
+#define DTCONVERT_INPUT_MAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Whole-file input for the converter helpers.
+//
+// Regular files are mapped read-only (MADV_SEQUENTIAL, plus MADV_HUGEPAGE
+// where the kernel supports it) so parsers can slice fields straight out of
+// the page cache. Pipes and other non-regular files fall back to read() into
+// a heap buffer. Either way data[len] is '\0', so callers that scan for a
+// terminating NUL keep working. DTCONVERT_MMAP=0 forces the read() path.
+// input_map_open() decompresses gzip/zstd files on the way (see
+// compress_io.h); those always take the read() path.
+//
+// The mapping is only valid while the file keeps its size; truncating the
+// input during a conversion raises SIGBUS, as with any mmap reader.
+
+typedef struct {
+    const char *data;
+    size_t len;
+    bool mapped;
+    size_t map_len;
+    // Prefix already dropped by input_map_release(); reset to 0 before
+    // reading the input again from the start.
+    size_t released;
+} InputMap;
+
+// Loads the whole of path. Prints an error and returns 1 on failure.
+int input_map_open(InputMap *m, const char *path);
+
+// Maps fd if it refers to a non-empty regular file. Returns 0 when mapped,
+// 1 when the caller should stream the descriptor itself, -1 on error (errno
+// set). fd is not closed.
+int input_map_fd(InputMap *m, int fd);
+
+// Tells the kernel the first upto bytes will not be read again, so resident
+// memory stays bounded on multi-GB inputs. Cheap to call per record: pages
+// are only dropped once enough input has been consumed. Dropped pages are
+// re-read from the file if touched again.
+void input_map_release(InputMap *m, size_t upto);
+
+// Drops the pages that lie entirely inside [off, off + len), for readers that
+// visit the input out of order. Safe to call from several threads at once.
+void input_map_drop(const InputMap *m, size_t off, size_t len);
+
+void input_map_close(InputMap *m);
+
+#endif // DTCONVERT_INPUT_MAP_H
@@ -0,0 +1,222 @@
+#include "json_scan.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "csv_scan.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define JSON_SCAN_X86 1
+#endif
+
+// ---------------- Block classification ----------------
+
+// One bit per byte of a 64-byte block.
+typedef struct {
+    uint64_t backslash;
+    uint64_t quote;
+    uint64_t space;
+    // '{', '}', '[', ']', ':' and ','
+    uint64_t op;
+} JsonMasks;
+
+static JsonMasks classify_scalar(const char *p) {
+    JsonMasks m = {0, 0, 0, 0};
+    for (int i = 0; i < 64; i++) {
+        uint64_t bit = (uint64_t)1 << i;
+        switch (p[i]) {
+            case '\\': m.backslash |= bit; break;
+            case '"': m.quote |= bit; break;
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r': m.space |= bit; break;
+            case '{':
+            case '}':
+            case '[':
+            case ']':
+            case ':':
+            case ',': m.op |= bit; break;
+            default: break;
+        }
+    }
+    return m;
+}
+
+#ifdef JSON_SCAN_X86
+// '[' and ']' differ from '{' and '}' only in bit 0x20, so two compares on
+// (v | 0x20) cover all four brackets.
+static JsonMasks classify_sse2(const char *p) {
+    const __m128i bslash = _mm_set1_epi8('\\');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i lbrace = _mm_set1_epi8('{');
+    const __m128i rbrace = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+
+    JsonMasks m = {0, 0, 0, 0};
+    for (int i = 0; i < 64; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i folded = _mm_or_si128(v, case_bit);
+        __m128i space = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+        __m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(folded, lbrace), _mm_cmpeq_epi8(folded, rbrace)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)));
+        m.backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, bslash)) << i;
+        m.quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << i;
+        m.space |= (uint64_t)(uint16_t)_mm_movemask_epi8(space) << i;
+        m.op |= (uint64_t)(uint16_t)_mm_movemask_epi8(op) << i;
+    }
+    return m;
+}
+
+__attribute__((target("avx2"))) static JsonMasks classify_avx2(const char *p) {
+    const __m256i bslash = _mm256_set1_epi8('\\');
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i lbrace = _mm256_set1_epi8('{');
+    const __m256i rbrace = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+
+    JsonMasks m = {0, 0, 0, 0};
+    for (int i = 0; i < 64; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i folded = _mm256_or_si256(v, case_bit);
+        __m256i space = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)),
+                                        _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)));
+        __m256i op =
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(folded, lbrace), _mm256_cmpeq_epi8(folded, rbrace)),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, comma)));
+        m.backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, bslash)) << i;
+        m.quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << i;
+        m.space |= (uint64_t)(uint32_t)_mm256_movemask_epi8(space) << i;
+        m.op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << i;
+    }
+    return m;
+}
+#endif
+
+// ---------------- Structural bits ----------------
+
+// Bit i of the result is the XOR of bits 0..i of x: set inside a string when
+// x holds the quotes (opening quote included, closing quote excluded).
+static inline uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// Bytes that follow an odd-length run of backslashes, i.e. escaped ones.
+// A run that starts on an even bit and ends on an odd one (or the reverse) has
+// odd length; adding the run starts to the runs carries out to the byte just
+// past each run, which is then kept only where the parity matches.
+static inline uint64_t escaped_bytes(JsonScanState *st, uint64_t backslash) {
+    const uint64_t even = 0x5555555555555555ULL;
+    const uint64_t odd = ~even;
+
+    uint64_t starts = backslash & ~(backslash << 1);
+    // A run carried in from the previous block flips the parity of bit 0.
+    uint64_t even_start_mask = even ^ st->escaped;
+    uint64_t even_starts = starts & even_start_mask;
+    uint64_t odd_starts = starts & ~even_start_mask;
+
+    uint64_t even_carries = backslash + even_starts;
+    uint64_t odd_carries;
+    bool ends_odd = __builtin_add_overflow(backslash, odd_starts, &odd_carries);
+    odd_carries |= st->escaped;
+    st->escaped = ends_odd ? 1 : 0;
+
+    uint64_t even_ends = even_carries & ~backslash;
+    uint64_t odd_ends = odd_carries & ~backslash;
+    return (even_ends & odd) | (odd_ends & even);
+}
+
+static inline size_t index_block(JsonScanState *st, JsonMasks m, size_t base, size_t *out) {
+    uint64_t quote = m.quote & ~escaped_bytes(st, m.backslash);
+    uint64_t in_string = prefix_xor(quote) ^ st->in_string;
+    st->in_string = (uint64_t)((int64_t)in_string >> 63);
+
+    uint64_t scalar = ~(in_string | quote | m.space | m.op);
+    uint64_t scalar_starts = scalar & ~((scalar << 1) | st->scalar);
+    st->scalar = scalar >> 63;
+
+    uint64_t bits = (m.op & ~in_string) | quote | scalar_starts;
+    size_t n = 0;
+    while (bits) {
+        out[n++] = base + (size_t)__builtin_ctzll(bits);
+        bits &= bits - 1;
+    }
+    return n;
+}
+
+// ---------------- Dispatch ----------------
+
+static size_t index_scalar(JsonScanState *st, const char *p, size_t n, size_t base, size_t *out) {
+    size_t k = 0;
+    for (size_t i = 0; i < n; i += 64) k += index_block(st, classify_scalar(p + i), base + i, out + k);
+    return k;
+}
+
+#ifdef JSON_SCAN_X86
+static size_t index_sse2(JsonScanState *st, const char *p, size_t n, size_t base, size_t *out) {
+    size_t k = 0;
+    for (size_t i = 0; i < n; i += 64) k += index_block(st, classify_sse2(p + i), base + i, out + k);
+    return k;
+}
+
+__attribute__((target("avx2"))) static size_t index_avx2(JsonScanState *st, const char *p, size_t n, size_t base,
+                                                         size_t *out) {
+    size_t k = 0;
+    for (size_t i = 0; i < n; i += 64) k += index_block(st, classify_avx2(p + i), base + i, out + k);
+    return k;
+}
+#endif
+
+typedef size_t (*IndexFn)(JsonScanState *st, const char *p, size_t n, size_t base, size_t *out);
+
+static IndexFn index_fn = NULL;
+
+static IndexFn index_get(void) {
+    IndexFn fn = __atomic_load_n(&index_fn, __ATOMIC_ACQUIRE);
+    if (fn) return fn;
+
+    // Follow whatever variant the CSV scanner picked.
+    const char *impl = csv_scan_impl();
+    fn = index_scalar;
+#ifdef JSON_SCAN_X86
+    if (strcmp(impl, "avx2") == 0) fn = index_avx2;
+    if (strcmp(impl, "sse2") == 0) fn = index_sse2;
+#else
+    (void)impl;
+#endif
+    __atomic_store_n(&index_fn, fn, __ATOMIC_RELEASE);
+    return fn;
+}
+
+size_t json_scan_index(JsonScanState *st, const char *p, size_t n, size_t base, size_t *out) {
+    size_t whole = n / 64 * 64;
+    size_t k = whole ? index_get()(st, p, whole, base, out) : 0;
+    if (whole < n) {
+        // Pad the tail with spaces, which never produce an entry.
+        char tail[64];
+        memset(tail, ' ', sizeof(tail));
+        memcpy(tail, p + whole, n - whole);
+        k += index_block(st, classify_scalar(tail), base + whole, out + k);
+    }
+    return k;
+}
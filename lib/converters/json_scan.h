@@ -0,0 +1,35 @@
+#ifndef DTCONVERT_JSON_SCAN_H
+#define DTCONVERT_JSON_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Stage one of data_convert's JSON reader, after simdjson: a structural index.
+//
+// Input is classified 64 bytes at a time (SSE2/AVX2, or scalar; the variant
+// follows csv_scan_impl() and DTCONVERT_SIMD). Escaped quotes and string
+// bodies are masked out with carry-less bit tricks, so the parser only ever
+// looks at the offsets this returns:
+//
+// - '{', '}', '[', ']', ':' and ',' outside strings;
+// - every unescaped '"' (opening and closing);
+// - the first byte of each bare scalar (number, true, false, null).
+//
+// Whitespace never produces an entry.
+
+// Carried from one call to the next so the input can be indexed in pieces.
+typedef struct {
+    // Bit 0: the first byte of the next piece is escaped by a backslash.
+    uint64_t escaped;
+    // All ones while a string is open.
+    uint64_t in_string;
+    // Bit 0: the previous piece ended inside a bare scalar.
+    uint64_t scalar;
+} JsonScanState;
+
+// Appends the offsets (base + i) of the structural bytes of p[0..n) to out,
+// which needs room for n entries, and returns how many were written. n must
+// be a multiple of 64 except on the last call for an input. st starts zeroed.
+size_t json_scan_index(JsonScanState *st, const char *p, size_t n, size_t base, size_t *out);
+
+#endif // DTCONVERT_JSON_SCAN_H
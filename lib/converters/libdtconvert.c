@@ -0,0 +1,202 @@
+#include "libdtconvert.h"
+
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// State of the helper_run() call on this thread, if any.
+static __thread jmp_buf *unwind_to = NULL;
+static __thread int unwind_code = 0;
+// Worker sets this thread has running, innermost first.
+static __thread HelperThreads *threads = NULL;
+// Set while helper_exit() joins them; the status of the first failed worker.
+static __thread bool unwinding = false;
+static __thread int worker_code = 0;
+// On a worker thread, the set it belongs to.
+static __thread HelperThreads *worker_of = NULL;
+
+// ---------------- Worker threads ----------------
+
+void helper_threads_started(HelperThreads *t) {
+    t->code = 0;
+    t->in_process = unwind_to != NULL;
+    t->outer = threads;
+    threads = t;
+}
+
+void helper_thread_attach(HelperThreads *t) {
+    worker_of = t;
+}
+
+void helper_threads_stopped(HelperThreads *t) {
+    threads = t->outer;
+    int code = __atomic_load_n(&t->code, __ATOMIC_ACQUIRE);
+    if (code == 0) return;
+    if (!unwinding) helper_exit(code);
+    if (worker_code == 0) worker_code = code;
+}
+
+// A worker only records its status and leaves the rest to the helper's
+// thread, which owns the stack the workers point into.
+static _Noreturn void worker_exit(HelperThreads *t, int code) {
+    int none = 0;
+    __atomic_compare_exchange_n(&t->code, &none, code != 0 ? code : 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    if (t->stop) t->stop(t->ctx);
+    pthread_exit(NULL);
+}
+
+// ---------------- Held resources ----------------
+
+typedef enum { HELD_FD, HELD_FILE, HELD_MAP, HELD_HEAP, HELD_STREAM } HeldKind;
+
+typedef struct {
+    HeldKind kind;
+    int fd;
+    void *p;
+    size_t len;
+    // Path named by compress_finish() errors, for HELD_STREAM.
+    char *path;
+} Held;
+
+// Everything held on this thread, oldest first; each helper_run() owns the
+// entries from its starting count up.
+static __thread Held *held = NULL;
+static __thread size_t held_n = 0, held_cap = 0;
+
+static void hold(Held h) {
+    if (!unwind_to) return;
+    if (held_n == held_cap) {
+        size_t cap = held_cap ? held_cap * 2 : 16;
+        Held *nh = (Held *)realloc(held, cap * sizeof(*nh));
+        // Untracked, it is only leaked if the helper fails.
+        if (!nh) {
+            free(h.path);
+            return;
+        }
+        held = nh;
+        held_cap = cap;
+    }
+    held[held_n++] = h;
+}
+
+static void drop(HeldKind kind, int fd, const void *p) {
+    for (size_t i = held_n; i-- > 0;) {
+        Held *h = &held[i];
+        if (h->kind != kind || (kind == HELD_FD ? h->fd != fd : h->p != p)) continue;
+        free(h->path);
+        memmove(h, h + 1, (held_n - i - 1) * sizeof(*h));
+        held_n--;
+        return;
+    }
+}
+
+// Releases entries down to from, newest first, so a descriptor is closed
+// before the (de)compressor behind it is waited for.
+static void release_held(size_t from) {
+    while (held_n > from) {
+        Held h = held[--held_n];
+        switch (h.kind) {
+            case HELD_FD:
+                close(h.fd);
+                break;
+            case HELD_FILE:
+                fclose((FILE *)h.p);
+                break;
+            case HELD_MAP:
+                munmap(h.p, h.len);
+                break;
+            case HELD_HEAP:
+                free(h.p);
+                break;
+            case HELD_STREAM:
+                compress_finish((CompressStream *)h.p, h.path ? h.path : "input");
+                break;
+        }
+        free(h.path);
+    }
+}
+
+void helper_hold_fd(int fd) {
+    if (fd >= 0) hold((Held){.kind = HELD_FD, .fd = fd});
+}
+
+void helper_drop_fd(int fd) {
+    if (fd >= 0) drop(HELD_FD, fd, NULL);
+}
+
+void helper_hold_file(FILE *f) {
+    if (f) hold((Held){.kind = HELD_FILE, .p = f});
+}
+
+void helper_drop_file(FILE *f) {
+    if (f) drop(HELD_FILE, -1, f);
+}
+
+void helper_hold_map(const void *p, size_t len) {
+    if (p) hold((Held){.kind = len ? HELD_MAP : HELD_HEAP, .p = (void *)p, .len = len});
+}
+
+void helper_drop_map(const void *p) {
+    if (!p) return;
+    drop(HELD_MAP, -1, p);
+    drop(HELD_HEAP, -1, p);
+}
+
+void helper_hold_stream(CompressStream *s, const char *path) {
+    if (s) hold((Held){.kind = HELD_STREAM, .p = s, .path = unwind_to ? strdup(path) : NULL});
+}
+
+void helper_drop_stream(CompressStream *s) {
+    if (s) drop(HELD_STREAM, -1, s);
+}
+
+// ---------------- Running helpers ----------------
+
+_Noreturn void helper_exit(int code) {
+    if (worker_of && worker_of->in_process) worker_exit(worker_of, code);
+    if (unwind_to) {
+        // Workers still running would be left pointing into the frames
+        // longjmp() discards.
+        unwinding = true;
+        while (threads) {
+            HelperThreads *t = threads;
+            if (t->stop) t->stop(t->ctx);
+            t->join(t->ctx);
+        }
+        unwinding = false;
+        // Report the worker's error rather than a failure it caused here.
+        unwind_code = worker_code != 0 ? worker_code : code != 0 ? code : 1;
+        worker_code = 0;
+        longjmp(*unwind_to, 1);
+    }
+    exit(code);
+}
+
+int helper_run(HelperMain entry, int argc, char **argv) {
+    jmp_buf env;
+    jmp_buf *saved = unwind_to;
+    volatile size_t mark = held_n;
+    int rc;
+    if (setjmp(env) == 0) {
+        unwind_to = &env;
+        rc = entry(argc, argv);
+    } else {
+        rc = unwind_code;
+        // Outside the jump target, so helpers that end here find nothing held.
+        unwind_to = saved;
+        release_held(mark);
+    }
+    unwind_to = saved;
+    // Anything a helper that returned normally left behind is its own leak.
+    while (held_n > mark) free(held[--held_n].path);
+    if (held_n == 0) {
+        free(held);
+        held = NULL;
+        held_cap = 0;
+    }
+    return rc;
+}
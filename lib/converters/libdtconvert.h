@@ -0,0 +1,78 @@
+#ifndef DTCONVERT_LIBDTCONVERT_H
+#define DTCONVERT_LIBDTCONVERT_H
+
+// Entry points of the built-in converters, collected in libdtconvert.a.
+//
+// Each helper program (data_convert, sql_convert, tokenize, pg_store) is its
+// *_main() plus a main() that calls it; the library is the same sources built
+// with -DDTCONVERT_NO_MAIN. dtconvert links it and runs these conversions in
+// its own process instead of exec'ing the helper through a module script.
+//
+// The helpers end on fatal errors through helper_exit(). Inside helper_run()
+// that unwinds back to the caller, which gets the exit code, also when the
+// error happens on one of the helper's worker threads; in the standalone
+// programs it ends the process as before. The files, descriptors, mappings
+// and (de)compressors the failed conversion held are released on the way
+// (see helper_hold_fd() below), so long-lived callers such as --batch and
+// --watch workers do not run out of descriptors. Other heap memory is not
+// reclaimed: a failure costs a leak, never the caller's process.
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "compress_io.h"
+
+typedef int (*HelperMain)(int argc, char **argv);
+
+int data_convert_main(int argc, char **argv);
+int sql_convert_main(int argc, char **argv);
+int tokenize_main(int argc, char **argv);
+int pg_store_main(int argc, char **argv);
+
+// Runs entry(argc, argv) and returns its exit status, including when it
+// fails through helper_exit(). argv strings must be writable.
+int helper_run(HelperMain entry, int argc, char **argv);
+
+// Ends the running helper with status code (see above).
+_Noreturn void helper_exit(int code);
+
+// What the running helper holds, for helper_exit() to release. Whoever opens
+// a resource holds it, and drops it right before releasing it normally. A
+// mapping with len 0 is a malloc()ed buffer. Streams are released with
+// compress_finish(s, path). These do nothing outside helper_run() or on
+// another thread than the one running the helper.
+void helper_hold_fd(int fd);
+void helper_drop_fd(int fd);
+void helper_hold_file(FILE *f);
+void helper_drop_file(FILE *f);
+void helper_hold_map(const void *p, size_t len);
+void helper_drop_map(const void *p);
+void helper_hold_stream(CompressStream *s, const char *path);
+void helper_drop_stream(CompressStream *s);
+
+// Worker threads. A helper that starts threads using the calling thread's
+// stack registers them with helper_threads_started(), with callbacks that
+// stop the workers (wake every wait so they return) and join them; join
+// ends with helper_threads_stopped(), which fails the helper if a worker
+// did. Each worker calls helper_thread_attach() first. In between:
+// - helper_exit() on a worker records its status, calls stop and ends only
+//   that thread. stop also wakes the helper's thread where it waits for the
+//   workers, which then calls helper_exit() itself.
+// - helper_exit() on the helper's thread stops and joins the workers before
+//   unwinding, and reports a failed worker's status over its own.
+// In the standalone programs helper_exit() still ends the process at once.
+typedef struct HelperThreads {
+    void (*stop)(void *ctx);  // may be NULL
+    void (*join)(void *ctx);
+    void *ctx;
+    // Private to libdtconvert.c.
+    int code;
+    int in_process;
+    struct HelperThreads *outer;
+} HelperThreads;
+
+void helper_threads_started(HelperThreads *t);
+void helper_thread_attach(HelperThreads *t);
+void helper_threads_stopped(HelperThreads *t);
+
+#endif // DTCONVERT_LIBDTCONVERT_H
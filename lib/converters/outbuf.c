@@ -0,0 +1,285 @@
+#include "outbuf.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "csv_scan.h"
+#include "libdtconvert.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define OUTBUF_X86 1
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024  // glibc only defines it under _XOPEN_SOURCE
+#endif
+
+// ---------------- JSON special-byte scan ----------------
+
+// Index of the first '"', '\\' or control byte (< 0x20) in p[0..n), or n.
+static size_t json_special_scalar(const char *p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        unsigned char ch = (unsigned char)p[i];
+        if (ch == '"' || ch == '\\' || ch < 0x20) return i;
+    }
+    return n;
+}
+
+#ifdef OUTBUF_X86
+static size_t json_special_sse2(const char *p, size_t n) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    const __m128i ctl = _mm_set1_epi8(0x1f);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        // v <= 0x1f (unsigned) exactly when max(v, 0x1f) == 0x1f
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)),
+                                 _mm_cmpeq_epi8(_mm_max_epu8(v, ctl), ctl));
+        unsigned int bits = (unsigned int)_mm_movemask_epi8(m);
+        if (bits) return i + (size_t)__builtin_ctz(bits);
+    }
+    return i + json_special_scalar(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) static size_t json_special_avx2(const char *p, size_t n) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i bslash = _mm256_set1_epi8('\\');
+    const __m256i ctl = _mm256_set1_epi8(0x1f);
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, bslash)),
+                                    _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctl), ctl));
+        unsigned int bits = (unsigned int)_mm256_movemask_epi8(m);
+        if (bits) return i + (size_t)__builtin_ctz(bits);
+    }
+    // VEX-encoded 16-byte step rather than json_special_sse2(); see scan_avx2()
+    // in csv_scan.c.
+    if (i + 16 <= n) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i q = _mm256_castsi256_si128(quote), bs = _mm256_castsi256_si128(bslash);
+        __m128i c = _mm256_castsi256_si128(ctl);
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, q), _mm_cmpeq_epi8(v, bs)),
+                                 _mm_cmpeq_epi8(_mm_max_epu8(v, c), c));
+        unsigned int bits = (unsigned int)_mm_movemask_epi8(m);
+        if (bits) return i + (size_t)__builtin_ctz(bits);
+        i += 16;
+    }
+    return i + json_special_scalar(p + i, n - i);
+}
+#endif
+
+typedef size_t (*SpecialFn)(const char *p, size_t n);
+
+static SpecialFn special_fn = NULL;
+
+static SpecialFn special_get(void) {
+    SpecialFn fn = __atomic_load_n(&special_fn, __ATOMIC_ACQUIRE);
+    if (fn) return fn;
+
+    // Follow whatever variant the CSV scanner picked.
+    const char *impl = csv_scan_impl();
+    fn = json_special_scalar;
+#ifdef OUTBUF_X86
+    if (strcmp(impl, "avx2") == 0) fn = json_special_avx2;
+    if (strcmp(impl, "sse2") == 0) fn = json_special_sse2;
+#else
+    (void)impl;
+#endif
+    __atomic_store_n(&special_fn, fn, __ATOMIC_RELEASE);
+    return fn;
+}
+
+// ---------------- Buffer ----------------
+
+void ob_init(OutBuf *b, int fd) {
+    memset(b, 0, sizeof(*b));
+    b->fd = fd;
+}
+
+int ob_open(OutBuf *b, const char *path) {
+    ob_init(b, -1);
+    return compress_open_write(path, &b->fd, &b->z);
+}
+
+static void write_all(OutBuf *b, const char *s, size_t n) {
+    while (n > 0 && b->err == 0) {
+        ssize_t w = write(b->fd, s, n);
+        if (w < 0) {
+            if (errno != EINTR) b->err = errno;
+            continue;
+        }
+        s += w;
+        n -= (size_t)w;
+    }
+}
+
+void ob_flush(OutBuf *b) {
+    if (b->fd < 0) return;
+    write_all(b, b->data, b->len);
+    b->len = 0;
+}
+
+void ob_writev(OutBuf *b, struct iovec *iov, int n) {
+    ob_flush(b);
+    while (n > 0 && b->err == 0) {
+        ssize_t done = writev(b->fd, iov, n < IOV_MAX ? n : IOV_MAX);
+        if (done < 0) {
+            if (errno != EINTR) b->err = errno;
+            continue;
+        }
+        while (n > 0 && (size_t)done >= iov->iov_len) {
+            done -= (ssize_t)iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + done;
+            iov->iov_len -= (size_t)done;
+        }
+    }
+}
+
+void ob_put_slow(OutBuf *b, const char *s, size_t n) {
+    if (b->err) return;
+
+    if (b->fd >= 0) {
+        ob_flush(b);
+        if (n >= OB_BLOCK) {
+            write_all(b, s, n);
+            return;
+        }
+        if (!b->data) {
+            b->data = (char *)malloc(OB_BLOCK);
+            if (!b->data) {
+                b->err = ENOMEM;
+                return;
+            }
+            b->cap = OB_BLOCK;
+        }
+    } else {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap - b->len < n) cap *= 2;
+        char *data = (char *)realloc(b->data, cap);
+        if (!data) {
+            b->err = ENOMEM;
+            return;
+        }
+        b->data = data;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+}
+
+int ob_close(OutBuf *b, const char *path) {
+    if (b->fd >= 0) {
+        ob_flush(b);
+        helper_drop_fd(b->fd);
+        if (close(b->fd) != 0 && b->err == 0) b->err = errno;
+        b->fd = -1;
+    }
+    int err = b->err;
+    ob_free(b);
+    int rc = compress_finish(b->z, path);
+    b->z = NULL;
+    if (err != 0) {
+        fprintf(stderr, "Error: cannot write '%s': %s\n", path, strerror(err));
+        return 1;
+    }
+    return rc;
+}
+
+void ob_free(OutBuf *b) {
+    free(b->data);
+    b->data = NULL;
+    b->len = 0;
+    b->cap = 0;
+}
+
+// ---------------- Escapers ----------------
+
+void ob_quoted(OutBuf *b, const char *s, size_t n, char quote) {
+    ob_putc(b, quote);
+    const char *end = s + n;
+    while (s < end) {
+        const char *q = (const char *)memchr(s, quote, (size_t)(end - s));
+        if (!q) {
+            ob_put(b, s, (size_t)(end - s));
+            break;
+        }
+        // copy through the quote, then double it
+        ob_put(b, s, (size_t)(q - s) + 1);
+        ob_putc(b, quote);
+        s = q + 1;
+    }
+    ob_putc(b, quote);
+}
+
+void ob_csv_field(OutBuf *b, const char *s, size_t n) {
+    if (csv_scan_special(s, n) == n) {
+        ob_put(b, s, n);
+    } else {
+        ob_quoted(b, s, n, '"');
+    }
+}
+
+void ob_json_string(OutBuf *b, const char *s, size_t n) {
+    SpecialFn special = special_get();
+    ob_putc(b, '"');
+    size_t i = 0;
+    while (i < n) {
+        size_t run = special(s + i, n - i);
+        ob_put(b, s + i, run);
+        i += run;
+        if (i >= n) break;
+
+        unsigned char ch = (unsigned char)s[i++];
+        switch (ch) {
+            case '"': ob_put(b, "\\\"", 2); break;
+            case '\\': ob_put(b, "\\\\", 2); break;
+            case '\b': ob_put(b, "\\b", 2); break;
+            case '\f': ob_put(b, "\\f", 2); break;
+            case '\n': ob_put(b, "\\n", 2); break;
+            case '\r': ob_put(b, "\\r", 2); break;
+            case '\t': ob_put(b, "\\t", 2); break;
+            default: {
+                static const char hex[] = "0123456789abcdef";
+                char esc[6] = {'\\', 'u', '0', '0', hex[ch >> 4], hex[ch & 15]};
+                ob_put(b, esc, sizeof(esc));
+            }
+        }
+    }
+    ob_putc(b, '"');
+}
+
+void ob_yaml_string(OutBuf *b, const char *s, size_t n) {
+    SpecialFn special = special_get();
+    ob_putc(b, '"');
+    size_t i = 0;
+    while (i < n) {
+        size_t run = special(s + i, n - i);
+        ob_put(b, s + i, run);
+        i += run;
+        if (i >= n) break;
+
+        char ch = s[i++];
+        switch (ch) {
+            case '"': ob_put(b, "\\\"", 2); break;
+            case '\\': ob_put(b, "\\\\", 2); break;
+            case '\n': ob_put(b, "\\n", 2); break;
+            case '\r': ob_put(b, "\\r", 2); break;
+            case '\t': ob_put(b, "\\t", 2); break;
+            // other control bytes pass through unescaped
+            default: ob_putc(b, ch); break;
+        }
+    }
+    ob_putc(b, '"');
+}
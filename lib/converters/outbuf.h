@@ -0,0 +1,92 @@
+#ifndef DTCONVERT_OUTBUF_H
+#define DTCONVERT_OUTBUF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "compress_io.h"
+
+// Output buffer shared by the converter helpers.
+//
+// Bytes are appended to a block that goes to fd with one write() when it
+// fills (OB_BLOCK bytes), instead of a stdio call per character. A buffer
+// with fd == -1 only accumulates in memory, e.g. for a worker thread
+// formatting rows that another thread writes.
+//
+// Errors are sticky: the first failed write or allocation is kept in err and
+// everything after it is dropped, so callers check once, at ob_close().
+//
+// ob_open() on a .gz/.zst path writes through a compressor (see
+// compress_io.h); ob_close() waits for it to finish.
+//
+// The escapers copy runs of bytes that need no escaping with a single memcpy;
+// the runs are found with SSE2/AVX2 (see csv_scan.h for DTCONVERT_SIMD).
+
+#define OB_BLOCK ((size_t)256 * 1024)
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int fd;
+    int err;
+    // Compressor behind fd, for ob_open() paths ending in .gz/.zst.
+    CompressStream *z;
+} OutBuf;
+
+void ob_init(OutBuf *b, int fd);
+
+// Creates/truncates path for writing. Prints an error and returns 1 on failure.
+int ob_open(OutBuf *b, const char *path);
+
+// Flushes and closes the file. Prints an error naming path and returns 1 if
+// any write failed.
+int ob_close(OutBuf *b, const char *path);
+
+void ob_free(OutBuf *b);
+
+void ob_flush(OutBuf *b);
+
+// Flushes b, then writes the n buffers in order with writev(). iov is
+// consumed.
+void ob_writev(OutBuf *b, struct iovec *iov, int n);
+
+// Slow path of ob_put(); also used for writes larger than a block.
+void ob_put_slow(OutBuf *b, const char *s, size_t n);
+
+static inline void ob_put(OutBuf *b, const char *s, size_t n) {
+    if (n == 0) return;
+    if (n > b->cap - b->len) {
+        ob_put_slow(b, s, n);
+        return;
+    }
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+}
+
+static inline void ob_putc(OutBuf *b, char ch) {
+    if (b->len == b->cap) {
+        ob_put_slow(b, &ch, 1);
+        return;
+    }
+    b->data[b->len++] = ch;
+}
+
+static inline void ob_puts(OutBuf *b, const char *s) { ob_put(b, s, strlen(s)); }
+
+// s wrapped in quote, with every quote inside doubled (CSV "", SQL '').
+void ob_quoted(OutBuf *b, const char *s, size_t n, char quote);
+
+// A CSV field, quoted only when it contains ',', '"', CR or LF.
+void ob_csv_field(OutBuf *b, const char *s, size_t n);
+
+// A JSON string literal, quotes included.
+void ob_json_string(OutBuf *b, const char *s, size_t n);
+
+// A double-quoted YAML scalar: like JSON, but only '"', '\\', LF, CR and tab
+// are escaped.
+void ob_yaml_string(OutBuf *b, const char *s, size_t n);
+
+#endif // DTCONVERT_OUTBUF_H
@@ -0,0 +1,350 @@
+#include "parquet.h"
+
+#include <string.h>
+#include <strings.h>
+
+#include "snappy.h"
+
+#ifdef DTCONVERT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// ---------------- Compression ----------------
+
+int pq_codec_from_name(const char *name) {
+    if (strcasecmp(name, "none") == 0 || strcasecmp(name, "uncompressed") == 0) return PQ_UNCOMPRESSED;
+    if (strcasecmp(name, "snappy") == 0) return PQ_SNAPPY;
+#ifdef DTCONVERT_HAVE_ZSTD
+    if (strcasecmp(name, "zstd") == 0) return PQ_ZSTD;
+#endif
+    return -1;
+}
+
+size_t pq_compress_bound(int codec, size_t n) {
+    switch (codec) {
+        case PQ_SNAPPY: return snappy_max_compressed_length(n);
+#ifdef DTCONVERT_HAVE_ZSTD
+        case PQ_ZSTD: return ZSTD_compressBound(n);
+#endif
+        default: return n;
+    }
+}
+
+size_t pq_compress(int codec, const char *in, size_t n, char *out) {
+    switch (codec) {
+        case PQ_SNAPPY: return snappy_compress(in, n, out);
+#ifdef DTCONVERT_HAVE_ZSTD
+        case PQ_ZSTD: {
+            size_t r = ZSTD_compress(out, ZSTD_compressBound(n), in, n, 3);
+            return ZSTD_isError(r) ? SIZE_MAX : r;
+        }
+#endif
+        default:
+            if (n) memcpy(out, in, n);
+            return n;
+    }
+}
+
+// ---------------- RLE / bit-packing hybrid ----------------
+
+static void put_uvarint(OutBuf *out, uint64_t v) {
+    while (v >= 0x80) {
+        ob_putc(out, (char)(v | 0x80));
+        v >>= 7;
+    }
+    ob_putc(out, (char)v);
+}
+
+int pq_bit_width(uint32_t max) {
+    int w = 1;
+    while (w < 32 && (max >> w) != 0) w++;
+    return w;
+}
+
+// True when v[i..i+8) are all equal.
+static bool run_of_8(const uint32_t *v, size_t i, size_t n) {
+    if (n - i < 8) return false;
+    for (size_t k = 1; k < 8; k++) {
+        if (v[i + k] != v[i]) return false;
+    }
+    return true;
+}
+
+// Bit-packed runs are kept to 63 groups, the most some readers accept.
+#define PQ_MAX_GROUPS 63
+
+void pq_rle_encode(OutBuf *out, const uint32_t *v, size_t n, int width) {
+    size_t value_bytes = ((size_t)width + 7) / 8;
+    size_t i = 0;
+    while (i < n) {
+        if (run_of_8(v, i, n)) {
+            size_t run = 8;
+            while (i + run < n && v[i + run] == v[i]) run++;
+            put_uvarint(out, (uint64_t)run << 1);
+            for (size_t b = 0; b < value_bytes; b++) ob_putc(out, (char)(v[i] >> (8 * b)));
+            i += run;
+            continue;
+        }
+
+        // Groups of 8 up to the next group that starts a run. The last group
+        // may be padded past n; readers stop at the page's value count.
+        size_t groups = 0;
+        do {
+            groups++;
+        } while (groups < PQ_MAX_GROUPS && i + 8 * groups < n && !run_of_8(v, i + 8 * groups, n));
+
+        put_uvarint(out, (uint64_t)groups << 1 | 1);
+        uint64_t acc = 0;
+        int bits = 0;
+        for (size_t k = 0; k < 8 * groups; k++) {
+            uint64_t x = i + k < n ? v[i + k] : 0;
+            acc |= x << bits;
+            bits += width;
+            while (bits >= 8) {
+                ob_putc(out, (char)acc);
+                acc >>= 8;
+                bits -= 8;
+            }
+        }
+        i += 8 * groups;
+    }
+}
+
+// ---------------- Thrift compact protocol ----------------
+
+#define TH_TRUE 1
+#define TH_FALSE 2
+#define TH_I32 5
+#define TH_I64 6
+#define TH_BINARY 8
+#define TH_LIST 9
+#define TH_STRUCT 12
+
+#define TH_MAX_DEPTH 8
+
+typedef struct {
+    OutBuf *out;
+    // Last field id written at each struct nesting level.
+    int last[TH_MAX_DEPTH];
+    int depth;
+} Thrift;
+
+static void th_varint(Thrift *t, int64_t v) { put_uvarint(t->out, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63)); }
+
+static void th_field(Thrift *t, int id, int type) {
+    int delta = id - t->last[t->depth];
+    if (delta > 0 && delta <= 15) {
+        ob_putc(t->out, (char)(delta << 4 | type));
+    } else {
+        ob_putc(t->out, (char)type);
+        th_varint(t, id);
+    }
+    t->last[t->depth] = id;
+}
+
+static void th_i32(Thrift *t, int id, int32_t v) {
+    th_field(t, id, TH_I32);
+    th_varint(t, v);
+}
+
+static void th_i64(Thrift *t, int id, int64_t v) {
+    th_field(t, id, TH_I64);
+    th_varint(t, v);
+}
+
+static void th_bool(Thrift *t, int id, bool v) { th_field(t, id, v ? TH_TRUE : TH_FALSE); }
+
+static void th_raw_binary(Thrift *t, const char *s) {
+    size_t n = strlen(s);
+    put_uvarint(t->out, n);
+    ob_put(t->out, s, n);
+}
+
+static void th_binary(Thrift *t, int id, const char *s) {
+    th_field(t, id, TH_BINARY);
+    th_raw_binary(t, s);
+}
+
+// A struct element of a list, or the contents after th_struct().
+static void th_begin(Thrift *t) { t->last[++t->depth] = 0; }
+
+static void th_struct(Thrift *t, int id) {
+    th_field(t, id, TH_STRUCT);
+    th_begin(t);
+}
+
+static void th_end(Thrift *t) {
+    ob_putc(t->out, 0);
+    t->depth--;
+}
+
+static void th_list(Thrift *t, int id, int elem_type, size_t n) {
+    th_field(t, id, TH_LIST);
+    if (n < 15) {
+        ob_putc(t->out, (char)(n << 4 | (size_t)elem_type));
+    } else {
+        ob_putc(t->out, (char)(0xF0 | elem_type));
+        put_uvarint(t->out, n);
+    }
+}
+
+// An empty struct as a union member, e.g. LogicalType.STRING.
+static void th_empty_struct(Thrift *t, int id) {
+    th_struct(t, id);
+    th_end(t);
+}
+
+// ---------------- Page headers and footer ----------------
+
+// PageType
+#define PQ_DATA_PAGE 0
+#define PQ_DICTIONARY_PAGE 2
+
+static void page_header_begin(Thrift *t, OutBuf *out, int type, int32_t uncompressed, int32_t compressed) {
+    memset(t, 0, sizeof(*t));
+    t->out = out;
+    th_i32(t, 1, type);
+    th_i32(t, 2, uncompressed);
+    th_i32(t, 3, compressed);
+}
+
+void pq_write_dictionary_page_header(OutBuf *out, int32_t uncompressed, int32_t compressed, int32_t num_values) {
+    Thrift t;
+    page_header_begin(&t, out, PQ_DICTIONARY_PAGE, uncompressed, compressed);
+    th_struct(&t, 7);
+    th_i32(&t, 1, num_values);
+    th_i32(&t, 2, PQ_PLAIN_DICTIONARY);
+    th_end(&t);
+    ob_putc(out, 0);
+}
+
+void pq_write_data_page_header(OutBuf *out, int32_t uncompressed, int32_t compressed, int32_t num_values,
+                               int encoding) {
+    Thrift t;
+    page_header_begin(&t, out, PQ_DATA_PAGE, uncompressed, compressed);
+    th_struct(&t, 5);
+    th_i32(&t, 1, num_values);
+    th_i32(&t, 2, encoding);
+    th_i32(&t, 3, PQ_RLE);
+    th_i32(&t, 4, PQ_RLE);
+    th_end(&t);
+    ob_putc(out, 0);
+}
+
+// ConvertedType, the legacy annotation older readers look at.
+#define PQ_CONVERTED_UTF8 0
+#define PQ_CONVERTED_DATE 6
+#define PQ_CONVERTED_TIMESTAMP_MICROS 10
+
+static void write_schema_element(Thrift *t, const PqColumn *c) {
+    th_begin(t);
+    th_i32(t, 1, c->type);
+    th_i32(t, 3, c->optional ? 1 : 0);
+    th_binary(t, 4, c->name);
+    switch (c->logical) {
+        case PQ_LOGICAL_STRING:
+            th_i32(t, 6, PQ_CONVERTED_UTF8);
+            th_struct(t, 10);
+            th_empty_struct(t, PQ_LOGICAL_STRING);
+            th_end(t);
+            break;
+        case PQ_LOGICAL_DATE:
+            th_i32(t, 6, PQ_CONVERTED_DATE);
+            th_struct(t, 10);
+            th_empty_struct(t, PQ_LOGICAL_DATE);
+            th_end(t);
+            break;
+        case PQ_LOGICAL_TIMESTAMP:
+            // TIMESTAMP_MICROS implies UTC, so wall-clock columns go without.
+            if (c->utc) th_i32(t, 6, PQ_CONVERTED_TIMESTAMP_MICROS);
+            th_struct(t, 10);
+            th_struct(t, PQ_LOGICAL_TIMESTAMP);
+            th_bool(t, 1, c->utc);
+            th_struct(t, 2);
+            th_empty_struct(t, 2);  // TimeUnit.MICROS
+            th_end(t);
+            th_end(t);
+            th_end(t);
+            break;
+        default: break;
+    }
+    th_end(t);
+}
+
+static void write_column_chunk(Thrift *t, const PqColumn *c, const PqChunk *k, int codec) {
+    bool dict = k->dictionary_page_offset >= 0;
+    th_begin(t);
+    th_i64(t, 2, dict ? k->dictionary_page_offset : k->data_page_offset);
+    th_struct(t, 3);
+    th_i32(t, 1, c->type);
+    th_list(t, 2, TH_I32, dict ? 3 : 2);
+    if (dict) {
+        th_varint(t, PQ_PLAIN_DICTIONARY);
+        th_varint(t, PQ_RLE_DICTIONARY);
+    } else {
+        th_varint(t, PQ_PLAIN);
+    }
+    th_varint(t, PQ_RLE);
+    th_list(t, 3, TH_BINARY, 1);
+    th_raw_binary(t, c->name);
+    th_i32(t, 4, codec);
+    th_i64(t, 5, k->num_values);
+    th_i64(t, 6, k->uncompressed_size);
+    th_i64(t, 7, k->compressed_size);
+    th_i64(t, 9, k->data_page_offset);
+    if (dict) th_i64(t, 11, k->dictionary_page_offset);
+    th_end(t);
+    th_end(t);
+}
+
+void pq_write_footer(OutBuf *out, const PqColumn *cols, size_t ncols, const PqRowGroup *groups, size_t ngroups,
+                     int codec, int64_t rows) {
+    OutBuf meta;
+    ob_init(&meta, -1);
+    Thrift t;
+    memset(&t, 0, sizeof(t));
+    t.out = &meta;
+
+    th_i32(&t, 1, 1);
+    th_list(&t, 2, TH_STRUCT, ncols + 1);
+    th_begin(&t);
+    th_binary(&t, 4, "schema");
+    th_i32(&t, 5, (int32_t)ncols);
+    th_end(&t);
+    for (size_t c = 0; c < ncols; c++) write_schema_element(&t, &cols[c]);
+    th_i64(&t, 3, rows);
+
+    th_list(&t, 4, TH_STRUCT, ngroups);
+    for (size_t g = 0; g < ngroups; g++) {
+        const PqRowGroup *rg = &groups[g];
+        int64_t uncompressed = 0, compressed = 0;
+        th_begin(&t);
+        th_list(&t, 1, TH_STRUCT, ncols);
+        for (size_t c = 0; c < ncols; c++) {
+            write_column_chunk(&t, &cols[c], &rg->chunks[c], codec);
+            uncompressed += rg->chunks[c].uncompressed_size;
+            compressed += rg->chunks[c].compressed_size;
+        }
+        th_i64(&t, 2, uncompressed);
+        th_i64(&t, 3, rg->rows);
+        if (ncols > 0) {
+            const PqChunk *first = &rg->chunks[0];
+            th_i64(&t, 5, first->dictionary_page_offset >= 0 ? first->dictionary_page_offset : first->data_page_offset);
+        }
+        th_i64(&t, 6, compressed);
+        th_end(&t);
+    }
+    th_binary(&t, 6, "dtconvert");
+    ob_putc(&meta, 0);
+
+    if (meta.err) {
+        out->err = meta.err;
+    } else {
+        uint8_t len[4];
+        for (int i = 0; i < 4; i++) len[i] = (uint8_t)(meta.len >> (8 * i));
+        ob_put(out, meta.data, meta.len);
+        ob_put(out, (const char *)len, 4);
+        ob_put(out, PARQUET_MAGIC, 4);
+    }
+    ob_free(&meta);
+}
@@ -0,0 +1,96 @@
+#ifndef DTCONVERT_PARQUET_H
+#define DTCONVERT_PARQUET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "outbuf.h"
+
+// Parquet file layout, as written by data_convert.
+//
+// A file is "PAR1", column chunks grouped into row groups, a FileMetaData
+// footer, the footer's length and "PAR1" again. Each column chunk is an
+// optional dictionary page followed by data pages (format v1): definition
+// levels (optional columns only) and values, together compressed with the
+// chunk's codec. Page headers and the footer are Thrift compact-protocol
+// structs, encoded here by hand; there is no Thrift or Parquet dependency.
+// Only flat schemas are written, so there are never repetition levels.
+
+#define PARQUET_MAGIC "PAR1"
+
+// Physical types
+#define PQ_BOOLEAN 0
+#define PQ_INT32 1
+#define PQ_INT64 2
+#define PQ_DOUBLE 5
+#define PQ_BYTE_ARRAY 6
+
+// Logical types (LogicalType union tags)
+#define PQ_LOGICAL_NONE 0
+#define PQ_LOGICAL_STRING 1
+#define PQ_LOGICAL_DATE 6
+#define PQ_LOGICAL_TIMESTAMP 8
+
+// Encodings
+#define PQ_PLAIN 0
+#define PQ_PLAIN_DICTIONARY 2
+#define PQ_RLE 3
+#define PQ_RLE_DICTIONARY 8
+
+// Compression codecs
+#define PQ_UNCOMPRESSED 0
+#define PQ_SNAPPY 1
+#define PQ_ZSTD 6
+
+typedef struct {
+    const char *name;
+    int type;
+    bool optional;
+    int logical;
+    // PQ_LOGICAL_TIMESTAMP: microseconds, UTC-adjusted or wall-clock.
+    bool utc;
+} PqColumn;
+
+typedef struct {
+    int64_t dictionary_page_offset;  // -1 without a dictionary page
+    int64_t data_page_offset;
+    int64_t num_values;
+    int64_t uncompressed_size;
+    int64_t compressed_size;
+} PqChunk;
+
+typedef struct {
+    PqChunk *chunks;  // one per column
+    int64_t rows;
+} PqRowGroup;
+
+// Codec for a DTCONVERT_PARQUET_COMPRESSION value (none, snappy or zstd), or
+// -1 when the name is unknown or the codec was not built in.
+int pq_codec_from_name(const char *name);
+
+// Worst-case compressed size of n bytes.
+size_t pq_compress_bound(int codec, size_t n);
+
+// Compresses in[0..n) into out (pq_compress_bound() bytes). Returns the
+// compressed length, or SIZE_MAX on failure.
+size_t pq_compress(int codec, const char *in, size_t n, char *out);
+
+// Bits needed for values up to max (at least 1).
+int pq_bit_width(uint32_t max);
+
+// Appends v[0..n) in the RLE / bit-packing hybrid encoding, without a length
+// prefix: runs of 8 or more equal values are run-length encoded, the rest
+// bit-packed in groups of 8.
+void pq_rle_encode(OutBuf *out, const uint32_t *v, size_t n, int width);
+
+// Page headers. Sizes are of the page body after the header.
+void pq_write_dictionary_page_header(OutBuf *out, int32_t uncompressed, int32_t compressed, int32_t num_values);
+void pq_write_data_page_header(OutBuf *out, int32_t uncompressed, int32_t compressed, int32_t num_values,
+                               int encoding);
+
+// The FileMetaData footer, its length and the closing magic.
+void pq_write_footer(OutBuf *out, const PqColumn *cols, size_t ncols, const PqRowGroup *groups, size_t ngroups,
+                     int codec, int64_t rows);
+
+#endif // DTCONVERT_PARQUET_H
@@ -1,5 +1,7 @@
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,11 +9,17 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "compress_io.h"
+#include "csv_scan.h"
+#include "input_map.h"
+#include "libdtconvert.h"
+#include "type_infer.h"
+
 #define MAX_IDENT 128
 
 static void die(const char *msg) {
     fprintf(stderr, "Error: %s\n", msg);
-    exit(1);
+    helper_exit(1);
 }
 
 static void *xmalloc(size_t n) {
@@ -137,7 +145,7 @@ static bool jmatch(J *j, char ch) {
 static void jexpect(J *j, char ch) {
     if (!jmatch(j, ch)) {
         fprintf(stderr, "Error: JSON parse error: expected '%c'\n", ch);
-        exit(1);
+        helper_exit(1);
     }
 }
 
@@ -260,37 +268,14 @@ static void jskip_value(J *j) {
     }
 }
 
-static char *read_all(const char *path, size_t *out_len) {
-    FILE *f = fopen(path, "rb");
-    if (!f) {
-        fprintf(stderr, "Error: cannot open '%s': %s\n", path, strerror(errno));
-        return NULL;
-    }
-    if (fseek(f, 0, SEEK_END) != 0) {
-        fclose(f);
-        return NULL;
-    }
-    long sz = ftell(f);
-    if (sz < 0) {
-        fclose(f);
-        return NULL;
-    }
-    rewind(f);
-
-    char *buf = (char *)xmalloc((size_t)sz + 1);
-    size_t nread = fread(buf, 1, (size_t)sz, f);
-    fclose(f);
-    buf[nread] = '\0';
-    if (out_len) *out_len = nread;
-    return buf;
-}
-
 typedef struct {
     char *connection;
     char schema[MAX_IDENT];
     char table[MAX_IDENT];
     bool create_table;
     bool truncate;
+    // Declare typed columns in CREATE TABLE (also DTCONVERT_INFER_TYPES=1).
+    bool infer_types;
     char *query;
 } PgCfg;
 
@@ -300,6 +285,7 @@ static void cfg_init(PgCfg *cfg) {
     snprintf(cfg->table, sizeof(cfg->table), "%s", "data");
     cfg->create_table = false;
     cfg->truncate = false;
+    cfg->infer_types = type_infer_enabled();
 }
 
 static void cfg_free(PgCfg *cfg) {
@@ -333,11 +319,10 @@ static void parse_schema_table(const char *table, char schema_out[MAX_IDENT], ch
 
 static int load_config(const char *path, PgCfg *cfg) {
     cfg_init(cfg);
-    size_t len = 0;
-    char *buf = read_all(path, &len);
-    if (!buf) return 1;
+    InputMap in;
+    if (input_map_open(&in, path) != 0) return 1;
 
-    J j = {.s = buf, .n = len, .i = 0};
+    J j = {.s = in.data, .n = in.len, .i = 0};
     jexpect(&j, '{');
 
     while (true) {
@@ -377,6 +362,13 @@ static int load_config(const char *path, PgCfg *cfg) {
             } else {
                 cfg->truncate = b;
             }
+        } else if (strcmp(key, "infer_types") == 0) {
+            bool b;
+            if (!jparse_bool(&j, &b)) {
+                jskip_value(&j);
+            } else {
+                cfg->infer_types = b;
+            }
         } else if (strcmp(key, "query") == 0) {
             char *v = jparse_string(&j);
             // strip trailing semicolons/spaces
@@ -403,7 +395,7 @@ static int load_config(const char *path, PgCfg *cfg) {
         jexpect(&j, ',');
     }
 
-    free(buf);
+    input_map_close(&in);
 
     if (!cfg->connection || cfg->connection[0] == '\0') {
         fprintf(stderr, "Error: Config requires a non-empty 'connection' string\n");
@@ -446,46 +438,11 @@ static bool consume_newline(Cur *c) {
 }
 
 static char *csv_field(Cur *c) {
-    bool quoted = false;
-    if (cpeek(c) == '"') {
-        quoted = true;
-        (void)cget(c);
-    }
-
-    char *out = NULL;
-    size_t cap = 0, len = 0;
-
-    while (!ceof(c)) {
-        char ch = cpeek(c);
-        if (quoted) {
-            if (ch == '"') {
-                (void)cget(c);
-                if (cpeek(c) == '"') {
-                    (void)cget(c);
-                    ch = '"';
-                } else {
-                    quoted = false;
-                    break;
-                }
-            }
-        } else {
-            if (ch == ',' || ch == '\n' || ch == '\r') break;
-        }
+    CsvField f;
+    (void)csv_scan_field(c->s, c->n, &c->i, true, &f);
 
-        ch = cget(c);
-        if (len + 2 > cap) {
-            cap = cap ? cap * 2 : 64;
-            out = (char *)xrealloc(out, cap);
-        }
-        out[len++] = ch;
-    }
-
-    if (!out) {
-        out = (char *)xmalloc(1);
-        out[0] = '\0';
-    } else {
-        out[len] = '\0';
-    }
+    char *out = (char *)xmalloc(f.len + 1);
+    out[csv_unescape(&f, out)] = '\0';
     return out;
 }
 
@@ -554,13 +511,39 @@ static void make_unique_idents(StrVec *cols) {
     }
 }
 
-static int read_csv_header(const char *csv_path, StrVec *cols_out) {
-    memset(cols_out, 0, sizeof(*cols_out));
-    size_t len = 0;
-    char *buf = read_all(csv_path, &len);
-    if (!buf) return 1;
+// Joins the type of every field below the header into types. \copy reads
+// only an unquoted empty field as NULL, so a quoted "" or the word null in a
+// typed column would fail the load: both count as text here.
+static void infer_csv_types(Cur *c, size_t ncols, DataType *types) {
+    size_t col = 0;
+    while (!ceof(c)) {
+        if (col == 0 && consume_newline(c)) continue;
+
+        CsvField f;
+        (void)csv_scan_field(c->s, c->n, &c->i, true, &f);
+        if (col < ncols && types[col] != DT_TEXT) {
+            DataType t = type_of_value(f.ptr, f.len);
+            if (t == DT_NULL && (f.len > 0 || f.quoted)) t = DT_TEXT;
+            types[col] = type_join(types[col], t);
+        }
 
-    Cur c = {.s = buf, .n = len, .i = 0};
+        if (cpeek(c) == ',') {
+            (void)cget(c);
+            col++;
+        } else if (consume_newline(c)) {
+            col = 0;
+        } else {
+            (void)cget(c);  // junk after a closing quote
+        }
+    }
+}
+
+// With types_out, also infers a type for each column from the rest of the
+// file (see type_infer.h); otherwise only the header line is parsed, and with
+// a mapping the rest of the file is never read.
+static int read_csv_header(const InputMap *in, StrVec *cols_out, DataType **types_out) {
+    memset(cols_out, 0, sizeof(*cols_out));
+    Cur c = {.s = in->data, .n = in->len, .i = 0};
 
     // skip empty lines
     while (!ceof(&c)) {
@@ -582,11 +565,19 @@ static int read_csv_header(const char *csv_path, StrVec *cols_out) {
         break;
     }
 
-    free(buf);
+    if (types_out) {
+        *types_out = (DataType *)calloc(cols_out->len ? cols_out->len : 1, sizeof(DataType));
+        if (!*types_out) die("out of memory");
+        infer_csv_types(&c, cols_out->len, *types_out);
+    }
 
     if (cols_out->len == 0) {
         fprintf(stderr, "Error: CSV appears to be empty\n");
         sv_free(cols_out);
+        if (types_out) {
+            free(*types_out);
+            *types_out = NULL;
+        }
         return 1;
     }
 
@@ -596,40 +587,52 @@ static int read_csv_header(const char *csv_path, StrVec *cols_out) {
 
 // ---------------- psql execution helpers ----------------
 
-static int run_psql(const char *connection, const char *sql, const char *stdin_path, const char *stdout_path) {
+// psql's stdin is fed from stdin_data when given, through a pipe written
+// here. stdout_path is written compressed when it ends in .gz/.zst (see
+// compress_io.h); the compressor runs here too, between psql and the file.
+static int run_psql(const char *connection, const char *sql, const InputMap *stdin_data, const char *stdout_path) {
     char *psql_path = shutil_which("psql");
     if (!psql_path) {
         fprintf(stderr, "Error: psql is required (install PostgreSQL client tools)\n");
         return 1;
     }
 
+    int in_fd = -1, feed_fd = -1, out_fd = -1;
+    CompressStream *out_z = NULL;
+    if (stdin_data) {
+        int p[2];
+        if (pipe(p) != 0) {
+            perror("pipe");
+            free(psql_path);
+            return 1;
+        }
+        in_fd = p[0];
+        feed_fd = p[1];
+        fcntl(feed_fd, F_SETFD, FD_CLOEXEC);
+    }
+    if (stdout_path && compress_open_write(stdout_path, &out_fd, &out_z) != 0) {
+        if (in_fd >= 0) close(in_fd);
+        if (feed_fd >= 0) close(feed_fd);
+        free(psql_path);
+        return 1;
+    }
+
     pid_t pid = fork();
     if (pid < 0) {
         perror("fork");
+        if (in_fd >= 0) close(in_fd);
+        if (feed_fd >= 0) close(feed_fd);
+        helper_drop_fd(out_fd);
+        if (out_fd >= 0) close(out_fd);
+        compress_finish(out_z, stdout_path);
         free(psql_path);
         return 1;
     }
 
     if (pid == 0) {
-        if (stdin_path) {
-            FILE *in = fopen(stdin_path, "rb");
-            if (!in) {
-                fprintf(stderr, "Error: cannot open '%s': %s\n", stdin_path, strerror(errno));
-                _exit(1);
-            }
-            dup2(fileno(in), STDIN_FILENO);
-            fclose(in);
-        }
-
-        if (stdout_path) {
-            FILE *out = fopen(stdout_path, "wb");
-            if (!out) {
-                fprintf(stderr, "Error: cannot write '%s': %s\n", stdout_path, strerror(errno));
-                _exit(1);
-            }
-            dup2(fileno(out), STDOUT_FILENO);
-            fclose(out);
-        }
+        if (in_fd >= 0) dup2(in_fd, STDIN_FILENO);
+        if (out_fd >= 0) dup2(out_fd, STDOUT_FILENO);
+        signal(SIGPIPE, SIG_DFL);
 
         char *const argv[] = {
             psql_path,
@@ -649,20 +652,53 @@ static int run_psql(const char *connection, const char *sql, const char *stdin_p
         _exit(127);
     }
 
+    // psql holds its own copies; closing ours lets the pipes see EOF.
+    if (in_fd >= 0) close(in_fd);
+    helper_drop_fd(out_fd);
+    if (out_fd >= 0) close(out_fd);
+    if (feed_fd >= 0) {
+        // A psql that exits early closes the pipe: EPIPE, not SIGPIPE.
+        void (*old_pipe)(int) = signal(SIGPIPE, SIG_IGN);
+        const char *p = stdin_data->data;
+        size_t n = stdin_data->len;
+        while (n > 0) {
+            ssize_t w = write(feed_fd, p, n);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            p += w;
+            n -= (size_t)w;
+        }
+        close(feed_fd);
+        signal(SIGPIPE, old_pipe);
+    }
+
     int status = 0;
     waitpid(pid, &status, 0);
     free(psql_path);
 
-    if (WIFEXITED(status)) return WEXITSTATUS(status);
-    return 1;
+    int rc = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    if (compress_finish(out_z, stdout_path) != 0 && rc == 0) rc = 1;
+    return rc;
 }
 
+// The CSV is read once (mapped, or buffered for stdin and compressed files):
+// the header and column types come from it, then psql's COPY is fed from it.
 static int csv_to_postgresql(const char *csv_path, const char *config_path) {
     PgCfg cfg;
     if (load_config(config_path, &cfg) != 0) return 1;
 
+    InputMap in;
+    if (input_map_open(&in, csv_path) != 0) {
+        cfg_free(&cfg);
+        return 1;
+    }
+
     StrVec cols;
-    if (read_csv_header(csv_path, &cols) != 0) {
+    DataType *types = NULL;
+    if (read_csv_header(&in, &cols, cfg.create_table && cfg.infer_types ? &types : NULL) != 0) {
+        input_map_close(&in);
         cfg_free(&cfg);
         return 1;
     }
@@ -672,30 +708,36 @@ static int csv_to_postgresql(const char *csv_path, const char *config_path) {
 
     if (cfg.create_table) {
         // Build CREATE TABLE
-        size_t sqlcap = 1024 + cols.len * 64;
+        size_t sqlcap = 1024 + cols.len * (MAX_IDENT + 32);
         char *sql = (char *)xmalloc(sqlcap);
         snprintf(sql, sqlcap, "CREATE TABLE IF NOT EXISTS %s (", fq);
         for (size_t i = 0; i < cols.len; i++) {
             if (i) strncat(sql, ", ", sqlcap - strlen(sql) - 1);
             strncat(sql, cols.items[i], sqlcap - strlen(sql) - 1);
-            strncat(sql, " TEXT", sqlcap - strlen(sql) - 1);
+            strncat(sql, " ", sqlcap - strlen(sql) - 1);
+            strncat(sql, types ? type_sql_name(types[i]) : "TEXT", sqlcap - strlen(sql) - 1);
         }
         strncat(sql, ");", sqlcap - strlen(sql) - 1);
+        free(types);
 
         int rc = run_psql(cfg.connection, sql, NULL, NULL);
         free(sql);
         if (rc != 0) {
+            input_map_close(&in);
             sv_free(&cols);
             cfg_free(&cfg);
             return rc;
         }
     }
 
-    if (cfg.truncate) {
+    // Incremental imports (DTCONVERT_PG_APPEND=1) add to the rows already there.
+    const char *append = getenv("DTCONVERT_PG_APPEND");
+    if (cfg.truncate && !(append && strcmp(append, "1") == 0)) {
         char sql[512];
         snprintf(sql, sizeof(sql), "TRUNCATE %s;", fq);
         int rc = run_psql(cfg.connection, sql, NULL, NULL);
         if (rc != 0) {
+            input_map_close(&in);
             sv_free(&cols);
             cfg_free(&cfg);
             return rc;
@@ -712,8 +754,9 @@ static int csv_to_postgresql(const char *csv_path, const char *config_path) {
     }
     strncat(copy, ") FROM STDIN WITH (FORMAT csv, HEADER true)", sqlcap - strlen(copy) - 1);
 
-    int rc = run_psql(cfg.connection, copy, csv_path, NULL);
+    int rc = run_psql(cfg.connection, copy, &in, NULL);
 
+    input_map_close(&in);
     free(copy);
     sv_free(&cols);
     cfg_free(&cfg);
@@ -745,7 +788,7 @@ static void usage(void) {
             "  postgresql-to-csv: <config.json> <output.csv>\n");
 }
 
-int main(int argc, char **argv) {
+int pg_store_main(int argc, char **argv) {
     if (argc != 4) {
         usage();
         return 2;
@@ -768,3 +811,9 @@ int main(int argc, char **argv) {
     usage();
     return 2;
 }
+
+#ifndef DTCONVERT_NO_MAIN
+int main(int argc, char **argv) {
+    return pg_store_main(argc, argv);
+}
+#endif
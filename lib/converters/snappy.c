@@ -0,0 +1,113 @@
+#include "snappy.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define SNAPPY_BLOCK ((size_t)1 << 16)
+#define SNAPPY_HASH_BITS 14
+// Matches are only looked for this far from the end of a block, so the
+// 4-byte loads never run past it.
+#define SNAPPY_MARGIN 15
+
+size_t snappy_max_compressed_length(size_t n) { return 32 + n + n / 6; }
+
+static inline uint32_t load32(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash32(uint32_t v) { return (v * 0x1e35a7bdu) >> (32 - SNAPPY_HASH_BITS); }
+
+static char *put_varint(char *out, size_t v) {
+    while (v >= 0x80) {
+        *out++ = (char)(v | 0x80);
+        v >>= 7;
+    }
+    *out++ = (char)v;
+    return out;
+}
+
+static char *emit_literal(char *out, const char *p, size_t n) {
+    size_t len = n - 1;
+    if (len < 60) {
+        *out++ = (char)(len << 2);
+    } else {
+        // Tags 60..63: the length follows in 1..4 bytes.
+        int bytes = len < 0x100 ? 1 : len < 0x10000 ? 2 : len < 0x1000000 ? 3 : 4;
+        *out++ = (char)((59 + bytes) << 2);
+        for (int i = 0; i < bytes; i++) *out++ = (char)(len >> (8 * i));
+    }
+    memcpy(out, p, n);
+    return out + n;
+}
+
+// One copy tag of at most 64 bytes.
+static char *emit_copy_upto64(char *out, size_t offset, size_t len) {
+    if (len < 12 && offset < 2048) {
+        *out++ = (char)(1 | ((len - 4) << 2) | ((offset >> 8) << 5));
+        *out++ = (char)offset;
+    } else {
+        *out++ = (char)(2 | ((len - 1) << 2));
+        *out++ = (char)offset;
+        *out++ = (char)(offset >> 8);
+    }
+    return out;
+}
+
+static char *emit_copy(char *out, size_t offset, size_t len) {
+    // Leave at least 4 bytes for the last tag, since the short form needs 4.
+    while (len >= 68) {
+        out = emit_copy_upto64(out, offset, 64);
+        len -= 64;
+    }
+    if (len > 64) {
+        out = emit_copy_upto64(out, offset, 60);
+        len -= 60;
+    }
+    return emit_copy_upto64(out, offset, len);
+}
+
+static char *compress_block(const char *in, size_t n, char *out, uint16_t *table) {
+    const char *end = in + n;
+    const char *next_emit = in;
+    if (n >= SNAPPY_MARGIN) {
+        memset(table, 0, sizeof(uint16_t) << SNAPPY_HASH_BITS);
+        const char *limit = end - SNAPPY_MARGIN;
+        const char *ip = in + 1;
+        // Searches speed up the longer nothing matches, so incompressible
+        // data passes quickly.
+        uint32_t skip = 32;
+        while (ip < limit) {
+            uint32_t v = load32(ip);
+            uint32_t h = hash32(v);
+            const char *candidate = in + table[h];
+            table[h] = (uint16_t)(ip - in);
+            if (candidate >= ip || load32(candidate) != v) {
+                ip += skip++ >> 5;
+                continue;
+            }
+
+            if (ip > next_emit) out = emit_literal(out, next_emit, (size_t)(ip - next_emit));
+            size_t len = 4;
+            while (ip + len < end && candidate[len] == ip[len]) len++;
+            out = emit_copy(out, (size_t)(ip - candidate), len);
+            ip += len;
+            next_emit = ip;
+            skip = 32;
+            if (ip < limit) table[hash32(load32(ip - 1))] = (uint16_t)(ip - 1 - in);
+        }
+    }
+    if (next_emit < end) out = emit_literal(out, next_emit, (size_t)(end - next_emit));
+    return out;
+}
+
+size_t snappy_compress(const char *in, size_t n, char *out) {
+    uint16_t table[1 << SNAPPY_HASH_BITS];
+    char *p = put_varint(out, n);
+    for (size_t off = 0; off < n; off += SNAPPY_BLOCK) {
+        size_t len = n - off < SNAPPY_BLOCK ? n - off : SNAPPY_BLOCK;
+        p = compress_block(in + off, len, p, table);
+    }
+    return (size_t)(p - out);
+}
@@ -0,0 +1,19 @@
+#ifndef DTCONVERT_SNAPPY_H
+#define DTCONVERT_SNAPPY_H
+
+#include <stddef.h>
+
+// Snappy compressor (raw format, no framing), for Parquet pages.
+//
+// Greedy LZ77 over 64 KiB blocks with a 16K-entry hash table of 4-byte
+// sequences, emitting the standard literal and copy tags, so any Snappy
+// decoder reads the result. Only compression is needed here.
+
+// Worst-case output size for n input bytes.
+size_t snappy_max_compressed_length(size_t n);
+
+// Compresses in[0..n) into out, which needs snappy_max_compressed_length(n)
+// bytes, and returns the compressed length.
+size_t snappy_compress(const char *in, size_t n, char *out);
+
+#endif // DTCONVERT_SNAPPY_H
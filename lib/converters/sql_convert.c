@@ -4,11 +4,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 
+#include "compress_io.h"
+#include "csv_scan.h"
+#include "input_map.h"
+#include "libdtconvert.h"
+#include "outbuf.h"
+#include "type_infer.h"
+
 static void die(const char *msg) {
     fprintf(stderr, "Error: %s\n", msg);
-    exit(1);
+    helper_exit(1);
 }
 
 static void *xmalloc(size_t n) {
@@ -53,23 +61,6 @@ static bool is_ident(const char *s) {
     return true;
 }
 
-static char *escape_sql_literal(const char *s) {
-    // duplicate single quotes
-    size_t extra = 0;
-    for (const char *p = s ? s : ""; *p; p++) {
-        if (*p == '\'') extra++;
-    }
-    size_t n = strlen(s ? s : "");
-    char *out = (char *)xmalloc(n + extra + 1);
-    size_t j = 0;
-    for (const char *p = s ? s : ""; *p; p++) {
-        out[j++] = *p;
-        if (*p == '\'') out[j++] = '\'';
-    }
-    out[j] = '\0';
-    return out;
-}
-
 // ---------------- CSV reader/writer (minimal RFC4180-ish) ----------------
 
 typedef struct {
@@ -93,254 +84,218 @@ static void sl_free(StrList *sl) {
     memset(sl, 0, sizeof(*sl));
 }
 
+// A field value: a slice of the mapped input, or of an unescaped copy when
+// the field contained "" pairs. Not NUL-terminated.
+typedef struct {
+    const char *ptr;
+    size_t len;
+} CsvCell;
+
 typedef struct {
-    char ***rows;
+    // nrows * ncols cells, row-major; short rows are padded with "".
+    CsvCell *cells;
     size_t nrows;
     size_t cap;
 
     char **header;
     size_t ncols;
+
+    // The cells point into in and into the copies in owned.
+    InputMap in;
+    bool mapped;
+    StrList owned;
 } Csv;
 
 static void csv_free(Csv *c) {
     if (!c) return;
     for (size_t i = 0; i < c->ncols; i++) free(c->header[i]);
     free(c->header);
-
-    for (size_t r = 0; r < c->nrows; r++) {
-        for (size_t j = 0; j < c->ncols; j++) free(c->rows[r][j]);
-        free(c->rows[r]);
-    }
-    free(c->rows);
+    free(c->cells);
+    sl_free(&c->owned);
+    if (c->mapped) input_map_close(&c->in);
     memset(c, 0, sizeof(*c));
 }
 
-static char *csv_parse_field(const char **p) {
-    const char *s = *p;
-    bool quoted = false;
-
-    if (*s == '"') {
-        quoted = true;
-        s++;
-    }
-
-    char *out = NULL;
-    size_t cap = 0, len = 0;
-
-    while (*s) {
-        char ch = *s;
-        if (quoted) {
-            if (ch == '"') {
-                s++;
-                if (*s == '"') {
-                    ch = '"';
-                    s++;
-                } else {
-                    quoted = false;
-                    break;
-                }
-            } else {
-                s++;
-            }
-        } else {
-            if (ch == ',' || ch == '\n' || ch == '\r') break;
-            s++;
-        }
-
-        if (len + 2 > cap) {
-            cap = cap ? cap * 2 : 64;
-            out = (char *)xrealloc(out, cap);
-        }
-        out[len++] = ch;
-    }
-
-    if (!out) {
-        out = (char *)xmalloc(1);
-        out[0] = '\0';
-    } else {
-        out[len] = '\0';
-    }
+// Length of what follows a closing quote at p, up to the delimiter. Blanks
+// there are dropped, but "ab"cd is read as abcd, as lenient RFC 4180 readers
+// do, rather than shifting cd into the next column.
+static size_t csv_after_quote(const char *p, const char *end, size_t *tail_len) {
+    const char *q = p;
+    bool blank = true;
+    while (q < end && *q != ',' && *q != '\r' && *q != '\n') {
+        if (*q != ' ' && *q != '\t') blank = false;
+        q++;
+    }
+    *tail_len = blank ? 0 : (size_t)(q - p);
+    return (size_t)(q - p);
+}
 
-    *p = s;
+// Parses one field starting at *p into a NUL-terminated copy.
+static char *csv_parse_field(const char **p, const char *end) {
+    const char *base = *p;
+    size_t pos = 0;
+    CsvField f;
+    (void)csv_scan_field(base, (size_t)(end - base), &pos, true, &f);
+    size_t tail_len = 0;
+    const char *tail = base + pos;
+    if (f.quoted) pos += csv_after_quote(tail, end, &tail_len);
+
+    char *out = (char *)xmalloc(f.len + tail_len + 1);
+    size_t n = csv_unescape(&f, out);
+    memcpy(out + n, tail, tail_len);
+    out[n + tail_len] = '\0';
+    *p = base + pos;
     return out;
 }
 
-static void csv_consume_delim(const char **p) {
+// Parses one field starting at *p as a slice of the input; only a field with
+// "" pairs or text after its closing quote is copied (into owned).
+static CsvCell csv_slice_field(const char **p, const char *end, StrList *owned) {
+    const char *base = *p;
+    size_t pos = 0;
+    CsvField f;
+    (void)csv_scan_field(base, (size_t)(end - base), &pos, true, &f);
+    size_t tail_len = 0;
+    const char *tail = base + pos;
+    if (f.quoted) pos += csv_after_quote(tail, end, &tail_len);
+    *p = base + pos;
+    if (!f.escaped && tail_len == 0) return (CsvCell){f.ptr, f.len};
+
+    char *copy = (char *)xmalloc(f.len + tail_len);
+    sl_push(owned, copy);
+    size_t n = csv_unescape(&f, copy);
+    memcpy(copy + n, tail, tail_len);
+    return (CsvCell){copy, n + tail_len};
+}
+
+static void csv_consume_delim(const char **p, const char *end) {
     const char *s = *p;
+    if (s >= end) return;
     if (*s == ',') {
         s++;
     } else if (*s == '\r') {
         s++;
-        if (*s == '\n') s++;
+        if (s < end && *s == '\n') s++;
     } else if (*s == '\n') {
         s++;
     }
     *p = s;
 }
 
-static bool csv_at_eol(const char *s) {
-    return *s == '\0' || *s == '\n' || *s == '\r';
+static bool csv_at_eol(const char *s, const char *end) {
+    return s >= end || *s == '\n' || *s == '\r';
 }
 
-static int csv_read_all(const char *path, Csv *out) {
-    memset(out, 0, sizeof(*out));
-
-    FILE *f = fopen(path, "rb");
-    if (!f) {
-        fprintf(stderr, "Error: cannot open '%s': %s\n", path, strerror(errno));
-        return 1;
+// Skips lines holding only spaces and tabs.
+static const char *csv_skip_blank_lines(const char *p, const char *end) {
+    while (p < end) {
+        const char *q = p;
+        while (q < end && (*q == ' ' || *q == '\t')) q++;
+        if (q == end || (*q != '\r' && *q != '\n')) break;
+        csv_consume_delim(&q, end);
+        p = q;
     }
+    return p;
+}
 
-    // Read full file into memory (small-tool assumption)
-    if (fseek(f, 0, SEEK_END) != 0) {
-        fclose(f);
-        return 1;
-    }
-    long sz = ftell(f);
-    if (sz < 0) {
-        fclose(f);
-        return 1;
-    }
-    rewind(f);
+static int csv_read_all(const char *path, Csv *out) {
+    memset(out, 0, sizeof(*out));
 
-    char *buf = (char *)xmalloc((size_t)sz + 1);
-    size_t nread = fread(buf, 1, (size_t)sz, f);
-    fclose(f);
-    buf[nread] = '\0';
+    if (input_map_open(&out->in, path) != 0) return 1;
+    out->mapped = true;
 
-    const char *p = buf;
-    // skip leading empty lines
-    while (*p) {
-        const char *q = p;
-        while (*q == ' ' || *q == '\t') q++;
-        if (*q == '\r' || *q == '\n') {
-            csv_consume_delim(&q);
-            p = q;
-            continue;
-        }
-        break;
-    }
+    const char *p = out->in.data;
+    const char *end = out->in.data + out->in.len;
+    p = csv_skip_blank_lines(p, end);
 
     // header
     StrList hdr = {0};
-    while (*p) {
-        char *field = csv_parse_field(&p);
+    while (p < end) {
+        char *field = csv_parse_field(&p, end);
         sl_push(&hdr, field);
-        if (csv_at_eol(p)) {
-            csv_consume_delim(&p);
+        if (csv_at_eol(p, end)) {
+            csv_consume_delim(&p, end);
             break;
         }
-        if (*p == ',') {
-            csv_consume_delim(&p);
-            continue;
-        }
+        if (*p == ',') csv_consume_delim(&p, end);
     }
 
-    if (hdr.len == 0) {
-        free(buf);
-        return 1;
-    }
+    if (hdr.len == 0) return 1;
 
     out->ncols = hdr.len;
     out->header = hdr.items;
-    // transfer ownership
-    hdr.items = NULL;
-    hdr.len = hdr.cap = 0;
 
     // rows
-    while (*p) {
-        // skip empty lines
-        const char *q = p;
-        while (*q == ' ' || *q == '\t') q++;
-        if (*q == '\r' || *q == '\n') {
-            csv_consume_delim(&q);
-            p = q;
-            continue;
+    while ((p = csv_skip_blank_lines(p, end)) < end) {
+        if (out->nrows + 1 > out->cap) {
+            out->cap = out->cap ? out->cap * 2 : 16;
+            out->cells = (CsvCell *)xrealloc(out->cells, out->cap * out->ncols * sizeof(CsvCell));
         }
+        CsvCell *row = out->cells + out->nrows++ * out->ncols;
+        for (size_t c = 0; c < out->ncols; c++) row[c] = (CsvCell){"", 0};
 
-        char **row = (char **)xmalloc(out->ncols * sizeof(char *));
-        for (size_t c = 0; c < out->ncols; c++) row[c] = xstrdup("");
-
+        bool eol = false;
         for (size_t c = 0; c < out->ncols; c++) {
-            char *field = csv_parse_field(&p);
-            free(row[c]);
-            row[c] = field;
-
-            if (csv_at_eol(p)) {
-                csv_consume_delim(&p);
+            row[c] = csv_slice_field(&p, end, &out->owned);
+            if (csv_at_eol(p, end)) {
+                csv_consume_delim(&p, end);
+                eol = true;
                 break;
             }
-            if (*p == ',') {
-                csv_consume_delim(&p);
-                continue;
-            }
+            if (*p == ',') csv_consume_delim(&p, end);
         }
 
-        if (out->nrows + 1 > out->cap) {
-            out->cap = out->cap ? out->cap * 2 : 16;
-            out->rows = (char ***)xrealloc(out->rows, out->cap * sizeof(char **));
+        // drop fields past the header's column count
+        if (!eol) {
+            while (p < end && *p != '\n' && *p != '\r') p++;
+            csv_consume_delim(&p, end);
         }
-        out->rows[out->nrows++] = row;
-
-        // consume rest of line if any
-        while (*p && *p != '\n' && *p != '\r') p++;
-        if (*p) csv_consume_delim(&p);
     }
 
-    free(buf);
     return 0;
 }
 
-static void csv_write_escaped(FILE *f, const char *s) {
-    bool need_quote = false;
-    for (const char *p = s ? s : ""; *p; p++) {
-        if (*p == ',' || *p == '"' || *p == '\n' || *p == '\r') {
-            need_quote = true;
-            break;
-        }
-    }
-
-    if (!need_quote) {
-        fputs(s ? s : "", f);
-        return;
-    }
-
-    fputc('"', f);
-    for (const char *p = s ? s : ""; *p; p++) {
-        if (*p == '"') fputc('"', f);
-        fputc(*p, f);
-    }
-    fputc('"', f);
-}
-
 static int csv_write(const char *path, char **header, size_t ncols, char ***rows, size_t nrows) {
-    FILE *f = fopen(path, "wb");
-    if (!f) {
-        fprintf(stderr, "Error: cannot write '%s': %s\n", path, strerror(errno));
-        return 1;
-    }
+    OutBuf out;
+    if (ob_open(&out, path) != 0) return 1;
 
     for (size_t c = 0; c < ncols; c++) {
-        if (c) fputc(',', f);
-        csv_write_escaped(f, header[c]);
+        if (c) ob_putc(&out, ',');
+        ob_csv_field(&out, header[c], strlen(header[c]));
     }
-    fputc('\n', f);
+    ob_putc(&out, '\n');
 
     for (size_t r = 0; r < nrows; r++) {
         for (size_t c = 0; c < ncols; c++) {
-            if (c) fputc(',', f);
-            csv_write_escaped(f, rows[r][c]);
+            const char *v = rows[r][c] ? rows[r][c] : "";
+            if (c) ob_putc(&out, ',');
+            ob_csv_field(&out, v, strlen(v));
         }
-        fputc('\n', f);
+        ob_putc(&out, '\n');
     }
 
-    fclose(f);
-    return 0;
+    return ob_close(&out, path);
 }
 
 // ---------------- SQL generation/parsing ----------------
 
-static int csv_to_sql(const char *in_csv, const char *out_sql, const char *table, bool create_table) {
+// One INSERT value. Typed columns (--infer-types) get bare numbers, TRUE/FALSE
+// and NULL; everything else is a quoted literal.
+static void sql_write_value(OutBuf *out, DataType t, const char *v, size_t n) {
+    if (t == DT_TEXT) {
+        ob_quoted(out, v, n, '\'');
+    } else if (type_is_null(v, n)) {
+        ob_puts(out, "NULL");
+    } else if (t == DT_BOOLEAN) {
+        ob_puts(out, (v[0] | 0x20) == 't' ? "TRUE" : "FALSE");
+    } else if (type_is_number(t)) {
+        ob_put(out, v, n);
+    } else {
+        ob_quoted(out, v, n, '\'');
+    }
+}
+
+static int csv_to_sql(const char *in_csv, const char *out_sql, const char *table, bool create_table, bool infer) {
     if (!is_ident(table)) {
         fprintf(stderr, "Error: Invalid SQL identifier: %s\n", table);
         return 1;
@@ -381,48 +336,70 @@ static int csv_to_sql(const char *in_csv, const char *out_sql, const char *table
         }
     }
 
-    FILE *out = fopen(out_sql, "wb");
-    if (!out) {
-        fprintf(stderr, "Error: cannot write '%s': %s\n", out_sql, strerror(errno));
+    // Every column is TEXT unless --infer-types finds a type that fits all of
+    // its values.
+    DataType *types = (DataType *)xmalloc(csv.ncols * sizeof(DataType));
+    for (size_t c = 0; c < csv.ncols; c++) types[c] = infer ? DT_NULL : DT_TEXT;
+    if (infer) {
+        for (size_t r = 0; r < csv.nrows; r++) {
+            for (size_t c = 0; c < csv.ncols; c++) {
+                const CsvCell *v = &csv.cells[r * csv.ncols + c];
+                type_add(&types[c], v->ptr, v->len);
+            }
+        }
+    }
+
+    OutBuf out;
+    if (ob_open(&out, out_sql) != 0) {
+        free(types);
         csv_free(&csv);
         return 1;
     }
 
-    fprintf(out, "-- Generated by dtconvert (csv -> sql)\n");
+    ob_puts(&out, "-- Generated by dtconvert (csv -> sql)\n");
 
     if (create_table) {
-        fprintf(out, "CREATE TABLE IF NOT EXISTS %s (", table);
+        ob_puts(&out, "CREATE TABLE IF NOT EXISTS ");
+        ob_puts(&out, table);
+        ob_puts(&out, " (");
         for (size_t i = 0; i < csv.ncols; i++) {
-            if (i) fputs(", ", out);
-            fprintf(out, "%s TEXT", csv.header[i]);
+            if (i) ob_puts(&out, ", ");
+            ob_puts(&out, csv.header[i]);
+            ob_putc(&out, ' ');
+            ob_puts(&out, type_sql_name(types[i]));
         }
-        fputs(");\n", out);
+        ob_puts(&out, ");\n");
+    }
+
+    // The column list is the same for every INSERT; build it once.
+    OutBuf cols;
+    ob_init(&cols, -1);
+    ob_puts(&cols, "INSERT INTO ");
+    ob_puts(&cols, table);
+    ob_puts(&cols, " (");
+    for (size_t c = 0; c < csv.ncols; c++) {
+        if (c) ob_puts(&cols, ", ");
+        ob_puts(&cols, csv.header[c]);
     }
+    ob_puts(&cols, ") VALUES (");
+    if (cols.err) die("out of memory");
 
     // INSERT lines
     for (size_t r = 0; r < csv.nrows; r++) {
-        fprintf(out, "INSERT INTO %s (", table);
-        for (size_t c = 0; c < csv.ncols; c++) {
-            if (c) fputs(", ", out);
-            fputs(csv.header[c], out);
-        }
-        fputs(") VALUES (", out);
-
+        ob_put(&out, cols.data, cols.len);
         for (size_t c = 0; c < csv.ncols; c++) {
-            if (c) fputs(", ", out);
-            char *esc = escape_sql_literal(csv.rows[r][c]);
-            fputc('\'', out);
-            fputs(esc, out);
-            fputc('\'', out);
-            free(esc);
+            const CsvCell *v = &csv.cells[r * csv.ncols + c];
+            if (c) ob_puts(&out, ", ");
+            sql_write_value(&out, types[c], v->ptr, v->len);
         }
-        fputs(");\n", out);
+        ob_puts(&out, ");\n");
     }
 
-    fputc('\n', out);
-    fclose(out);
+    ob_putc(&out, '\n');
+    ob_free(&cols);
+    free(types);
     csv_free(&csv);
-    return 0;
+    return ob_close(&out, out_sql);
 }
 
 static void skip_ws(const char **p) {
@@ -502,12 +479,43 @@ static char *parse_sql_string_literal(const char **p) {
     return out;
 }
 
+// A quoted literal, or a bare token such as a number, TRUE/FALSE or NULL
+// (written by csv-to-sql --infer-types). NULL reads as an empty field and
+// booleans as true/false.
+static char *parse_sql_value(const char **p) {
+    skip_ws(p);
+    if (**p == '\'') return parse_sql_string_literal(p);
+
+    const char *s = *p;
+    while (**p && **p != ',' && **p != ')' && !isspace((unsigned char)**p)) (*p)++;
+    size_t n = (size_t)(*p - s);
+    if (n == 0) return NULL;
+    if (n == 4 && strncasecmp(s, "null", 4) == 0) return xstrdup("");
+    if (n == 4 && strncasecmp(s, "true", 4) == 0) return xstrdup("true");
+    if (n == 5 && strncasecmp(s, "false", 5) == 0) return xstrdup("false");
+
+    char *out = (char *)xmalloc(n + 1);
+    memcpy(out, s, n);
+    out[n] = '\0';
+    return out;
+}
+
+// Closes the input of sql_to_csv(). Returns 1 if its decompressor (see
+// compress_io.h) reported corrupt data.
+static int close_input(FILE *f, CompressStream *z, const char *path) {
+    helper_drop_file(f);
+    fclose(f);
+    return compress_finish(z, path);
+}
+
 static int sql_to_csv(const char *in_sql, const char *out_csv) {
-    FILE *f = fopen(in_sql, "rb");
-    if (!f) {
-        fprintf(stderr, "Error: cannot open '%s': %s\n", in_sql, strerror(errno));
-        return 1;
-    }
+    int fd;
+    CompressStream *z;
+    if (compress_open_read(in_sql, &fd, &z) != 0) return 1;
+    FILE *f = fdopen(fd, "rb");
+    if (!f) die("out of memory");
+    helper_drop_fd(fd);
+    helper_hold_file(f);
 
     char *line = NULL;
     size_t cap = 0;
@@ -560,10 +568,10 @@ static int sql_to_csv(const char *in_sql, const char *out_csv) {
             goto next_line;
         }
 
-        // parse values (single-quoted literals only)
+        // parse values
         StrList vals = {0};
         while (true) {
-            char *v = parse_sql_string_literal(&p);
+            char *v = parse_sql_value(&p);
             if (!v) {
                 sl_free(&vals);
                 sl_free(&cols_this);
@@ -591,7 +599,7 @@ static int sql_to_csv(const char *in_sql, const char *out_csv) {
                 sl_free(&vals);
                 sl_free(&cols_this);
                 free(line);
-                fclose(f);
+                close_input(f, z, in_sql);
                 fprintf(stderr, "Error: SQL contains mixed column sets; not supported in MVP\n");
                 // free columns/rows
                 for (size_t r = 0; r < nrows; r++) {
@@ -607,7 +615,7 @@ static int sql_to_csv(const char *in_sql, const char *out_csv) {
                     sl_free(&vals);
                     sl_free(&cols_this);
                     free(line);
-                    fclose(f);
+                    close_input(f, z, in_sql);
                     fprintf(stderr, "Error: SQL contains mixed column sets; not supported in MVP\n");
                     for (size_t r = 0; r < nrows; r++) {
                         for (size_t c = 0; c < columns.len; c++) free(rows[r][c]);
@@ -647,14 +655,14 @@ static int sql_to_csv(const char *in_sql, const char *out_csv) {
     }
 
     free(line);
-    fclose(f);
+    int rc = close_input(f, z, in_sql);
 
-    if (columns.len == 0) {
+    if (rc == 0 && columns.len == 0) {
         fprintf(stderr, "Error: No INSERT statements found (this MVP only parses INSERTs generated by dtconvert)\n");
         return 1;
     }
 
-    int rc = csv_write(out_csv, columns.items, columns.len, rows, nrows);
+    if (rc == 0) rc = csv_write(out_csv, columns.items, columns.len, rows, nrows);
 
     for (size_t r = 0; r < nrows; r++) {
         for (size_t c = 0; c < columns.len; c++) free(rows[r][c]);
@@ -668,10 +676,11 @@ static int sql_to_csv(const char *in_sql, const char *out_csv) {
 
 static void usage(void) {
     fprintf(stderr,
-            "Usage: sql_convert <csv-to-sql|sql-to-csv> <input> <output> [--table NAME] [--create]\n");
+            "Usage: sql_convert <csv-to-sql|sql-to-csv> <input> <output> [--table NAME] [--create] "
+            "[--infer-types]\n");
 }
 
-int main(int argc, char **argv) {
+int sql_convert_main(int argc, char **argv) {
     if (argc < 4) {
         usage();
         return 2;
@@ -683,6 +692,7 @@ int main(int argc, char **argv) {
 
     char *table = xstrdup("data");
     bool create_table = false;
+    bool infer = type_infer_enabled();
 
     for (int i = 4; i < argc; i++) {
         if (strcmp(argv[i], "--table") == 0) {
@@ -700,6 +710,10 @@ int main(int argc, char **argv) {
             create_table = true;
             continue;
         }
+        if (strcmp(argv[i], "--infer-types") == 0) {
+            infer = true;
+            continue;
+        }
         free(table);
         fprintf(stderr, "Error: Unknown argument: %s\n", argv[i]);
         return 2;
@@ -709,7 +723,7 @@ int main(int argc, char **argv) {
 
     int rc;
     if (strcmp(cmd, "csv-to-sql") == 0) {
-        rc = csv_to_sql(in_path, out_path, table, create_table);
+        rc = csv_to_sql(in_path, out_path, table, create_table, infer);
     } else if (strcmp(cmd, "sql-to-csv") == 0) {
         rc = sql_to_csv(in_path, out_path);
     } else {
@@ -720,3 +734,9 @@ int main(int argc, char **argv) {
     free(table);
     return rc == 0 ? 0 : 1;
 }
+
+#ifndef DTCONVERT_NO_MAIN
+int main(int argc, char **argv) {
+    return sql_convert_main(argc, argv);
+}
+#endif
@@ -5,9 +5,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "compress_io.h"
+#include "input_map.h"
+#include "libdtconvert.h"
+#include "outbuf.h"
+
 static void die(const char *msg) {
     fprintf(stderr, "Error: %s\n", msg);
-    exit(1);
+    helper_exit(1);
 }
 
 static void *xmalloc(size_t n) {
@@ -22,8 +27,9 @@ static void *xrealloc(void *p, size_t n) {
     return q;
 }
 
+// Compares the name before any .gz/.zst suffix, so tokens.json.gz is JSON.
 static bool ends_with_ci(const char *s, const char *suffix) {
-    size_t ns = strlen(s);
+    size_t ns = strlen(s) - compress_suffix_len(s);
     size_t nf = strlen(suffix);
     if (nf > ns) return false;
     const char *p = s + (ns - nf);
@@ -35,29 +41,6 @@ static bool ends_with_ci(const char *s, const char *suffix) {
     return true;
 }
 
-static void json_write_escaped(FILE *f, const char *s) {
-    fputc('"', f);
-    for (const unsigned char *p = (const unsigned char *)(s ? s : ""); *p; p++) {
-        unsigned char ch = *p;
-        switch (ch) {
-            case '"': fputs("\\\"", f); break;
-            case '\\': fputs("\\\\", f); break;
-            case '\b': fputs("\\b", f); break;
-            case '\f': fputs("\\f", f); break;
-            case '\n': fputs("\\n", f); break;
-            case '\r': fputs("\\r", f); break;
-            case '\t': fputs("\\t", f); break;
-            default:
-                if (ch < 0x20) {
-                    fprintf(f, "\\u%04x", (unsigned int)ch);
-                } else {
-                    fputc((char)ch, f);
-                }
-        }
-    }
-    fputc('"', f);
-}
-
 typedef struct {
     char **items;
     size_t len;
@@ -82,33 +65,6 @@ static void tokens_free(Tokens *t) {
     memset(t, 0, sizeof(*t));
 }
 
-static int read_all(const char *path, char **out_buf, size_t *out_len) {
-    FILE *f = fopen(path, "rb");
-    if (!f) {
-        fprintf(stderr, "Error: cannot open '%s': %s\n", path, strerror(errno));
-        return 1;
-    }
-    if (fseek(f, 0, SEEK_END) != 0) {
-        fclose(f);
-        return 1;
-    }
-    long sz = ftell(f);
-    if (sz < 0) {
-        fclose(f);
-        return 1;
-    }
-    rewind(f);
-
-    char *buf = (char *)xmalloc((size_t)sz + 1);
-    size_t nread = fread(buf, 1, (size_t)sz, f);
-    fclose(f);
-
-    buf[nread] = '\0';
-    *out_buf = buf;
-    *out_len = nread;
-    return 0;
-}
-
 // Tokenization model (byte-based, ASCII classes):
 // - sequences of [A-Za-z0-9_] are one token
 // - any non-whitespace, non-word byte is its own token
@@ -148,42 +104,34 @@ static int tokenize_text(const char *buf, size_t len, Tokens *out) {
 }
 
 static int write_tokens_txt(const char *path, const Tokens *t) {
-    FILE *f = fopen(path, "wb");
-    if (!f) {
-        fprintf(stderr, "Error: cannot write '%s': %s\n", path, strerror(errno));
-        return 1;
-    }
+    OutBuf out;
+    if (ob_open(&out, path) != 0) return 1;
 
     for (size_t i = 0; i < t->len; i++) {
-        fputs(t->items[i], f);
-        fputc('\n', f);
+        ob_puts(&out, t->items[i]);
+        ob_putc(&out, '\n');
     }
 
-    fclose(f);
-    return 0;
+    return ob_close(&out, path);
 }
 
 static int write_tokens_json(const char *path, const Tokens *t) {
-    FILE *f = fopen(path, "wb");
-    if (!f) {
-        fprintf(stderr, "Error: cannot write '%s': %s\n", path, strerror(errno));
-        return 1;
-    }
+    OutBuf out;
+    if (ob_open(&out, path) != 0) return 1;
 
-    fputs("[\n", f);
+    ob_puts(&out, "[\n");
     for (size_t i = 0; i < t->len; i++) {
-        fputs("  ", f);
-        json_write_escaped(f, t->items[i]);
-        if (i + 1 < t->len) fputs(",", f);
-        fputc('\n', f);
+        ob_puts(&out, "  ");
+        ob_json_string(&out, t->items[i], strlen(t->items[i]));
+        if (i + 1 < t->len) ob_putc(&out, ',');
+        ob_putc(&out, '\n');
     }
-    fputs("]\n", f);
+    ob_puts(&out, "]\n");
 
-    fclose(f);
-    return 0;
+    return ob_close(&out, path);
 }
 
-int main(int argc, char **argv) {
+int tokenize_main(int argc, char **argv) {
     if (argc != 3) {
         fprintf(stderr, "Usage: tokenize <input.txt> <output.(txt|json)>\n");
         return 2;
@@ -192,13 +140,12 @@ int main(int argc, char **argv) {
     const char *in_path = argv[1];
     const char *out_path = argv[2];
 
-    char *buf = NULL;
-    size_t len = 0;
-    if (read_all(in_path, &buf, &len) != 0) return 1;
+    InputMap in;
+    if (input_map_open(&in, in_path) != 0) return 1;
 
     Tokens t = {0};
-    int rc = tokenize_text(buf, len, &t);
-    free(buf);
+    int rc = tokenize_text(in.data, in.len, &t);
+    input_map_close(&in);
     if (rc != 0) {
         tokens_free(&t);
         return 1;
@@ -214,3 +161,9 @@ int main(int argc, char **argv) {
     tokens_free(&t);
     return wrc == 0 ? 0 : 1;
 }
+
+#ifndef DTCONVERT_NO_MAIN
+int main(int argc, char **argv) {
+    return tokenize_main(argc, argv);
+}
+#endif
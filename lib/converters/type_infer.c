@@ -0,0 +1,163 @@
+#include "type_infer.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+bool type_infer_enabled(void) {
+    const char *s = getenv("DTCONVERT_INFER_TYPES");
+    return s && s[0] && strcmp(s, "0") != 0 && strcasecmp(s, "false") != 0;
+}
+
+// ---------------- Recognizers ----------------
+
+static inline bool is_digit(char ch) { return ch >= '0' && ch <= '9'; }
+
+// True when all 8 bytes at p are ASCII digits: each byte must be 0x3N, and
+// adding 6 must not carry it past 0x3F. A carry out of a byte only happens for
+// bytes >= 0xFA, which fail the first test anyway.
+static inline bool eight_digits(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    const uint64_t hi = 0xF0F0F0F0F0F0F0F0ULL;
+    return ((v & hi) | (((v + 0x0606060606060606ULL) & hi) >> 4)) == 0x3333333333333333ULL;
+}
+
+// Length of the run of digits at the start of p[0..n).
+static size_t digit_run(const char *p, size_t n) {
+    size_t i = 0;
+    while (i + 8 <= n && eight_digits(p + i)) i += 8;
+    while (i < n && is_digit(p[i])) i++;
+    return i;
+}
+
+static int two_digits(const char *p) {
+    if (!is_digit(p[0]) || !is_digit(p[1])) return -1;
+    return (p[0] - '0') * 10 + (p[1] - '0');
+}
+
+// n digits without leading zeros; the limits are compared as digit strings of
+// the same length.
+static DataType integer_type(const char *d, size_t n, bool neg) {
+    if (n < 10) return DT_INTEGER;
+    if (n == 10) return memcmp(d, neg ? "2147483648" : "2147483647", 10) <= 0 ? DT_INTEGER : DT_BIGINT;
+    if (n < 19) return DT_BIGINT;
+    if (n == 19) return memcmp(d, neg ? "9223372036854775808" : "9223372036854775807", 19) <= 0 ? DT_BIGINT : DT_NUMERIC;
+    return DT_NUMERIC;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+static DataType number_type(const char *s, size_t n) {
+    size_t i = s[0] == '-' ? 1 : 0;
+    const char *digits = s + i;
+    size_t d = digit_run(digits, n - i);
+    if (d == 0 || (d > 1 && digits[0] == '0')) return DT_TEXT;
+    i += d;
+    if (i == n) return integer_type(digits, d, s[0] == '-');
+
+    if (s[i] == '.') {
+        size_t f = digit_run(s + i + 1, n - i - 1);
+        if (f == 0) return DT_TEXT;
+        i += 1 + f;
+    }
+    if (i < n && (s[i] == 'e' || s[i] == 'E')) {
+        i++;
+        if (i < n && (s[i] == '+' || s[i] == '-')) i++;
+        size_t e = digit_run(s + i, n - i);
+        if (e == 0) return DT_TEXT;
+        i += e;
+    }
+    return i == n ? DT_NUMERIC : DT_TEXT;
+}
+
+static bool valid_date(int y, int m, int d) {
+    static const int days[12] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (y < 1 || m < 1 || m > 12 || d < 1 || d > days[m - 1]) return false;
+    bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    return m != 2 || d < 29 || leap;
+}
+
+static DataType date_type(const char *s, size_t n) {
+    if (n < 10 || s[4] != '-' || s[7] != '-') return DT_TEXT;
+    int yh = two_digits(s), yl = two_digits(s + 2), m = two_digits(s + 5), d = two_digits(s + 8);
+    if (yh < 0 || yl < 0 || !valid_date(yh * 100 + yl, m, d)) return DT_TEXT;
+    if (n == 10) return DT_DATE;
+
+    // Time of day: HH:MM[:SS[.fraction]]
+    if ((s[10] != 'T' && s[10] != ' ') || n < 16 || s[13] != ':') return DT_TEXT;
+    int hh = two_digits(s + 11), mm = two_digits(s + 14);
+    if (hh < 0 || hh > 23 || mm < 0 || mm > 59) return DT_TEXT;
+    size_t i = 16;
+    if (i < n && s[i] == ':') {
+        int ss = i + 3 <= n ? two_digits(s + i + 1) : -1;
+        if (ss < 0 || ss > 59) return DT_TEXT;
+        i += 3;
+        if (i < n && s[i] == '.') {
+            size_t f = digit_run(s + i + 1, n - i - 1);
+            if (f == 0) return DT_TEXT;
+            i += 1 + f;
+        }
+    }
+    if (i == n) return DT_TIMESTAMP;
+
+    // Offset: Z, +HH, +HHMM or +HH:MM
+    if (s[i] == 'Z') return i + 1 == n ? DT_TIMESTAMPTZ : DT_TEXT;
+    if (s[i] != '+' && s[i] != '-') return DT_TEXT;
+    i++;
+    int oh = i + 2 <= n ? two_digits(s + i) : -1;
+    if (oh < 0 || oh > 23) return DT_TEXT;
+    i += 2;
+    if (i < n && s[i] == ':') i++;
+    if (i < n) {
+        int om = i + 2 <= n ? two_digits(s + i) : -1;
+        if (om < 0 || om > 59) return DT_TEXT;
+        i += 2;
+    }
+    return i == n ? DT_TIMESTAMPTZ : DT_TEXT;
+}
+
+// ---------------- Public API ----------------
+
+bool type_is_null(const char *s, size_t n) { return n == 0 || (n == 4 && strncasecmp(s, "null", 4) == 0); }
+
+DataType type_of_value(const char *s, size_t n) {
+    if (n == 0) return DT_NULL;
+    // The first byte rules out all but one or two candidates.
+    switch (s[0]) {
+        case 't':
+        case 'T': return n == 4 && strncasecmp(s, "true", 4) == 0 ? DT_BOOLEAN : DT_TEXT;
+        case 'f':
+        case 'F': return n == 5 && strncasecmp(s, "false", 5) == 0 ? DT_BOOLEAN : DT_TEXT;
+        case 'n':
+        case 'N': return type_is_null(s, n) ? DT_NULL : DT_TEXT;
+        case '-': return number_type(s, n);
+        default: break;
+    }
+    if (!is_digit(s[0])) return DT_TEXT;
+    DataType t = number_type(s, n);
+    return t != DT_TEXT ? t : date_type(s, n);
+}
+
+DataType type_join(DataType a, DataType b) {
+    if (a == b || b == DT_NULL) return a;
+    if (a == DT_NULL) return b;
+    if (type_is_number(a) && type_is_number(b)) return a > b ? a : b;
+    if ((a == DT_DATE && b == DT_TIMESTAMP) || (a == DT_TIMESTAMP && b == DT_DATE)) return DT_TIMESTAMP;
+    return DT_TEXT;
+}
+
+const char *type_sql_name(DataType t) {
+    switch (t) {
+        case DT_BOOLEAN: return "BOOLEAN";
+        case DT_INTEGER: return "INTEGER";
+        case DT_BIGINT: return "BIGINT";
+        case DT_NUMERIC: return "NUMERIC";
+        case DT_DATE: return "DATE";
+        case DT_TIMESTAMP: return "TIMESTAMP";
+        case DT_TIMESTAMPTZ: return "TIMESTAMP WITH TIME ZONE";
+        case DT_NULL:
+        case DT_TEXT: break;
+    }
+    return "TEXT";
+}
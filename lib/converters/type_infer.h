@@ -0,0 +1,57 @@
+#ifndef DTCONVERT_TYPE_INFER_H
+#define DTCONVERT_TYPE_INFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Column type inference shared by data_convert, sql_convert and pg_store
+// (--infer-types, or DTCONVERT_INFER_TYPES=1).
+//
+// Every value of a column is classified on its own and the column takes the
+// join of those types, so a column is only typed when all of its values fit.
+// Empty values and "null" are nulls and fit every type. Recognized forms:
+//
+// - booleans: true, false (any case);
+// - integers and decimals in JSON number syntax: no leading '+' or zeros, so
+//   "007" and "+1" stay text;
+// - dates (YYYY-MM-DD) and timestamps (date, 'T' or ' ', HH:MM[:SS[.f]],
+//   optional Z or +HH[:MM] offset).
+//
+// Digit runs are checked 8 bytes at a time.
+
+typedef enum {
+    // Only nulls so far.
+    DT_NULL = 0,
+    DT_BOOLEAN,
+    // Integers that fit in 32 bits, then 64 bits.
+    DT_INTEGER,
+    DT_BIGINT,
+    DT_NUMERIC,
+    DT_DATE,
+    DT_TIMESTAMP,
+    DT_TIMESTAMPTZ,
+    DT_TEXT,
+} DataType;
+
+// True when DTCONVERT_INFER_TYPES is set to anything but "", "0" or "false".
+bool type_infer_enabled(void);
+
+DataType type_of_value(const char *s, size_t n);
+
+// Narrowest type that holds values of both a and b.
+DataType type_join(DataType a, DataType b);
+
+// Joins the type of one value into *t.
+static inline void type_add(DataType *t, const char *s, size_t n) {
+    if (*t != DT_TEXT) *t = type_join(*t, type_of_value(s, n));
+}
+
+// An empty value or "null" (any case).
+bool type_is_null(const char *s, size_t n);
+
+static inline bool type_is_number(DataType t) { return t == DT_INTEGER || t == DT_BIGINT || t == DT_NUMERIC; }
+
+// Column type for CREATE TABLE. Columns holding only nulls are TEXT.
+const char *type_sql_name(DataType t);
+
+#endif // DTCONVERT_TYPE_INFER_H
@@ -6,6 +6,12 @@
 
 set -euo pipefail
 
+if [ "${1:-}" = "--describe" ]; then
+  echo "dtconvert-describe 1"
+  echo "csv pdf resource=cpu description=CSV to PDF converter"
+  exit 0
+fi
+
 if [ $# -lt 2 ]; then
   echo "Usage: $0 <input.csv> <output.pdf>" >&2
   exit 1
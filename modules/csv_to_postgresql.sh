@@ -6,6 +6,12 @@
 
 set -euo pipefail
 
+if [ "${1:-}" = "--describe" ]; then
+  echo "dtconvert-describe 1"
+  echo "csv postgresql stream=in resource=db-connection description=CSV to PostgreSQL importer"
+  exit 0
+fi
+
 if [ $# -lt 2 ]; then
   echo "Usage: $0 <input.csv> <config.json>" >&2
   exit 1
@@ -14,7 +20,7 @@ fi
 INPUT_FILE="$1"
 CONFIG_FILE="$2"
 
-if [ ! -f "$INPUT_FILE" ]; then
+if [ "$INPUT_FILE" != "-" ] && [ ! -f "$INPUT_FILE" ]; then
   echo "Error: Input file not found: $INPUT_FILE" >&2
   exit 1
 fi
@@ -7,6 +7,12 @@
 
 set -euo pipefail
 
+if [ "${1:-}" = "--describe" ]; then
+  echo "dtconvert-describe 1"
+  echo "csv sql stream=in,out output=named resource=cpu description=CSV to SQL converter"
+  exit 0
+fi
+
 if [ $# -lt 2 ]; then
   echo "Usage: $0 <input.csv> <output.sql>" >&2
   exit 1
@@ -15,7 +21,7 @@ fi
 INPUT_FILE="$1"
 OUTPUT_FILE="$2"
 
-if [ ! -f "$INPUT_FILE" ]; then
+if [ "$INPUT_FILE" != "-" ] && [ ! -f "$INPUT_FILE" ]; then
   echo "Error: Input file not found: $INPUT_FILE" >&2
   exit 1
 fi
@@ -31,6 +37,12 @@ TABLE_NAME="${DTCONVERT_SQL_TABLE:-}"
 if [ -z "$TABLE_NAME" ]; then
   # Default: derive from output file basename
   base="$(basename "$OUTPUT_FILE")"
+  # stdout ("-") has no name to go by
+  [ "$OUTPUT_FILE" = "-" ] && base="data.sql"
+  # out.sql.gz names table "out", like out.sql
+  case "$base" in
+    *.gz|*.GZ|*.zst|*.ZST) base="${base%.*}" ;;
+  esac
   TABLE_NAME="${base%.*}"
   TABLE_NAME="${TABLE_NAME//[^A-Za-z0-9_]/_}"
   if [[ ! "$TABLE_NAME" =~ ^[A-Za-z_] ]]; then
@@ -1,5 +1,11 @@
 #!/bin/bash
 # CSV to Text converter
+if [ "${1:-}" = "--describe" ]; then
+    echo "dtconvert-describe 1"
+    echo "csv txt stream=in,out resource=io-bound description=CSV to Text converter"
+    exit 0
+fi
+
 if [ $# -lt 2 ]; then
     echo "Usage: $0 <input.csv> <output.txt>"
     exit 1
@@ -8,6 +14,10 @@ fi
 INPUT_FILE="$1"
 OUTPUT_FILE="$2"
 
+# "-" is standard input / output
+[ "$INPUT_FILE" = "-" ] && INPUT_FILE=/dev/stdin
+[ "$OUTPUT_FILE" = "-" ] && OUTPUT_FILE=/dev/stdout
+
 # Simple CSV to formatted text using column command
 if command -v column &> /dev/null; then
     column -t -s ',' "$INPUT_FILE" > "$OUTPUT_FILE"
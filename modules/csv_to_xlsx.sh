@@ -4,6 +4,12 @@
 
 set -euo pipefail
 
+if [ "${1:-}" = "--describe" ]; then
+  echo "dtconvert-describe 1"
+  echo "csv xlsx resource=memory-heavy description=CSV to XLSX converter"
+  exit 0
+fi
+
 if [ $# -lt 2 ]; then
   echo "Usage: $0 <input.csv> <output.xlsx>" >&2
   exit 1
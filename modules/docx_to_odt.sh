@@ -4,6 +4,12 @@
 
 set -e
 
+if [ "${1:-}" = "--describe" ]; then
+  echo "dtconvert-describe 1"
+  echo "docx odt resource=memory-heavy description=DOCX to ODT converter"
+  exit 0
+fi
+
 if [ $# -lt 2 ]; then
   echo "Usage: $0 <input.docx> <output.odt>" >&2
   exit 1
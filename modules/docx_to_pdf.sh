@@ -4,6 +4,12 @@
 
 set -e
 
+if [ "${1:-}" = "--describe" ]; then
+    echo "dtconvert-describe 1"
+    echo "docx pdf resource=memory-heavy description=DOCX to PDF converter"
+    exit 0
+fi
+
 # Check for required arguments
 if [ $# -lt 2 ]; then
     echo "Usage: $0 <input.docx> <output.pdf>"
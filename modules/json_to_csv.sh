@@ -12,7 +12,7 @@ fi
 INPUT_FILE="$1"
 OUTPUT_FILE="$2"
 
-if [ ! -f "$INPUT_FILE" ]; then
+if [ "$INPUT_FILE" != "-" ] && [ ! -f "$INPUT_FILE" ]; then
   echo "Error: Input file not found: $INPUT_FILE" >&2
   exit 1
 fi
@@ -4,6 +4,12 @@
 
 set -e
 
+if [ "${1:-}" = "--describe" ]; then
+  echo "dtconvert-describe 1"
+  echo "odt docx resource=memory-heavy description=ODT to DOCX converter"
+  exit 0
+fi
+
 if [ $# -lt 2 ]; then
   echo "Usage: $0 <input.odt> <output.docx>" >&2
   exit 1
@@ -1,5 +1,11 @@
 #!/bin/bash
 # ODT to PDF converter
+if [ "${1:-}" = "--describe" ]; then
+    echo "dtconvert-describe 1"
+    echo "odt pdf resource=memory-heavy description=ODT to PDF converter"
+    exit 0
+fi
+
 if [ $# -lt 2 ]; then
     echo "Usage: $0 <input.odt> <output.pdf>"
     exit 1
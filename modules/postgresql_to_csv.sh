@@ -7,6 +7,12 @@
 
 set -euo pipefail
 
+if [ "${1:-}" = "--describe" ]; then
+  echo "dtconvert-describe 1"
+  echo "postgresql csv stream=out resource=db-connection description=PostgreSQL to CSV exporter"
+  exit 0
+fi
+
 if [ $# -lt 2 ]; then
   echo "Usage: $0 <config.json> <output.csv>" >&2
   exit 1
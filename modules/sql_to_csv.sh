@@ -5,6 +5,12 @@
 
 set -euo pipefail
 
+if [ "${1:-}" = "--describe" ]; then
+  echo "dtconvert-describe 1"
+  echo "sql csv stream=in,out resource=cpu description=SQL to CSV converter"
+  exit 0
+fi
+
 if [ $# -lt 2 ]; then
   echo "Usage: $0 <input.sql> <output.csv>" >&2
   exit 1
@@ -13,7 +19,7 @@ fi
 INPUT_FILE="$1"
 OUTPUT_FILE="$2"
 
-if [ ! -f "$INPUT_FILE" ]; then
+if [ "$INPUT_FILE" != "-" ] && [ ! -f "$INPUT_FILE" ]; then
   echo "Error: Input file not found: $INPUT_FILE" >&2
   exit 1
 fi
@@ -3,6 +3,12 @@
 
 set -euo pipefail
 
+if [ "${1:-}" = "--describe" ]; then
+    echo "dtconvert-describe 1"
+    echo "txt pdf resource=cpu description=Text to PDF converter"
+    exit 0
+fi
+
 if [ $# -lt 2 ]; then
     echo "Usage: $0 <input.txt> <output.pdf>" >&2
     exit 1
@@ -4,6 +4,12 @@
 
 set -euo pipefail
 
+if [ "${1:-}" = "--describe" ]; then
+  echo "dtconvert-describe 1"
+  echo "txt tokens stream=in,out resource=cpu description=Text to tokens converter"
+  exit 0
+fi
+
 if [ $# -lt 2 ]; then
   echo "Usage: $0 <input.txt> <output.(txt|json)>" >&2
   exit 1
@@ -12,7 +18,7 @@ fi
 INPUT_FILE="$1"
 OUTPUT_FILE="$2"
 
-if [ ! -f "$INPUT_FILE" ]; then
+if [ "$INPUT_FILE" != "-" ] && [ ! -f "$INPUT_FILE" ]; then
   echo "Error: Input file not found: $INPUT_FILE" >&2
   exit 1
 fi
@@ -4,6 +4,12 @@
 
 set -euo pipefail
 
+if [ "${1:-}" = "--describe" ]; then
+  echo "dtconvert-describe 1"
+  echo "xlsx csv resource=memory-heavy description=XLSX to CSV converter"
+  exit 0
+fi
+
 if [ $# -lt 2 ]; then
   echo "Usage: $0 <input.xlsx> <output.csv>" >&2
   exit 1
@@ -32,6 +32,10 @@ echo
 
 tmpdir="$(mktemp -d /tmp/dtconvert_conversions.XXXXXX)"
 trap 'rm -rf "$tmpdir"' EXIT
+# Keep the planner's timings, the converter index and cached outputs out of the user's cache
+export DTCONVERT_COSTS="$tmpdir/costs.tsv"
+export DTCONVERT_INDEX="$tmpdir/index.tsv"
+export DTCONVERT_CACHE="$tmpdir/cache"
 
 # Inputs
 cat >"$tmpdir/in.csv" <<'CSV'
@@ -96,6 +100,118 @@ skip_test() {
 run_and_check_nonempty "csv_to_json" "$tmpdir/out.csv.json" "$DTCONVERT" "$tmpdir/in.csv" --to json -o "$tmpdir/out.csv.json" -f
 run_and_check_nonempty "json_to_csv" "$tmpdir/out.json.csv" "$DTCONVERT" "$tmpdir/out.csv.json" --from json --to csv -o "$tmpdir/out.json.csv" -f
 
+# CSV <-> NDJSON
+run_and_check_nonempty "csv_to_ndjson" "$tmpdir/out.csv.ndjson" "$DTCONVERT" "$tmpdir/in.csv" --to ndjson -o "$tmpdir/out.csv.ndjson" -f
+run_and_check_nonempty "ndjson_to_csv" "$tmpdir/out.ndjson.csv" "$DTCONVERT" "$tmpdir/out.csv.ndjson" --to csv -o "$tmpdir/out.ndjson.csv" -f
+
+# CSV <-> Arrow IPC
+run_and_check_nonempty "csv_to_arrow" "$tmpdir/out.csv.arrow" "$DTCONVERT" "$tmpdir/in.csv" --to arrow -o "$tmpdir/out.csv.arrow" -f
+run "arrow_to_csv (round trip matches the input)" bash -c '
+  "$1" "$2/out.csv.arrow" --to csv -o "$2/out.arrow.csv" -f >/dev/null &&
+  cmp -s "$2/in.csv" "$2/out.arrow.csv" &&
+  "$1" "$2/in.csv" --to arrow -o "$2/typed.arrow" -f --infer-types >/dev/null &&
+  "$1" "$2/typed.arrow" --to csv -o "$2/typed.csv" -f >/dev/null &&
+  cmp -s "$2/in.csv" "$2/typed.csv"' _ "$DTCONVERT" "$tmpdir"
+
+# Null strings in an Arrow input stay null in JSON (pyarrow writes the input)
+if command -v python3 >/dev/null 2>&1 && python3 -c "import pyarrow" >/dev/null 2>&1; then
+  run "arrow_to_json (null strings)" bash -c '
+    python3 -c "import pyarrow as pa, sys; t = pa.table({\"s\": pa.array([\"x\", None, \"\"])}); w = pa.ipc.new_stream(sys.argv[1], t.schema); w.write_table(t); w.close()" "$2/nulls.arrow" &&
+    "$1" "$2/nulls.arrow" --to json -o "$2/nulls.json" -f &&
+    grep -q "\"s\": null" "$2/nulls.json" && grep -q "\"s\": \"\"" "$2/nulls.json"' _ "$DTCONVERT" "$tmpdir"
+else
+  skip_test "arrow_to_json (null strings)" "missing python3 pyarrow"
+fi
+
+# CSV -> Parquet
+run "csv_to_parquet (PAR1 at both ends)" bash -c '
+  "$1" "$2/in.csv" --to parquet -o "$2/out.csv.parquet" -f >/dev/null &&
+  [ "$(head -c 4 "$2/out.csv.parquet")" = PAR1 ] && [ "$(tail -c 4 "$2/out.csv.parquet")" = PAR1 ]' _ "$DTCONVERT" "$tmpdir"
+
+# pyarrow reads back every row, across small row groups and from a column
+# that stays dictionary-encoded as well as one that falls back to PLAIN
+if command -v python3 >/dev/null 2>&1 && python3 -c "import pyarrow" >/dev/null 2>&1; then
+  awk 'BEGIN {
+    print "id,color"
+    for (i = 0; i < 5000; i++) printf "value %d,%s\n", i, (i % 3 == 0 ? "red" : i % 3 == 1 ? "green" : "blue")
+  }' >"$tmpdir/pq.csv"
+  run "csv_to_parquet (read back by pyarrow)" bash -c '
+    DTCONVERT_PARQUET_ROW_GROUP_ROWS=700 "$1" "$2/pq.csv" --to parquet -o "$2/pq.parquet" -f >/dev/null &&
+    python3 -c "
+import csv, sys
+import pyarrow.parquet as pq
+f = pq.ParquetFile(sys.argv[2])
+assert f.metadata.num_row_groups == 8
+enc = [set(f.metadata.row_group(g).column(c).encodings) for g in range(8) for c in range(2)]
+assert \"PLAIN\" in enc[0] and \"RLE_DICTIONARY\" not in enc[0]
+assert \"RLE_DICTIONARY\" in enc[1]
+with open(sys.argv[1], newline=\"\") as src:
+    assert f.read().to_pylist() == list(csv.DictReader(src))
+" "$2/pq.csv" "$2/pq.parquet"' _ "$DTCONVERT" "$tmpdir"
+else
+  skip_test "csv_to_parquet (read back by pyarrow)" "missing python3 pyarrow"
+fi
+
+# Null strings in an Arrow input stay null in Parquet, empty strings stay empty
+if command -v python3 >/dev/null 2>&1 && python3 -c "import pyarrow" >/dev/null 2>&1; then
+  run "arrow_to_parquet (null strings)" bash -c '
+    python3 -c "import pyarrow as pa, sys; t = pa.table({\"s\": pa.array([\"x\", None, \"\"])}); w = pa.ipc.new_stream(sys.argv[1], t.schema); w.write_table(t); w.close()" "$2/pq_nulls.arrow" &&
+    "$1" "$2/pq_nulls.arrow" --to parquet -o "$2/pq_nulls.parquet" -f &&
+    python3 -c "import pyarrow.parquet as pq, sys; assert pq.read_table(sys.argv[1]).column(\"s\").to_pylist() == [\"x\", None, \"\"]" "$2/pq_nulls.parquet"' _ "$DTCONVERT" "$tmpdir"
+else
+  skip_test "arrow_to_parquet (null strings)" "missing python3 pyarrow"
+fi
+
+# Compressed input/output (gzip through zlib)
+if need_cmd gzip; then
+  gzip -c "$tmpdir/in.csv" >"$tmpdir/in.csv.gz"
+  run_and_check_nonempty "csv_gz_to_json_gz" "$tmpdir/out.json.gz" "$DTCONVERT" "$tmpdir/in.csv.gz" --to json -o "$tmpdir/out.json.gz" -f
+else
+  skip_test "csv_gz_to_json_gz" "missing gzip"
+fi
+
+# Standard input -> standard output
+run_and_check_nonempty "stdin_csv_to_stdout_json" "$tmpdir/out.stdin.json" \
+  bash -c '"$1" - --from csv --to json <"$2" >"$3"' _ "$DTCONVERT" "$tmpdir/in.csv" "$tmpdir/out.stdin.json"
+
+# Parallel chunked parsing: a CSV of many 64 KiB chunks with quoted commas,
+# "" escapes and quoted newlines (which land on chunk edges), and the same
+# rows as NDJSON, parse identically on 1 and 8 threads. The literal quote in
+# row 9000's unquoted field throws off the guessed boundaries after it, so
+# a range overruns and the serial reader takes over.
+awk 'BEGIN {
+  print "id,name,quote,note"
+  for (i = 0; i < 20000; i++) {
+    note = (i % 7 == 0) ? "\"line one " i "\nline two\"" : "plain " i
+    if (i == 9000) note = "5\" tall"
+    printf "%d,\"Doe, J %d\",\"say \"\"hi\"\" %d\",%s\n", i, i, i, note
+  }
+}' >"$tmpdir/big.csv"
+run "parallel csv parse (-j 1 vs -j 8)" bash -c '
+  export DTCONVERT_CHUNK_SIZE=65536 &&
+  "$1" "$2/big.csv" --to ndjson -o "$2/big.1.ndjson" -f --no-cache -j 1 >/dev/null &&
+  "$1" "$2/big.csv" --to ndjson -o "$2/big.8.ndjson" -f --no-cache -j 8 >/dev/null &&
+  [ "$(wc -l < "$2/big.1.ndjson")" -eq 20000 ] && cmp "$2/big.1.ndjson" "$2/big.8.ndjson"' _ "$DTCONVERT" "$tmpdir"
+run "parallel ndjson parse (-j 1 vs -j 8)" bash -c '
+  export DTCONVERT_CHUNK_SIZE=65536 &&
+  "$1" "$2/big.1.ndjson" --to csv -o "$2/big.1.csv" -f --no-cache -j 1 >/dev/null &&
+  "$1" "$2/big.1.ndjson" --to csv -o "$2/big.8.csv" -f --no-cache -j 8 >/dev/null &&
+  cmp "$2/big.1.csv" "$2/big.8.csv"' _ "$DTCONVERT" "$tmpdir"
+
+# Ordered parallel formatting: the JSON, NDJSON and YAML writers produce the
+# same bytes on 1 and 4 threads, from CSV ranges and from the blocks a
+# serial (JSON) reader hands over
+run "parallel json/ndjson/yaml output (-j 1 vs -j 4)" bash -c '
+  export DTCONVERT_CHUNK_SIZE=65536 &&
+  for fmt in json ndjson yaml; do
+    "$1" "$2/big.csv" --to $fmt -o "$2/fmt.1.$fmt" -f --no-cache -j 1 >/dev/null &&
+    "$1" "$2/big.csv" --to $fmt -o "$2/fmt.4.$fmt" -f --no-cache -j 4 >/dev/null &&
+    cmp "$2/fmt.1.$fmt" "$2/fmt.4.$fmt" || exit 1
+  done &&
+  "$1" "$2/fmt.1.json" --to yaml -o "$2/blocks.1.yaml" -f --no-cache -j 1 >/dev/null &&
+  "$1" "$2/fmt.1.json" --to yaml -o "$2/blocks.4.yaml" -f --no-cache -j 4 >/dev/null &&
+  cmp "$2/blocks.1.yaml" "$2/blocks.4.yaml" && cmp "$2/fmt.1.yaml" "$2/blocks.1.yaml"' _ "$DTCONVERT" "$tmpdir"
+
 # JSON <-> YAML
 run_and_check_nonempty "json_to_yaml" "$tmpdir/out.json.yaml" "$DTCONVERT" "$tmpdir/in.json" --to yaml -o "$tmpdir/out.json.yaml" -f
 run_and_check_nonempty "yaml_to_json" "$tmpdir/out.yaml.json" "$DTCONVERT" "$tmpdir/in.yaml" --to json -o "$tmpdir/out.yaml.json" -f
@@ -113,6 +229,108 @@ run_and_check_nonempty "txt_to_tokens" "$tmpdir/out.tokens" "$DTCONVERT" "$tmpdi
 # CSV <-> SQL
 run_and_check_nonempty "csv_to_sql" "$tmpdir/out.csv.sql" "$DTCONVERT" "$tmpdir/in.csv" --to sql -o "$tmpdir/out.csv.sql" -f
 run_and_check_nonempty "sql_to_csv" "$tmpdir/out.sql.csv" "$DTCONVERT" "$tmpdir/out.csv.sql" --from sql --to csv -o "$tmpdir/out.sql.csv" -f
+run "csv_to_sql (one INSERT per row)" bash -c '
+  printf "a,b\n1,2\n3,4\n5,6\n" > "$2/rows.csv" &&
+  "$1" "$2/rows.csv" --to sql -o "$2/rows.sql" -f &&
+  [ "$(grep -c "^INSERT" "$2/rows.sql")" -eq 3 ]' _ "$DTCONVERT" "$tmpdir"
+
+# The scalar, SSE2 and AVX2 CSV scanners agree on quoted, CRLF-terminated,
+# multi-line fields longer than a vector, and keep text after a closing quote
+# ("ab"cd) in its own field
+awk 'BEGIN {
+  printf "id,text,note\r\n"
+  for (i = 0; i < 300; i++) {
+    printf "%d,\"a fairly long field, with commas, \"\"quotes\"\" and %d\",", i, i
+    if (i % 5 == 0) printf "\"first line\r\nsecond line %d\"\r\n", i; else printf "unquoted note %d\r\n", i
+  }
+  printf "300,\"ab\"cd,x\r\n"
+}' >"$tmpdir/simd.csv"
+run "csv scanner (DTCONVERT_SIMD=scalar, sse2, avx2)" bash -c '
+  for simd in scalar sse2 avx2; do
+    DTCONVERT_SIMD=$simd "$1" "$2/simd.csv" --to json -o "$2/simd.$simd.json" -f --no-cache >/dev/null &&
+    DTCONVERT_SIMD=$simd DTCONVERT_SQL_TABLE=simd "$1" "$2/simd.csv" --to sql -o "$2/simd.$simd.sql" -f --no-cache >/dev/null || exit 1
+  done &&
+  [ "$(grep -c "^INSERT" "$2/simd.scalar.sql")" -eq 301 ] &&
+  grep -q "\"id\": \"300\", \"text\": \"abcd\", \"note\": \"x\"" "$2/simd.scalar.json" &&
+  grep -q "VALUES (.300., .abcd., .x.);" "$2/simd.scalar.sql" &&
+  cmp "$2/simd.scalar.json" "$2/simd.sse2.json" && cmp "$2/simd.scalar.json" "$2/simd.avx2.json" &&
+  cmp "$2/simd.scalar.sql" "$2/simd.sse2.sql" && cmp "$2/simd.scalar.sql" "$2/simd.avx2.sql"' _ "$DTCONVERT" "$tmpdir"
+
+# Two-step conversion, streamed NDJSON -> CSV -> SQL
+run_and_check_nonempty "ndjson_to_sql (piped)" "$tmpdir/out.ndjson.sql" "$DTCONVERT" "$tmpdir/out.csv.ndjson" --to sql -o "$tmpdir/out.ndjson.sql" -f
+
+# Planner: print the cheapest route without converting
+run "explain (ndjson -> sql)" "$DTCONVERT" "$tmpdir/out.csv.ndjson" --to sql --explain
+run "list converters (modules describe themselves)" \
+  bash -c '"$1" --list-converters >/dev/null && grep -q "modules/csv_to_sql.sh" "$DTCONVERT_INDEX"' _ "$DTCONVERT"
+
+# Same conversion through the module script and helper program
+run_and_check_nonempty "csv_to_sql (DTCONVERT_NATIVE=0)" "$tmpdir/out.module.sql" \
+  env DTCONVERT_NATIVE=0 "$DTCONVERT" "$tmpdir/in.csv" --to sql -o "$tmpdir/out.module.sql" -f
+
+# A repeated conversion is served from the cache, byte for byte
+run "cache (repeat matches a fresh run)" bash -c '
+  "$1" "$2/in.yaml" --to ndjson -o "$2/cache.1.ndjson" -f &&
+  "$1" "$2/in.yaml" --to ndjson -o "$2/cache.2.ndjson" -f -v | grep -q "reused from cache" &&
+  "$1" "$2/in.yaml" --to ndjson -o "$2/cache.3.ndjson" -f --no-cache &&
+  cmp -s "$2/cache.1.ndjson" "$2/cache.2.ndjson" && cmp -s "$2/cache.1.ndjson" "$2/cache.3.ndjson"' _ "$DTCONVERT" "$tmpdir"
+
+# Rows appended to a CSV are converted on the next --incremental run, once
+run "incremental (appended rows only)" bash -c '
+  printf "id,name\n1,a\n" > "$2/log.csv" &&
+  "$1" "$2/log.csv" --to ndjson -o "$2/log.ndjson" --incremental &&
+  printf "2,b\n3,c\n" >> "$2/log.csv" &&
+  "$1" "$2/log.csv" --to ndjson -o "$2/log.ndjson" --incremental &&
+  "$1" "$2/log.csv" --to ndjson -o "$2/log.ndjson" --incremental &&
+  [ "$(wc -l < "$2/log.ndjson")" -eq 3 ]' _ "$DTCONVERT" "$tmpdir"
+
+# A rotated log is converted from its first record, even once the new file
+# has grown past the old offset
+run "incremental (rotated, then grown past the old offset)" bash -c '
+  printf "id,note\naaa,x\nbbb,y\n" > "$2/rot.csv" &&
+  "$1" "$2/rot.csv" --to ndjson -o "$2/rot.ndjson" --incremental &&
+  mv "$2/rot.csv" "$2/rot.csv.1" &&
+  printf "id,note\nccc,first\nddd,second\neee,third\n" > "$2/rot.csv" &&
+  "$1" "$2/rot.csv" --to ndjson -o "$2/rot.ndjson" --incremental &&
+  [ "$(wc -l < "$2/rot.ndjson")" -eq 5 ] &&
+  grep -q "\"ccc\"" "$2/rot.ndjson" && ! grep -q "\"note\":\"\"" "$2/rot.ndjson"' _ "$DTCONVERT" "$tmpdir"
+
+# A run over a header-only CSV must not stop the first real import creating
+# the table
+run "incremental (header-only first run)" bash -c '
+  printf "id,name\n" > "$2/hdr.csv" &&
+  DTCONVERT_SQL_CREATE=1 "$1" "$2/hdr.csv" --to sql -o "$2/hdr.sql" --incremental &&
+  printf "1,a\n" >> "$2/hdr.csv" &&
+  DTCONVERT_SQL_CREATE=1 "$1" "$2/hdr.csv" --to sql -o "$2/hdr.sql" --incremental &&
+  grep -q "^CREATE TABLE" "$2/hdr.sql"' _ "$DTCONVERT" "$tmpdir"
+
+# Batch mode over several inputs on two workers
+run_and_check_nonempty "batch (-j 2)" "$tmpdir/batch/out.csv.json" \
+  "$DTCONVERT" --batch "$tmpdir/in.csv" "$tmpdir/out.csv.ndjson" "$tmpdir/out.json.yaml" --to json -o "$tmpdir/batch" -j 2 -f
+
+# Watch mode converts files already in the folder and files dropped in later
+run "watch (existing and new files)" bash -c '
+  mkdir -p "$2/inbox" && cp "$2/in.csv" "$2/inbox/early.csv" &&
+  { "$1" watch "$2/inbox" --to json --out "$2/watched" -j 1 >/dev/null & } && pid=$! &&
+  sleep 0.3 && cp "$2/in.csv" "$2/inbox/late.csv" &&
+  for _ in $(seq 50); do [ -s "$2/watched/early.json" ] && [ -s "$2/watched/late.json" ] && break; sleep 0.1; done
+  kill -INT $pid; wait $pid && [ -s "$2/watched/early.json" ] && [ -s "$2/watched/late.json" ]' _ "$DTCONVERT" "$tmpdir"
+
+# Server mode: a --client run matches a direct one, standard output included
+run "serve + --client" bash -c '
+  { "$1" serve --socket "$2/dt.sock" -j 1 >/dev/null & } && pid=$! &&
+  for _ in $(seq 50); do [ -S "$2/dt.sock" ] && break; sleep 0.1; done
+  "$1" --client --socket "$2/dt.sock" - --from csv --to ndjson < "$2/in.csv" > "$2/client.ndjson"; rc=$?
+  kill -INT $pid; wait $pid &&
+  [ $rc -eq 0 ] && "$1" - --from csv --to ndjson < "$2/in.csv" | cmp -s - "$2/client.ndjson"' _ "$DTCONVERT" "$tmpdir"
+
+# A setting the server was started with does not apply to a client's job
+run "serve (client settings only)" bash -c '
+  { DTCONVERT_SQL_TABLE=server_table "$1" serve --socket "$2/dt2.sock" -j 1 >/dev/null & } && pid=$! &&
+  for _ in $(seq 50); do [ -S "$2/dt2.sock" ] && break; sleep 0.1; done
+  "$1" --client --socket "$2/dt2.sock" "$2/in.csv" --to sql -o "$2/client.sql" -f --no-cache >/dev/null; rc=$?
+  kill -INT $pid; wait $pid &&
+  [ $rc -eq 0 ] && grep -q "^INSERT INTO client " "$2/client.sql"' _ "$DTCONVERT" "$tmpdir"
 
 # XLSX <-> CSV
 if need_cmd xlsx2csv || need_cmd libreoffice || need_cmd ssconvert; then
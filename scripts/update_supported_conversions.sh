@@ -2,11 +2,11 @@
 set -euo pipefail
 
 ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
-SRC="$ROOT_DIR/src/conversion.c"
+DTCONVERT="$ROOT_DIR/bin/dtconvert"
 README="$ROOT_DIR/README.md"
 
-if [[ ! -f "$SRC" ]]; then
-  echo "Error: missing $SRC" >&2
+if [[ ! -x "$DTCONVERT" ]]; then
+  echo "Error: missing $DTCONVERT (run make first)" >&2
   exit 1
 fi
 if [[ ! -f "$README" ]]; then
@@ -17,31 +17,42 @@ fi
 start_marker='<!-- BEGIN SUPPORTED_CONVERSIONS (autogen) -->'
 end_marker='<!-- END SUPPORTED_CONVERSIONS (autogen) -->'
 
-# Extract registry entries of the form {"from", "to", "path", "desc"}
-# and output a stable, simple markdown table.
+# Ask dtconvert itself, so converters found through --describe are listed
+# with the built-in ones. DTCONVERT_INDEX=0 skips a possibly stale index.
+# Columns: FROM TO PROGRAM RESOURCE STREAM DESCRIPTION, after a header line.
 rows="$(
-  awk '
-    BEGIN { FS="\"" }
-    /\{"[a-z0-9]+"[[:space:]]*,[[:space:]]*"[a-z0-9]+"[[:space:]]*,[[:space:]]*"[^\"]+"[[:space:]]*,[[:space:]]*"[^\"]+"\}/ {
-      from=$2; to=$4; path=$6; desc=$8;
-      if (from != "" && to != "" && path != "" && desc != "") {
-        printf("%s\t%s\t%s\t%s\n", from, to, path, desc);
-      }
-    }
-  ' "$SRC" | LC_ALL=C sort -t $'\t' -k1,1 -k2,2
+  cd "$ROOT_DIR" &&
+    DTCONVERT_INDEX=0 "$DTCONVERT" --list-converters |
+    awk 'NR > 1 && NF >= 3 { printf("%s\t%s\t%s\n", $1, $2, $3) }' |
+    LC_ALL=C sort -t $'\t' -k1,1 -k2,2 -u
 )"
+if [[ -z "$rows" ]]; then
+  echo "Error: dtconvert --list-converters listed no converters" >&2
+  exit 1
+fi
 
+# A stable markdown table, each column padded to its widest cell.
 {
   echo "$start_marker"
   echo
-  echo "| From | To | Implementation |"
-  echo "|------|----|----------------|"
-  if [[ -n "$rows" ]]; then
-    while IFS=$'\t' read -r from to path desc; do
-      # Keep it compact; description lives in code.
-      printf '| %s | %s | %s |\n' "$from" "$to" "$path"
-    done <<< "$rows"
-  fi
+  printf '%s\n' "$rows" | awk -F '\t' '
+    {
+      from[NR] = $1; to[NR] = $2; path[NR] = $3
+      if (length($1) > w1) w1 = length($1)
+      if (length($2) > w2) w2 = length($2)
+      if (length($3) > w3) w3 = length($3)
+    }
+    function dashes(n,   s) { s = ""; while (n-- > 0) s = s "-"; return s }
+    END {
+      if (w1 < 4) w1 = 4
+      if (w2 < 2) w2 = 2
+      if (w3 < 14) w3 = 14
+      fmt = "| %-" w1 "s | %-" w2 "s | %-" w3 "s |\n"
+      printf(fmt, "From", "To", "Implementation")
+      printf(fmt, dashes(w1), dashes(w2), dashes(w3))
+      for (i = 1; i <= NR; i++) printf(fmt, from[i], to[i], path[i])
+    }
+  '
   echo
   echo "$end_marker"
 } >"$ROOT_DIR/.supported_conversions.tmp"
@@ -0,0 +1,843 @@
+#include "../include/dtconvert.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <glob.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// Batch mode: many inputs, one target format, N worker processes.
+//
+// Workers are forked once and convert file after file in-process, so the
+// startup and converter lookup (see prepare_conversion()) are paid once per
+// worker rather than once per file. Jobs are sorted largest first and dealt
+// round-robin onto per-worker queues in shared memory; a worker takes from
+// the head of its own queue and, once it is empty, steals the largest pending
+// job from the other queues. Each registry entry has a resource class, and a
+// job only starts while its class is under its concurrency limit and its
+// estimated RSS fits the memory budget (see Admission); estimates are fed by
+// the peaks wait4() reports. The parent only spawns workers, replaces any
+// that die mid-job, and prints the summary.
+
+#define BATCH_PENDING (-1)
+#define BATCH_MIN_ESTIMATE_KB 1024L
+
+// Per resource class (ResourceClass order): concurrent jobs (0 = one per
+// worker) and the memory charged per job until one has been measured.
+// LibreOffice instances sharing a user profile also get in each other's way,
+// hence one memory-heavy job at a time.
+static const int default_limits[RESOURCE_CLASSES] = {0, 0, 4, 1};
+static const long default_estimates_kb[RESOURCE_CLASSES] = {64L << 10, 16L << 10, 32L << 10, 1L << 20};
+
+typedef struct {
+    const char *input_format;   // --from
+    const char *output_format;  // --to
+    const char *output_dir;     // -o (config file for storage targets)
+    bool storage_target;
+    bool overwrite;
+    bool verbose;
+    bool infer_types;
+    bool no_cache;
+    int limit[RESOURCE_CLASSES];  // --limit; 0 = default
+    long budget_kb;               // --memory-budget; 0 = none
+} BatchOptions;
+
+typedef struct {
+    char *input;
+    char *output;
+    off_t size;
+    ResourceClass resource;
+} BatchJob;
+
+typedef struct {
+    BatchJob *items;
+    size_t len;
+    size_t cap;
+    size_t skipped;  // directory entries with no route to the target
+} JobList;
+
+// ---------------- Shared state ----------------
+
+typedef struct {
+    size_t head;  // first slot not yet taken
+    size_t tail;  // one past this queue's last slot
+} JobQueue;
+
+typedef struct {
+    int status;  // exit code, or BATCH_PENDING
+    double seconds;
+    long peak_kb;  // peak RSS measured for the job (0 if unknown)
+} JobResult;
+
+typedef struct {
+    long job;        // in progress, or -1
+    long charge_kb;  // memory reserved for it
+} WorkerState;
+
+// Admission control: a job starts only while its resource class is under its
+// limit and its class's memory estimate fits in what is left of the budget.
+// Estimates start from a per-class default and are replaced by the largest
+// peak RSS measured for the class so far.
+typedef struct {
+    pthread_mutex_t lock;  // process-shared and robust; guards all of Shared
+    pthread_cond_t released;
+    int limit[RESOURCE_CLASSES];
+    int active[RESOURCE_CLASSES];
+    long estimate_kb[RESOURCE_CLASSES];
+    bool measured[RESOURCE_CLASSES];
+    int running;
+    long reserved_kb;
+    long budget_kb;  // 0 = no budget
+} Admission;
+
+typedef struct {
+    Admission *adm;
+    JobQueue *queues;      // one per worker
+    size_t *slots;         // job indices, largest first within each queue; SIZE_MAX once taken
+    WorkerState *workers;  // per worker
+    JobResult *results;    // per job
+    size_t nqueues;
+} Shared;
+
+static void *shared_alloc(size_t n) {
+    void *p = mmap(NULL, n ? n : 1, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static void shared_free(void *p, size_t n) {
+    if (p) munmap(p, n ? n : 1);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// ---------------- Job list ----------------
+
+static void batch_usage(const char *program) {
+    printf("Usage:\n");
+    printf("  %s --batch <dir|glob|file>... --to <format> [-o DIR] [-j N] [options]\n", program);
+    printf("  %s --files-from <list|-> --to <format> [-o DIR] [-j N] [options]\n", program);
+    printf("\nOptions:\n");
+    printf("  --from FORMAT         Input format of every file (default: each file's extension)\n");
+    printf("  -o, --output DIR      Write outputs into DIR (default: next to each input);\n");
+    printf("                        for DB targets, the JSON config file\n");
+    printf("  -j, --jobs N          Files converted in parallel (default/0: one per CPU)\n");
+    printf("  --limit CLASS=N[,...] Most jobs of a resource class at once: cpu, io-bound,\n");
+    printf("                        db-connection (default 4), memory-heavy (default 1)\n");
+    printf("  --memory-budget SIZE  Estimated RSS of running jobs stays under SIZE (e.g. 8G;\n");
+    printf("                        default: 3/4 of RAM; 0: none)\n");
+    printf("  -f, --force           Overwrite existing output files\n");
+    printf("  --infer-types, --no-cache\n");
+    printf("                        As for single conversions\n");
+    printf("  -v, --verbose         Print the plan before starting\n");
+}
+
+static bool add_job(JobList *list, const char *input, off_t size) {
+    if (list->len == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 64;
+        BatchJob *items = realloc(list->items, cap * sizeof(*items));
+        if (!items) return false;
+        list->items = items;
+        list->cap = cap;
+    }
+    char *copy = strdup(input);
+    if (!copy) return false;
+    list->items[list->len++] = (BatchJob){.input = copy, .output = NULL, .size = size};
+    return true;
+}
+
+static int by_input(const void *a, const void *b) {
+    return strcmp(((const BatchJob *)a)->input, ((const BatchJob *)b)->input);
+}
+
+// Regular files directly inside dir (hidden ones excluded), as jobs in name
+// order.
+static bool add_directory(JobList *list, const char *dir) {
+    size_t first = list->len;
+    DIR *d = opendir(dir);
+    if (!d) {
+        fprintf(stderr, "Error: Cannot read directory '%s': %s\n", dir, strerror(errno));
+        return false;
+    }
+    bool ok = true;
+    struct dirent *e;
+    while (ok && (e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        char path[MAX_PATH_LEN];
+        int n = snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (n < 0 || (size_t)n >= sizeof(path)) continue;
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        ok = add_job(list, path, st.st_size);
+    }
+    closedir(d);
+    qsort(list->items + first, list->len - first, sizeof(BatchJob), by_input);
+    return ok;
+}
+
+// A directory, a glob pattern the shell did not expand, or a file. Missing
+// files still become jobs, which fail like a single conversion would.
+static bool add_source(JobList *list, const char *src) {
+    struct stat st;
+    if (stat(src, &st) == 0) {
+        if (S_ISDIR(st.st_mode)) return add_directory(list, src);
+        return add_job(list, src, st.st_size);
+    }
+    if (strpbrk(src, "*?[") != NULL) {
+        glob_t g;
+        int rc = glob(src, 0, NULL, &g);
+        if (rc == GLOB_NOMATCH) {
+            fprintf(stderr, "Warning: No files match '%s'\n", src);
+            return true;
+        }
+        if (rc != 0) {
+            fprintf(stderr, "Error: Cannot expand '%s'\n", src);
+            return false;
+        }
+        bool ok = true;
+        for (size_t i = 0; ok && i < g.gl_pathc; i++) {
+            if (stat(g.gl_pathv[i], &st) == 0 && S_ISREG(st.st_mode)) ok = add_job(list, g.gl_pathv[i], st.st_size);
+        }
+        globfree(&g);
+        return ok;
+    }
+    return add_job(list, src, 0);
+}
+
+// One path per line; "-" reads the list from standard input.
+static bool add_files_from(JobList *list, const char *list_path) {
+    FILE *f = strcmp(list_path, "-") == 0 ? stdin : fopen(list_path, "r");
+    if (!f) {
+        fprintf(stderr, "Error: Cannot read file list '%s': %s\n", list_path, strerror(errno));
+        return false;
+    }
+    bool ok = true;
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    while (ok && (n = getline(&line, &cap, f)) >= 0) {
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) line[--n] = '\0';
+        if (n == 0) continue;
+        struct stat st;
+        ok = add_job(list, line, stat(line, &st) == 0 ? st.st_size : 0);
+    }
+    free(line);
+    if (f != stdin) fclose(f);
+    return ok;
+}
+
+static char *job_output_path(const char *input, const BatchOptions *opt) {
+    if (opt->storage_target) return strdup(opt->output_dir);
+    return derive_output_path(input, opt->output_dir, opt->output_format);
+}
+
+static void free_jobs(JobList *list) {
+    for (size_t i = 0; i < list->len; i++) {
+        free(list->items[i].input);
+        free(list->items[i].output);
+    }
+    free(list->items);
+}
+
+static int by_output(const void *a, const void *b) {
+    const BatchJob *x = *(const BatchJob *const *)a;
+    const BatchJob *y = *(const BatchJob *const *)b;
+    int c = strcmp(x->output, y->output);
+    if (c != 0) return c;
+    return x < y ? -1 : x > y;
+}
+
+// Sets dup[i] for every job whose output an earlier job already writes (two
+// inputs with the same base name going into one -o directory).
+static bool mark_duplicate_outputs(const JobList *list, bool *dup) {
+    const BatchJob **by = malloc((list->len ? list->len : 1) * sizeof(*by));
+    if (!by) return false;
+    size_t n = 0;
+    for (size_t i = 0; i < list->len; i++) {
+        if (list->items[i].output) by[n++] = &list->items[i];
+    }
+    qsort(by, n, sizeof(*by), by_output);
+    for (size_t k = 1; k < n; k++) {
+        if (strcmp(by[k]->output, by[k - 1]->output) == 0) dup[by[k] - list->items] = true;
+    }
+    free(by);
+    return true;
+}
+
+// ---------------- Workers ----------------
+
+// A worker killed while holding the lock leaves it to the next owner.
+static void sched_lock(Admission *adm) {
+    if (pthread_mutex_lock(&adm->lock) == EOWNERDEAD) pthread_mutex_consistent(&adm->lock);
+}
+
+static void sched_unlock(Admission *adm) {
+    pthread_mutex_unlock(&adm->lock);
+}
+
+// Waits (lock held) for a job to finish; the timeout covers a worker that
+// died without signalling.
+static void sched_wait(Admission *adm) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += 1;
+    if (pthread_cond_timedwait(&adm->released, &adm->lock, &ts) == EOWNERDEAD) pthread_mutex_consistent(&adm->lock);
+}
+
+static bool admissible(const Admission *adm, ResourceClass c) {
+    if (adm->active[c] >= adm->limit[c]) return false;
+    // With nothing running, a job larger than the whole budget still starts.
+    if (adm->budget_kb <= 0 || adm->running == 0) return true;
+    return adm->reserved_kb + adm->estimate_kb[c] <= adm->budget_kb;
+}
+
+// First (largest) job in q that may start now, as a slot index, or SIZE_MAX.
+static size_t first_admissible(const Shared *sh, const JobQueue *q, const BatchJob *jobs) {
+    for (size_t k = q->head; k < q->tail; k++) {
+        size_t j = sh->slots[k];
+        if (j != SIZE_MAX && admissible(sh->adm, jobs[j].resource)) return k;
+    }
+    return SIZE_MAX;
+}
+
+// Own queue first; then the largest admissible job waiting anywhere else.
+// Blocks while jobs are queued but none may start; -1 once all are taken.
+static long take_job(Shared *sh, const BatchJob *jobs, size_t self) {
+    Admission *adm = sh->adm;
+    long j = -1;
+    sched_lock(adm);
+    for (;;) {
+        JobQueue *from = &sh->queues[self];
+        size_t k = first_admissible(sh, from, jobs);
+        bool pending = from->head < from->tail;
+        if (k == SIZE_MAX) {
+            off_t best = -1;
+            for (size_t w = 0; w < sh->nqueues; w++) {
+                JobQueue *q = &sh->queues[w];
+                if (q->head < q->tail) pending = true;
+                size_t c = w == self ? SIZE_MAX : first_admissible(sh, q, jobs);
+                if (c != SIZE_MAX && jobs[sh->slots[c]].size > best) {
+                    best = jobs[sh->slots[c]].size;
+                    from = q;
+                    k = c;
+                }
+            }
+        }
+        if (k != SIZE_MAX) {
+            j = (long)sh->slots[k];
+            sh->slots[k] = SIZE_MAX;
+            while (from->head < from->tail && sh->slots[from->head] == SIZE_MAX) from->head++;
+            ResourceClass c = jobs[j].resource;
+            adm->active[c]++;
+            adm->running++;
+            adm->reserved_kb += adm->estimate_kb[c];
+            sh->workers[self] = (WorkerState){j, adm->estimate_kb[c]};
+            break;
+        }
+        if (!pending) break;
+        sched_wait(adm);
+    }
+    sched_unlock(adm);
+    return j;
+}
+
+// Records worker w's job as finished (lock held), returns its reservation and
+// folds the measured peak into its class's estimate.
+static void finish_job(Shared *sh, const BatchJob *jobs, size_t w, int status, double seconds, long peak_kb) {
+    Admission *adm = sh->adm;
+    WorkerState *ws = &sh->workers[w];
+    if (ws->job < 0) return;
+    ResourceClass c = jobs[ws->job].resource;
+    sh->results[ws->job] = (JobResult){status, seconds, peak_kb};
+    adm->active[c]--;
+    adm->running--;
+    adm->reserved_kb -= ws->charge_kb;
+    if (peak_kb > 0) {
+        if (peak_kb < BATCH_MIN_ESTIMATE_KB) peak_kb = BATCH_MIN_ESTIMATE_KB;
+        if (!adm->measured[c] || peak_kb > adm->estimate_kb[c]) adm->estimate_kb[c] = peak_kb;
+        adm->measured[c] = true;
+    }
+    *ws = (WorkerState){-1, 0};
+    pthread_cond_broadcast(&adm->released);
+}
+
+static int run_job(const BatchJob *job, const BatchOptions *opt) {
+    Document *doc = document_create(job->input);
+    if (!doc) return ERR_CONVERSION_FAILED;
+    if (!document_exists(doc)) {
+        fprintf(stderr, "Error: File '%s' does not exist\n", job->input);
+        document_destroy(doc);
+        return ERR_FILE_NOT_FOUND;
+    }
+
+    ConversionRequest request = {0};
+    request.input = doc;
+    request.input_format = (char *)opt->input_format;
+    request.output_format = (char *)opt->output_format;
+    request.output_path = job->output;
+    request.overwrite = opt->overwrite;
+    request.infer_types = opt->infer_types;
+    request.no_cache = opt->no_cache;
+    int rc = convert_document(&request);
+    if (rc != SUCCESS) fprintf(stderr, "Error: '%s' failed with error code %d\n", job->input, rc);
+
+    document_destroy(doc);
+    return rc;
+}
+
+static long self_peak_kb(void) {
+    struct rusage ru;
+    return getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_maxrss : 0;
+}
+
+// A job's peak is what wait4() reported for the converter processes it ran
+// or, for an in-process conversion, how far it raised this worker's own
+// high-water mark (0 when it stayed below an earlier job's).
+static void run_queue(Shared *sh, const BatchJob *jobs, const BatchOptions *opt, size_t self) {
+    long j;
+    while ((j = take_job(sh, jobs, self)) >= 0) {
+        (void)take_converter_peak_rss();
+        long before = self_peak_kb();
+        double t0 = now_seconds();
+        int rc = run_job(&jobs[j], opt);
+        double seconds = now_seconds() - t0;
+        long peak = take_converter_peak_rss();
+        long grew = self_peak_kb() - before;
+        if (grew > peak) peak = grew;
+
+        sched_lock(sh->adm);
+        finish_job(sh, jobs, self, rc, seconds, peak);
+        sched_unlock(sh->adm);
+    }
+}
+
+static pid_t spawn_worker(Shared *sh, const BatchJob *jobs, const BatchOptions *opt, size_t self) {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        run_queue(sh, jobs, opt, self);
+        save_converter_costs();
+        fflush(NULL);
+        _exit(0);
+    }
+    return pid;
+}
+
+static bool jobs_pending(Shared *sh) {
+    sched_lock(sh->adm);
+    bool pending = false;
+    for (size_t w = 0; w < sh->nqueues && !pending; w++) pending = sh->queues[w].head < sh->queues[w].tail;
+    sched_unlock(sh->adm);
+    return pending;
+}
+
+// Runs the queued jobs on nworkers processes and waits for all of them. A
+// worker that dies mid-job (a converter crash, or the OOM killer) fails that
+// job, charges its peak RSS to the job's class, and is replaced while work
+// remains.
+static void run_workers(Shared *sh, const BatchJob *jobs, const BatchOptions *opt) {
+    size_t n = sh->nqueues;
+    pid_t *pids = calloc(n, sizeof(pid_t));
+    size_t alive = 0;
+    for (size_t w = 0; pids && w < n; w++) {
+        pids[w] = spawn_worker(sh, jobs, opt, w);
+        if (pids[w] > 0) alive++;
+    }
+    if (alive == 0) {
+        // No processes to be had: work through every queue here.
+        run_queue(sh, jobs, opt, 0);
+        free(pids);
+        return;
+    }
+
+    while (alive > 0) {
+        int status;
+        struct rusage ru;
+        pid_t pid = wait4(-1, &status, 0, &ru);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        size_t w = 0;
+        while (w < n && pids[w] != pid) w++;
+        if (w == n) continue;
+        pids[w] = 0;
+        alive--;
+
+        sched_lock(sh->adm);
+        long j = sh->workers[w].job;
+        if (j >= 0) {
+            int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            finish_job(sh, jobs, w, code != 0 ? code : ERR_CONVERSION_FAILED, 0.0, ru.ru_maxrss);
+        }
+        sched_unlock(sh->adm);
+        if (j < 0) continue;
+        fprintf(stderr, "Error: Worker died converting '%s'\n", jobs[j].input);
+        if (jobs_pending(sh)) {
+            pids[w] = spawn_worker(sh, jobs, opt, w);
+            if (pids[w] > 0) alive++;
+        }
+    }
+    free(pids);
+}
+
+// ---------------- Scheduling ----------------
+
+typedef struct {
+    off_t size;
+    size_t index;
+} SizedJob;
+
+static int by_size_desc(const void *a, const void *b) {
+    const SizedJob *x = a;
+    const SizedJob *y = b;
+    if (x->size != y->size) return x->size < y->size ? 1 : -1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+// Deals the runnable jobs, largest first, round-robin onto nqueues queues
+// laid out back to back in sh->slots.
+static bool fill_queues(Shared *sh, const JobList *list, const size_t *runnable, size_t nrunnable) {
+    SizedJob *sorted = malloc((nrunnable ? nrunnable : 1) * sizeof(*sorted));
+    if (!sorted) return false;
+    for (size_t i = 0; i < nrunnable; i++) sorted[i] = (SizedJob){list->items[runnable[i]].size, runnable[i]};
+    qsort(sorted, nrunnable, sizeof(*sorted), by_size_desc);
+
+    size_t start = 0;
+    for (size_t w = 0; w < sh->nqueues; w++) {
+        size_t count = nrunnable / sh->nqueues + (w < nrunnable % sh->nqueues ? 1 : 0);
+        for (size_t k = 0; k < count; k++) sh->slots[start + k] = sorted[w + k * sh->nqueues].index;
+
+        sh->queues[w].head = start;
+        sh->queues[w].tail = start + count;
+        sh->workers[w] = (WorkerState){-1, 0};
+        start += count;
+    }
+    free(sorted);
+    return true;
+}
+
+static bool init_admission(Admission *adm, const BatchOptions *opt, size_t workers) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    int err = pthread_mutex_init(&adm->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (err != 0) return false;
+
+    pthread_condattr_t cattr;
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+    err = pthread_cond_init(&adm->released, &cattr);
+    pthread_condattr_destroy(&cattr);
+    if (err != 0) return false;
+
+    for (int c = 0; c < RESOURCE_CLASSES; c++) {
+        adm->limit[c] = opt->limit[c] > 0 ? opt->limit[c] : default_limits[c];
+        if (adm->limit[c] <= 0 || (size_t)adm->limit[c] > workers) adm->limit[c] = (int)workers;
+        adm->estimate_kb[c] = default_estimates_kb[c];
+    }
+    adm->budget_kb = opt->budget_kb;
+    return true;
+}
+
+static void print_summary(const JobList *list, const JobResult *results, double elapsed, size_t workers) {
+    size_t ok = 0, failed = 0;
+    printf("%-6s %4s %9s %8s  %s\n", "STATUS", "CODE", "SECONDS", "PEAK_MIB", "INPUT -> OUTPUT");
+    for (size_t i = 0; i < list->len; i++) {
+        const BatchJob *job = &list->items[i];
+        int status = results[i].status == BATCH_PENDING ? ERR_CONVERSION_FAILED : results[i].status;
+        if (status == SUCCESS) {
+            ok++;
+        } else {
+            failed++;
+        }
+        printf("%-6s %4d %9.3f %8.1f  %s -> %s\n", status == SUCCESS ? "ok" : "failed", status,
+               results[i].seconds, (double)results[i].peak_kb / 1024.0, job->input, job->output ? job->output : "-");
+    }
+    printf("Batch: %zu converted, %zu failed", ok, failed);
+    if (list->skipped > 0) printf(", %zu skipped (no converter)", list->skipped);
+    printf(" in %.2fs on %zu worker%s\n", elapsed, workers, workers == 1 ? "" : "s");
+}
+
+// ---------------- Command ----------------
+
+// "cpu=8,memory-heavy=2": sets limit[] per class. Prints an error naming what
+// it could not parse.
+static bool parse_limits(const char *spec, int *limit) {
+    char *copy = strdup(spec);
+    if (!copy) return false;
+    bool ok = true;
+    char *save = NULL;
+    for (char *item = strtok_r(copy, ",", &save); item && ok; item = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(item, '=');
+        ResourceClass c;
+        char *end = NULL;
+        long n = 0;
+        if (eq) {
+            *eq = '\0';
+            n = strtol(eq + 1, &end, 10);
+        }
+        ok = eq && parse_resource_class(item, &c) && end != eq + 1 && *end == '\0' && n >= 1 && n <= 1024;
+        if (ok) limit[c] = (int)n;
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Bad --limit '%s' (expected CLASS=N[,...] with CLASS one of cpu, io-bound, "
+                        "db-connection, memory-heavy)\n", spec);
+    }
+    free(copy);
+    return ok;
+}
+
+// "8G", "512M", "4096K" or bytes; 0 turns the budget off.
+static bool parse_budget(const char *spec, long *kb) {
+    if (!parse_size_kb(spec, kb)) {
+        fprintf(stderr, "Error: Bad memory budget '%s' (expected e.g. 8G, 512M, or 0 for none)\n", spec);
+        return false;
+    }
+    return true;
+}
+
+// Three quarters of physical memory.
+static long default_budget_kb(void) {
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || page <= 0) return 0;
+    return (long)((double)pages * (double)page / 1024.0 * 0.75);
+}
+
+bool is_batch_command(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--batch") == 0 || strcmp(argv[i], "--files-from") == 0) return true;
+    }
+    return false;
+}
+
+int batch_command(int argc, char **argv) {
+    BatchOptions opt = {0};
+    JobList list = {0};
+    const char **sources = calloc((size_t)argc, sizeof(char *));
+    size_t nsources = 0;
+    const char *files_from = NULL;
+    const char *budget = NULL;
+    long jobs = 0;
+    int rc = ERR_INVALID_ARGS;
+    char *from = NULL;
+    char *to = NULL;
+    JobResult *results = NULL;
+    size_t *runnable = NULL;
+    size_t nrunnable = 0;
+    bool *dup = NULL;
+    Shared sh = {0};
+    if (!sources) return ERR_CONVERSION_FAILED;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        bool has_value = i + 1 < argc;
+        if (strcmp(a, "--batch") == 0) {
+            continue;
+        } else if (strcmp(a, "--files-from") == 0 && has_value) {
+            files_from = argv[++i];
+        } else if (strcmp(a, "--from") == 0 && has_value) {
+            free(from);
+            from = strdup(argv[++i]);
+        } else if (strcmp(a, "--to") == 0 && has_value) {
+            free(to);
+            to = strdup(argv[++i]);
+        } else if ((strcmp(a, "-o") == 0 || strcmp(a, "--output") == 0) && has_value) {
+            opt.output_dir = argv[++i];
+        } else if (strcmp(a, "-j") == 0 || strcmp(a, "--jobs") == 0 || strcmp(a, "--threads") == 0) {
+            char *end = NULL;
+            jobs = has_value ? strtol(argv[i + 1], &end, 10) : -1;
+            if (!has_value || end == argv[i + 1] || *end != '\0' || jobs < 0 || jobs > 1024) {
+                fprintf(stderr, "Error: %s expects a job count (0-1024)\n", a);
+                goto out;
+            }
+            i++;
+        } else if (strcmp(a, "--limit") == 0 && has_value) {
+            if (!parse_limits(argv[++i], opt.limit)) goto out;
+        } else if (strcmp(a, "--memory-budget") == 0 && has_value) {
+            budget = argv[++i];
+        } else if (strcmp(a, "-f") == 0 || strcmp(a, "--force") == 0) {
+            opt.overwrite = true;
+        } else if (strcmp(a, "-v") == 0 || strcmp(a, "--verbose") == 0) {
+            opt.verbose = true;
+        } else if (strcmp(a, "--infer-types") == 0) {
+            opt.infer_types = true;
+        } else if (strcmp(a, "--no-cache") == 0) {
+            opt.no_cache = true;
+        } else if (strcmp(a, "-h") == 0 || strcmp(a, "--help") == 0) {
+            batch_usage(argv[0]);
+            rc = SUCCESS;
+            goto out;
+        } else if (a[0] == '-' && a[1] != '\0') {
+            fprintf(stderr, "Error: Unknown or incomplete argument: %s\n", a);
+            goto out;
+        } else {
+            sources[nsources++] = a;
+        }
+    }
+
+    if (!to) {
+        fprintf(stderr, "Error: Output format not specified (use --to)\n");
+        goto out;
+    }
+    if (nsources == 0 && !files_from) {
+        batch_usage(argv[0]);
+        goto out;
+    }
+    // Flags win over the environment; --limit entries add to it.
+    int env_limit[RESOURCE_CLASSES] = {0};
+    const char *env = getenv("DTCONVERT_BATCH_LIMITS");
+    if (env && *env && !parse_limits(env, env_limit)) goto out;
+    for (int c = 0; c < RESOURCE_CLASSES; c++) {
+        if (opt.limit[c] == 0) opt.limit[c] = env_limit[c];
+    }
+    if (!budget) budget = getenv("DTCONVERT_MEMORY_BUDGET");
+    if (budget && *budget) {
+        if (!parse_budget(budget, &opt.budget_kb)) goto out;
+    } else {
+        opt.budget_kb = default_budget_kb();
+    }
+
+    str_lower(to);
+    if (from) str_lower(from);
+    opt.output_format = canonical_format(to);
+    opt.input_format = from ? canonical_format(from) : NULL;
+    opt.storage_target = strcmp(opt.output_format, "postgresql") == 0;
+    if (opt.storage_target && !opt.output_dir) {
+        fprintf(stderr, "Error: PostgreSQL target requires -o <config.json>\n");
+        goto out;
+    }
+    if (opt.output_dir && !opt.storage_target && mkdir(opt.output_dir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error: Cannot create output directory '%s': %s\n", opt.output_dir, strerror(errno));
+        rc = ERR_CONVERSION_FAILED;
+        goto out;
+    }
+
+    rc = ERR_CONVERSION_FAILED;
+    for (size_t i = 0; i < nsources; i++) {
+        size_t before = list.len;
+        struct stat st;
+        bool from_dir = stat(sources[i], &st) == 0 && S_ISDIR(st.st_mode);
+        if (!add_source(&list, sources[i])) goto out;
+        if (!from_dir) continue;
+
+        // Files found in a directory are only taken when they convert to the
+        // target; the rest are counted as skipped.
+        size_t kept = before;
+        for (size_t k = before; k < list.len; k++) {
+            Document *doc = document_create(list.items[k].input);
+            const char *fmt = opt.input_format ? opt.input_format : (doc ? canonical_format(doc->extension) : "");
+            bool routable = fmt[0] != '\0' && prepare_conversion(fmt, opt.output_format, list.items[k].size, NULL) != -1;
+            document_destroy(doc);
+            if (routable) {
+                list.items[kept++] = list.items[k];
+            } else {
+                free(list.items[k].input);
+                list.skipped++;
+            }
+        }
+        list.len = kept;
+    }
+    if (files_from && !add_files_from(&list, files_from)) goto out;
+
+    // Plan every job up front: unsupported inputs fail here without taking a
+    // worker, and every converter is resolved before the workers fork.
+    results = shared_alloc(list.len * sizeof(JobResult));
+    runnable = malloc((list.len ? list.len : 1) * sizeof(size_t));
+    dup = calloc(list.len ? list.len : 1, sizeof(bool));
+    if (!results || !runnable || !dup) goto out;
+    for (size_t i = 0; i < list.len; i++) {
+        list.items[i].output = job_output_path(list.items[i].input, &opt);
+        if (!list.items[i].output) goto out;
+    }
+    if (!opt.storage_target && !mark_duplicate_outputs(&list, dup)) goto out;
+
+    off_t total_bytes = 0;
+    for (size_t i = 0; i < list.len; i++) {
+        BatchJob *job = &list.items[i];
+        results[i] = (JobResult){BATCH_PENDING, 0.0, 0};
+        if (dup[i]) {
+            fprintf(stderr, "Error: '%s' would overwrite the output of another input (%s)\n", job->output,
+                    job->input);
+            results[i].status = ERR_INVALID_ARGS;
+            continue;
+        }
+        Document *doc = document_create(job->input);
+        const char *fmt = opt.input_format ? opt.input_format : (doc ? canonical_format(doc->extension) : "");
+        int steps = prepare_conversion(fmt, opt.output_format, job->size, &job->resource);
+        if (steps < 0) {
+            fprintf(stderr, "Error: %s for %s -> %s (%s)\n",
+                    steps == -2 ? "Converter not installed" : "No converter found", fmt, opt.output_format,
+                    job->input);
+            results[i].status = ERR_NO_CONVERTER;
+        } else {
+            runnable[nrunnable++] = i;
+            total_bytes += job->size;
+        }
+        document_destroy(doc);
+    }
+
+    size_t workers = jobs > 0 ? (size_t)jobs : (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+    if (workers > nrunnable) workers = nrunnable > 0 ? nrunnable : 1;
+
+    sh.nqueues = workers;
+    sh.adm = shared_alloc(sizeof(Admission));
+    sh.queues = shared_alloc(workers * sizeof(JobQueue));
+    sh.slots = shared_alloc(nrunnable * sizeof(size_t));
+    sh.workers = shared_alloc(workers * sizeof(WorkerState));
+    sh.results = results;
+    if (!sh.adm || !sh.queues || !sh.slots || !sh.workers || !init_admission(sh.adm, &opt, workers) ||
+        !fill_queues(&sh, &list, runnable, nrunnable)) {
+        fprintf(stderr, "Error: Cannot set up the batch queues\n");
+        goto out;
+    }
+
+    if (opt.verbose) {
+        printf("Batch: %zu file%s (%.1f MiB) -> %s on %zu worker%s\n", nrunnable, nrunnable == 1 ? "" : "s",
+               (double)total_bytes / (1024.0 * 1024.0), opt.output_format, workers, workers == 1 ? "" : "s");
+        printf("Limits:");
+        for (int c = 0; c < RESOURCE_CLASSES; c++) {
+            printf("%s %s %d", c ? "," : "", resource_class_name((ResourceClass)c), sh.adm->limit[c]);
+        }
+        if (opt.budget_kb > 0) {
+            printf("; memory budget %.1f GiB\n", (double)opt.budget_kb / (1024.0 * 1024.0));
+        } else {
+            printf("; no memory budget\n");
+        }
+    }
+
+    double t0 = now_seconds();
+    if (nrunnable > 0) run_workers(&sh, list.items, &opt);
+    save_converter_costs();  // jobs run here if no worker could be forked
+    print_summary(&list, results, now_seconds() - t0, workers);
+
+    rc = SUCCESS;
+    for (size_t i = 0; i < list.len; i++) {
+        if (results[i].status != SUCCESS) rc = ERR_CONVERSION_FAILED;
+    }
+
+out:
+    shared_free(sh.adm, sizeof(Admission));
+    shared_free(sh.queues, sh.nqueues * sizeof(JobQueue));
+    shared_free(sh.slots, nrunnable * sizeof(size_t));
+    shared_free(sh.workers, sh.nqueues * sizeof(WorkerState));
+    shared_free(results, list.len * sizeof(JobResult));
+    free(runnable);
+    free(dup);
+    free_jobs(&list);
+    free(sources);
+    free(from);
+    free(to);
+    return rc;
+}
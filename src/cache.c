@@ -0,0 +1,419 @@
+// copy_file_range()
+#define _GNU_SOURCE
+
+#include "../include/dtconvert.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+
+// Conversion cache.
+//
+// A step's output is stored as <dir>/<key>.<format>, where the key chains
+// XXH64 hashes: the first step's input key is the hash of the input file's
+// bytes, and each step's output key hashes the key of its input with the
+// program, its version (size and mtime of the script, or of dtconvert itself
+// for the in-process converters), the formats and the DTCONVERT_* settings
+// that can change the output. Intermediates are therefore found without
+// hashing them: a plan whose first steps match an earlier one starts from
+// the last output it finds.
+//
+// The directory is DTCONVERT_CACHE (default $XDG_CACHE_HOME/dtconvert/outputs;
+// 0 or --no-cache turns the cache off) and is kept under DTCONVERT_CACHE_SIZE
+// (default 1G) by deleting the least recently used entries; a hit refreshes
+// the entry's mtime. Outputs larger than a quarter of the limit are not
+// stored, so one of them cannot evict everything else. Outputs handed to the
+// user are reflinked where the file system allows and copied otherwise, so
+// editing one cannot change the cache; private intermediates are hard-linked.
+
+#define DEFAULT_CACHE_KB (1L << 20)
+#define EVICT_TO 0.9        // evicting stops at this fraction of the limit
+#define MAX_ENTRY_SHARE 4   // outputs over 1/4 of the limit are not stored
+#define STALE_TEMP_SECONDS 3600
+
+static bool cache_disabled = false;
+static char *cache_dir = NULL;
+static bool cache_dir_known = false;
+static long long cache_limit = 0;          // bytes
+static long long stored_since_scan = -1;   // bytes this process added; -1 before the first scan
+
+extern char **environ;
+
+// ---------------- XXH64 ----------------
+
+#define XXH_P1 0x9E3779B185EBCA87ULL
+#define XXH_P2 0xC2B2AE3D27D4EB4FULL
+#define XXH_P3 0x165667B19E3779F9ULL
+#define XXH_P4 0x85EBCA77C2B2AE63ULL
+#define XXH_P5 0x27D4EB2F165667C5ULL
+
+static uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));  // little-endian hosts only, like the helpers
+    return v;
+}
+
+static uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_P2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_P1;
+}
+
+static uint64_t xxh_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh_round(0, val);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+uint64_t xxh64(const void *data, size_t len, uint64_t seed) {
+    const unsigned char *p = data;
+    const unsigned char *end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + XXH_P1 + XXH_P2;
+        uint64_t v2 = seed + XXH_P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_P1;
+        const unsigned char *limit = end - 32;
+        do {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    } else {
+        h = seed + XXH_P5;
+    }
+    h += (uint64_t)len;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxh_round(0, read64(p));
+        h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)read32(p) * XXH_P1;
+        h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= (uint64_t)*p * XXH_P5;
+        h = rotl64(h, 11) * XXH_P1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+// ---------------- Keys ----------------
+
+void conversion_cache_disable(void) {
+    cache_disabled = true;
+}
+
+// The cache directory, or NULL when the cache is off.
+static const char *cache_directory(void) {
+    if (cache_disabled) return NULL;
+    if (cache_dir_known) return cache_dir;
+    cache_dir_known = true;
+    cache_dir = cache_file_path("DTCONVERT_CACHE", "outputs");
+
+    long kb = DEFAULT_CACHE_KB;
+    const char *size = getenv("DTCONVERT_CACHE_SIZE");
+    if (size && *size && !parse_size_kb(size, &kb)) {
+        fprintf(stderr, "Warning: Ignoring bad DTCONVERT_CACHE_SIZE '%s' (expected e.g. 2G or 500M)\n", size);
+        kb = DEFAULT_CACHE_KB;
+    }
+    cache_limit = (long long)kb * 1024;
+    if (cache_limit == 0) {
+        free(cache_dir);
+        cache_dir = NULL;
+    }
+    return cache_dir;
+}
+
+bool conversion_cache_enabled(void) {
+    return cache_directory() != NULL;
+}
+
+bool cache_input_key(const char *path, uint64_t *key) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        *key = xxh64("", 0, 0);
+        return true;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+    *key = xxh64(data, (size_t)st.st_size, 0);
+    munmap(data, (size_t)st.st_size);
+    return true;
+}
+
+// Settings that cannot change what a converter writes.
+static bool setting_ignored(const char *name) {
+    static const char *const ignored[] = {
+        "DTCONVERT_HOME=",
+        "DTCONVERT_COSTS=",
+        "DTCONVERT_INDEX=",
+        "DTCONVERT_CACHE=",
+        "DTCONVERT_CACHE_SIZE=",
+        "DTCONVERT_NATIVE=",
+        "DTCONVERT_THREADS=",
+        "DTCONVERT_SIMD=",
+        "DTCONVERT_CHUNK_SIZE=",
+        "DTCONVERT_BATCH_LIMITS=",
+        "DTCONVERT_MEMORY_BUDGET=",
+        "DTCONVERT_INPUT_FORMAT=",  // the step's formats are part of the key
+        "DTCONVERT_OUTPUT_FORMAT=",
+        "DTCONVERT_OPENAI_",
+    };
+    for (size_t i = 0; i < sizeof(ignored) / sizeof(ignored[0]); i++) {
+        if (strncmp(name, ignored[i], strlen(ignored[i])) == 0) return true;
+    }
+    return false;
+}
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// XXH64 of the relevant DTCONVERT_* variables, sorted so their order in the
+// environment does not matter.
+static uint64_t settings_hash(void) {
+    size_t n = 0;
+    for (char **e = environ; *e; e++) n++;
+    const char **vars = malloc((n + 1) * sizeof(*vars));
+    if (!vars) return 0;
+    size_t len = 0;
+    for (char **e = environ; *e; e++) {
+        if (strncmp(*e, "DTCONVERT_", 10) == 0 && !setting_ignored(*e)) vars[len++] = *e;
+    }
+    qsort(vars, len, sizeof(*vars), compare_strings);
+    uint64_t h = 0;
+    for (size_t i = 0; i < len; i++) h = xxh64(vars[i], strlen(vars[i]) + 1, h);
+    free(vars);
+    return h;
+}
+
+uint64_t cache_step_key(uint64_t input_key, const char *program, const char *version_file, const char *from_format,
+                        const char *to_format, const char *variant) {
+    struct stat st = {0};
+    if (version_file) (void)stat(version_file, &st);
+    char buf[2 * MAX_PATH_LEN];
+    int n = snprintf(buf, sizeof(buf), "%s %016llx %s %lld %lld.%09ld %s %s %s %016llx", DTCONVERT_VERSION,
+                     (unsigned long long)input_key, program, (long long)st.st_size, (long long)st.st_mtim.tv_sec,
+                     (long)st.st_mtim.tv_nsec, from_format, to_format, variant ? variant : "",
+                     (unsigned long long)settings_hash());
+    if (n < 0) n = 0;
+    if ((size_t)n >= sizeof(buf)) n = (int)sizeof(buf) - 1;
+    return xxh64(buf, (size_t)n, 0);
+}
+
+// ---------------- Files ----------------
+
+static char *object_path(const char *dir, uint64_t key, const char *ext) {
+    size_t len = strlen(dir) + strlen(ext) + 24;
+    char *path = malloc(len);
+    if (path) snprintf(path, len, "%s/%016llx.%s", dir, (unsigned long long)key, ext);
+    return path;
+}
+
+static bool copy_fd(int in, int out) {
+    char buf[1 << 16];
+    for (;;) {
+        ssize_t n = read(in, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) return true;
+        for (ssize_t off = 0; off < n;) {
+            ssize_t w = write(out, buf + off, (size_t)(n - off));
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return false;
+            off += w;
+        }
+    }
+}
+
+// dst becomes an independent copy of src: a reflink where the file system
+// shares extents (btrfs, XFS), else a copy made in the kernel where possible.
+static bool clone_file(const char *src, const char *dst) {
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+    bool ok = false;
+#ifdef FICLONE
+    ok = ioctl(out, FICLONE, in) == 0;
+#endif
+    if (!ok) {
+        ssize_t n;
+        while ((n = copy_file_range(in, NULL, out, NULL, 1 << 30, 0)) > 0) {
+        }
+        // Not supported between these file systems: copy from where it stopped
+        ok = n == 0 || copy_fd(in, out);
+    }
+    if (close(out) != 0) ok = false;
+    close(in);
+    if (!ok) unlink(dst);
+    return ok;
+}
+
+// Intermediates are private to dtconvert and only read, so they may share
+// the cache's inode; anything else gets its own copy.
+static bool place_file(const char *src, const char *dst, bool intermediate) {
+    if (intermediate && link(src, dst) == 0) return true;
+    return clone_file(src, dst);
+}
+
+typedef struct {
+    char *name;
+    long long bytes;
+    struct timespec used;
+} CacheEntry;
+
+static int compare_used(const void *a, const void *b) {
+    const CacheEntry *x = a;
+    const CacheEntry *y = b;
+    if (x->used.tv_sec != y->used.tv_sec) return x->used.tv_sec < y->used.tv_sec ? -1 : 1;
+    if (x->used.tv_nsec != y->used.tv_nsec) return x->used.tv_nsec < y->used.tv_nsec ? -1 : 1;
+    return 0;
+}
+
+// Deletes least recently used entries until the directory is back under
+// EVICT_TO of the limit. Leftover temporaries of crashed runs go too.
+static void evict(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    CacheEntry *entries = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    long long total = 0;
+    time_t now = time(NULL);
+    struct dirent *ent;
+    while ((ent = readdir(d))) {
+        if (ent->d_name[0] == '.') continue;
+        struct stat st;
+        if (fstatat(dirfd(d), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) continue;
+        if (strstr(ent->d_name, ".tmp.")) {
+            if (now - st.st_mtim.tv_sec > STALE_TEMP_SECONDS) unlinkat(dirfd(d), ent->d_name, 0);
+            continue;
+        }
+        if (len == cap) {
+            size_t grown_cap = cap ? cap * 2 : 256;
+            CacheEntry *grown = realloc(entries, grown_cap * sizeof(*grown));
+            if (!grown) break;
+            entries = grown;
+            cap = grown_cap;
+        }
+        char *name = strdup(ent->d_name);
+        if (!name) break;
+        entries[len++] = (CacheEntry){name, (long long)st.st_blocks * 512, st.st_mtim};
+        total += (long long)st.st_blocks * 512;
+    }
+
+    if (total > cache_limit) {
+        qsort(entries, len, sizeof(*entries), compare_used);
+        long long target = (long long)(cache_limit * EVICT_TO);
+        for (size_t i = 0; i < len && total > target; i++) {
+            if (unlinkat(dirfd(d), entries[i].name, 0) == 0) total -= entries[i].bytes;
+        }
+    }
+    for (size_t i = 0; i < len; i++) free(entries[i].name);
+    free(entries);
+    closedir(d);
+    stored_since_scan = 0;
+}
+
+bool cache_fetch(uint64_t key, const char *ext, const char *output_path, bool intermediate) {
+    const char *dir = cache_directory();
+    if (!dir) return false;
+    char *obj = object_path(dir, key, ext);
+    if (!obj) return false;
+
+    bool ok = false;
+    if (strcmp(output_path, "-") == 0) {
+        int in = open(obj, O_RDONLY | O_CLOEXEC);
+        if (in >= 0) {
+            fflush(stdout);
+            ok = copy_fd(in, STDOUT_FILENO);
+            close(in);
+        }
+    } else if (access(obj, R_OK) == 0) {
+        // The caller has checked that output_path may be replaced.
+        unlink(output_path);
+        ok = place_file(obj, output_path, intermediate);
+    }
+    if (ok) utimensat(AT_FDCWD, obj, NULL, 0);  // most recently used
+    free(obj);
+    return ok;
+}
+
+void cache_store(uint64_t key, const char *ext, const char *output_path, bool intermediate) {
+    const char *dir = cache_directory();
+    if (!dir || strcmp(output_path, "-") == 0) return;
+    char *obj = object_path(dir, key, ext);
+    if (!obj) return;
+    // Checked before anything is copied: eviction would otherwise make room
+    // for an oversized entry by deleting every other one, and then it too.
+    struct stat out;
+    if (access(obj, F_OK) == 0 || stat(output_path, &out) != 0 ||
+        (long long)out.st_blocks * 512 > cache_limit / MAX_ENTRY_SHARE) {
+        free(obj);
+        return;
+    }
+    make_parent_dirs(obj);
+
+    // Written under a temporary name so a concurrent reader never sees half
+    // an entry.
+    size_t len = strlen(obj) + 32;
+    char *tmp = malloc(len);
+    if (tmp) {
+        snprintf(tmp, len, "%s.tmp.%ld", obj, (long)getpid());
+        if (place_file(output_path, tmp, intermediate) && rename(tmp, obj) == 0) {
+            struct stat st;
+            if (stat(obj, &st) == 0 && stored_since_scan >= 0) stored_since_scan += (long long)st.st_blocks * 512;
+        } else {
+            unlink(tmp);
+        }
+        free(tmp);
+    }
+    free(obj);
+
+    // A scan per process, then again each time a sixteenth of the limit has
+    // been added, keeps batches from re-reading the directory for every file.
+    if (stored_since_scan < 0 || stored_since_scan > cache_limit / 16) evict(dir);
+}
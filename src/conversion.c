@@ -1,39 +1,42 @@
 #include "../include/dtconvert.h"
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/resource.h>
+#include <time.h>
 
-// Converter registry structure
-typedef struct {
-    char *from_format;
-    char *to_format;
-    char *converter_path;
-    char *description;
-} Converter;
-
-// Built-in converter registry
-static Converter converters[] = {
-    {"docx", "pdf", "modules/docx_to_pdf.sh", "DOCX to PDF converter"},
-    {"docx", "odt", "modules/docx_to_odt.sh", "DOCX to ODT converter"},
-    {"odt", "pdf", "modules/odt_to_pdf.sh", "ODT to PDF converter"},
-    {"odt", "docx", "modules/odt_to_docx.sh", "ODT to DOCX converter"},
-    {"txt", "pdf", "modules/txt_to_pdf.sh", "Text to PDF converter"},
-    {"csv", "txt", "modules/csv_to_txt.sh", "CSV to Text converter"},
-    {"csv", "pdf", "modules/csv_to_pdf.sh", "CSV to PDF converter"},
-    {"csv", "xlsx", "modules/csv_to_xlsx.sh", "CSV to XLSX converter"},
-    {"xlsx", "csv", "modules/xlsx_to_csv.sh", "XLSX to CSV converter"},
-    {"csv", "json", "lib/converters/data_convert", "CSV to JSON converter"},
-    {"json", "csv", "lib/converters/data_convert", "JSON to CSV converter"},
-    {"json", "yaml", "lib/converters/data_convert", "JSON to YAML converter"},
-    {"yaml", "json", "lib/converters/data_convert", "YAML to JSON converter"},
-    {"csv", "yaml", "lib/converters/data_convert", "CSV to YAML converter"},
-    {"yaml", "csv", "lib/converters/data_convert", "YAML to CSV converter"},
-    {"csv", "sql", "modules/csv_to_sql.sh", "CSV to SQL converter"},
-    {"sql", "csv", "modules/sql_to_csv.sh", "SQL to CSV converter"},
-    {"txt", "tokens", "modules/txt_to_tokens.sh", "Text to tokens converter"},
-    {"csv", "postgresql", "modules/csv_to_postgresql.sh", "CSV to PostgreSQL importer"},
-    {"postgresql", "csv", "modules/postgresql_to_csv.sh", "PostgreSQL to CSV exporter"},
-    {NULL, NULL, NULL, NULL}  // Sentinel
-};
+// The registry (src/registry.c), fetched by each entry point below.
+static const Converter *converters = NULL;
+
+static const char *resource_names[RESOURCE_CLASSES] = {"cpu", "io-bound", "db-connection", "memory-heavy"};
+
+const char *resource_class_name(ResourceClass resource) {
+    return resource >= 0 && resource < RESOURCE_CLASSES ? resource_names[resource] : "?";
+}
+
+bool parse_resource_class(const char *name, ResourceClass *out) {
+    for (int c = 0; c < RESOURCE_CLASSES; c++) {
+        if (strcasecmp(name, resource_names[c]) == 0) {
+            *out = (ResourceClass)c;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Largest resident set (KiB) of the converter processes reaped since the last
+// take_converter_peak_rss(); wait4() reports it for the child and whatever
+// it waited for, so a module script accounts for the tool it ran.
+static long converter_peak_kb = 0;
+
+static void note_converter_rusage(const struct rusage *ru) {
+    if (ru->ru_maxrss > converter_peak_kb) converter_peak_kb = ru->ru_maxrss;
+}
+
+long take_converter_peak_rss(void) {
+    long peak = converter_peak_kb;
+    converter_peak_kb = 0;
+    return peak;
+}
 
 static bool is_storage_format(const char *format) {
     return (format && strcmp(format, "postgresql") == 0);
@@ -65,148 +68,415 @@ static char *make_temp_with_ext(const char *ext) {
     return out;
 }
 
+// ---------------- Planner ----------------
+
+// A route from one format to another: converter ids in order, and what the
+// cost model expects the whole run to take.
+typedef struct {
+    int *steps;
+    int count;
+    double cost;  // estimated seconds
+} Plan;
+
+static void plan_free(Plan *plan) {
+    free(plan->steps);
+    *plan = (Plan){0};
+}
+
+typedef struct {
+    double cost;
+    int node;
+} HeapItem;
+
 typedef struct {
-    const char *name;
-    int prev;
-    int prev_converter;
-    bool seen;
-} Node;
+    HeapItem *items;
+    size_t len;
+} Heap;
+
+// The heap is sized for one entry per edge plus the start, which is as many
+// as the lazy-deletion Dijkstra below can push.
+static void heap_push(Heap *h, double cost, int node) {
+    size_t i = h->len++;
+    while (i > 0 && h->items[(i - 1) / 2].cost > cost) {
+        h->items[i] = h->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    h->items[i] = (HeapItem){cost, node};
+}
+
+static HeapItem heap_pop(Heap *h) {
+    HeapItem top = h->items[0];
+    HeapItem last = h->items[--h->len];
+    size_t i = 0;
+    for (;;) {
+        size_t c = 2 * i + 1;
+        if (c >= h->len) break;
+        if (c + 1 < h->len && h->items[c + 1].cost < h->items[c].cost) c++;
+        if (h->items[c].cost >= last.cost) break;
+        h->items[i] = h->items[c];
+        i = c;
+    }
+    if (h->len > 0) h->items[i] = last;
+    return top;
+}
 
-static int format_index(Node *nodes, int n, const char *name) {
+static int format_index(const char **names, int n, const char *name) {
     for (int i = 0; i < n; i++) {
-        if (nodes[i].name && strcmp(nodes[i].name, name) == 0) return i;
+        if (strcmp(names[i], name) == 0) return i;
     }
     return -1;
 }
 
-static int build_nodes(Node *nodes, int max_nodes) {
-    int n = 0;
-    for (int i = 0; converters[i].from_format != NULL; i++) {
-        const char *a = converters[i].from_format;
-        const char *b = converters[i].to_format;
+// Estimated seconds for converter cid on an input of the given size.
+static double step_cost(int cid, off_t bytes, CostBasis *basis) {
+    const Converter *c = &converters[cid];
+    return converter_cost(c->from_format, c->to_format, c->converter_path, c->resource, &c->hint,
+                          find_native_converter(c->converter_path) != NULL, bytes, basis);
+}
 
-        if (format_index(nodes, n, a) < 0 && n < max_nodes) {
-            nodes[n++] = (Node){.name = a, .prev = -1, .prev_converter = -1, .seen = false};
+// Cheapest route from -> to (Dijkstra over the registry, every step costed
+// for the input size). Returns the step count, or -1 if there is none.
+static int find_path(const char *from, const char *to, off_t bytes, Plan *plan) {
+    *plan = (Plan){0};
+    converters = converter_registry();
+    int nconv = 0;
+    while (converters[nconv].from_format) nconv++;
+
+    // Formats are the nodes; each converter's ends are looked up once.
+    const char **names = malloc((size_t)(2 * nconv + 1) * sizeof(*names));
+    int *ends = malloc((size_t)(2 * nconv + 1) * sizeof(int));
+    double *dist = malloc((size_t)(2 * nconv + 1) * sizeof(double));
+    int *via = malloc((size_t)(2 * nconv + 1) * sizeof(int));
+    Heap heap = {malloc((size_t)(nconv + 1) * sizeof(HeapItem)), 0};
+    int rc = -1;
+    if (!names || !ends || !dist || !via || !heap.items) goto out;
+
+    int n = 0;
+    for (int cid = 0; cid < nconv; cid++) {
+        for (int side = 0; side < 2; side++) {
+            const char *name = side ? converters[cid].to_format : converters[cid].from_format;
+            int v = format_index(names, n, name);
+            if (v < 0) {
+                v = n;
+                names[n++] = name;
+            }
+            ends[2 * cid + side] = v;
         }
-        if (format_index(nodes, n, b) < 0 && n < max_nodes) {
-            nodes[n++] = (Node){.name = b, .prev = -1, .prev_converter = -1, .seen = false};
+    }
+    int start = format_index(names, n, from);
+    int goal = format_index(names, n, to);
+    if (start < 0 || goal < 0) goto out;
+
+    for (int v = 0; v < n; v++) {
+        dist[v] = -1.0;  // unreached
+        via[v] = -1;
+    }
+    dist[start] = 0.0;
+    heap_push(&heap, 0.0, start);
+    while (heap.len > 0) {
+        HeapItem top = heap_pop(&heap);
+        int u = top.node;
+        if (top.cost > dist[u]) continue;  // stale entry
+        if (u == goal) break;
+
+        for (int cid = 0; cid < nconv; cid++) {
+            if (ends[2 * cid] != u) continue;
+            // Avoid routing INTO a storage format unless it's the final target.
+            if (is_storage_format(converters[cid].to_format) && strcmp(to, converters[cid].to_format) != 0) continue;
+
+            int v = ends[2 * cid + 1];
+            double d = dist[u] + step_cost(cid, bytes, NULL);
+            if (dist[v] >= 0.0 && dist[v] <= d) continue;
+            dist[v] = d;
+            via[v] = cid;
+            heap_push(&heap, d, v);
         }
     }
-    return n;
+    if (dist[goal] < 0.0 || goal == start) goto out;
+
+    int count = 0;
+    for (int cur = goal; cur != start; cur = ends[2 * via[cur]]) count++;
+    plan->steps = malloc((size_t)count * sizeof(int));
+    if (!plan->steps) goto out;
+    plan->count = count;
+    plan->cost = dist[goal];
+    for (int cur = goal, i = count - 1; cur != start; cur = ends[2 * via[cur]], i--) plan->steps[i] = via[cur];
+    rc = count;
+
+out:
+    free(names);
+    free(ends);
+    free(dist);
+    free(via);
+    free(heap.items);
+    return rc;
 }
 
-static int find_path(const char *from, const char *to, int *out_converters, int max_steps) {
-    Node nodes[64] = {0};
-    int n = build_nodes(nodes, 64);
+// The planner's formats for one step, for helpers that cannot go by extension
+// (standard input/output, "-").
+static void export_step_formats(int converter_id) {
+    setenv("DTCONVERT_INPUT_FORMAT", converters[converter_id].from_format, 1);
+    setenv("DTCONVERT_OUTPUT_FORMAT", converters[converter_id].to_format, 1);
+}
 
-    int start = format_index(nodes, n, from);
-    int goal = format_index(nodes, n, to);
-    if (start < 0 || goal < 0) return -1;
+static char *resolve_converter_path_with_fallbacks(const char *converter_path);
 
-    int q[64];
-    int qh = 0, qt = 0;
-    nodes[start].seen = true;
-    q[qt++] = start;
+// Step a can feed step b through a pipe: a writes sequentially and b reads
+// sequentially. Otherwise the intermediate goes through a temp file.
+static bool stages_stream(int a, int b) {
+    return (converters[a].flags & CONV_STREAM_OUT) && (converters[b].flags & CONV_STREAM_IN);
+}
 
-    while (qh < qt) {
-        int u = q[qh++];
-        if (u == goal) break;
+static void close_fds(const int *fds, int n) {
+    for (int i = 0; i < n; i++) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+}
+
+// Starts one stage of a piped run in a child process. in_fd/out_fd, when not
+// -1, become its standard input/output (and input/output are then "-").
+// Built-in converters run in the child without an exec.
+static pid_t start_stage(int cid, const char *input, const char *output, int in_fd, int out_fd,
+                         const int *pipe_fds, int npipe_fds) {
+    NativeConverter native = find_native_converter(converters[cid].converter_path);
+    char *resolved = NULL;
+    if (!native) {
+        resolved = resolve_converter_path_with_fallbacks(converters[cid].converter_path);
+        if (!resolved) {
+            fprintf(stderr, "Error: Converter not found or not executable: %s\n", converters[cid].converter_path);
+            return -1;
+        }
+    }
 
-        for (int cid = 0; converters[cid].from_format != NULL; cid++) {
-            if (strcmp(converters[cid].from_format, nodes[u].name) != 0) continue;
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (in_fd >= 0) dup2(in_fd, STDIN_FILENO);
+        if (out_fd >= 0) dup2(out_fd, STDOUT_FILENO);
+        close_fds(pipe_fds, npipe_fds);
+        export_step_formats(cid);
+        if (native) _exit(native(input, output));
 
-            // Avoid routing INTO a storage format unless it's the final target.
-            if (is_storage_format(converters[cid].to_format) && strcmp(to, "postgresql") != 0) continue;
+        execl(resolved, resolved, input, output, NULL);
+        fprintf(stderr, "Error: Failed to execute converter: %s: %s\n", resolved, strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+    if (pid < 0) fprintf(stderr, "Error: Failed to fork process\n");
+    free(resolved);
+    return pid;
+}
+
+// Runs steps [first, last] at the same time, each connected to the next by a
+// pipe. Returns 0 when every stage succeeded.
+static int run_piped_stages(const int *steps_ids, int first, int last, const char *input, const char *output) {
+    int n = last - first + 1;
+    int *pipe_fds = malloc((size_t)(2 * n) * sizeof(int));
+    pid_t *pids = malloc((size_t)n * sizeof(pid_t));
+    int npipe_fds = 0;
+    if (!pipe_fds || !pids) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(pipe_fds);
+        free(pids);
+        return -1;
+    }
+    for (int k = 0; k < n - 1; k++) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            fprintf(stderr, "Error: Failed to create pipe: %s\n", strerror(errno));
+            close_fds(pipe_fds, npipe_fds);
+            free(pipe_fds);
+            free(pids);
+            return -1;
+        }
+        // Stages run as programs must not hold the other pipes' ends open
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        pipe_fds[npipe_fds++] = fds[0];
+        pipe_fds[npipe_fds++] = fds[1];
+    }
 
-            int v = format_index(nodes, n, converters[cid].to_format);
-            if (v < 0) continue;
-            if (nodes[v].seen) continue;
+    int started = 0;
+    for (int k = 0; k < n; k++) {
+        int in_fd = k > 0 ? pipe_fds[2 * (k - 1)] : -1;
+        int out_fd = k < n - 1 ? pipe_fds[2 * k + 1] : -1;
+        pid_t pid = start_stage(steps_ids[first + k], k > 0 ? "-" : input, k < n - 1 ? "-" : output, in_fd, out_fd,
+                                pipe_fds, npipe_fds);
+        if (pid < 0) break;
+        pids[started++] = pid;
+    }
+    // The children hold their ends now; closing ours lets EOF and EPIPE
+    // propagate when a stage exits.
+    close_fds(pipe_fds, npipe_fds);
 
-            nodes[v].seen = true;
-            nodes[v].prev = u;
-            nodes[v].prev_converter = cid;
-            q[qt++] = v;
-            if (qt >= 64) break;
+    int rc = started == n ? 0 : -1;
+    for (int k = 0; k < started; k++) {
+        int status;
+        struct rusage ru;
+        if (wait4(pids[k], &status, 0, &ru) < 0) {
+            rc = -1;
+            continue;
+        }
+        note_converter_rusage(&ru);
+        int code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        if (code != 0) {
+            fprintf(stderr, "Error: %s failed with code %d\n", converters[steps_ids[first + k]].description, code);
+            if (rc == 0) rc = code;
         }
     }
+    free(pipe_fds);
+    free(pids);
+    return rc;
+}
 
-    if (!nodes[goal].seen) return -1;
+// Cache keys of each step's output, 0 where it cannot be cached: the input
+// must be a regular file, and nothing at or before the step may involve a
+// database, whose contents change under the same key. Only the final output
+// has a name worth keying on; intermediates get random temp names.
+static void plan_cache_keys(const Plan *plan, const char *input, const char *output, uint64_t *keys) {
+    memset(keys, 0, (size_t)plan->count * sizeof(*keys));
+    uint64_t key;
+    if (!conversion_cache_enabled() || !cache_input_key(input, &key)) return;
+    for (int s = 0; s < plan->count; s++) {
+        const Converter *c = &converters[plan->steps[s]];
+        if (c->resource == RESOURCE_DB || is_storage_format(c->to_format)) return;
+        char variant[MAX_PATH_LEN] = "";
+        if (s == plan->count - 1) {
+            const char *base = strrchr(output, '/');
+            base = base ? base + 1 : output;
+            snprintf(variant, sizeof(variant), "%s%s%s", output + strlen(output) - compression_suffix_len(output),
+                     (c->flags & CONV_NAMED_OUTPUT) ? "|" : "", (c->flags & CONV_NAMED_OUTPUT) ? base : "");
+        }
+        // In-process converters are as new as dtconvert itself.
+        bool native = find_native_converter(c->converter_path) != NULL;
+        char *version = native ? strdup("/proc/self/exe") : resolve_converter_path_with_fallbacks(c->converter_path);
+        key = cache_step_key(key, c->converter_path, version, c->from_format, c->to_format, variant);
+        free(version);
+        keys[s] = key;
+    }
+}
 
-    int tmp[64];
-    int steps = 0;
-    for (int cur = goal; cur != start; cur = nodes[cur].prev) {
-        if (steps >= 64) break;
-        tmp[steps++] = nodes[cur].prev_converter;
+// Runs converter cid on its own and records how long it took for the cost
+// model. Stages of a piped group overlap, so only whole steps are timed.
+static int run_step(int cid, const char *input, const char *output) {
+    struct stat st;
+    off_t bytes = stat(input, &st) == 0 && S_ISREG(st.st_mode) ? st.st_size : -1;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    export_step_formats(cid);
+    int rc = execute_converter(converters[cid].converter_path, input, output);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (rc == 0 && bytes >= 0) {
+        double seconds = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+        record_converter_run(converters[cid].from_format, converters[cid].to_format, converters[cid].converter_path,
+                             bytes, seconds);
     }
-    if (steps <= 0 || steps > max_steps) return -1;
+    return rc;
+}
 
-    for (int i = 0; i < steps; i++) {
-        out_converters[i] = tmp[steps - 1 - i];
+static void remove_temps(char **temp_paths, int temp_count) {
+    for (int k = 0; k < temp_count; k++) {
+        unlink(temp_paths[k]);
+        free(temp_paths[k]);
     }
-    return steps;
 }
 
-static int execute_pipeline(ConversionRequest *request, const char *from_format) {
-    int steps_ids[64];
-    int steps = find_path(from_format, request->output_format, steps_ids, 64);
-    if (steps < 0) {
-        fprintf(stderr, "Error: No converter found for %s -> %s\n", from_format, request->output_format);
-        return ERR_NO_CONVERTER;
+// Runs the planned steps. Consecutive steps that can stream run concurrently
+// as one group joined by pipes; a step that needs a seekable input (or a
+// producer that needs a seekable output) starts a new group, fed by a temp
+// file the previous group wrote.
+static int execute_pipeline(ConversionRequest *request, const Plan *plan) {
+    const int *steps_ids = plan->steps;
+    int steps = plan->count;
+    if (steps < 1) return ERR_CONVERSION_FAILED;
+
+    for (int s = 0; s < steps - 1; s++) {
+        if (is_storage_format(converters[steps_ids[s]].to_format)) {
+            fprintf(stderr, "Error: Cannot pipeline through storage target '%s'\n", converters[steps_ids[s]].to_format);
+            return ERR_CONVERSION_FAILED;
+        }
     }
 
+    FILE *info = verbose_stream(request);
     const char *current_input = request->input->full_path;
-    char *temp_paths[64] = {0};
+    char **temp_paths = calloc((size_t)steps, sizeof(char *));
+    uint64_t *keys = calloc((size_t)steps, sizeof(*keys));
     int temp_count = 0;
+    if (!temp_paths || !keys) {
+        free(temp_paths);
+        free(keys);
+        return ERR_CONVERSION_FAILED;
+    }
+    plan_cache_keys(plan, current_input, request->output_path, keys);
+
+    // Start after the last step whose output is cached.
+    int first = 0;
+    for (int s = steps - 1; s >= 0 && first == 0; s--) {
+        if (!keys[s]) continue;
+        const char *format = converters[steps_ids[s]].to_format;
+        if (s == steps - 1) {
+            if (cache_fetch(keys[s], format, request->output_path, false)) first = steps;
+            continue;
+        }
+        char *tmp = make_temp_with_ext(format);
+        if (tmp && cache_fetch(keys[s], format, tmp, true)) {
+            temp_paths[temp_count++] = tmp;
+            current_input = tmp;
+            first = s + 1;
+        } else if (tmp) {
+            unlink(tmp);
+            free(tmp);
+        }
+    }
+    if (first == 1 && request->verbose) fprintf(info, "Step 1/%d: reused from cache\n", steps);
+    if (first > 1 && request->verbose) fprintf(info, "Steps 1-%d/%d: reused from cache\n", first, steps);
 
-    for (int s = 0; s < steps; s++) {
-        int cid = steps_ids[s];
-        const char *to_fmt = converters[cid].to_format;
-
-        const char *step_output = NULL;
-        char *tmp = NULL;
+    while (first < steps) {
+        int last = first;
+        while (last + 1 < steps && stages_stream(steps_ids[last], steps_ids[last + 1])) last++;
 
-        bool last = (s == steps - 1);
-        if (last) {
-            step_output = request->output_path;
-        } else {
-            if (is_storage_format(to_fmt)) {
-                fprintf(stderr, "Error: Cannot pipeline through storage target '%s'\n", to_fmt);
-                for (int k = 0; k < temp_count; k++) {
-                    unlink(temp_paths[k]);
-                    free(temp_paths[k]);
-                }
-                return ERR_CONVERSION_FAILED;
-            }
-            tmp = make_temp_with_ext(to_fmt);
+        const char *group_output = request->output_path;
+        if (last < steps - 1) {
+            char *tmp = make_temp_with_ext(converters[steps_ids[last]].to_format);
             if (!tmp) {
                 fprintf(stderr, "Error: Failed to create temp file\n");
-                for (int k = 0; k < temp_count; k++) {
-                    unlink(temp_paths[k]);
-                    free(temp_paths[k]);
-                }
+                remove_temps(temp_paths, temp_count);
+                free(temp_paths);
+                free(keys);
                 return ERR_CONVERSION_FAILED;
             }
             temp_paths[temp_count++] = tmp;
-            step_output = tmp;
+            group_output = tmp;
         }
 
-        int rc = execute_converter(converters[cid].converter_path, current_input, step_output);
-        if (rc != 0) {
-            fprintf(stderr, "Error: Converter failed with code %d\n", rc);
-            for (int k = 0; k < temp_count; k++) {
-                unlink(temp_paths[k]);
-                free(temp_paths[k]);
+        if (request->verbose) {
+            for (int s = first; s <= last; s++) {
+                fprintf(info, "Step %d/%d: %s%s\n", s + 1, steps, converters[steps_ids[s]].description,
+                        s < last ? " (piped)" : "");
             }
+        }
+
+        int rc;
+        if (first == last) {
+            rc = run_step(steps_ids[first], current_input, group_output);
+            if (rc != 0) fprintf(stderr, "Error: Converter failed with code %d\n", rc);
+        } else {
+            rc = run_piped_stages(steps_ids, first, last, current_input, group_output);
+        }
+        if (rc != 0) {
+            remove_temps(temp_paths, temp_count);
+            free(temp_paths);
+            free(keys);
             return ERR_CONVERSION_FAILED;
         }
+        if (keys[last]) cache_store(keys[last], converters[steps_ids[last]].to_format, group_output, last < steps - 1);
 
-        current_input = step_output;
+        current_input = group_output;
+        first = last + 1;
     }
 
-    for (int k = 0; k < temp_count; k++) {
-        unlink(temp_paths[k]);
-        free(temp_paths[k]);
-    }
+    remove_temps(temp_paths, temp_count);
+    free(temp_paths);
+    free(keys);
     return SUCCESS;
 }
 
@@ -215,12 +485,23 @@ int convert_document(ConversionRequest *request) {
         return ERR_INVALID_ARGS;
     }
 
+    // Helpers are reached through module scripts, so the thread count travels
+    // in the environment rather than on their command lines.
+    if (request->threads != 0) {
+        char threads[16];
+        snprintf(threads, sizeof(threads), "%d", request->threads < 0 ? 0 : request->threads);
+        setenv("DTCONVERT_THREADS", threads, 1);
+    }
+    if (request->infer_types) setenv("DTCONVERT_INFER_TYPES", "1", 1);
+    if (request->no_cache) conversion_cache_disable();
+
     // Storage targets (e.g., postgresql) use output_path as a config file path.
     bool output_is_config = is_storage_format(request->output_format);
     
-    const char *from_format = (request->input_format && request->input_format[0] != '\0')
-                                 ? request->input_format
-                                 : request->input->extension;
+    const char *from_format = canonical_format((request->input_format && request->input_format[0] != '\0')
+                                                   ? request->input_format
+                                                   : request->input->extension);
+    const char *to_format = canonical_format(request->output_format);
 
     if (!request->output_path) {
         fprintf(stderr, "Error: Missing -o/--output argument\n");
@@ -233,42 +514,110 @@ int convert_document(ConversionRequest *request) {
             return ERR_FILE_NOT_FOUND;
         }
     } else {
-        // Check if output file exists
-        if (!request->overwrite && access(request->output_path, F_OK) == 0) {
+        // Check if output file exists ("-" is standard output)
+        if (!request->overwrite && strcmp(request->output_path, "-") != 0 &&
+            access(request->output_path, F_OK) == 0) {
             fprintf(stderr, "Error: Output file '%s' already exists. Use -f to overwrite.\n",
                     request->output_path);
             return ERR_CONVERSION_FAILED;
         }
     }
 
-    // Try direct converter first
-    int converter_id = find_converter(from_format, request->output_format);
-    if (converter_id >= 0) {
-        int result = execute_converter(converters[converter_id].converter_path,
-                                       request->input->full_path,
-                                       request->output_path);
+    Plan plan;
+    if (find_path(from_format, to_format, request->input->size, &plan) < 0) {
+        fprintf(stderr, "Error: No converter found for %s -> %s\n", from_format, to_format);
+        return ERR_NO_CONVERTER;
+    }
 
-        if (result != 0) {
-            fprintf(stderr, "Error: Converter failed with code %d\n", result);
-            return ERR_CONVERSION_FAILED;
+    int result;
+    if (plan.count == 1) {
+        int converter_id = plan.steps[0];
+        const char *format = converters[converter_id].to_format;
+        uint64_t key;
+        plan_cache_keys(&plan, request->input->full_path, request->output_path, &key);
+        if (key && cache_fetch(key, format, request->output_path, false)) {
+            result = SUCCESS;
+            if (request->verbose) {
+                fprintf(verbose_stream(request), "Output reused from cache: %s\n", converters[converter_id].description);
+            }
+        } else {
+            result = run_step(converter_id, request->input->full_path, request->output_path);
+            if (result != 0) {
+                fprintf(stderr, "Error: Converter failed with code %d\n", result);
+                result = ERR_CONVERSION_FAILED;
+            } else {
+                if (key) cache_store(key, format, request->output_path, false);
+                if (request->verbose) {
+                    fprintf(verbose_stream(request), "Converter executed: %s\n", converters[converter_id].description);
+                }
+            }
         }
-
+    } else {
+        // Pipeline (e.g., postgresql -> csv -> json)
         if (request->verbose) {
-            printf("Converter executed: %s\n", converters[converter_id].description);
+            fprintf(verbose_stream(request), "Converting %s -> %s in %d steps (estimated %.3fs)\n", from_format,
+                    to_format, plan.count, plan.cost);
         }
-        return SUCCESS;
+        result = execute_pipeline(request, &plan);
     }
+    plan_free(&plan);
+    return result;
+}
+
+int prepare_conversion(const char *from_format, const char *to_format, off_t size, ResourceClass *resource) {
+    Plan plan;
+    int steps = find_path(from_format, to_format, size, &plan);
+    if (steps < 0) return -1;
 
-    // Pipeline fallback (e.g., postgresql -> csv -> json)
-    if (request->verbose) {
-        printf("No direct converter for %s -> %s; attempting pipeline...\n", from_format, request->output_format);
+    if (resource) {
+        *resource = RESOURCE_CPU;
+        for (int s = 0; s < steps; s++) {
+            if (converters[plan.steps[s]].resource > *resource) *resource = converters[plan.steps[s]].resource;
+        }
+    }
+    for (int s = 0; s < steps; s++) {
+        const char *path = converters[plan.steps[s]].converter_path;
+        if (find_native_converter(path)) continue;
+        char *resolved = resolve_converter_path_with_fallbacks(path);
+        if (!resolved) {
+            steps = -2;
+            break;
+        }
+        free(resolved);
     }
-    return execute_pipeline(request, from_format);
+    plan_free(&plan);
+    return steps;
+}
+
+static const char *basis_names[] = {"static", "measured", "measured (same program)"};
+
+int explain_conversion(const char *from_format, const char *to_format, off_t size, FILE *out) {
+    Plan plan;
+    if (find_path(from_format, to_format, size, &plan) < 0) {
+        fprintf(stderr, "Error: No converter found for %s -> %s\n", from_format, to_format);
+        return ERR_NO_CONVERTER;
+    }
+
+    fprintf(out, "Plan: %s -> %s, %d step%s for %.1f MiB of input\n", from_format, to_format, plan.count,
+            plan.count == 1 ? "" : "s", (double)size / (1024.0 * 1024.0));
+    for (int s = 0; s < plan.count; s++) {
+        int cid = plan.steps[s];
+        CostBasis basis = COST_STATIC;
+        double cost = step_cost(cid, size, &basis);
+        bool piped = s + 1 < plan.count && stages_stream(cid, plan.steps[s + 1]);
+        fprintf(out, "  %d. %-8s -> %-10s %-30s %-13s %8.3fs %s%s\n", s + 1, converters[cid].from_format,
+                converters[cid].to_format, converters[cid].converter_path, resource_class_name(converters[cid].resource),
+                cost, basis_names[basis], piped ? ", piped" : "");
+    }
+    fprintf(out, "Estimated cost: %.3fs\n", plan.cost);
+    plan_free(&plan);
+    return SUCCESS;
 }
 
 int find_converter(const char *from_format, const char *to_format) {
     if (!from_format || !to_format) return -1;
-    
+    converters = converter_registry();
+
     for (int i = 0; converters[i].from_format != NULL; i++) {
         if (strcmp(converters[i].from_format, from_format) == 0 &&
             strcmp(converters[i].to_format, to_format) == 0) {
@@ -356,95 +705,119 @@ static char *resolve_converter_path(const char *converter_path) {
     return xstrdup0(converter_path);
 }
 
-static char *resolve_converter_path_with_fallbacks(const char *converter_path) {
-    if (!converter_path) return NULL;
-
-    // 1) Direct resolution: dev tree (repo root + modules/..., lib/converters/...)
-    char *p = resolve_converter_path(converter_path);
-    if (p && access(p, X_OK) == 0) return p;
-    free(p);
+// Directories that may hold converters of one kind, in lookup order:
+//   - the dev tree: $DTCONVERT_HOME/<kind>, else <exe prefix>/<kind>
+//   - an installed tree under $DTCONVERT_HOME, which may name either
+//     <prefix>/lib/dtconvert or <prefix>
+//   - the install next to the executable: <exe prefix>/lib/dtconvert/...
+//   - the system-wide installs under /usr/local and /usr
+// Modules install to .../lib/dtconvert/converters and helper binaries to
+// .../lib/dtconvert/lib/converters (see the Makefile).
+char **converter_search_dirs(const char *kind) {
+    bool modules = strcmp(kind, "modules") == 0;
+    const char *installed = modules ? "converters" : "lib/converters";
+    char *candidates[8] = {0};
+    int n = 0;
 
-    // 2) If DTCONVERT_HOME is set, support both:
-    //    - DTCONVERT_HOME=<repo root> (dev tree)
-    //    - DTCONVERT_HOME=<prefix>/lib/dtconvert (installed tree root)
-    //    - DTCONVERT_HOME=<prefix> (installed prefix)
     const char *home = getenv("DTCONVERT_HOME");
+    char *prefix = exe_dir_parent();
     if (home && home[0] != '\0') {
-        if (strncmp(converter_path, "modules/", 8) == 0) {
-            const char *leaf = converter_path + 8;
-            // installed-tree root
-            char *p1 = path_join3(home, "converters", leaf);
-            if (p1 && access(p1, X_OK) == 0) return p1;
-            free(p1);
-            // prefix root
-            char *p2 = path_join3(home, "lib/dtconvert/converters", leaf);
-            if (p2 && access(p2, X_OK) == 0) return p2;
-            free(p2);
-        } else if (strncmp(converter_path, "lib/converters/", 15) == 0) {
-            const char *leaf = converter_path + 15;
-            // installed-tree root
-            char *p1 = path_join3(home, "lib/converters", leaf);
-            if (p1 && access(p1, X_OK) == 0) return p1;
-            free(p1);
-            // prefix root
-            char *p2 = path_join3(home, "lib/dtconvert/lib/converters", leaf);
-            if (p2 && access(p2, X_OK) == 0) return p2;
-            free(p2);
-        }
+        candidates[n++] = path_join2(home, kind);
+        if (modules) candidates[n++] = path_join2(home, installed);
+        candidates[n++] = path_join3(home, "lib/dtconvert", installed);
+    } else if (prefix) {
+        candidates[n++] = path_join2(prefix, kind);
+    } else {
+        // Last resort: relative to the working directory.
+        candidates[n++] = xstrdup0(kind);
     }
+    if (prefix) candidates[n++] = path_join3(prefix, "lib/dtconvert", installed);
+    candidates[n++] = path_join3("/usr/local", "lib/dtconvert", installed);
+    candidates[n++] = path_join3("/usr", "lib/dtconvert", installed);
+    free(prefix);
 
-    // 3) Support installed layout relative to the executable's prefix.
-    //    If dtconvert is installed to <prefix>/bin/dtconvert, then:
-    //    - modules are at <prefix>/lib/dtconvert/converters/
-    //    - helper binaries are at <prefix>/lib/dtconvert/lib/converters/
-    char *prefix = exe_dir_parent();
-    if (prefix) {
-        if (strncmp(converter_path, "modules/", 8) == 0) {
-            const char *leaf = converter_path + 8;
-            char *p1 = path_join3(prefix, "lib/dtconvert/converters", leaf);
-            if (p1 && access(p1, X_OK) == 0) {
-                free(prefix);
-                return p1;
-            }
-            free(p1);
-        } else if (strncmp(converter_path, "lib/converters/", 15) == 0) {
-            const char *leaf = converter_path + 15;
-            char *p1 = path_join3(prefix, "lib/dtconvert/lib/converters", leaf);
-            if (p1 && access(p1, X_OK) == 0) {
-                free(prefix);
-                return p1;
-            }
-            free(p1);
+    char **dirs = calloc((size_t)n + 1, sizeof(*dirs));
+    int len = 0;
+    for (int i = 0; i < n; i++) {
+        bool dup = !candidates[i] || !dirs;
+        for (int j = 0; !dup && j < len; j++) dup = strcmp(dirs[j], candidates[i]) == 0;
+        if (dup) {
+            free(candidates[i]);
+        } else {
+            dirs[len++] = candidates[i];
         }
-        free(prefix);
     }
+    return dirs;
+}
 
-    // System-wide install fallbacks.
-    // Makefile installs modules to /usr/local/lib/dtconvert/converters/ and helpers to /usr/local/lib/dtconvert/lib/converters/.
-    const char *local_root = "/usr/local/lib/dtconvert";
-    const char *usr_root = "/usr/lib/dtconvert";
+void free_string_list(char **list) {
+    if (!list) return;
+    for (size_t i = 0; list[i]; i++) free(list[i]);
+    free(list);
+}
 
-    if (converter_path && strncmp(converter_path, "modules/", 8) == 0) {
-        const char *leaf = converter_path + 8;
-        char *p1 = path_join2("/usr/local/lib/dtconvert/converters", leaf);
-        if (p1 && access(p1, X_OK) == 0) return p1;
-        free(p1);
-        char *p2 = path_join2("/usr/lib/dtconvert/converters", leaf);
-        if (p2 && access(p2, X_OK) == 0) return p2;
-        free(p2);
+static char *lookup_converter_path(const char *converter_path) {
+    if (!converter_path) return NULL;
+
+    const char *kind = NULL;
+    if (strncmp(converter_path, "modules/", 8) == 0) {
+        kind = "modules";
+    } else if (strncmp(converter_path, "lib/converters/", 15) == 0) {
+        kind = "lib/converters";
+    }
+    if (!kind) {
+        char *p = resolve_converter_path(converter_path);
+        if (p && access(p, X_OK) == 0) return p;
+        free(p);
+        return NULL;
     }
 
-    if (converter_path && strncmp(converter_path, "lib/converters/", 15) == 0) {
-        char *p1 = path_join2(local_root, converter_path);
-        if (p1 && access(p1, X_OK) == 0) return p1;
-        free(p1);
-        char *p2 = path_join2(usr_root, converter_path);
-        if (p2 && access(p2, X_OK) == 0) return p2;
-        free(p2);
+    const char *leaf = converter_path + strlen(kind) + 1;
+    char **dirs = converter_search_dirs(kind);
+    char *found = NULL;
+    for (size_t i = 0; dirs && dirs[i] && !found; i++) {
+        char *p = path_join2(dirs[i], leaf);
+        if (p && access(p, X_OK) == 0) {
+            found = p;
+        } else {
+            free(p);
+        }
     }
+    free_string_list(dirs);
+    return found;
+}
+
+// Resolved paths, kept for the life of the process: a batch run converts many
+// files with the same few converters, and each lookup costs several access()
+// calls. Failed lookups are not kept.
+typedef struct {
+    char *converter_path;
+    char *resolved;
+} ResolvedPath;
+static ResolvedPath *resolve_cache = NULL;
+static size_t resolve_cache_len = 0;
 
-    // Give up.
-    return NULL;
+// Returns a malloc'ed copy of converter_path's resolved location, or NULL.
+static char *resolve_converter_path_with_fallbacks(const char *converter_path) {
+    if (!converter_path) return NULL;
+    for (size_t i = 0; i < resolve_cache_len; i++) {
+        if (strcmp(resolve_cache[i].converter_path, converter_path) == 0) return strdup(resolve_cache[i].resolved);
+    }
+
+    char *resolved = lookup_converter_path(converter_path);
+    ResolvedPath *grown = resolved ? realloc(resolve_cache, (resolve_cache_len + 1) * sizeof(*grown)) : NULL;
+    if (grown) {
+        resolve_cache = grown;
+        char *key = strdup(converter_path);
+        char *kept = strdup(resolved);
+        if (key && kept) {
+            resolve_cache[resolve_cache_len++] = (ResolvedPath){key, kept};
+        } else {
+            free(key);
+            free(kept);
+        }
+    }
+    return resolved;
 }
 
 int execute_converter(const char *converter_path, const char *input_path, const char *output_path) {
@@ -452,6 +825,14 @@ int execute_converter(const char *converter_path, const char *input_path, const
         return -1;
     }
 
+    // Built-in converters skip the path lookup and fork/exec entirely; the
+    // helper writes "-" through its own descriptor, so stdio goes out first.
+    NativeConverter native = find_native_converter(converter_path);
+    if (native) {
+        fflush(NULL);
+        return native(input_path, output_path);
+    }
+
     char *resolved = resolve_converter_path_with_fallbacks(converter_path);
     if (!resolved) {
         fprintf(stderr, "Error: Converter not found or not executable: %s\n", converter_path);
@@ -471,7 +852,8 @@ int execute_converter(const char *converter_path, const char *input_path, const
     } else if (pid > 0) {
         // Parent process
         int status;
-        (void)waitpid(pid, &status, 0);
+        struct rusage ru;
+        if (wait4(pid, &status, 0, &ru) == pid) note_converter_rusage(&ru);
         free(resolved);
         
         if (WIFEXITED(status)) {
@@ -0,0 +1,254 @@
+#include "../include/dtconvert.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+
+// Converter cost model for the planner.
+//
+// A step is estimated as start-up time plus input size over throughput. Both
+// start from static figures per resource class, or the converter's own
+// --describe hints, and are replaced by timings of earlier runs, kept in a
+// small tab-separated file shared by every dtconvert process
+// (DTCONVERT_COSTS, default $XDG_CACHE_HOME/dtconvert/costs.tsv;
+// DTCONVERT_COSTS=0 turns it off). Runs on inputs under 1 MiB measure
+// start-up; larger ones measure throughput. A pair that has never run takes
+// the combined timings of its program's other pairs (data_convert is about as
+// fast at csv -> yaml as at csv -> json), so a measured route is not passed
+// over for an optimistic guess. Each process loads the file once and merges
+// its own runs back into it under flock() when saved.
+
+#define COSTS_HEADER "# dtconvert converter costs v1: from to program small_runs small_seconds runs bytes seconds"
+#define SMALL_INPUT (1024 * 1024)
+#define MAX_RUNS 256.0  // older runs are halved away beyond this, so costs follow change
+
+typedef struct {
+    double startup;  // seconds per run
+    double rate;     // bytes per second
+} StaticCost;
+
+// Per ResourceClass. Built-in cpu converters running in-process skip the exec
+// and start in about a millisecond.
+static const StaticCost static_costs[RESOURCE_CLASSES] = {
+    {0.02, 50e6},  // cpu (external program)
+    {0.01, 200e6}, // io-bound
+    {0.10, 50e6},  // db-connection
+    {3.00, 5e6},   // memory-heavy
+};
+static const StaticCost native_cost = {0.001, 100e6};
+
+typedef struct {
+    char *from;
+    char *to;
+    char *program;  // converter path in the registry
+    double small_runs;
+    double small_seconds;
+    double runs;
+    double bytes;
+    double seconds;
+} CostEntry;
+
+typedef struct {
+    CostEntry *items;
+    size_t len;
+    size_t cap;
+} CostTable;
+
+static CostTable known;    // loaded from the file
+static CostTable pending;  // this process's runs, not yet saved
+static bool loaded = false;
+
+// ---------------- Table ----------------
+
+static CostEntry *table_find(CostTable *t, const char *from, const char *to, const char *program, bool create) {
+    for (size_t i = 0; i < t->len; i++) {
+        const CostEntry *e = &t->items[i];
+        if (strcmp(e->from, from) == 0 && strcmp(e->to, to) == 0 && strcmp(e->program, program) == 0) {
+            return &t->items[i];
+        }
+    }
+    if (!create) return NULL;
+    if (t->len == t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : 16;
+        CostEntry *items = realloc(t->items, cap * sizeof(*items));
+        if (!items) return NULL;
+        t->items = items;
+        t->cap = cap;
+    }
+    char *f = strdup(from);
+    char *g = strdup(to);
+    char *h = strdup(program);
+    if (!f || !g || !h) {
+        free(f);
+        free(g);
+        free(h);
+        return NULL;
+    }
+    t->items[t->len] = (CostEntry){.from = f, .to = g, .program = h};
+    return &t->items[t->len++];
+}
+
+static void table_clear(CostTable *t) {
+    for (size_t i = 0; i < t->len; i++) {
+        free(t->items[i].from);
+        free(t->items[i].to);
+        free(t->items[i].program);
+    }
+    t->len = 0;
+}
+
+static void entry_add(CostEntry *e, const CostEntry *d) {
+    e->small_runs += d->small_runs;
+    e->small_seconds += d->small_seconds;
+    e->runs += d->runs;
+    e->bytes += d->bytes;
+    e->seconds += d->seconds;
+    if (e->small_runs > MAX_RUNS) {
+        e->small_runs /= 2;
+        e->small_seconds /= 2;
+    }
+    if (e->runs > MAX_RUNS) {
+        e->runs /= 2;
+        e->bytes /= 2;
+        e->seconds /= 2;
+    }
+}
+
+// ---------------- File ----------------
+
+// Replaces t with the file's contents; malformed lines are ignored.
+static void read_costs(FILE *f, CostTable *t) {
+    table_clear(t);
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        char from[MAX_FORMAT_LEN * 2];
+        char to[MAX_FORMAT_LEN * 2];
+        char program[MAX_PATH_LEN];
+        CostEntry d = {0};
+        if (sscanf(line, "%31s %31s %1023s %lf %lf %lf %lf %lf", from, to, program, &d.small_runs,
+                   &d.small_seconds, &d.runs, &d.bytes, &d.seconds) != 8) {
+            continue;
+        }
+        CostEntry *e = table_find(t, from, to, program, true);
+        if (e) entry_add(e, &d);
+    }
+}
+
+static void load_costs(void) {
+    if (loaded) return;
+    loaded = true;
+    char *path = cache_file_path("DTCONVERT_COSTS", "costs.tsv");
+    if (!path) return;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    free(path);
+    if (fd < 0) return;
+    FILE *f = fdopen(fd, "r");
+    if (!f) {
+        close(fd);
+        return;
+    }
+    flock(fd, LOCK_SH);
+    read_costs(f, &known);
+    fclose(f);  // drops the lock
+}
+
+void save_converter_costs(void) {
+    if (pending.len == 0) return;
+    char *path = cache_file_path("DTCONVERT_COSTS", "costs.tsv");
+    if (!path) {
+        table_clear(&pending);
+        return;
+    }
+    make_parent_dirs(path);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    free(path);
+    if (fd < 0) return;  // the cache is an optimisation; say nothing
+    FILE *f = fdopen(fd, "r+");
+    if (!f) {
+        close(fd);
+        return;
+    }
+
+    // Other processes may have saved since we loaded: merge into their view.
+    flock(fd, LOCK_EX);
+    read_costs(f, &known);
+    for (size_t i = 0; i < pending.len; i++) {
+        const CostEntry *p = &pending.items[i];
+        CostEntry *e = table_find(&known, p->from, p->to, p->program, true);
+        if (e) entry_add(e, &pending.items[i]);
+    }
+    table_clear(&pending);
+
+    // Overwritten in place and trimmed after: truncating to zero first makes
+    // ext4 (auto_da_alloc) start writeback on close, a few ms per run.
+    rewind(f);
+    fprintf(f, "%s\n", COSTS_HEADER);
+    for (size_t i = 0; i < known.len; i++) {
+        const CostEntry *e = &known.items[i];
+        fprintf(f, "%s\t%s\t%s\t%.0f\t%.6f\t%.0f\t%.0f\t%.6f\n", e->from, e->to, e->program, e->small_runs,
+                e->small_seconds, e->runs, e->bytes, e->seconds);
+    }
+    long end = fflush(f) == 0 ? ftell(f) : -1;
+    if (end >= 0 && ftruncate(fd, end) != 0) {
+        // The tail of the old contents stays; read_costs() skips what it cannot parse.
+    }
+    fclose(f);  // drops the lock
+}
+
+// ---------------- Estimates ----------------
+
+void record_converter_run(const char *from, const char *to, const char *program, off_t bytes, double seconds) {
+    if (bytes < 0 || seconds < 0) return;
+    CostEntry d = {0};
+    if (bytes < SMALL_INPUT) {
+        d = (CostEntry){.small_runs = 1, .small_seconds = seconds};
+    } else {
+        d = (CostEntry){.runs = 1, .bytes = (double)bytes, .seconds = seconds};
+    }
+    CostEntry *p = table_find(&pending, from, to, program, true);
+    if (p) entry_add(p, &d);
+    load_costs();
+    CostEntry *k = table_find(&known, from, to, program, true);
+    if (k) entry_add(k, &d);
+}
+
+double converter_cost(const char *from, const char *to, const char *program, ResourceClass resource,
+                      const CostHint *hint, bool native, off_t bytes, CostBasis *basis) {
+    StaticCost c = static_costs[resource];
+    if (hint && hint->startup > 0) c.startup = hint->startup;
+    if (hint && hint->rate > 0) c.rate = hint->rate;
+    if (native && resource == RESOURCE_CPU) {
+        // A declared start-up is the exec'd program's; in-process there is none.
+        c.startup = native_cost.startup;
+        if (!(hint && hint->rate > 0)) c.rate = native_cost.rate;
+    }
+    CostBasis how = COST_STATIC;
+
+    load_costs();
+    CostEntry sum = {0};
+    const CostEntry *e = table_find(&known, from, to, program, false);
+    if (e) {
+        sum = *e;
+        how = COST_MEASURED;
+    } else {
+        for (size_t i = 0; i < known.len; i++) {
+            if (strcmp(known.items[i].program, program) != 0) continue;
+            sum.small_runs += known.items[i].small_runs;
+            sum.small_seconds += known.items[i].small_seconds;
+            sum.runs += known.items[i].runs;
+            sum.bytes += known.items[i].bytes;
+            sum.seconds += known.items[i].seconds;
+            how = COST_PROGRAM;
+        }
+    }
+    if (sum.small_runs > 0) c.startup = sum.small_seconds / sum.small_runs;
+    if (sum.runs > 0) {
+        // What the large runs took beyond start-up went into moving bytes.
+        double busy = sum.seconds - sum.runs * c.startup;
+        if (busy < 1e-3 * sum.runs) busy = 1e-3 * sum.runs;
+        c.rate = sum.bytes / busy;
+    }
+    if (sum.small_runs <= 0 && sum.runs <= 0) how = COST_STATIC;
+    if (basis) *basis = how;
+    return c.startup + (double)(bytes > 0 ? bytes : 0) / c.rate;
+}
@@ -17,7 +17,9 @@ Document* document_create(const char *path) {
     }
     
     // Get absolute path (avoid fixed buffers; required for _FORTIFY_SOURCE)
-    char *resolved = realpath(path, NULL);
+    // "-" (standard input) is kept as is for the helpers
+    bool is_stdin = strcmp(path, "-") == 0;
+    char *resolved = is_stdin ? NULL : realpath(path, NULL);
     if (resolved) {
         doc->full_path = resolved; // already malloc'ed
     } else {
@@ -42,14 +44,9 @@ Document* document_create(const char *path) {
         return NULL;
     }
     
-    // Extract extension
-    char *dot = strrchr(filename, '.');
-    if (dot && dot != filename) {
-        doc->extension = strdup(dot + 1);
-        str_lower(doc->extension);
-    } else {
-        doc->extension = strdup("");
-    }
+    // Extract extension (data.csv.gz is csv; the helpers decompress it)
+    char *ext = document_get_extension(filename);
+    doc->extension = ext ? ext : strdup("");
     if (!doc->extension) {
         document_destroy(doc);
         return NULL;
@@ -57,7 +54,10 @@ Document* document_create(const char *path) {
     
     // Check file existence and get size
     struct stat st;
-    if (stat(doc->full_path, &st) == 0) {
+    if (is_stdin) {
+        doc->exists = true;
+        doc->size = 0;
+    } else if (stat(doc->full_path, &st) == 0) {
         doc->exists = true;
         doc->size = st.st_size;
     } else {
@@ -86,10 +86,18 @@ bool document_exists(const Document *doc) {
 char* document_get_extension(const char *filename) {
     if (!filename) return NULL;
     
-    char *dot = strrchr(filename, '.');
-    if (!dot || dot == filename) return NULL;
+    // Look past a .gz/.zst suffix
+    size_t len = strlen(filename) - compression_suffix_len(filename);
+    char *dot = NULL;
+    for (size_t i = len; i > 0 && filename[i - 1] != '/'; i--) {
+        if (filename[i - 1] == '.') {
+            dot = (char *)filename + i - 1;
+            break;
+        }
+    }
+    if (!dot || dot == filename || dot[-1] == '/') return NULL;
     
-    char *ext = strdup(dot + 1);
+    char *ext = strndup(dot + 1, len - (size_t)(dot + 1 - filename));
     if (ext) str_lower(ext);
     
     return ext;
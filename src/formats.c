@@ -8,7 +8,7 @@ bool is_supported_format(const char *format) {
     if (!format) return false;
     
     const char *supported_formats[] = {
-        "pdf", "docx", "txt", "csv", "odt", "xlsx", "json", "yaml", "sql", "tokens", "postgresql", "html", "md",
+        "pdf", "docx", "txt", "csv", "odt", "xlsx", "json", "ndjson", "jsonl", "yaml", "arrow", "arrows", "parquet", "sql", "tokens", "postgresql", "html", "md",
         NULL
     };
     
@@ -34,7 +34,12 @@ const char* get_format_description(const char *format) {
         {"txt", "Plain Text File"},
         {"csv", "Comma Separated Values"},
         {"json", "JavaScript Object Notation"},
+        {"ndjson", "Newline-delimited JSON (one object per line)"},
+        {"jsonl", "JSON Lines (same as ndjson)"},
         {"yaml", "YAML Ain't Markup Language"},
+        {"arrow", "Apache Arrow IPC stream (columnar record batches)"},
+        {"arrows", "Apache Arrow IPC stream (same as arrow)"},
+        {"parquet", "Apache Parquet (columnar, write-only)"},
         {"sql", "SQL (INSERT statements)"},
         {"odt", "OpenDocument Text"},
         {"xlsx", "Microsoft Excel Spreadsheet"},
@@ -52,4 +57,14 @@ const char* get_format_description(const char *format) {
     }
     
     return "Unknown Format";
+}
+
+// Map alternate names of a format to the name used in the converter registry
+const char* canonical_format(const char *format) {
+    if (!format) return NULL;
+
+    if (strcmp(format, "jsonl") == 0) return "ndjson";
+    if (strcmp(format, "arrows") == 0) return "arrow";
+
+    return format;
 }
\ No newline at end of file
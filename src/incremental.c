@@ -0,0 +1,507 @@
+// copy_file_range()
+#define _GNU_SOURCE
+
+#include "../include/dtconvert.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+
+// Incremental conversion of append-only CSV (--incremental, --follow).
+//
+// A checkpoint next to the output (<output>.dtckpt) records how far into the
+// input the converted records reach, a hash of the header line, and the
+// output's size after the last run. It also records the input's device and
+// inode and a hash of the bytes just before that offset: an input that was
+// truncated or replaced (a rotated log) is converted again from just after
+// its header, even when it has already grown past the old offset. The next
+// run copies the header and the complete records appended since then into a
+// temporary CSV, converts that with the usual plan, and appends the result to
+// the output. A record is complete once its line ending (outside quotes) has
+// been written, so a line still being written is left for the next run.
+//
+// File outputs are appended exactly once: an output longer than the
+// checkpoint says is a run that died before saving it, and is cut back first.
+// PostgreSQL imports are at least once (DTCONVERT_PG_APPEND=1 keeps pg_store
+// from truncating the table after the first run). --follow repeats every
+// DTCONVERT_FOLLOW_INTERVAL seconds (default 1) until interrupted.
+
+#define CHECKPOINT_SUFFIX ".dtckpt"
+#define CHECKPOINT_HEADER "dtconvert-checkpoint 1"
+#define COPY_CHUNK (1 << 20)
+#define TAIL_BYTES 256
+
+typedef struct {
+    char input[MAX_PATH_LEN];
+    off_t header_bytes;  // length of the header line, line ending included
+    uint64_t header_hash;
+    off_t offset;        // input bytes converted; always a record boundary
+    dev_t dev;           // the input file that offset refers to
+    ino_t ino;
+    uint64_t tail_hash;  // hash of the TAIL_BYTES before offset (fewer at the start)
+    off_t output_size;   // output size after the last run; -1 for storage targets
+    long long records;
+} Checkpoint;
+
+// Targets whose output can grow by appending another conversion's output.
+static const char *appendable_formats[] = {"ndjson", "sql", "postgresql", NULL};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+// ---------------- Checkpoint ----------------
+
+static bool read_checkpoint(const char *path, Checkpoint *ck) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    char line[MAX_PATH_LEN + 64];
+    bool ok = fgets(line, sizeof(line), f) && strcmp(line, CHECKPOINT_HEADER "\n") == 0;
+    int fields = 0;
+    while (ok && fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = '\0';
+        unsigned long long u, w;
+        long long v;
+        if (strncmp(line, "input ", 6) == 0) {
+            size_t len = strlen(line + 6);
+            if (len >= sizeof(ck->input)) break;
+            memcpy(ck->input, line + 6, len + 1);
+            fields++;
+        } else if (sscanf(line, "header_bytes %lld", &v) == 1) {
+            ck->header_bytes = (off_t)v;
+            fields++;
+        } else if (sscanf(line, "header_hash %llx", &u) == 1) {
+            ck->header_hash = (uint64_t)u;
+            fields++;
+        } else if (sscanf(line, "offset %lld", &v) == 1) {
+            ck->offset = (off_t)v;
+            fields++;
+        } else if (sscanf(line, "file %llu %llu", &u, &w) == 2) {
+            ck->dev = (dev_t)u;
+            ck->ino = (ino_t)w;
+            fields++;
+        } else if (sscanf(line, "tail_hash %llx", &u) == 1) {
+            ck->tail_hash = (uint64_t)u;
+            fields++;
+        } else if (sscanf(line, "output_size %lld", &v) == 1) {
+            ck->output_size = (off_t)v;
+            fields++;
+        } else if (sscanf(line, "records %lld", &v) == 1) {
+            ck->records = v;
+            fields++;
+        }
+    }
+    fclose(f);
+    return ok && fields == 8 && ck->offset >= ck->header_bytes && ck->header_bytes > 0;
+}
+
+// Replaced atomically, so a crash leaves the previous checkpoint.
+static bool write_checkpoint(const char *path, const Checkpoint *ck) {
+    char tmp[MAX_PATH_LEN + 32];
+    snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+    FILE *f = fopen(tmp, "w");
+    if (!f) return false;
+    fprintf(f,
+            "%s\ninput %s\nheader_bytes %lld\nheader_hash %016llx\noffset %lld\nfile %llu %llu\ntail_hash %016llx\n"
+            "output_size %lld\nrecords %lld\n",
+            CHECKPOINT_HEADER, ck->input, (long long)ck->header_bytes, (unsigned long long)ck->header_hash,
+            (long long)ck->offset, (unsigned long long)ck->dev, (unsigned long long)ck->ino,
+            (unsigned long long)ck->tail_hash, (long long)ck->output_size, ck->records);
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return false;
+    }
+    return true;
+}
+
+// ---------------- Input ----------------
+
+// Reads [start, end) of fd in chunks, calling scan on each.
+static bool for_each_chunk(int fd, off_t start, off_t end, bool (*scan)(const char *, size_t, void *), void *arg) {
+    char *buf = malloc(COPY_CHUNK);
+    if (!buf) return false;
+    bool ok = true;
+    for (off_t pos = start; ok && pos < end;) {
+        size_t want = (size_t)(end - pos < COPY_CHUNK ? end - pos : COPY_CHUNK);
+        ssize_t n = pread(fd, buf, want, pos);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ok = false;
+            break;
+        }
+        ok = scan(buf, (size_t)n, arg);
+        pos += n;
+    }
+    free(buf);
+    return ok;
+}
+
+typedef struct {
+    off_t pos;       // input offset of the next byte scanned
+    off_t boundary;  // offset just past the last complete record
+    long long records;
+    bool quoted;
+    bool stop_at_first;  // for the header: stop after one record
+} RecordScan;
+
+// Finds record ends: a line feed outside quotes. A "" escape toggles twice.
+static bool scan_records(const char *p, size_t n, void *arg) {
+    RecordScan *rs = arg;
+    for (size_t i = 0; i < n; i++) {
+        if (p[i] == '"') {
+            rs->quoted = !rs->quoted;
+        } else if (p[i] == '\n' && !rs->quoted) {
+            rs->boundary = rs->pos + (off_t)i + 1;
+            rs->records++;
+            if (rs->stop_at_first) return false;
+        }
+    }
+    rs->pos += (off_t)n;
+    return true;
+}
+
+typedef struct {
+    uint64_t hash;
+    char *bytes;
+    size_t len;
+} HeaderRead;
+
+static bool collect_header(const char *p, size_t n, void *arg) {
+    HeaderRead *h = arg;
+    char *grown = realloc(h->bytes, h->len + n);
+    if (!grown) return false;
+    memcpy(grown + h->len, p, n);
+    h->bytes = grown;
+    h->len += n;
+    return true;
+}
+
+// Hash of the TAIL_BYTES of fd before offset (all of them, if fewer).
+static bool hash_tail(int fd, off_t offset, uint64_t *hash) {
+    HeaderRead h = {0};
+    bool ok = for_each_chunk(fd, offset > TAIL_BYTES ? offset - TAIL_BYTES : 0, offset, collect_header, &h);
+    if (ok) *hash = xxh64(h.bytes, h.len, 0);
+    free(h.bytes);
+    return ok;
+}
+
+static bool copy_range(int in, off_t start, off_t end, int out) {
+    off_t pos = start;
+    while (pos < end) {
+        ssize_t n = copy_file_range(in, &pos, out, NULL, (size_t)(end - pos), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n > 0) continue;
+        if (n == 0) return false;  // the input shrank under us
+        // Not supported between these file systems: plain copy
+        char *buf = malloc(COPY_CHUNK);
+        if (!buf) return false;
+        while (pos < end) {
+            size_t want = (size_t)(end - pos < COPY_CHUNK ? end - pos : COPY_CHUNK);
+            ssize_t r = pread(in, buf, want, pos);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0 || write(out, buf, (size_t)r) != r) {
+                free(buf);
+                return false;
+            }
+            pos += r;
+        }
+        free(buf);
+    }
+    return true;
+}
+
+// ---------------- Runs ----------------
+
+typedef struct {
+    ConversionRequest *request;
+    const char *from_format;
+    const char *to_format;
+    bool storage_target;
+    char checkpoint_path[MAX_PATH_LEN + 16];
+    Checkpoint ck;
+    bool have_checkpoint;
+} Incremental;
+
+static void remove_dir_files(const char *dir, const char *a, const char *b) {
+    char path[MAX_PATH_LEN * 2];
+    snprintf(path, sizeof(path), "%s/%s", dir, a);
+    unlink(path);
+    if (b) {
+        snprintf(path, sizeof(path), "%s/%s", dir, b);
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+// Converts input[offset, end) (with the header in front) and appends it to
+// the output. Returns SUCCESS or an ERR_* code.
+static int convert_range(Incremental *inc, int in_fd, off_t end, long long records) {
+    ConversionRequest *request = inc->request;
+    char dir[] = "/tmp/dtconvert_incXXXXXX";
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "Error: Failed to create temp directory: %s\n", strerror(errno));
+        return ERR_CONVERSION_FAILED;
+    }
+
+    // csv -> sql names its table after the output, so the piece keeps its name.
+    const char *out_name = strrchr(request->output_path, '/');
+    out_name = out_name ? out_name + 1 : request->output_path;
+    char piece_in[MAX_PATH_LEN];
+    char piece_out[MAX_PATH_LEN * 2];
+    snprintf(piece_in, sizeof(piece_in), "%s/records.csv", dir);
+    snprintf(piece_out, sizeof(piece_out), "%s/%s", dir, out_name);
+
+    int rc = ERR_CONVERSION_FAILED;
+    int fd = open(piece_in, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    bool copied = fd >= 0 && copy_range(in_fd, 0, inc->ck.header_bytes, fd) &&
+                  copy_range(in_fd, inc->ck.offset, end, fd);
+    if (fd >= 0 && close(fd) != 0) copied = false;
+    if (!copied) {
+        fprintf(stderr, "Error: Failed to copy new records from %s\n", request->input->path);
+        remove_dir_files(dir, "records.csv", NULL);
+        return rc;
+    }
+
+    Document *doc = document_create(piece_in);
+    if (!doc) {
+        remove_dir_files(dir, "records.csv", NULL);
+        return rc;
+    }
+    ConversionRequest piece = *request;
+    piece.input = doc;
+    piece.input_format = "csv";
+    piece.output_path = inc->storage_target ? request->output_path : piece_out;
+    piece.overwrite = true;
+    piece.verbose = false;
+    // Only the first run that converts records creates or empties the table; a
+    // checkpoint saved while the input held just its header does not count.
+    bool first = inc->ck.records == 0;
+    if (!first) {
+        setenv("DTCONVERT_SQL_CREATE", "0", 1);
+        setenv("DTCONVERT_PG_APPEND", "1", 1);
+    }
+    rc = convert_document(&piece);
+    document_destroy(doc);
+
+    if (rc == SUCCESS && !inc->storage_target) {
+        // A longer output is a run that appended but died before its checkpoint.
+        int out = open(request->output_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
+        int src = open(piece_out, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        bool ok = out >= 0 && src >= 0 && fstat(src, &st) == 0;
+        off_t base = inc->ck.output_size > 0 ? inc->ck.output_size : 0;
+        ok = ok && ftruncate(out, base) == 0 && lseek(out, base, SEEK_SET) == base &&
+             copy_range(src, 0, st.st_size, out);
+        if (out >= 0 && close(out) != 0) ok = false;
+        if (src >= 0) close(src);
+        if (ok) {
+            inc->ck.output_size = base + st.st_size;
+        } else {
+            fprintf(stderr, "Error: Failed to append to %s: %s\n", request->output_path, strerror(errno));
+            rc = ERR_CONVERSION_FAILED;
+        }
+    }
+    remove_dir_files(dir, "records.csv", out_name);
+    if (rc != SUCCESS) return rc;
+
+    inc->ck.offset = end;
+    inc->ck.records += records;
+    if (!hash_tail(in_fd, end, &inc->ck.tail_hash) || !write_checkpoint(inc->checkpoint_path, &inc->ck)) {
+        fprintf(stderr, "Error: Failed to save checkpoint %s: %s\n", inc->checkpoint_path, strerror(errno));
+        return ERR_CONVERSION_FAILED;
+    }
+    inc->have_checkpoint = true;
+    return SUCCESS;
+}
+
+// One pass: converts whatever complete records were appended. *added gets
+// their count.
+static int run_once(Incremental *inc, long long *added) {
+    ConversionRequest *request = inc->request;
+    *added = 0;
+    int fd = open(request->input->full_path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Error: Cannot read %s: %s\n", request->input->path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return ERR_FILE_NOT_FOUND;
+    }
+
+    int rc = SUCCESS;
+    // A different file, or different bytes before the offset, is a log that
+    // was rotated or rewritten, even if it has grown past the offset since.
+    bool replaced = false;
+    if (inc->ck.header_bytes != 0 && st.st_size >= inc->ck.offset) {
+        uint64_t tail = 0;
+        replaced = st.st_dev != inc->ck.dev || st.st_ino != inc->ck.ino ||
+                   !hash_tail(fd, inc->ck.offset, &tail) || tail != inc->ck.tail_hash;
+    }
+    if (inc->ck.header_bytes == 0 || st.st_size < inc->ck.offset || replaced) {
+        // No header yet, or the log was truncated or rotated: start over
+        // after its header, appending to what was converted before.
+        RecordScan rs = {.stop_at_first = true};
+        for_each_chunk(fd, 0, st.st_size, scan_records, &rs);
+        if (rs.boundary == 0) goto out;  // header line not complete yet
+        if (inc->ck.header_bytes != 0 && request->verbose) {
+            fprintf(verbose_stream(request), "%s was truncated or replaced; converting it again from the start\n",
+                    request->input->path);
+        }
+        HeaderRead h = {0};
+        if (!for_each_chunk(fd, 0, rs.boundary, collect_header, &h)) {
+            free(h.bytes);
+            rc = ERR_CONVERSION_FAILED;
+            goto out;
+        }
+        uint64_t hash = xxh64(h.bytes, h.len, 0);
+        free(h.bytes);
+        if (inc->ck.header_bytes != 0 && hash != inc->ck.header_hash) {
+            fprintf(stderr, "Error: The header of %s no longer matches %s; remove the checkpoint to start over\n",
+                    request->input->path, inc->checkpoint_path);
+            rc = ERR_CONVERSION_FAILED;
+            goto out;
+        }
+        inc->ck.header_bytes = rs.boundary;
+        inc->ck.header_hash = hash;
+        inc->ck.offset = rs.boundary;
+    } else {
+        HeaderRead h = {0};
+        bool read_ok = for_each_chunk(fd, 0, inc->ck.header_bytes, collect_header, &h);
+        bool same = read_ok && xxh64(h.bytes, h.len, 0) == inc->ck.header_hash;
+        free(h.bytes);
+        if (!same) {
+            fprintf(stderr, "Error: The header of %s no longer matches %s; remove the checkpoint to start over\n",
+                    request->input->path, inc->checkpoint_path);
+            rc = ERR_CONVERSION_FAILED;
+            goto out;
+        }
+    }
+
+    inc->ck.dev = st.st_dev;
+    inc->ck.ino = st.st_ino;
+
+    RecordScan rs = {.pos = inc->ck.offset};
+    if (!for_each_chunk(fd, inc->ck.offset, st.st_size, scan_records, &rs)) {
+        rc = ERR_CONVERSION_FAILED;
+        goto out;
+    }
+    if (rs.boundary > inc->ck.offset) {
+        rc = convert_range(inc, fd, rs.boundary, rs.records);
+        if (rc == SUCCESS) *added = rs.records;
+    } else if (!inc->have_checkpoint) {
+        // Nothing to convert yet, but the next run must know the header.
+        inc->ck.output_size = inc->storage_target ? -1 : 0;
+        if (!inc->storage_target) {
+            int out = open(request->output_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+            if (out >= 0) close(out);
+        }
+        if (hash_tail(fd, inc->ck.offset, &inc->ck.tail_hash) && write_checkpoint(inc->checkpoint_path, &inc->ck)) {
+            inc->have_checkpoint = true;
+        }
+    }
+out:
+    close(fd);
+    return rc;
+}
+
+static bool is_appendable(const char *format) {
+    for (int i = 0; appendable_formats[i]; i++) {
+        if (strcmp(appendable_formats[i], format) == 0) return true;
+    }
+    return false;
+}
+
+static double follow_interval(void) {
+    const char *s = getenv("DTCONVERT_FOLLOW_INTERVAL");
+    if (!s || !*s) return 1.0;
+    char *end = NULL;
+    double v = strtod(s, &end);
+    if (end == s || *end != '\0' || v <= 0) {
+        fprintf(stderr, "Warning: Ignoring bad DTCONVERT_FOLLOW_INTERVAL '%s'\n", s);
+        return 1.0;
+    }
+    return v;
+}
+
+int convert_incremental(ConversionRequest *request) {
+    Incremental inc = {.request = request};
+    inc.from_format = canonical_format((request->input_format && request->input_format[0] != '\0')
+                                           ? request->input_format
+                                           : request->input->extension);
+    inc.to_format = canonical_format(request->output_format);
+    inc.storage_target = strcmp(inc.to_format, "postgresql") == 0;
+
+    if (strcmp(request->input->path, "-") == 0 || strcmp(request->output_path, "-") == 0) {
+        fprintf(stderr, "Error: --incremental needs a file to read and an output to append to, not \"-\"\n");
+        return ERR_INVALID_ARGS;
+    }
+    if (strcmp(inc.from_format, "csv") != 0 || compression_suffix_len(request->input->path) > 0) {
+        fprintf(stderr, "Error: --incremental reads uncompressed CSV (got %s)\n", request->input->path);
+        return ERR_UNSUPPORTED_FORMAT;
+    }
+    if (!is_appendable(inc.to_format)) {
+        fprintf(stderr, "Error: --incremental appends to ndjson, sql or postgresql outputs, not %s\n", inc.to_format);
+        return ERR_UNSUPPORTED_FORMAT;
+    }
+
+    snprintf(inc.checkpoint_path, sizeof(inc.checkpoint_path), "%s%s", request->output_path, CHECKPOINT_SUFFIX);
+    inc.have_checkpoint = read_checkpoint(inc.checkpoint_path, &inc.ck);
+    if (!inc.have_checkpoint && access(inc.checkpoint_path, F_OK) == 0) {
+        fprintf(stderr, "Error: Unreadable checkpoint %s\n", inc.checkpoint_path);
+        return ERR_CONVERSION_FAILED;
+    }
+    if (inc.have_checkpoint) {
+        if (strcmp(inc.ck.input, request->input->full_path) != 0) {
+            fprintf(stderr, "Error: %s records progress through %s, not %s\n", inc.checkpoint_path, inc.ck.input,
+                    request->input->full_path);
+            return ERR_CONVERSION_FAILED;
+        }
+        struct stat st;
+        if (!inc.storage_target && (stat(request->output_path, &st) != 0 || st.st_size < inc.ck.output_size)) {
+            fprintf(stderr, "Error: %s is missing or shorter than %s records; remove the checkpoint to start over\n",
+                    request->output_path, inc.checkpoint_path);
+            return ERR_CONVERSION_FAILED;
+        }
+    } else {
+        if (!inc.storage_target && !request->overwrite && access(request->output_path, F_OK) == 0) {
+            fprintf(stderr, "Error: Output file '%s' already exists. Use -f to overwrite.\n", request->output_path);
+            return ERR_CONVERSION_FAILED;
+        }
+        snprintf(inc.ck.input, sizeof(inc.ck.input), "%s", request->input->full_path);
+        inc.ck.output_size = inc.storage_target ? -1 : 0;
+    }
+
+    // Each run converts a fresh slice; caching those would only fill the cache.
+    conversion_cache_disable();
+
+    if (request->follow) {
+        struct sigaction sa = {0};
+        sa.sa_handler = request_stop;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+    }
+
+    FILE *info = verbose_stream(request);
+    double interval = follow_interval();
+    int rc;
+    do {
+        long long added = 0;
+        rc = run_once(&inc, &added);
+        if (rc != SUCCESS) break;
+        save_converter_costs();
+        if (request->verbose && (added > 0 || !request->follow)) {
+            fprintf(info, "Appended %lld record%s (%lld in total, through byte %lld)\n", added, added == 1 ? "" : "s",
+                    inc.ck.records, (long long)inc.ck.offset);
+            fflush(info);
+        }
+        if (!request->follow) break;
+        struct timespec ts = {(time_t)interval, (long)((interval - (double)(time_t)interval) * 1e9)};
+        while (!stop_requested && nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+        }
+    } while (!stop_requested);
+    return rc;
+}
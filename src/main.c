@@ -1,9 +1,26 @@
 #include "../include/dtconvert.h"
 
 int main(int argc, char *argv[]) {
+    if (is_client_command(argc, argv)) {
+        return client_command(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "serve") == 0) {
+        return serve_command(argc, argv);
+    }
+    return run_command(argc, argv);
+}
+
+// Everything but the server and its client; server jobs run it too.
+int run_command(int argc, char *argv[]) {
     if (argc >= 2 && strcmp(argv[1], "ai") == 0) {
         return ai_command(argc, argv);
     }
+    if (argc >= 2 && strcmp(argv[1], "watch") == 0) {
+        return watch_command(argc, argv);
+    }
+    if (is_batch_command(argc, argv)) {
+        return batch_command(argc, argv);
+    }
 
     ConversionRequest request = {0};
     
@@ -57,6 +74,30 @@ int main(int argc, char *argv[]) {
     
     request.input = doc;
 
+    // Standard input has no extension to detect the format from, and its
+    // output goes to standard output unless -o says otherwise.
+    bool from_stdin = strcmp(doc->path, "-") == 0;
+    if (from_stdin && (request.input_format == NULL || request.input_format[0] == '\0')) {
+        fprintf(stderr, "Error: Reading standard input requires --from <format>\n");
+        document_destroy(doc);
+        free(request.input_format);
+        free(request.output_format);
+        free(request.output_path);
+        return ERR_INVALID_ARGS;
+    }
+
+    if (request.explain) {
+        const char *from = canonical_format((request.input_format && request.input_format[0] != '\0')
+                                                ? request.input_format
+                                                : doc->extension);
+        int result = explain_conversion(from, canonical_format(request.output_format), doc->size, stdout);
+        document_destroy(doc);
+        free(request.input_format);
+        free(request.output_format);
+        free(request.output_path);
+        return result;
+    }
+
     if (strcmp(request.output_format, "postgresql") == 0 && request.output_path == NULL) {
         fprintf(stderr, "Error: PostgreSQL target requires -o <config.json>\n");
         document_destroy(doc);
@@ -65,10 +106,22 @@ int main(int argc, char *argv[]) {
         return ERR_INVALID_ARGS;
     }
     
+    if (from_stdin && request.output_path == NULL) {
+        request.output_path = strdup("-");
+        if (!request.output_path) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            document_destroy(doc);
+            free(request.input_format);
+            free(request.output_format);
+            return ERR_CONVERSION_FAILED;
+        }
+    }
+    
     // Generate output path if not specified
     if (request.output_path == NULL) {
         char base_path[MAX_PATH_LEN];
         snprintf(base_path, sizeof(base_path), "%s", doc->full_path);
+        base_path[strlen(base_path) - compression_suffix_len(base_path)] = '\0';
         char *dot = strrchr(base_path, '.');
         if (dot) *dot = '\0';
         
@@ -85,18 +138,20 @@ int main(int argc, char *argv[]) {
         }
     }
     
+    FILE *info = verbose_stream(&request);
     if (request.verbose) {
-        printf("Converting: %s -> %s\n", doc->path, request.output_path);
-        printf("Input format: %s\n", request.input_format ? request.input_format : doc->extension);
-        printf("Output format: %s\n", request.output_format);
+        fprintf(info, "Converting: %s -> %s\n", doc->path, request.output_path);
+        fprintf(info, "Input format: %s\n", request.input_format ? request.input_format : doc->extension);
+        fprintf(info, "Output format: %s\n", request.output_format);
     }
     
     // Perform conversion
-    int result = convert_document(&request);
+    int result = request.incremental || request.follow ? convert_incremental(&request) : convert_document(&request);
+    save_converter_costs();
     
     if (result == SUCCESS) {
         if (request.verbose) {
-            printf("Conversion successful!\n");
+            fprintf(info, "Conversion successful!\n");
         }
     } else {
         fprintf(stderr, "Conversion failed with error code: %d\n", result);
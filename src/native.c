@@ -0,0 +1,107 @@
+#include "../include/dtconvert.h"
+#include "../lib/converters/libdtconvert.h"
+
+#include <ctype.h>
+
+// Built-in converters run in-process through libdtconvert. Each entry stands
+// in for a registry path: the helper it would exec, or the module script that
+// wraps one, whose argument handling is repeated here.
+
+#define MAX_HELPER_ARGS 8
+
+// helper_run() with private, writable copies of args (helpers may edit argv).
+static int run_helper(HelperMain entry, int argc, const char *const *args) {
+    char *argv[MAX_HELPER_ARGS + 1] = {0};
+    int rc = 1;
+    for (int i = 0; i < argc; i++) {
+        argv[i] = strdup(args[i]);
+        if (!argv[i]) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            goto out;
+        }
+    }
+    rc = helper_run(entry, argc, argv);
+out:
+    for (int i = 0; i < argc; i++) free(argv[i]);
+    return rc;
+}
+
+static int native_data_convert(const char *input_path, const char *output_path) {
+    const char *args[] = {"data_convert", input_path, output_path};
+    return run_helper(data_convert_main, 3, args);
+}
+
+static int native_txt_to_tokens(const char *input_path, const char *output_path) {
+    const char *args[] = {"tokenize", input_path, output_path};
+    return run_helper(tokenize_main, 3, args);
+}
+
+// As modules/csv_to_sql.sh: the table is DTCONVERT_SQL_TABLE, or the output
+// file's base name made into an identifier.
+static int native_csv_to_sql(const char *input_path, const char *output_path) {
+    char table[MAX_PATH_LEN];
+    const char *env_table = getenv("DTCONVERT_SQL_TABLE");
+    if (env_table && env_table[0] != '\0') {
+        snprintf(table, sizeof(table), "%s", env_table);
+    } else {
+        const char *base = strcmp(output_path, "-") == 0 ? "data.sql" : output_path;
+        const char *slash = strrchr(base, '/');
+        if (slash) base = slash + 1;
+        snprintf(table, sizeof(table), "%s", base);
+        table[strlen(table) - compression_suffix_len(table)] = '\0';
+        char *dot = strrchr(table, '.');
+        if (dot) *dot = '\0';
+        for (char *p = table; *p; p++) {
+            if (!isalnum((unsigned char)*p) && *p != '_') *p = '_';
+        }
+        if (!isalpha((unsigned char)table[0]) && table[0] != '_') snprintf(table, sizeof(table), "data");
+    }
+
+    const char *args[MAX_HELPER_ARGS] = {"sql_convert", "csv-to-sql", input_path, output_path, "--table", table};
+    int argc = 6;
+    const char *create = getenv("DTCONVERT_SQL_CREATE");
+    if (create && strcmp(create, "1") == 0) args[argc++] = "--create";
+    return run_helper(sql_convert_main, argc, args);
+}
+
+static int native_sql_to_csv(const char *input_path, const char *output_path) {
+    const char *args[] = {"sql_convert", "sql-to-csv", input_path, output_path};
+    return run_helper(sql_convert_main, 4, args);
+}
+
+static int native_csv_to_postgresql(const char *input_path, const char *config_path) {
+    const char *args[] = {"pg_store", "csv-to-postgresql", input_path, config_path};
+    return run_helper(pg_store_main, 4, args);
+}
+
+static int native_postgresql_to_csv(const char *config_path, const char *output_path) {
+    const char *args[] = {"pg_store", "postgresql-to-csv", config_path, output_path};
+    return run_helper(pg_store_main, 4, args);
+}
+
+static const struct {
+    const char *converter_path;
+    NativeConverter run;
+} native_converters[] = {
+    {"lib/converters/data_convert", native_data_convert},
+    {"modules/csv_to_json.sh", native_data_convert},
+    {"modules/json_to_csv.sh", native_data_convert},
+    {"modules/csv_to_sql.sh", native_csv_to_sql},
+    {"modules/sql_to_csv.sh", native_sql_to_csv},
+    {"modules/txt_to_tokens.sh", native_txt_to_tokens},
+    {"modules/csv_to_postgresql.sh", native_csv_to_postgresql},
+    {"modules/postgresql_to_csv.sh", native_postgresql_to_csv},
+};
+
+// DTCONVERT_NATIVE=0 sends everything through the helper programs again,
+// e.g. to use edited module scripts.
+NativeConverter find_native_converter(const char *converter_path) {
+    if (!converter_path) return NULL;
+    const char *env = getenv("DTCONVERT_NATIVE");
+    if (env && strcmp(env, "0") == 0) return NULL;
+
+    for (size_t i = 0; i < sizeof(native_converters) / sizeof(native_converters[0]); i++) {
+        if (strcmp(native_converters[i].converter_path, converter_path) == 0) return native_converters[i].run;
+    }
+    return NULL;
+}
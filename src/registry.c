@@ -0,0 +1,509 @@
+#include "../include/dtconvert.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+
+// Converter registry.
+//
+// The table below covers the converters that ship with dtconvert. Any other
+// executable in a converter directory (modules/, lib/converters/ and their
+// installed counterparts, see converter_search_dirs()) can add to it by
+// answering `--describe` with
+//
+//     dtconvert-describe 1
+//     <from> <to> [stream=in|out|in,out] [output=named] [resource=CLASS] [startup=SEC] [rate=BYTES_PER_SEC]
+//                 [description=TEXT]
+//
+// one line per conversion it offers (description takes the rest of the line;
+// output=named says the output depends on the output file's name).
+// An entry for a pair and program already in the table updates it; anything
+// else is added, and the planner weighs it against the other routes. Probing
+// every file costs a fork/exec each, so the result is kept in an index file
+// (DTCONVERT_INDEX, default $XDG_CACHE_HOME/dtconvert/index.tsv; 0 turns it
+// off) that is reused while the directories' modification times are
+// unchanged. Adding or removing a converter updates its directory's mtime;
+// editing one in place does not, so touch the directory after doing that.
+
+#define DESCRIBE_HEADER "dtconvert-describe 1"
+#define INDEX_HEADER "# dtconvert converter index v2"
+#define DESCRIBE_MAX (64 * 1024)
+#define DESCRIBE_TIMEOUT_MS 5000
+
+// Built-in converter registry
+static const Converter builtin_converters[] = {
+    {"docx", "pdf", "modules/docx_to_pdf.sh", "DOCX to PDF converter", 0, RESOURCE_MEMORY, {0, 0}},
+    {"docx", "odt", "modules/docx_to_odt.sh", "DOCX to ODT converter", 0, RESOURCE_MEMORY, {0, 0}},
+    {"odt", "pdf", "modules/odt_to_pdf.sh", "ODT to PDF converter", 0, RESOURCE_MEMORY, {0, 0}},
+    {"odt", "docx", "modules/odt_to_docx.sh", "ODT to DOCX converter", 0, RESOURCE_MEMORY, {0, 0}},
+    {"txt", "pdf", "modules/txt_to_pdf.sh", "Text to PDF converter", 0, RESOURCE_CPU, {0, 0}},
+    {"csv", "txt", "modules/csv_to_txt.sh", "CSV to Text converter", CONV_STREAMS, RESOURCE_IO, {0, 0}},
+    {"csv", "pdf", "modules/csv_to_pdf.sh", "CSV to PDF converter", 0, RESOURCE_CPU, {0, 0}},
+    {"csv", "xlsx", "modules/csv_to_xlsx.sh", "CSV to XLSX converter", 0, RESOURCE_MEMORY, {0, 0}},
+    {"xlsx", "csv", "modules/xlsx_to_csv.sh", "XLSX to CSV converter", 0, RESOURCE_MEMORY, {0, 0}},
+    {"csv", "json", "lib/converters/data_convert", "CSV to JSON converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"json", "csv", "lib/converters/data_convert", "JSON to CSV converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"json", "yaml", "lib/converters/data_convert", "JSON to YAML converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"yaml", "json", "lib/converters/data_convert", "YAML to JSON converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"csv", "yaml", "lib/converters/data_convert", "CSV to YAML converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"yaml", "csv", "lib/converters/data_convert", "YAML to CSV converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"csv", "ndjson", "lib/converters/data_convert", "CSV to NDJSON converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"ndjson", "csv", "lib/converters/data_convert", "NDJSON to CSV converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"json", "ndjson", "lib/converters/data_convert", "JSON to NDJSON converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"ndjson", "json", "lib/converters/data_convert", "NDJSON to JSON converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"yaml", "ndjson", "lib/converters/data_convert", "YAML to NDJSON converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"ndjson", "yaml", "lib/converters/data_convert", "NDJSON to YAML converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"csv", "arrow", "lib/converters/data_convert", "CSV to Arrow IPC converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"arrow", "csv", "lib/converters/data_convert", "Arrow IPC to CSV converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"json", "arrow", "lib/converters/data_convert", "JSON to Arrow IPC converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"arrow", "json", "lib/converters/data_convert", "Arrow IPC to JSON converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"ndjson", "arrow", "lib/converters/data_convert", "NDJSON to Arrow IPC converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"arrow", "ndjson", "lib/converters/data_convert", "Arrow IPC to NDJSON converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"yaml", "arrow", "lib/converters/data_convert", "YAML to Arrow IPC converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"arrow", "yaml", "lib/converters/data_convert", "Arrow IPC to YAML converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"csv", "parquet", "lib/converters/data_convert", "CSV to Parquet converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"json", "parquet", "lib/converters/data_convert", "JSON to Parquet converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"ndjson", "parquet", "lib/converters/data_convert", "NDJSON to Parquet converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"yaml", "parquet", "lib/converters/data_convert", "YAML to Parquet converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"arrow", "parquet", "lib/converters/data_convert", "Arrow IPC to Parquet converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"csv", "sql", "modules/csv_to_sql.sh", "CSV to SQL converter", CONV_STREAMS | CONV_NAMED_OUTPUT, RESOURCE_CPU, {0, 0}},
+    {"sql", "csv", "modules/sql_to_csv.sh", "SQL to CSV converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"txt", "tokens", "modules/txt_to_tokens.sh", "Text to tokens converter", CONV_STREAMS, RESOURCE_CPU, {0, 0}},
+    {"csv", "postgresql", "modules/csv_to_postgresql.sh", "CSV to PostgreSQL importer", CONV_STREAM_IN, RESOURCE_DB, {0, 0}},
+    {"postgresql", "csv", "modules/postgresql_to_csv.sh", "PostgreSQL to CSV exporter", CONV_STREAM_OUT, RESOURCE_DB, {0, 0}},
+    {NULL, NULL, NULL, NULL, 0, RESOURCE_CPU, {0, 0}}  // Sentinel
+};
+
+
+typedef struct {
+    Converter *items;
+    size_t len;
+    size_t cap;
+} Registry;
+
+static Registry registry;
+static bool registry_built = false;
+
+static const char *converter_kinds[] = {"lib/converters", "modules"};
+
+// ---------------- Entries ----------------
+
+static bool registry_push(Registry *r, const Converter *c) {
+    if (r->len == r->cap) {
+        size_t cap = r->cap ? r->cap * 2 : 64;
+        Converter *items = realloc(r->items, cap * sizeof(*items));
+        if (!items) return false;
+        r->items = items;
+        r->cap = cap;
+    }
+    r->items[r->len++] = *c;
+    return true;
+}
+
+static void converter_free(Converter *c) {
+    free(c->from_format);
+    free(c->to_format);
+    free(c->converter_path);
+    free(c->description);
+}
+
+static void registry_clear(Registry *r) {
+    for (size_t i = 0; i < r->len; i++) converter_free(&r->items[i]);
+    free(r->items);
+    *r = (Registry){0};
+}
+
+static bool valid_format_name(const char *s) {
+    size_t n = strlen(s);
+    if (n == 0 || n >= MAX_FORMAT_LEN) return false;
+    for (; *s; s++) {
+        if (!islower((unsigned char)*s) && !isdigit((unsigned char)*s)) return false;
+    }
+    return true;
+}
+
+// Fills c (malloc'd strings) from one describe line of the program at path.
+// Returns false for a malformed line.
+static bool parse_describe_line(char *line, const char *path, Converter *c) {
+    *c = (Converter){.resource = RESOURCE_CPU};
+    char *save = NULL;
+    char *from = strtok_r(line, " \t", &save);
+    char *to = strtok_r(NULL, " \t", &save);
+    if (!from || !to || !valid_format_name(from) || !valid_format_name(to) || strcmp(from, to) == 0) return false;
+
+    char *description = NULL;
+    char *tok;
+    while ((tok = strtok_r(NULL, " \t", &save))) {
+        char *value = strchr(tok, '=');
+        if (!value) return false;
+        *value++ = '\0';
+        char *end = NULL;
+        if (strcmp(tok, "stream") == 0) {
+            if (strcmp(value, "in") == 0) c->flags |= CONV_STREAM_IN;
+            else if (strcmp(value, "out") == 0) c->flags |= CONV_STREAM_OUT;
+            else if (strcmp(value, "in,out") == 0) c->flags |= CONV_STREAMS;
+            else return false;
+        } else if (strcmp(tok, "output") == 0) {
+            if (strcmp(value, "named") != 0) return false;
+            c->flags |= CONV_NAMED_OUTPUT;
+        } else if (strcmp(tok, "resource") == 0) {
+            if (!parse_resource_class(value, &c->resource)) return false;
+        } else if (strcmp(tok, "startup") == 0 || strcmp(tok, "rate") == 0) {
+            double v = strtod(value, &end);
+            if (end == value || *end != '\0' || v < 0) return false;
+            if (tok[0] == 's') c->hint.startup = v;
+            else c->hint.rate = v;
+        } else if (strcmp(tok, "description") == 0) {
+            // The rest of the line, tokenizer state and all.
+            if (save && *save) value[strlen(value)] = ' ';
+            description = value;
+            break;
+        } else {
+            return false;
+        }
+    }
+
+    for (char *p = description; p && *p; p++) {
+        if (*p == '\t') *p = ' ';  // the index is tab-separated
+    }
+    char fallback[2 * MAX_FORMAT_LEN + 16];
+    if (!description || !*description) {
+        snprintf(fallback, sizeof(fallback), "%s to %s converter", from, to);
+        description = fallback;
+    }
+    c->from_format = strdup(from);
+    c->to_format = strdup(to);
+    c->converter_path = strdup(path);
+    c->description = strdup(description);
+    if (!c->from_format || !c->to_format || !c->converter_path || !c->description) {
+        converter_free(c);
+        return false;
+    }
+    return true;
+}
+
+// Adds every entry of a --describe reply to r; ignored unless it has the
+// expected header.
+static void parse_describe(char *text, const char *path, Registry *r) {
+    char *save = NULL;
+    char *line = strtok_r(text, "\n", &save);
+    if (!line || strcmp(line, DESCRIBE_HEADER) != 0) return;
+    while ((line = strtok_r(NULL, "\n", &save))) {
+        size_t n = strlen(line);
+        if (n > 0 && line[n - 1] == '\r') line[n - 1] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+        Converter c;
+        if (parse_describe_line(line, path, &c) && !registry_push(r, &c)) converter_free(&c);
+    }
+}
+
+// ---------------- Probing ----------------
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Runs `file --describe` with no stdin and stderr, and returns its output
+// (malloc'd) if it exits 0 within the time limit; otherwise NULL.
+static char *probe_describe(const char *file) {
+    int fds[2];
+    if (pipe(fds) != 0) return NULL;
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return NULL;
+    }
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_RDWR);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDIN_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+        }
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execl(file, file, "--describe", (char *)NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+
+    char *buf = malloc(DESCRIBE_MAX + 1);
+    size_t len = 0;
+    bool ok = buf != NULL;
+    double deadline = now_ms() + DESCRIBE_TIMEOUT_MS;
+    while (ok) {
+        double left = deadline - now_ms();
+        struct pollfd pfd = {.fd = fds[0], .events = POLLIN};
+        int ready = left > 0 ? poll(&pfd, 1, (int)left) : 0;
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0 || len == DESCRIBE_MAX) {
+            ok = false;  // silent, stuck or too chatty: not a converter
+            kill(pid, SIGKILL);
+            break;
+        }
+        ssize_t n = read(fds[0], buf + len, DESCRIBE_MAX - len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += (size_t)n;
+    }
+    close(fds[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        free(buf);
+        return NULL;
+    }
+    buf[len] = '\0';
+    return buf;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static bool seen_leaf(char **seen, size_t n, const char *leaf) {
+    for (size_t i = 0; i < n; i++) {
+        if (strcmp(seen[i], leaf) == 0) return true;
+    }
+    return false;
+}
+
+// Probes the executables of one kind ("modules", "lib/converters"). A name
+// found in several directories is taken from the first, as lookups do.
+static void probe_kind(const char *kind, Registry *r) {
+    char **dirs = converter_search_dirs(kind);
+    if (!dirs) return;
+    char **seen = NULL;
+    size_t nseen = 0;
+    for (size_t d = 0; dirs[d]; d++) {
+        DIR *dir = opendir(dirs[d]);
+        if (!dir) continue;
+        char **names = NULL;
+        size_t nnames = 0;
+        struct dirent *ent;
+        while ((ent = readdir(dir))) {
+            if (ent->d_name[0] == '.' || seen_leaf(seen, nseen, ent->d_name)) continue;
+            char **grown = realloc(names, (nnames + 1) * sizeof(*names));
+            if (!grown) break;
+            names = grown;
+            if ((names[nnames] = strdup(ent->d_name))) nnames++;
+        }
+        closedir(dir);
+        qsort(names, nnames, sizeof(*names), compare_names);
+
+        for (size_t i = 0; i < nnames; i++) {
+            char file[MAX_PATH_LEN];
+            char logical[MAX_PATH_LEN];
+            struct stat st;
+            snprintf(file, sizeof(file), "%s/%s", dirs[d], names[i]);
+            snprintf(logical, sizeof(logical), "%s/%s", kind, names[i]);
+            if (stat(file, &st) != 0 || !S_ISREG(st.st_mode) || access(file, X_OK) != 0) {
+                free(names[i]);
+                continue;
+            }
+            char **grown = realloc(seen, (nseen + 1) * sizeof(*seen));
+            if (grown) {
+                seen = grown;
+                seen[nseen++] = names[i];
+            } else {
+                free(names[i]);
+                continue;
+            }
+            char *reply = probe_describe(file);
+            if (reply) parse_describe(reply, logical, r);
+            free(reply);
+        }
+        free(names);
+    }
+    for (size_t i = 0; i < nseen; i++) free(seen[i]);
+    free(seen);
+    free_string_list(dirs);
+}
+
+// ---------------- Index ----------------
+
+// The "dir" lines an up-to-date index starts with: every search directory
+// and its mtime ("-" when it does not exist). Returns a malloc'd string.
+static char *directory_stamps(void) {
+    size_t len = 0;
+    size_t cap = 1024;
+    char *out = malloc(cap);
+    if (!out) return NULL;
+    out[0] = '\0';
+    for (size_t k = 0; k < sizeof(converter_kinds) / sizeof(converter_kinds[0]); k++) {
+        char **dirs = converter_search_dirs(converter_kinds[k]);
+        for (size_t d = 0; dirs && dirs[d]; d++) {
+            char line[MAX_PATH_LEN + 64];
+            struct stat st;
+            if (stat(dirs[d], &st) == 0) {
+                snprintf(line, sizeof(line), "dir\t%s\t%lld.%09ld\n", dirs[d], (long long)st.st_mtim.tv_sec,
+                         (long)st.st_mtim.tv_nsec);
+            } else {
+                snprintf(line, sizeof(line), "dir\t%s\t-\n", dirs[d]);
+            }
+            size_t n = strlen(line);
+            if (len + n + 1 > cap) {
+                char *grown = realloc(out, cap = (len + n + 1) * 2);
+                if (!grown) {
+                    free(out);
+                    free_string_list(dirs);
+                    return NULL;
+                }
+                out = grown;
+            }
+            memcpy(out + len, line, n + 1);
+            len += n;
+        }
+        free_string_list(dirs);
+    }
+    return out;
+}
+
+// Loads the index at path into r if its directory stamps match. Returns false
+// if it is missing, stale or malformed.
+static bool read_index(const char *path, const char *stamps, Registry *r) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    char line[4096];
+    bool ok = fgets(line, sizeof(line), f) && strcmp(line, INDEX_HEADER "\n") == 0;
+    size_t matched = 0;
+    size_t stamps_len = strlen(stamps);
+    while (ok && fgets(line, sizeof(line), f)) {
+        size_t n = strlen(line);
+        if (strncmp(line, "dir\t", 4) == 0) {
+            ok = matched + n <= stamps_len && strncmp(stamps + matched, line, n) == 0;
+            matched += n;
+            continue;
+        }
+        if (strncmp(line, "conv\t", 5) != 0 || n == 0 || line[n - 1] != '\n') {
+            ok = false;
+            break;
+        }
+        line[n - 1] = '\0';
+        char *field[9];
+        char *save = NULL;
+        int nf = 0;
+        for (char *t = strtok_r(line, "\t", &save); t && nf < 9; t = strtok_r(NULL, "\t", &save)) field[nf++] = t;
+        Converter c = {0};
+        if (nf != 9 || !parse_resource_class(field[5], &c.resource)) {
+            ok = false;
+            break;
+        }
+        c.flags = (unsigned)strtoul(field[4], NULL, 10);
+        c.hint.startup = strtod(field[6], NULL);
+        c.hint.rate = strtod(field[7], NULL);
+        c.from_format = strdup(field[1]);
+        c.to_format = strdup(field[2]);
+        c.converter_path = strdup(field[3]);
+        c.description = strdup(field[8]);
+        if (!c.from_format || !c.to_format || !c.converter_path || !c.description || !registry_push(r, &c)) {
+            converter_free(&c);
+            ok = false;
+        }
+    }
+    fclose(f);
+    if (ok && matched != stamps_len) ok = false;
+    if (!ok) registry_clear(r);
+    return ok;
+}
+
+// Replaces the index atomically; failures only cost a re-probe next time.
+static void write_index(const char *path, const char *stamps, const Registry *r) {
+    make_parent_dirs(path);
+    char tmp[MAX_PATH_LEN];
+    snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    fprintf(f, "%s\n%s", INDEX_HEADER, stamps);
+    for (size_t i = 0; i < r->len; i++) {
+        const Converter *c = &r->items[i];
+        fprintf(f, "conv\t%s\t%s\t%s\t%u\t%s\t%g\t%g\t%s\n", c->from_format, c->to_format, c->converter_path,
+                c->flags, resource_class_name(c->resource), c->hint.startup, c->hint.rate, c->description);
+    }
+    if (fclose(f) != 0 || rename(tmp, path) != 0) unlink(tmp);
+}
+
+// Converters found in the search directories, from the index when it is
+// current and by probing otherwise.
+static void discover_converters(Registry *found) {
+    char *path = cache_file_path("DTCONVERT_INDEX", "index.tsv");
+    char *stamps = path ? directory_stamps() : NULL;
+    if (stamps && read_index(path, stamps, found)) {
+        free(stamps);
+        free(path);
+        return;
+    }
+    for (size_t k = 0; k < sizeof(converter_kinds) / sizeof(converter_kinds[0]); k++) {
+        probe_kind(converter_kinds[k], found);
+    }
+    if (stamps) write_index(path, stamps, found);
+    free(stamps);
+    free(path);
+}
+
+// ---------------- Registry ----------------
+
+const Converter *converter_registry(void) {
+    if (registry_built) return registry.items;
+    registry_built = true;
+
+    for (const Converter *b = builtin_converters; b->from_format; b++) {
+        Converter c = *b;
+        c.from_format = strdup(b->from_format);
+        c.to_format = strdup(b->to_format);
+        c.converter_path = strdup(b->converter_path);
+        c.description = strdup(b->description);
+        if (!c.from_format || !c.to_format || !c.converter_path || !c.description || !registry_push(&registry, &c)) {
+            converter_free(&c);
+        }
+    }
+
+    Registry found = {0};
+    discover_converters(&found);
+    for (size_t i = 0; i < found.len; i++) {
+        Converter *c = &found.items[i];
+        size_t j = 0;
+        while (j < registry.len && !(strcmp(registry.items[j].from_format, c->from_format) == 0 &&
+                                     strcmp(registry.items[j].to_format, c->to_format) == 0 &&
+                                     strcmp(registry.items[j].converter_path, c->converter_path) == 0)) {
+            j++;
+        }
+        if (j < registry.len) {
+            // The program's own description beats the table's.
+            converter_free(&registry.items[j]);
+            registry.items[j] = *c;
+        } else if (!registry_push(&registry, c)) {
+            converter_free(c);
+        }
+    }
+    free(found.items);
+
+    Converter sentinel = {0};
+    if (!registry_push(&registry, &sentinel)) {
+        // Out of memory: fall back to the table as it stands.
+        registry_clear(&registry);
+        return builtin_converters;
+    }
+    return registry.items;
+}
+
+void list_converters(FILE *out) {
+    const Converter *c = converter_registry();
+    fprintf(out, "%-10s %-10s %-32s %-13s %-7s %s\n", "FROM", "TO", "PROGRAM", "RESOURCE", "STREAM", "DESCRIPTION");
+    for (; c->from_format; c++) {
+        const char *stream = (c->flags & CONV_STREAMS) == CONV_STREAMS ? "in,out"
+                             : c->flags & CONV_STREAM_IN                  ? "in"
+                             : c->flags & CONV_STREAM_OUT                 ? "out"
+                                                                          : "-";
+        fprintf(out, "%-10s %-10s %-32s %-13s %-7s %s\n", c->from_format, c->to_format, c->converter_path,
+                resource_class_name(c->resource), stream, c->description);
+    }
+}
@@ -0,0 +1,530 @@
+// accept4(), ppoll(), struct ucred
+#define _GNU_SOURCE
+
+#include "../include/dtconvert.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+
+// Server mode: `dtconvert serve` keeps the registry, the resolved converter
+// paths and the cost table in memory, and `dtconvert --client ...` hands it a
+// command line instead of starting from scratch.
+//
+// The socket is SOCK_SEQPACKET, so a request and its reply are one message
+// each. A request is a list of NUL-terminated strings (the magic line, argc,
+// argv, then the client's DTCONVERT_* variables) with the client's standard
+// input, output and error and its working directory attached as SCM_RIGHTS
+// descriptors. The server forks one child per connection, up to -j at once;
+// the child reads the request, takes the descriptors as its own 0/1/2 and
+// its cwd, replaces the server's DTCONVERT_* variables with them, runs
+// run_command() and replies "status N". Relative paths, "-", messages and
+// exit codes therefore behave as if the client had run the command itself,
+// and a job cannot leave state behind for the next one. The parent only
+// accepts, forks and reaps, so a slow client never holds it up.
+
+#define REQUEST_MAGIC "dtconvert-request 1"
+#define REQUEST_MAX (64 * 1024)
+#define REQUEST_FDS 4  // stdin, stdout, stderr, cwd
+
+typedef struct {
+    pid_t pid;
+    double started;
+} Job;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void child_exited(int sig) {
+    (void)sig;  // only interrupts ppoll()
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// DTCONVERT_SOCKET, else $XDG_RUNTIME_DIR/dtconvert.sock, else
+// /tmp/dtconvert-<uid>.sock.
+static void default_socket_path(char *buf, size_t size) {
+    const char *env = getenv("DTCONVERT_SOCKET");
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    if (env && *env) {
+        snprintf(buf, size, "%s", env);
+    } else if (runtime && *runtime) {
+        snprintf(buf, size, "%s/dtconvert.sock", runtime);
+    } else {
+        snprintf(buf, size, "/tmp/dtconvert-%ld.sock", (long)getuid());
+    }
+}
+
+static bool socket_address(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", path);
+        return false;
+    }
+    memcpy(addr->sun_path, path, strlen(path) + 1);
+    return true;
+}
+
+static void serve_usage(const char *program) {
+    printf("Usage:\n");
+    printf("  %s serve [--socket PATH] [-j N] [-v]\n", program);
+    printf("  %s --client [--socket PATH] <usual arguments>\n", program);
+    printf("\nOptions:\n");
+    printf("  --socket PATH         Unix socket (default: $DTCONVERT_SOCKET, else\n");
+    printf("                        $XDG_RUNTIME_DIR/dtconvert.sock, else /tmp/dtconvert-<uid>.sock)\n");
+    printf("  -j, --jobs N          Conversions run at once (default/0: one per CPU)\n");
+    printf("  -v, --verbose         Log each job's command line, exit code and time\n");
+}
+
+// ---------------- Jobs ----------------
+
+// Runs in the forked child; never returns.
+static void run_job(int conn, bool verbose) {
+    char *buf = malloc(REQUEST_MAX);
+    union {
+        char space[CMSG_SPACE(REQUEST_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = {buf, REQUEST_MAX};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.space,
+                         .msg_controllen = sizeof(control.space)};
+    ssize_t n = buf ? recvmsg(conn, &msg, MSG_CMSG_CLOEXEC) : -1;
+
+    int fds[REQUEST_FDS];
+    int nfds = 0;
+    for (struct cmsghdr *c = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL; c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        int count = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (int i = 0; i < count; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+            if (nfds < REQUEST_FDS) {
+                fds[nfds++] = fd;
+            } else {
+                close(fd);
+            }
+        }
+    }
+
+    // argv and the variables, as NUL-terminated strings
+    char **strings = n > 0 ? malloc(((size_t)n + 1) * sizeof(char *)) : NULL;
+    int nstrings = 0;
+    bool ok = strings && !(msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) && nfds == REQUEST_FDS && buf[n - 1] == '\0';
+    for (char *p = buf; ok && p < buf + n; p += strlen(p) + 1) strings[nstrings++] = p;
+    long argc = ok && nstrings >= 2 && strcmp(strings[0], REQUEST_MAGIC) == 0 ? strtol(strings[1], NULL, 10) : -1;
+    if (argc < 1 || argc > nstrings - 2) {
+        static const char reply[] = "error malformed request";
+        send(conn, reply, sizeof(reply) - 1, MSG_NOSIGNAL);
+        _exit(ERR_INVALID_ARGS);
+    }
+    char **args = strings + 2;
+    if (verbose) {
+        fprintf(stderr, "[%ld]", (long)getpid());
+        for (long i = 1; i < argc; i++) fprintf(stderr, " %s", args[i]);
+        fprintf(stderr, "\n");
+    }
+
+    // Become the client: its descriptors, its directory, its settings.
+    for (int i = 0; i < 3; i++) {
+        if (dup2(fds[i], i) < 0) _exit(ERR_CONVERSION_FAILED);
+        close(fds[i]);
+    }
+    if (fchdir(fds[3]) != 0) _exit(ERR_CONVERSION_FAILED);
+    close(fds[3]);
+    // Settings the server was started with must not leak into a job whose
+    // client left them unset. unsetenv() reshuffles environ, so rescan.
+    for (size_t i = 0; environ[i];) {
+        const char *e = environ[i];
+        const char *eq = strchr(e, '=');
+        if (!eq || strncmp(e, "DTCONVERT_", 10) != 0 || strncmp(e, "DTCONVERT_SOCKET=", 17) == 0) {
+            i++;
+            continue;
+        }
+        char *name = strndup(e, (size_t)(eq - e));
+        if (!name) _exit(ERR_CONVERSION_FAILED);
+        unsetenv(name);
+        free(name);
+    }
+    for (int i = (int)argc + 2; i < nstrings; i++) {
+        char *eq = strchr(strings[i], '=');
+        if (!eq || strncmp(strings[i], "DTCONVERT_", 10) != 0) continue;
+        *eq = '\0';
+        setenv(strings[i], eq + 1, 1);
+    }
+    args[argc] = NULL;  // overwrites the first variable's pointer, already applied
+
+    int rc = run_command((int)argc, args);
+    fflush(NULL);
+    char reply[32];
+    int len = snprintf(reply, sizeof(reply), "status %d", rc);
+    send(conn, reply, (size_t)len, MSG_NOSIGNAL);
+    _exit(rc & 0xff);
+}
+
+// Collects finished jobs; with wait_all, blocks until none is left.
+static void reap_jobs(Job *jobs, size_t max, size_t *running, bool verbose, bool wait_all) {
+    int status;
+    pid_t pid;
+    while (*running > 0 && (pid = waitpid(-1, &status, wait_all ? 0 : WNOHANG)) != 0) {
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (size_t i = 0; i < max; i++) {
+            if (jobs[i].pid != pid) continue;
+            if (verbose) {
+                int code = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+                fprintf(stderr, "[%ld] exit %d in %.1f ms\n", (long)pid, code,
+                        (now_seconds() - jobs[i].started) * 1000.0);
+            }
+            jobs[i].pid = 0;
+            (*running)--;
+        }
+    }
+}
+
+// The first registry entry with c's source (or target) format.
+static const Converter *first_with_format(const Converter *reg, const Converter *c, bool source) {
+    const char *format = source ? c->from_format : c->to_format;
+    for (; reg != c; reg++) {
+        if (strcmp(source ? reg->from_format : reg->to_format, format) == 0) break;
+    }
+    return reg;
+}
+
+// Resolves every pair's route up front, so no job pays for the lookups.
+static void warm_converters(void) {
+    const Converter *reg = converter_registry();
+    for (const Converter *from = reg; from->from_format; from++) {
+        if (first_with_format(reg, from, true) != from) continue;
+        for (const Converter *to = reg; to->from_format; to++) {
+            if (first_with_format(reg, to, false) != to || strcmp(from->from_format, to->to_format) == 0) continue;
+            prepare_conversion(from->from_format, to->to_format, 0, NULL);
+        }
+    }
+}
+
+// ---------------- Server ----------------
+
+// A socket file nobody answers on is left over from a server that died.
+static int bind_socket(const char *path) {
+    struct sockaddr_un addr;
+    if (!socket_address(path, &addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            fprintf(stderr, "Error: A dtconvert server is already listening on %s\n", path);
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+    }
+    // Connecting lets a client use the server's access to files: owner only.
+    mode_t old = umask(0177);
+    int rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old);
+    if (rc != 0 || listen(fd, 128) != 0) {
+        fprintf(stderr, "Error: Cannot listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serve_command(int argc, char **argv) {
+    char path[MAX_PATH_LEN];
+    default_socket_path(path, sizeof(path));
+    long max = 0;
+    bool verbose = false;
+    for (int i = 2; i < argc; i++) {
+        const char *a = argv[i];
+        if (strcmp(a, "--socket") == 0 && i + 1 < argc) {
+            snprintf(path, sizeof(path), "%s", argv[++i]);
+        } else if (strcmp(a, "-j") == 0 || strcmp(a, "--jobs") == 0) {
+            char *end = NULL;
+            max = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : -1;
+            if (i + 1 >= argc || end == argv[i + 1] || *end != '\0' || max < 0 || max > 1024) {
+                fprintf(stderr, "Error: %s expects a job count (0-1024)\n", a);
+                return ERR_INVALID_ARGS;
+            }
+            i++;
+        } else if (strcmp(a, "-v") == 0 || strcmp(a, "--verbose") == 0) {
+            verbose = true;
+        } else if (strcmp(a, "-h") == 0 || strcmp(a, "--help") == 0) {
+            serve_usage(argv[0]);
+            return SUCCESS;
+        } else {
+            fprintf(stderr, "Error: Unknown or incomplete argument: %s\n", a);
+            return ERR_INVALID_ARGS;
+        }
+    }
+    if (max == 0) max = sysconf(_SC_NPROCESSORS_ONLN);
+    if (max < 1) max = 1;
+
+    warm_converters();
+    int lfd = bind_socket(path);
+    if (lfd < 0) return ERR_CONVERSION_FAILED;
+    Job *jobs = calloc((size_t)max, sizeof(Job));
+    if (!jobs) {
+        close(lfd);
+        unlink(path);
+        return ERR_CONVERSION_FAILED;
+    }
+
+    // The signals stay blocked except inside ppoll(), so none is missed
+    // between checking the flags and going to sleep.
+    sigset_t blocked, waiting;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigaddset(&blocked, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &blocked, &waiting);
+    struct sigaction sa = {0};
+    sigemptyset(&sa.sa_mask);
+    sa.sa_handler = request_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = child_exited;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    printf("Listening on %s (%ld job%s at once)\n", path, max, max == 1 ? "" : "s");
+    fflush(stdout);
+
+    size_t running = 0;
+    while (!stop_requested) {
+        reap_jobs(jobs, (size_t)max, &running, verbose, false);
+        // At the limit, connections wait in the listen queue.
+        struct pollfd pfd = {lfd, running < (size_t)max ? POLLIN : 0, 0};
+        if (ppoll(&pfd, 1, NULL, &waiting) < 0 && errno != EINTR) break;
+        if (!(pfd.revents & POLLIN)) continue;
+        int conn = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0) continue;
+
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(lfd);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+            signal(SIGCHLD, SIG_DFL);
+            sigprocmask(SIG_SETMASK, &waiting, NULL);
+            run_job(conn, verbose);
+        }
+        if (pid < 0) {
+            static const char reply[] = "error server cannot fork";
+            send(conn, reply, sizeof(reply) - 1, MSG_NOSIGNAL);
+        } else {
+            for (size_t i = 0; i < (size_t)max; i++) {
+                if (jobs[i].pid != 0) continue;
+                jobs[i] = (Job){pid, now_seconds()};
+                running++;
+                break;
+            }
+        }
+        close(conn);
+    }
+
+    // Let running jobs finish; new connections are refused from here on.
+    close(lfd);
+    unlink(path);
+    reap_jobs(jobs, (size_t)max, &running, verbose, true);
+    free(jobs);
+    return SUCCESS;
+}
+
+// ---------------- Client ----------------
+
+bool is_client_command(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--client") == 0) return true;
+    }
+    return false;
+}
+
+static bool append_string(char *buf, size_t *len, const char *s) {
+    size_t n = strlen(s) + 1;
+    if (*len + n > REQUEST_MAX) return false;
+    memcpy(buf + *len, s, n);
+    *len += n;
+    return true;
+}
+
+// The client hands its descriptors and working directory to whoever listens
+// on path, and the default path in /tmp is predictable. An existing socket
+// must therefore be the user's, in a directory that is theirs or root's and
+// that nobody else can replace it in (not writable by others, or sticky like
+// /tmp). A missing socket is left to connect() to report.
+static bool socket_is_ours(const char *path) {
+    uid_t uid = getuid();
+    struct stat st;
+    if (lstat(path, &st) != 0) return true;
+    if (!S_ISSOCK(st.st_mode) || st.st_uid != uid) {
+        fprintf(stderr, "Error: %s is not a socket owned by you; not sending it the request\n", path);
+        return false;
+    }
+
+    char dir[MAX_PATH_LEN];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (!slash) {
+        snprintf(dir, sizeof(dir), ".");
+    } else if (slash == dir) {
+        slash[1] = '\0';
+    } else {
+        *slash = '\0';
+    }
+    bool safe = stat(dir, &st) == 0 && (st.st_uid == uid || st.st_uid == 0) &&
+                (!(st.st_mode & (S_IWGRP | S_IWOTH)) || (st.st_mode & S_ISVTX));
+    if (!safe) {
+        fprintf(stderr, "Error: Others can replace sockets in %s; not sending it the request\n", dir);
+        return false;
+    }
+    return true;
+}
+
+// Sends the request; returns the connected socket, -1 (with errno) if there
+// is no server to send it to, or -2 if sending failed or the server is not
+// running as the user.
+static int send_request(const char *path, int argc, char **argv) {
+    struct sockaddr_un addr;
+    if (!socket_address(path, &addr)) return -1;
+    if (!socket_is_ours(path)) return -2;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    // The socket may have been swapped since it was checked; the peer cannot.
+    struct ucred peer;
+    socklen_t peer_len = sizeof(peer);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &peer_len) != 0 || peer.uid != getuid()) {
+        fprintf(stderr, "Error: The server on %s is not running as you; not sending it the request\n", path);
+        close(fd);
+        return -2;
+    }
+
+    char *buf = malloc(REQUEST_MAX);
+    size_t len = 0;
+    char count[16];
+    snprintf(count, sizeof(count), "%d", argc);
+    bool ok = buf && append_string(buf, &len, REQUEST_MAGIC) && append_string(buf, &len, count);
+    for (int i = 0; ok && i < argc; i++) ok = append_string(buf, &len, argv[i]);
+    for (char **e = environ; ok && *e; e++) {
+        if (strncmp(*e, "DTCONVERT_", 10) == 0 && strncmp(*e, "DTCONVERT_SOCKET=", 17) != 0) {
+            ok = append_string(buf, &len, *e);
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Command line too long for the dtconvert server\n");
+        free(buf);
+        close(fd);
+        errno = E2BIG;
+        return -2;
+    }
+
+    // Closed standard descriptors go over as /dev/null.
+    int fds[REQUEST_FDS];
+    int opened[REQUEST_FDS] = {-1, -1, -1, -1};
+    for (int i = 0; i < 3; i++) {
+        fds[i] = i;
+        if (fcntl(i, F_GETFD) < 0) fds[i] = opened[i] = open("/dev/null", i == 0 ? O_RDONLY : O_WRONLY);
+    }
+    fds[3] = opened[3] = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    union {
+        char space[CMSG_SPACE(REQUEST_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = {buf, len};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.space,
+                         .msg_controllen = sizeof(control.space)};
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(REQUEST_FDS * sizeof(int));
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+    ok = fds[0] >= 0 && fds[1] >= 0 && fds[2] >= 0 && fds[3] >= 0 && sendmsg(fd, &msg, MSG_NOSIGNAL) == (ssize_t)len;
+    int saved = errno;
+    for (int i = 0; i < REQUEST_FDS; i++) {
+        if (opened[i] >= 0) close(opened[i]);
+    }
+    free(buf);
+    if (!ok) {
+        fprintf(stderr, "Error: Cannot send the request to %s: %s\n", path, strerror(saved));
+        close(fd);
+        return -2;
+    }
+    return fd;
+}
+
+// `dtconvert --client [--socket PATH] <arguments>`: runs <arguments> on the
+// server, or here when no server is listening.
+int client_command(int argc, char **argv) {
+    char path[MAX_PATH_LEN];
+    default_socket_path(path, sizeof(path));
+    char **args = calloc((size_t)argc + 1, sizeof(char *));
+    if (!args) return ERR_CONVERSION_FAILED;
+    int nargs = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--client") == 0) continue;
+        if (i > 0 && strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            snprintf(path, sizeof(path), "%s", argv[++i]);
+            continue;
+        }
+        args[nargs++] = argv[i];
+    }
+    if (nargs >= 2 && strcmp(args[1], "serve") == 0) {
+        fprintf(stderr, "Error: --client cannot start a server\n");
+        free(args);
+        return ERR_INVALID_ARGS;
+    }
+
+    int fd = send_request(path, nargs, args);
+    if (fd == -1) {
+        fprintf(stderr, "Warning: No dtconvert server on %s (%s); converting here\n", path, strerror(errno));
+        int rc = run_command(nargs, args);
+        free(args);
+        return rc;
+    }
+    free(args);
+    if (fd < 0) return ERR_CONVERSION_FAILED;
+
+    char reply[256];
+    ssize_t n;
+    while ((n = recv(fd, reply, sizeof(reply) - 1, 0)) < 0 && errno == EINTR) {
+    }
+    close(fd);
+    int rc = ERR_CONVERSION_FAILED;
+    if (n > 0) {
+        reply[n] = '\0';
+        if (sscanf(reply, "status %d", &rc) != 1) {
+            fprintf(stderr, "Error: dtconvert server: %s\n", strncmp(reply, "error ", 6) == 0 ? reply + 6 : reply);
+            rc = ERR_CONVERSION_FAILED;
+        }
+    } else {
+        fprintf(stderr, "Error: The dtconvert server closed the connection without a result\n");
+    }
+    return rc;
+}
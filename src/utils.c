@@ -4,13 +4,27 @@ void print_usage(const char *program_name) {
     printf("dtconvert v%s\n", DTCONVERT_VERSION);
     printf("Usage:\n");
     printf("  %s <document> --to <format> [options]\n", program_name);
+    printf("  %s - --from <format> --to <format> [options]\n", program_name);
+    printf("  %s --batch <dir|glob|file>... --to <format> [-o DIR] [-j N] [options]\n", program_name);
+    printf("  %s watch <dir> --to <format> --out <dir> [-j N] [options]\n", program_name);
+    printf("  %s serve [--socket PATH] [-j N]\n", program_name);
+    printf("  %s --client [--socket PATH] <document> --to <format> [options]\n", program_name);
     printf("  %s ai <summarize|search|cite> ...\n", program_name);
     printf("\nOptions:\n");
     printf("  --from FORMAT         Override detected input format (e.g., postgresql)\n");
     printf("  --to FORMAT           Target format (pdf, docx, txt, etc.)\n");
-    printf("  -o, --output FILE     Output file path\n");
+    printf("  -o, --output FILE     Output file path (\"-\" for standard output, the default\n");
+    printf("                        when reading standard input)\n");
     printf("                        For DB targets (e.g., postgresql), this is a JSON config file path\n");
     printf("  -f, --force           Overwrite existing output file\n");
+    printf("  -j, --threads N       Worker threads for converters that support it (0 = all CPUs)\n");
+    printf("  --infer-types         Detect numbers, booleans, nulls and dates: typed JSON/YAML values,\n");
+    printf("                        typed columns for SQL/PostgreSQL targets\n");
+    printf("  --explain             Print the planned steps and their estimated cost, then exit\n");
+    printf("  --no-cache            Neither reuse nor keep cached conversion outputs\n");
+    printf("  --incremental         Convert only CSV records appended since the last run\n");
+    printf("  --follow              Keep converting records as they are appended (implies --incremental)\n");
+    printf("  --list-converters     List the built-in and discovered converters, then exit\n");
     printf("  -v, --verbose         Verbose output\n");
     printf("  -h, --help            Show this help message\n");
     printf("  --version             Show version information\n");
@@ -20,6 +34,10 @@ void print_usage(const char *program_name) {
     printf("  %s spreadsheet.xlsx --to csv --verbose\n", program_name);
     printf("  %s people.csv --to postgresql -o examples/postgresql.csv_to_postgresql.json\n", program_name);
     printf("  %s examples/postgresql.csv_to_postgresql.json --from postgresql --to csv -o export.csv\n", program_name);
+    printf("  %s - --from csv --to json < people.csv | jq .\n", program_name);
+    printf("  %s report.docx --to txt --explain\n", program_name);
+    printf("  %s --batch incoming/ --to json -o converted/ -j 8\n", program_name);
+    printf("  %s watch inbox/ --to ndjson --out converted/\n", program_name);
     printf("  %s ai search \"postgresql copy csv\" --open\n", program_name);
 }
 
@@ -40,6 +58,12 @@ int parse_arguments(int argc, char *argv[], ConversionRequest *request) {
     request->output_path = NULL;
     request->overwrite = false;
     request->verbose = false;
+    request->threads = 0;
+    request->infer_types = false;
+    request->explain = false;
+    request->no_cache = false;
+    request->incremental = false;
+    request->follow = false;
 
     // Global flags that should work in any position
     for (int j = 1; j < argc; j++) {
@@ -51,6 +75,10 @@ int parse_arguments(int argc, char *argv[], ConversionRequest *request) {
             print_version();
             return SUCCESS;
         }
+        if (strcmp(argv[j], "--list-converters") == 0) {
+            list_converters(stdout);
+            return SUCCESS;
+        }
     }
 
     if (argc < 3) {
@@ -65,9 +93,9 @@ int parse_arguments(int argc, char *argv[], ConversionRequest *request) {
     }
     memset(request->input, 0, sizeof(Document));
     
-    // Get document path (first non-option argument)
+    // Get document path (first non-option argument; "-" is standard input)
     int i = 1;
-    while (i < argc && argv[i][0] == '-') i++;
+    while (i < argc && argv[i][0] == '-' && argv[i][1] != '\0') i++;
     
     if (i >= argc) {
         fprintf(stderr, "Error: No document specified\n");
@@ -210,6 +238,40 @@ int parse_arguments(int argc, char *argv[], ConversionRequest *request) {
         } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0) {
             request->verbose = true;
             i++;
+        } else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--threads") == 0) {
+            char *end = NULL;
+            long n = (i + 1 < argc) ? strtol(argv[i + 1], &end, 10) : -1;
+            if (i + 1 >= argc || end == argv[i + 1] || *end != '\0' || n < 0 || n > 1024) {
+                fprintf(stderr, "Error: %s expects a thread count (0-1024)\n", argv[i]);
+                free(request->input->path);
+                free(request->input);
+                request->input = NULL;
+                free(request->input_format);
+                request->input_format = NULL;
+                free(request->output_format);
+                request->output_format = NULL;
+                free(request->output_path);
+                request->output_path = NULL;
+                return ERR_INVALID_ARGS;
+            }
+            // 0 asks the helpers for one thread per CPU
+            request->threads = n == 0 ? -1 : (int)n;
+            i += 2;
+        } else if (strcmp(argv[i], "--infer-types") == 0) {
+            request->infer_types = true;
+            i++;
+        } else if (strcmp(argv[i], "--explain") == 0) {
+            request->explain = true;
+            i++;
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            request->no_cache = true;
+            i++;
+        } else if (strcmp(argv[i], "--incremental") == 0) {
+            request->incremental = true;
+            i++;
+        } else if (strcmp(argv[i], "--follow") == 0) {
+            request->follow = true;
+            i++;
         } else {
             fprintf(stderr, "Error: Unknown argument: %s\n", argv[i]);
             free(request->input->path);
@@ -259,6 +321,49 @@ bool ends_with(const char *str, const char *suffix) {
     return strncmp(str + str_len - suffix_len, suffix, suffix_len) == 0;
 }
 
+// Length of a trailing ".gz" or ".zst" (any case). The helpers decompress and
+// compress such files on the fly, so the format is the extension before it.
+size_t compression_suffix_len(const char *filename) {
+    if (!filename) return 0;
+    size_t n = strlen(filename);
+    if (n > 3 && strcasecmp(filename + n - 3, ".gz") == 0) return 3;
+    if (n > 4 && strcasecmp(filename + n - 4, ".zst") == 0) return 4;
+    return 0;
+}
+
+// Where -v progress goes: stderr when the converted data is written to
+// standard output ("-o -"), so the two never mix.
+FILE* verbose_stream(const ConversionRequest *request) {
+    if (request && request->output_path && strcmp(request->output_path, "-") == 0) return stderr;
+    return stdout;
+}
+
+// As for a single conversion: <input minus extension>.<format>, placed in
+// output_dir when one is given (batch and watch modes).
+char *derive_output_path(const char *input, const char *output_dir, const char *format) {
+    char base[MAX_PATH_LEN];
+    const char *name = input;
+    if (output_dir) {
+        const char *slash = strrchr(input, '/');
+        if (slash) name = slash + 1;
+    }
+    snprintf(base, sizeof(base), "%s", name);
+    base[strlen(base) - compression_suffix_len(base)] = '\0';
+    char *dot = strrchr(base, '.');
+    char *slash = strrchr(base, '/');
+    if (dot && (!slash || dot > slash + 1)) *dot = '\0';
+
+    size_t len = (output_dir ? strlen(output_dir) + 1 : 0) + strlen(base) + strlen(format) + 2;
+    char *out = malloc(len);
+    if (!out) return NULL;
+    if (output_dir) {
+        snprintf(out, len, "%s/%s.%s", output_dir, base, format);
+    } else {
+        snprintf(out, len, "%s.%s", base, format);
+    }
+    return out;
+}
+
 char* replace_extension(const char *filename, const char *new_ext) {
     if (!filename || !new_ext) return NULL;
     
@@ -285,4 +390,59 @@ char* replace_extension(const char *filename, const char *new_ext) {
         strcat(result, new_ext);
     }
     return result;
-}
\ No newline at end of file
+}
+
+// Path of one of dtconvert's cache files: $env_var when set ("0" turns the
+// cache off and yields NULL), else $XDG_CACHE_HOME/dtconvert/<name>, else
+// ~/.cache/dtconvert/<name>. Returns a malloc'd path or NULL.
+char *cache_file_path(const char *env_var, const char *name) {
+    const char *env = getenv(env_var);
+    if (env && strcmp(env, "0") == 0) return NULL;
+    if (env && env[0] != '\0') return strdup(env);
+
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *dir = "dtconvert";
+    if (!base || base[0] == '\0') {
+        base = getenv("HOME");
+        dir = ".cache/dtconvert";
+    }
+    if (!base || base[0] == '\0') return NULL;
+    size_t len = strlen(base) + strlen(dir) + strlen(name) + 3;
+    char *path = malloc(len);
+    if (path) snprintf(path, len, "%s/%s/%s", base, dir, name);
+    return path;
+}
+
+// mkdir -p for the directories above path.
+void make_parent_dirs(const char *path) {
+    char buf[MAX_PATH_LEN];
+    snprintf(buf, sizeof(buf), "%s", path);
+    for (char *p = buf + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        (void)mkdir(buf, 0777);
+        *p = '/';
+    }
+}
+
+// A size such as 8G, 512M, 64KiB or a plain byte count, in KiB.
+bool parse_size_kb(const char *spec, long *kb) {
+    char *end = NULL;
+    double v = strtod(spec, &end);
+    double scale = 1.0 / 1024.0;
+    if (end != spec && *end) {
+        switch (toupper((unsigned char)*end)) {
+            case 'K': scale = 1.0; break;
+            case 'M': scale = 1024.0; break;
+            case 'G': scale = 1024.0 * 1024.0; break;
+            case 'T': scale = 1024.0 * 1024.0 * 1024.0; break;
+            default: scale = 0.0; break;
+        }
+        end++;
+        if (*end == 'i' || *end == 'I') end++;
+        if (*end == 'b' || *end == 'B') end++;
+    }
+    if (end == spec || *end != '\0' || scale == 0.0 || v < 0) return false;
+    *kb = (long)(v * scale);
+    return true;
+}
@@ -0,0 +1,548 @@
+// pipe2()
+#define _GNU_SOURCE
+
+#include "../include/dtconvert.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+
+// Watch mode: convert files as they land in a drop folder.
+//
+// The parent watches the directory with inotify (IN_CLOSE_WRITE for files
+// written in place, IN_MOVED_TO for files renamed into it) and queues every
+// new file that has a route to the target. Workers are forked once, after
+// the converters for every source format have been resolved, and block in
+// read() on a shared pipe; each job is one fixed-size record written whole
+// (under PIPE_BUF), so an idle worker wakes as soon as a file is queued and
+// no two take the same one. Workers report the start and end of each job on
+// a second pipe. The parent keeps the jobs the pipe has no room for, replaces
+// workers that die, and rescans the directory at startup and whenever the
+// inotify queue overflowed; a rescan skips files whose output is already
+// newer than they are. SIGINT/SIGTERM stop the watch: files not yet started
+// are dropped, running ones finish.
+
+#define WATCH_STARTED (-1)
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct {
+    const char *dir;
+    const char *input_format;   // --from
+    const char *output_format;  // --to
+    const char *output_dir;     // --out (config file for storage targets)
+    bool storage_target;
+    bool overwrite;
+    bool verbose;
+    bool infer_types;
+    bool no_cache;
+} WatchOptions;
+
+typedef struct {
+    double queued;  // CLOCK_MONOTONIC when the file was seen
+    char path[MAX_PATH_LEN];
+} WatchJob;
+
+typedef struct {
+    pid_t pid;
+    int status;      // WATCH_STARTED, or the conversion's exit code
+    double seconds;  // time queued (started) or converting (done)
+    char path[MAX_PATH_LEN];
+} WatchReport;
+
+_Static_assert(sizeof(WatchJob) <= PIPE_BUF, "jobs must be written to the pipe atomically");
+_Static_assert(sizeof(WatchReport) <= PIPE_BUF, "reports must be written to the pipe atomically");
+
+typedef struct {
+    pid_t pid;
+    char *current;  // input being converted, or NULL
+} Worker;
+
+typedef struct {
+    WatchOptions opt;
+    int inotify_fd;
+    int jobs[2];     // parent -> workers
+    int reports[2];  // workers -> parent
+    Worker *workers;
+    size_t nworkers;
+    WatchJob *backlog;  // queued but not yet in the pipe
+    size_t backlog_head;
+    size_t backlog_len;
+    size_t backlog_cap;
+    char **pending;  // queued and not started, to drop repeated events
+    size_t npending;
+    size_t cap_pending;
+    size_t converted;
+    size_t failed;
+} Watch;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void watch_usage(const char *program) {
+    printf("Usage:\n");
+    printf("  %s watch <dir> --to <format> --out <dir> [-j N] [options]\n", program);
+    printf("\nOptions:\n");
+    printf("  --from FORMAT         Input format of every file (default: each file's extension)\n");
+    printf("  -o, --out DIR         Write outputs into DIR (must not be the watched directory);\n");
+    printf("                        for DB targets, the JSON config file\n");
+    printf("  -j, --jobs N          Files converted in parallel (default/0: one per CPU)\n");
+    printf("  -f, --force           Overwrite existing output files\n");
+    printf("  --infer-types, --no-cache\n");
+    printf("                        As for single conversions\n");
+    printf("  -v, --verbose         Also report skipped files and how long each waited\n");
+}
+
+// ---------------- Workers ----------------
+
+static void send_report(int fd, int status, double seconds, const char *path) {
+    WatchReport r = {.pid = getpid(), .status = status, .seconds = seconds};
+    snprintf(r.path, sizeof(r.path), "%s", path);
+    while (write(fd, &r, sizeof(r)) < 0 && errno == EINTR) {
+    }
+}
+
+static int convert_file(const char *input, const WatchOptions *opt) {
+    Document *doc = document_create(input);
+    if (!doc) return ERR_CONVERSION_FAILED;
+    if (!document_exists(doc)) {
+        document_destroy(doc);
+        return ERR_FILE_NOT_FOUND;
+    }
+    char *output = opt->storage_target ? strdup(opt->output_dir)
+                                       : derive_output_path(input, opt->output_dir, opt->output_format);
+    if (!output) {
+        document_destroy(doc);
+        return ERR_CONVERSION_FAILED;
+    }
+
+    ConversionRequest request = {0};
+    request.input = doc;
+    request.input_format = (char *)opt->input_format;
+    request.output_format = (char *)opt->output_format;
+    request.output_path = output;
+    request.overwrite = opt->overwrite;
+    request.infer_types = opt->infer_types;
+    request.no_cache = opt->no_cache;
+    int rc = convert_document(&request);
+    save_converter_costs();
+
+    free(output);
+    document_destroy(doc);
+    return rc;
+}
+
+// Takes jobs until the parent closes the pipe. Ctrl-C reaches the whole
+// process group; workers ignore it and finish the file they are on.
+static void worker_loop(Watch *w) {
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTERM, SIG_DFL);
+    close(w->inotify_fd);
+    close(w->jobs[1]);
+    close(w->reports[0]);
+    for (;;) {
+        WatchJob job;
+        ssize_t n = read(w->jobs[0], &job, sizeof(job));
+        if (n < 0 && errno == EINTR) continue;
+        if (n != (ssize_t)sizeof(job)) break;
+        double t0 = now_seconds();
+        send_report(w->reports[1], WATCH_STARTED, t0 - job.queued, job.path);
+        int rc = convert_file(job.path, &w->opt);
+        fflush(NULL);
+        send_report(w->reports[1], rc, now_seconds() - t0, job.path);
+    }
+}
+
+static bool spawn_worker(Watch *w, size_t i) {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        worker_loop(w);
+        fflush(NULL);
+        _exit(0);
+    }
+    w->workers[i] = (Worker){pid, NULL};
+    return true;
+}
+
+// A worker that died mid-file fails that file and is replaced.
+static void reap_workers(Watch *w) {
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (size_t i = 0; i < w->nworkers; i++) {
+            if (w->workers[i].pid != pid) continue;
+            if (w->workers[i].current) {
+                int code = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+                printf("failed %s (worker exited with %d)\n", w->workers[i].current, code);
+                fflush(stdout);
+                w->failed++;
+                free(w->workers[i].current);
+            }
+            w->workers[i] = (Worker){0, NULL};
+            if (!stop_requested && !spawn_worker(w, i)) {
+                fprintf(stderr, "Error: Cannot replace a watch worker: %s\n", strerror(errno));
+            }
+        }
+    }
+}
+
+// ---------------- Queue ----------------
+
+static bool is_pending(const Watch *w, const char *path) {
+    for (size_t i = 0; i < w->npending; i++) {
+        if (strcmp(w->pending[i], path) == 0) return true;
+    }
+    return false;
+}
+
+static void drop_pending(Watch *w, const char *path) {
+    for (size_t i = 0; i < w->npending; i++) {
+        if (strcmp(w->pending[i], path) != 0) continue;
+        free(w->pending[i]);
+        w->pending[i] = w->pending[--w->npending];
+        return;
+    }
+}
+
+static bool enqueue(Watch *w, const char *path, double seen) {
+    if (w->backlog_head + w->backlog_len == w->backlog_cap) {
+        if (w->backlog_head > 0) {
+            memmove(w->backlog, w->backlog + w->backlog_head, w->backlog_len * sizeof(*w->backlog));
+            w->backlog_head = 0;
+        }
+        if (w->backlog_len == w->backlog_cap) {
+            size_t cap = w->backlog_cap ? w->backlog_cap * 2 : 64;
+            WatchJob *items = realloc(w->backlog, cap * sizeof(*items));
+            if (!items) return false;
+            w->backlog = items;
+            w->backlog_cap = cap;
+        }
+    }
+    if (w->npending == w->cap_pending) {
+        size_t cap = w->cap_pending ? w->cap_pending * 2 : 64;
+        char **items = realloc(w->pending, cap * sizeof(*items));
+        if (!items) return false;
+        w->pending = items;
+        w->cap_pending = cap;
+    }
+    char *copy = strdup(path);
+    if (!copy) return false;
+    w->pending[w->npending++] = copy;
+    WatchJob *job = &w->backlog[w->backlog_head + w->backlog_len++];
+    job->queued = seen;
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    return true;
+}
+
+// Moves queued jobs into the pipe until it is full.
+static void flush_backlog(Watch *w) {
+    while (w->backlog_len > 0) {
+        ssize_t n = write(w->jobs[1], &w->backlog[w->backlog_head], sizeof(WatchJob));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;  // EAGAIN: every worker is busy and the pipe is full
+        w->backlog_head++;
+        w->backlog_len--;
+    }
+    if (w->backlog_len == 0) w->backlog_head = 0;
+}
+
+// Queues dir/name if it is a regular file with a route to the target. A
+// rescan (from_scan) also skips files whose output is newer than they are.
+static void consider(Watch *w, const char *name, double seen, bool from_scan) {
+    if (name[0] == '.') return;  // hidden, or a partial upload
+    char path[MAX_PATH_LEN];
+    if ((size_t)snprintf(path, sizeof(path), "%s/%s", w->opt.dir, name) >= sizeof(path)) return;
+    if (is_pending(w, path)) return;
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return;
+
+    Document *doc = document_create(path);
+    const char *fmt = w->opt.input_format ? w->opt.input_format : (doc ? canonical_format(doc->extension) : "");
+    bool routable = fmt[0] != '\0' && prepare_conversion(fmt, w->opt.output_format, st.st_size, NULL) >= 0;
+    document_destroy(doc);
+    if (!routable) {
+        if (w->opt.verbose) printf("skipped %s (no conversion to %s)\n", path, w->opt.output_format);
+        return;
+    }
+    if (from_scan && !w->opt.storage_target) {
+        char *output = derive_output_path(path, w->opt.output_dir, w->opt.output_format);
+        struct stat out;
+        bool current = output && stat(output, &out) == 0 && out.st_mtime >= st.st_mtime;
+        free(output);
+        if (current) return;
+    }
+    if (!enqueue(w, path, seen)) fprintf(stderr, "Error: Out of memory queueing %s\n", path);
+}
+
+static bool scan_directory(Watch *w) {
+    DIR *d = opendir(w->opt.dir);
+    if (!d) return false;
+    double seen = now_seconds();
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) consider(w, e->d_name, seen, true);
+    closedir(d);
+    return true;
+}
+
+// ---------------- Events ----------------
+
+static void read_reports(Watch *w) {
+    WatchReport r;
+    ssize_t n;
+    while ((n = read(w->reports[0], &r, sizeof(r))) == (ssize_t)sizeof(r)) {
+        Worker *worker = NULL;
+        for (size_t i = 0; i < w->nworkers; i++) {
+            if (w->workers[i].pid == r.pid) worker = &w->workers[i];
+        }
+        if (r.status == WATCH_STARTED) {
+            drop_pending(w, r.path);
+            if (worker) {
+                free(worker->current);
+                worker->current = strdup(r.path);
+            }
+            if (w->opt.verbose) printf("started %s (queued %.1f ms)\n", r.path, r.seconds * 1000.0);
+        } else {
+            if (worker) {
+                free(worker->current);
+                worker->current = NULL;
+            }
+            if (r.status == SUCCESS) {
+                w->converted++;
+                char *output = w->opt.storage_target ? NULL
+                                                     : derive_output_path(r.path, w->opt.output_dir,
+                                                                          w->opt.output_format);
+                printf("ok %s -> %s (%.3fs)\n", r.path, output ? output : w->opt.output_dir, r.seconds);
+                free(output);
+            } else {
+                w->failed++;
+                printf("failed %s (error code %d, %.3fs)\n", r.path, r.status, r.seconds);
+            }
+        }
+    }
+    fflush(stdout);
+}
+
+// Returns false once the watched directory is gone.
+static bool read_events(Watch *w) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    double seen = now_seconds();
+    for (;;) {
+        ssize_t n = read(w->inotify_fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return true;  // EAGAIN: drained
+        for (char *p = buf; p < buf + n;) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                // Events were lost: look at everything again.
+                if (w->opt.verbose) printf("inotify queue overflowed; rescanning %s\n", w->opt.dir);
+                scan_directory(w);
+            } else if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                fprintf(stderr, "Error: %s was removed or moved; stopping\n", w->opt.dir);
+                return false;
+            } else if (ev->len > 0 && (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))) {
+                consider(w, ev->name, seen, false);
+            }
+        }
+    }
+}
+
+// ---------------- Command ----------------
+
+// Outputs written into the watched directory would be picked up as inputs.
+static bool same_directory(const char *a, const char *b) {
+    struct stat sa, sb;
+    return stat(a, &sa) == 0 && stat(b, &sb) == 0 && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+// Resolves the converters of every route into the target, so that the
+// workers inherit the lookups instead of each repeating them.
+static void warm_converters(const WatchOptions *opt) {
+    if (opt->input_format) {
+        prepare_conversion(opt->input_format, opt->output_format, 0, NULL);
+        return;
+    }
+    for (const Converter *c = converter_registry(); c->from_format; c++) {
+        prepare_conversion(c->from_format, opt->output_format, 0, NULL);
+    }
+}
+
+int watch_command(int argc, char **argv) {
+    Watch w = {.inotify_fd = -1, .jobs = {-1, -1}, .reports = {-1, -1}};
+    WatchOptions *opt = &w.opt;
+    char *from = NULL;
+    char *to = NULL;
+    long jobs = 0;
+    int rc = ERR_INVALID_ARGS;
+
+    for (int i = 2; i < argc; i++) {
+        const char *a = argv[i];
+        bool has_value = i + 1 < argc;
+        if (strcmp(a, "--from") == 0 && has_value) {
+            free(from);
+            from = strdup(argv[++i]);
+        } else if (strcmp(a, "--to") == 0 && has_value) {
+            free(to);
+            to = strdup(argv[++i]);
+        } else if ((strcmp(a, "-o") == 0 || strcmp(a, "--out") == 0 || strcmp(a, "--output") == 0) && has_value) {
+            opt->output_dir = argv[++i];
+        } else if (strcmp(a, "-j") == 0 || strcmp(a, "--jobs") == 0 || strcmp(a, "--threads") == 0) {
+            char *end = NULL;
+            jobs = has_value ? strtol(argv[i + 1], &end, 10) : -1;
+            if (!has_value || end == argv[i + 1] || *end != '\0' || jobs < 0 || jobs > 1024) {
+                fprintf(stderr, "Error: %s expects a job count (0-1024)\n", a);
+                goto out;
+            }
+            i++;
+        } else if (strcmp(a, "-f") == 0 || strcmp(a, "--force") == 0) {
+            opt->overwrite = true;
+        } else if (strcmp(a, "-v") == 0 || strcmp(a, "--verbose") == 0) {
+            opt->verbose = true;
+        } else if (strcmp(a, "--infer-types") == 0) {
+            opt->infer_types = true;
+        } else if (strcmp(a, "--no-cache") == 0) {
+            opt->no_cache = true;
+        } else if (strcmp(a, "-h") == 0 || strcmp(a, "--help") == 0) {
+            watch_usage(argv[0]);
+            rc = SUCCESS;
+            goto out;
+        } else if ((a[0] == '-' && a[1] != '\0') || opt->dir) {
+            fprintf(stderr, "Error: Unknown or incomplete argument: %s\n", a);
+            goto out;
+        } else {
+            opt->dir = a;
+        }
+    }
+
+    if (!opt->dir || !to || !opt->output_dir) {
+        watch_usage(argv[0]);
+        goto out;
+    }
+    str_lower(to);
+    if (from) str_lower(from);
+    opt->output_format = canonical_format(to);
+    opt->input_format = from ? canonical_format(from) : NULL;
+    opt->storage_target = strcmp(opt->output_format, "postgresql") == 0;
+    struct stat st;
+    if (stat(opt->dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "Error: '%s' is not a directory\n", opt->dir);
+        goto out;
+    }
+    if (!opt->storage_target && mkdir(opt->output_dir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error: Cannot create output directory '%s': %s\n", opt->output_dir, strerror(errno));
+        rc = ERR_CONVERSION_FAILED;
+        goto out;
+    }
+    if (!opt->storage_target && same_directory(opt->dir, opt->output_dir)) {
+        fprintf(stderr, "Error: --out must not be the watched directory\n");
+        goto out;
+    }
+
+    rc = ERR_CONVERSION_FAILED;
+    // Watch before the first scan, so a file arriving in between is not missed.
+    w.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w.inotify_fd < 0 || inotify_add_watch(w.inotify_fd, opt->dir, WATCH_EVENTS | IN_ONLYDIR) < 0) {
+        fprintf(stderr, "Error: Cannot watch '%s': %s\n", opt->dir, strerror(errno));
+        goto out;
+    }
+    if (pipe2(w.jobs, O_CLOEXEC) != 0 || pipe2(w.reports, O_CLOEXEC) != 0 ||
+        fcntl(w.jobs[1], F_SETFL, O_NONBLOCK) != 0 || fcntl(w.reports[0], F_SETFL, O_NONBLOCK) != 0) {
+        fprintf(stderr, "Error: Cannot set up the watch queues: %s\n", strerror(errno));
+        goto out;
+    }
+
+    warm_converters(opt);
+    w.nworkers = jobs > 0 ? (size_t)jobs : (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+    if (w.nworkers < 1) w.nworkers = 1;
+    w.workers = calloc(w.nworkers, sizeof(Worker));
+    if (!w.workers) goto out;
+
+    // Not SA_RESTART: poll() returns so the loop can notice.
+    struct sigaction sa = {0};
+    sa.sa_handler = request_stop;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    for (size_t i = 0; i < w.nworkers; i++) {
+        if (!spawn_worker(&w, i)) {
+            fprintf(stderr, "Error: Cannot start watch workers: %s\n", strerror(errno));
+            stop_requested = 1;
+            break;
+        }
+    }
+
+    printf("Watching %s -> %s (%s) on %zu worker%s\n", opt->dir, opt->output_dir, opt->output_format, w.nworkers,
+           w.nworkers == 1 ? "" : "s");
+    fflush(stdout);
+    scan_directory(&w);
+
+    rc = SUCCESS;
+    while (!stop_requested) {
+        flush_backlog(&w);
+        struct pollfd fds[3] = {
+            {w.inotify_fd, POLLIN, 0},
+            {w.reports[0], POLLIN, 0},
+            {w.jobs[1], w.backlog_len > 0 ? POLLOUT : 0, 0},
+        };
+        // Wakes at least once a second to notice workers that died.
+        if (poll(fds, 3, 1000) < 0 && errno != EINTR) break;
+        if ((fds[0].revents & POLLIN) && !read_events(&w)) {
+            rc = ERR_CONVERSION_FAILED;
+            break;
+        }
+        // Before reaping, so a dead worker's last start report has been seen.
+        read_reports(&w);
+        reap_workers(&w);
+    }
+
+    // Take back what the workers have not started; they see end-of-file
+    // once they finish their current file, and the report pipe reaches
+    // end-of-file when the last of them has exited.
+    close(w.jobs[1]);
+    w.jobs[1] = -1;
+    size_t dropped = w.backlog_len;
+    WatchJob job;
+    while (read(w.jobs[0], &job, sizeof(job)) == (ssize_t)sizeof(job)) dropped++;
+    if (dropped > 0) printf("Dropped %zu queued file%s\n", dropped, dropped == 1 ? "" : "s");
+    close(w.reports[1]);
+    w.reports[1] = -1;
+    fcntl(w.reports[0], F_SETFL, 0);
+    read_reports(&w);
+    for (size_t i = 0; i < w.nworkers; i++) {
+        if (w.workers[i].pid > 0) waitpid(w.workers[i].pid, NULL, 0);
+    }
+    printf("Watch: %zu converted, %zu failed\n", w.converted, w.failed);
+
+out:
+    if (w.inotify_fd >= 0) close(w.inotify_fd);
+    for (int i = 0; i < 2; i++) {
+        if (w.jobs[i] >= 0) close(w.jobs[i]);
+        if (w.reports[i] >= 0) close(w.reports[i]);
+    }
+    for (size_t i = 0; i < w.nworkers && w.workers; i++) free(w.workers[i].current);
+    for (size_t i = 0; i < w.npending; i++) free(w.pending[i]);
+    free(w.workers);
+    free(w.pending);
+    free(w.backlog);
+    free(from);
+    free(to);
+    return rc;
+}